@@ -508,6 +508,64 @@ inline Try<Nothing> rmdir(const std::string& directory, bool recursive = true)
 }
 
 
+// Returns the disk space used by the given file or directory tree,
+// akin to: 'du -s'. Files with multiple hard links within the tree
+// are only counted once.
+inline Try<Bytes> du(const std::string& path)
+{
+  char* paths[] = {const_cast<char*>(path.c_str()), NULL};
+
+  FTS* tree = fts_open(paths, FTS_NOCHDIR | FTS_PHYSICAL, NULL);
+  if (tree == NULL) {
+    return ErrnoError();
+  }
+
+  std::set<std::pair<dev_t, ino_t> > linked;
+
+  uint64_t blocks = 0;
+
+  FTSENT* node;
+  while ((node = fts_read(tree)) != NULL) {
+    switch (node->fts_info) {
+      case FTS_D:
+      case FTS_F:
+      case FTS_SL:
+      case FTS_SLNONE:
+      case FTS_DEFAULT:
+        if (node->fts_statp->st_nlink > 1 &&
+            !S_ISDIR(node->fts_statp->st_mode) &&
+            !linked.insert(std::make_pair(
+                node->fts_statp->st_dev,
+                node->fts_statp->st_ino)).second) {
+          break;
+        }
+        blocks += node->fts_statp->st_blocks;
+        break;
+      case FTS_NS:
+      case FTS_ERR:
+        errno = node->fts_errno;
+        fts_close(tree);
+        return ErrnoError();
+      default:
+        break;
+    }
+  }
+
+  if (errno != 0) {
+    ErrnoError error;
+    fts_close(tree);
+    return error;
+  }
+
+  if (fts_close(tree) < 0) {
+    return ErrnoError();
+  }
+
+  // Note that 'st_blocks' is in units of 512 bytes.
+  return Bytes(blocks * 512);
+}
+
+
 // Executes a command by calling "/bin/sh -c <command>", and returns
 // after the command has been completed. Returns 0 if succeeds, and
 // return -1 on error (e.g., fork/exec/waitpid failed). This function
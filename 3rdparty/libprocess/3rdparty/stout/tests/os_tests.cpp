@@ -14,6 +14,7 @@
 #include <sstream>
 #include <string>
 
+#include <stout/bytes.hpp>
 #include <stout/duration.hpp>
 #include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
@@ -120,6 +121,32 @@ TEST_F(OsTest, rmdir)
 }
 
 
+TEST_F(OsTest, du)
+{
+  const string& tmpdir = os::getcwd();
+
+  ASSERT_SOME(os::mkdir(tmpdir + "/a/b"));
+
+  Try<Bytes> empty = os::du(tmpdir + "/a");
+  ASSERT_SOME(empty);
+
+  const string data(Kilobytes(64).bytes(), 'x');
+  ASSERT_SOME(os::write(tmpdir + "/a/b/file", data));
+
+  Try<Bytes> usage = os::du(tmpdir + "/a");
+  ASSERT_SOME(usage);
+  EXPECT_GE(usage.get(), empty.get() + Kilobytes(64));
+
+  // Hard links are only counted once.
+  ASSERT_EQ(0, ::link((tmpdir + "/a/b/file").c_str(),
+                      (tmpdir + "/a/link").c_str()));
+
+  EXPECT_SOME_EQ(usage.get(), os::du(tmpdir + "/a"));
+
+  EXPECT_ERROR(os::du(tmpdir + "/nonexistent"));
+}
+
+
 TEST_F(OsTest, system)
 {
   EXPECT_EQ(0, os::system("exit 0"));
@@ -17,6 +17,8 @@ Duration MAX_REAP_INTERVAL();
 // Otherwise, returns None once the process has been reaped elsewhere
 // (or does not exist, which is indistinguishable from being reaped
 // elsewhere). This will never discard the returned future.
+// On Linux 5.3 and later the termination is observed as soon as it
+// happens (through a pidfd), otherwise within 'MAX_REAP_INTERVAL'.
 Future<Option<int> > reap(pid_t pid);
 
 } // namespace process {
@@ -44,6 +44,13 @@ public:
     bool isPath() const { return mode == PATH; }
     bool isFd() const { return mode == FD; }
 
+    // The file descriptor to redirect to, when redirecting to an open
+    // file descriptor, and the file to redirect to, when redirecting
+    // to a file. These allow launching the process by other means
+    // than 'subprocess' while honoring the same I/O redirection.
+    const Option<int>& descriptor() const { return fd; }
+    const Option<std::string>& file() const { return path; }
+
   private:
     friend class Subprocess;
 
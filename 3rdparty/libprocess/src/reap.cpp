@@ -1,26 +1,66 @@
+#include <errno.h>
+#include <unistd.h>
+
 #include <glog/logging.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include <process/defer.hpp>
 #include <process/delay.hpp>
 #include <process/future.hpp>
 #include <process/id.hpp>
+#include <process/io.hpp>
 #include <process/once.hpp>
 #include <process/owned.hpp>
 #include <process/reap.hpp>
 
 #include <stout/check.hpp>
 #include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
 #include <stout/multihashmap.hpp>
 #include <stout/none.hpp>
 #include <stout/os.hpp>
 #include <stout/result.hpp>
 #include <stout/try.hpp>
 
+#if defined(__linux__) && !defined(SYS_pidfd_open)
+#define SYS_pidfd_open 434 // The same on all architectures.
+#endif
+
 namespace process {
 
 
+// Returns a file descriptor referring to the process which becomes
+// readable once the process terminates. This allows the reaper to
+// learn about terminations as soon as they happen rather than by
+// polling. Returns None if pidfds are not supported, which requires
+// Linux 5.3 or later.
+static Result<int> pidfd(pid_t pid)
+{
+#ifdef __linux__
+  int fd = ::syscall(SYS_pidfd_open, pid, 0);
+  if (fd < 0) {
+    if (errno == ENOSYS || errno == EPERM) {
+      return None();
+    }
+    return ErrnoError();
+  }
+
+  return fd;
+#else
+  return None();
+#endif
+}
+
+
+// Processes are watched using a pidfd where supported (see above).
+// Otherwise, or if a pidfd can not be obtained, the reaper falls back
+// to polling the processes.
+//
 // TODO(bmahler): This can be optimized to use a thread per pid, where
 // each thread makes a blocking call to waitpid. This eliminates the
 // unfortunate poll delay.
@@ -50,7 +90,9 @@ Duration MAX_REAP_INTERVAL() { return Seconds(1); }
 class ReaperProcess : public Process<ReaperProcess>
 {
 public:
-  ReaperProcess() : ProcessBase(ID::generate("reaper")) {}
+  ReaperProcess()
+    : ProcessBase(ID::generate("reaper")),
+      pidfdSupported(true) {}
 
   Future<Option<int> > reap(pid_t pid)
   {
@@ -58,6 +100,7 @@ public:
     if (os::exists(pid)) {
       Owned<Promise<Option<int> > > promise(new Promise<Option<int> >());
       promises.put(pid, promise);
+      watch(pid);
       return promise->future();
     } else {
       return None();
@@ -67,6 +110,61 @@ public:
 protected:
   virtual void initialize() { wait(); }
 
+  // Starts watching the process with a pidfd, if possible.
+  void watch(pid_t pid)
+  {
+    if (!pidfdSupported || pidfds.contains(pid)) {
+      return;
+    }
+
+    Result<int> fd = pidfd(pid);
+
+    if (fd.isNone()) {
+      VLOG(1) << "Reaping processes by polling as pidfds are not supported";
+      pidfdSupported = false;
+      return;
+    } else if (fd.isError()) {
+      // Fall back to polling for this process.
+      VLOG(1) << "Failed to open pidfd of process " << pid << ": "
+              << fd.error();
+      return;
+    }
+
+    pidfds[pid] = fd.get();
+
+    io::poll(fd.get(), io::READ)
+      .onAny(defer(self(), &ReaperProcess::terminated, pid, lambda::_1));
+  }
+
+  void terminated(pid_t pid, const Future<short>& poll)
+  {
+    CHECK(pidfds.contains(pid));
+
+    os::close(pidfds[pid]);
+    pidfds.erase(pid);
+
+    if (!poll.isReady()) {
+      // Fall back to polling for this process.
+      LOG(WARNING) << "Failed to poll pidfd of process " << pid << ": "
+                   << (poll.isFailed() ? poll.failure() : "discarded");
+      return;
+    }
+
+    int status;
+    pid_t result = waitpid(pid, &status, WNOHANG);
+
+    if (result > 0) {
+      // We have reaped a child.
+      notify(pid, status);
+    } else if (result < 0 && errno == ECHILD) {
+      // The process was not our child, it will be reaped by someone
+      // else (its parent or init, if reparented).
+      notify(pid, None());
+    }
+
+    // Otherwise the process is picked up by polling.
+  }
+
   void wait()
   {
     // There are two cases to consider for each pid when it terminates:
@@ -80,6 +178,10 @@ protected:
     // between waitpid and the (!exists) conditional it will still exist as a
     // zombie; it will be reaped by us on the next loop.
     foreach (pid_t pid, promises.keys()) {
+      if (pidfds.contains(pid)) {
+        continue; // Watched by its pidfd.
+      }
+
       int status;
       if (waitpid(pid, &status, WNOHANG) > 0) {
         // We have reaped a child.
@@ -110,7 +212,8 @@ protected:
 private:
   const Duration interval()
   {
-    size_t count = promises.size();
+    // Only the processes that are not watched by a pidfd are polled.
+    size_t count = promises.keys().size() - pidfds.size();
 
     if (count <= LOW_PID_COUNT) {
       return MIN_REAP_INTERVAL();
@@ -127,6 +230,11 @@ private:
   }
 
   multihashmap<pid_t, Owned<Promise<Option<int> > > > promises;
+
+  // The pidfds of the processes that are watched rather than polled.
+  hashmap<pid_t, int> pidfds;
+
+  bool pidfdSupported;
 };
 
 
@@ -21,13 +21,16 @@
 #include <gmock/gmock.h>
 
 #include <iostream>
+#include <list>
 #include <memory>
 #include <unordered_set>
 #include <vector>
 
+#include <process/collect.hpp>
 #include <process/gmock.hpp>
 #include <process/gtest.hpp>
 #include <process/process.hpp>
+#include <process/reap.hpp>
 
 #include <stout/stopwatch.hpp>
 
@@ -37,6 +40,7 @@ using std::cout;
 using std::endl;
 using std::function;
 using std::istringstream;
+using std::list;
 using std::ostringstream;
 using std::string;
 using std::unique_ptr;
@@ -386,3 +390,38 @@ TEST(Process, Process_BENCHMARK_LargeNumberOfLinks)
     delete process;
   }
 }
+
+
+// Measures how long it takes to reap a large number of short-lived
+// children, as happens on a slave running many executors and
+// subprocesses (health checks, 'du', 'perf', etc).
+TEST(Reap, Reap_BENCHMARK_ShortLivedChildren)
+{
+  const size_t children = 10000;
+
+  // Fork the children in batches to stay within process limits.
+  const size_t batch = 500;
+
+  Stopwatch watch;
+  watch.start();
+
+  for (size_t i = 0; i < children; i += batch) {
+    list<Future<Option<int>>> statuses;
+
+    for (size_t j = 0; j < batch; j++) {
+      pid_t pid = ::fork();
+      ASSERT_NE(-1, pid);
+
+      if (pid == 0) {
+        ::_exit(0);
+      }
+
+      statuses.push_back(reap(pid));
+    }
+
+    AWAIT_READY_FOR(collect(statuses), Seconds(60));
+  }
+
+  cout << "Reaped " << children << " children in " << watch.elapsed()
+       << endl;
+}
@@ -1,6 +1,9 @@
 #include <signal.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include <sys/wait.h>
 
 #include <gtest/gtest.h>
@@ -177,3 +180,41 @@ TEST(Reap, TerminatedChildProcess)
 
   Clock::resume();
 }
+
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+// This test checks that terminations are observed without polling
+// where processes can be watched through a pidfd.
+TEST(Reap, TerminationWithoutPolling)
+{
+  int fd = ::syscall(SYS_pidfd_open, ::getpid(), 0);
+  if (fd < 0) {
+    LOG(WARNING) << "Skipping test as pidfds are not supported";
+    return;
+  }
+
+  ::close(fd);
+
+  Try<ProcessTree> tree = Fork(None(),
+                               Exec("sleep 10"))();
+
+  ASSERT_SOME(tree);
+  pid_t child = tree.get();
+
+  // Pause the clock so that the reaper does not poll.
+  Clock::pause();
+
+  Future<Option<int> > status = process::reap(child);
+
+  EXPECT_EQ(0, kill(child, SIGKILL));
+
+  AWAIT_READY(status);
+
+  ASSERT_SOME(status.get());
+  int status_ = status.get().get();
+  ASSERT_TRUE(WIFSIGNALED(status_));
+  ASSERT_EQ(SIGKILL, WTERMSIG(status_));
+
+  Clock::resume();
+}
+#endif // __linux__ && SYS_pidfd_open
@@ -0,0 +1,862 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <list>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <process/collect.hpp>
+#include <process/defer.hpp>
+#include <process/delay.hpp>
+#include <process/dispatch.hpp>
+#include <process/http.hpp>
+#include <process/id.hpp>
+#include <process/io.hpp>
+#include <process/owned.hpp>
+#include <process/process.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/json.hpp>
+#include <stout/lambda.hpp>
+#include <stout/numify.hpp>
+#include <stout/os.hpp>
+#include <stout/result.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+
+#include "docker/daemon.hpp"
+
+using namespace process;
+
+using std::list;
+using std::queue;
+using std::string;
+using std::vector;
+
+
+// The amount of time to wait before reconnecting to the event stream
+// of the daemon after it got disconnected.
+static const Duration EVENTS_RECONNECT_INTERVAL = Seconds(1);
+
+
+// Returns a connected, non-blocking socket for the unix socket at the
+// specified path.
+static Try<int> connect(const string& path)
+{
+  struct sockaddr_un address;
+
+  if (path.size() >= sizeof(address.sun_path)) {
+    return Error("Path '" + path + "' is too long for a unix socket");
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+  int s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (s < 0) {
+    return ErrnoError("Failed to create socket");
+  }
+
+  if (::connect(s, (struct sockaddr*) &address, sizeof(address)) < 0) {
+    ErrnoError error("Failed to connect to '" + path + "'");
+    os::close(s);
+    return error;
+  }
+
+  Try<Nothing> nonblock = os::nonblock(s);
+  if (nonblock.isError()) {
+    os::close(s);
+    return Error("Failed to set socket non-blocking: " + nonblock.error());
+  }
+
+  Try<Nothing> cloexec = os::cloexec(s);
+  if (cloexec.isError()) {
+    os::close(s);
+    return Error("Failed to set socket close-on-exec: " + cloexec.error());
+  }
+
+  return s;
+}
+
+
+// A response from the daemon. Header names are lower-cased since
+// they are case insensitive.
+struct Response
+{
+  uint16_t code;
+  hashmap<string, string> headers;
+  string body;
+};
+
+
+// Parses the status line and the headers of a response from the front
+// of the buffer, removing them from the buffer. Returns None if the
+// buffer does not contain all of the headers yet.
+static Result<Response> parse(string* buffer)
+{
+  size_t end = buffer->find("\r\n\r\n");
+  if (end == string::npos) {
+    return None();
+  }
+
+  vector<string> lines = strings::tokenize(buffer->substr(0, end), "\r\n");
+  buffer->erase(0, end + 4);
+
+  if (lines.empty()) {
+    return Error("Missing status line");
+  }
+
+  // The status line is of the form 'HTTP/1.1 200 OK'.
+  vector<string> status = strings::tokenize(lines[0], " ");
+  if (status.size() < 2 || !strings::startsWith(status[0], "HTTP/")) {
+    return Error("Malformed status line '" + lines[0] + "'");
+  }
+
+  Try<uint16_t> code = numify<uint16_t>(status[1]);
+  if (code.isError()) {
+    return Error("Malformed status code '" + status[1] + "'");
+  }
+
+  Response response;
+  response.code = code.get();
+
+  for (size_t i = 1; i < lines.size(); i++) {
+    size_t colon = lines[i].find(':');
+    if (colon == string::npos) {
+      return Error("Malformed header '" + lines[i] + "'");
+    }
+
+    string name = strings::lower(strings::trim(lines[i].substr(0, colon)));
+    response.headers[name] = strings::trim(lines[i].substr(colon + 1));
+  }
+
+  return response;
+}
+
+
+// Returns true if the body of the response is sent using the chunked
+// transfer encoding.
+static bool chunked(const Response& response)
+{
+  Option<string> encoding = response.headers.get("transfer-encoding");
+  return encoding.isSome() && strings::lower(encoding.get()) == "chunked";
+}
+
+
+// Decodes a chunk of a body sent with the chunked transfer encoding
+// from the front of the buffer, removing it from the buffer. Returns
+// None if the buffer does not contain the entire chunk yet. Note that
+// the last chunk of a body is empty.
+static Result<string> chunk(string* buffer)
+{
+  size_t end = buffer->find("\r\n");
+  if (end == string::npos) {
+    return None();
+  }
+
+  // Ignore any chunk extensions.
+  string line = buffer->substr(0, end);
+  line = strings::trim(line.substr(0, line.find(';')));
+
+  char* last = NULL;
+  unsigned long long size = ::strtoull(line.c_str(), &last, 16);
+  if (line.empty() || *last != '\0') {
+    return Error("Malformed chunk size '" + line + "'");
+  }
+
+  if (buffer->size() < end + 2 + size + 2) {
+    return None();
+  }
+
+  if (buffer->compare(end + 2 + size, 2, "\r\n") != 0) {
+    return Error("Malformed chunk");
+  }
+
+  string data = buffer->substr(end + 2, size);
+  buffer->erase(0, end + 2 + size + 2);
+
+  return data;
+}
+
+
+// Returns the request for the specified path, to be sent over a
+// persistent connection.
+static string request(const string& method, const string& path)
+{
+  return method + " " + path + " HTTP/1.1\r\n"
+    "Host: docker\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+}
+
+
+class DockerDaemonProcess : public Process<DockerDaemonProcess>
+{
+public:
+  DockerDaemonProcess(const string& _socket)
+    : ProcessBase(ID::generate("docker-daemon")),
+      socket(_socket),
+      sequence(0),
+      inspecting(0) {}
+
+  virtual ~DockerDaemonProcess() {}
+
+  Future<Docker::Container> inspect(const string& container)
+  {
+    // The daemon reports container names with a leading '/', while
+    // the containerizer (like the CLI) uses them without one.
+    Option<string> id =
+      names.get(strings::remove(container, "/", strings::PREFIX));
+
+    if (id.isSome() && containers.contains(id.get())) {
+      return containers.get(id.get()).get();
+    } else if (containers.contains(container)) {
+      return containers.get(container).get();
+    }
+
+    inspecting++;
+
+    Future<Docker::Container> future =
+      send("GET", "/containers/" + http::encode(container) + "/json")
+        .then(defer(self(), &Self::_inspect, container, sequence, lambda::_1));
+
+    future.onAny(defer(self(), &Self::inspected));
+
+    return future;
+  }
+
+  Future<list<Docker::Container> > ps(
+      bool all,
+      const Option<string>& prefix)
+  {
+    return send("GET", string("/containers/json") + (all ? "?all=1" : ""))
+      .then(defer(self(), &Self::_ps, prefix, lambda::_1));
+  }
+
+protected:
+  virtual void initialize()
+  {
+    watch();
+  }
+
+  virtual void finalize()
+  {
+    disconnect();
+    unwatch();
+
+    while (!requests.empty()) {
+      requests.front()->promise.fail("Docker daemon client terminated");
+      requests.pop();
+    }
+  }
+
+private:
+  // A request sent over the persistent connection.
+  struct Request
+  {
+    Request(const string& _data) : data(_data), retried(false) {}
+
+    const string data;
+
+    // Whether the request was already retried after the connection
+    // broke before any of the response was received.
+    bool retried;
+
+    Promise<Response> promise;
+  };
+
+  Future<Docker::Container> _inspect(
+      const string& container,
+      uint64_t requested,
+      const Response& response)
+  {
+    if (response.code == 404) {
+      return Failure("Failed to find container");
+    } else if (response.code != 200) {
+      return Failure(
+          "Failed to inspect container '" + container + "': " +
+          stringify(response.code) + " " + response.body);
+    }
+
+    Try<JSON::Object> parse = JSON::parse<JSON::Object>(response.body);
+    if (parse.isError()) {
+      return Failure("Failed to parse JSON: " + parse.error());
+    }
+
+    Try<Docker::Container> _container = Docker::Container::create(parse.get());
+    if (_container.isError()) {
+      return Failure("Unable to create container: " + _container.error());
+    }
+
+    // Only cache the container if the event stream was connected
+    // when it was requested and there has not been an event for the
+    // container since, which would have made the response stale.
+    if (watched.isSome() &&
+        requested >= watched.get() &&
+        invalidated.get(_container.get().id).get(0) <= requested) {
+      containers.put(_container.get().id, _container.get());
+      names.put(
+          strings::remove(_container.get().name, "/", strings::PREFIX),
+          _container.get().id);
+    }
+
+    return _container.get();
+  }
+
+  void inspected()
+  {
+    CHECK_GT(inspecting, 0u);
+
+    // The events are only needed to tell whether the response of an
+    // outstanding inspect is stale.
+    if (--inspecting == 0) {
+      invalidated.clear();
+    }
+  }
+
+  Future<list<Docker::Container> > _ps(
+      const Option<string>& prefix,
+      const Response& response)
+  {
+    if (response.code != 200) {
+      return Failure(
+          "Failed to list containers: " +
+          stringify(response.code) + " " + response.body);
+    }
+
+    Try<JSON::Array> parse = JSON::parse<JSON::Array>(response.body);
+    if (parse.isError()) {
+      return Failure("Failed to parse JSON: " + parse.error());
+    }
+
+    list<Future<Docker::Container> > futures;
+
+    foreach (const JSON::Value& value, parse.get().values) {
+      if (!value.is<JSON::Object>()) {
+        return Failure("Expecting an array of objects");
+      }
+
+      Result<JSON::Array> _names =
+        value.as<JSON::Object>().find<JSON::Array>("Names");
+
+      if (!_names.isSome() ||
+          _names.get().values.empty() ||
+          !_names.get().values.front().is<JSON::String>()) {
+        return Failure("Unable to find Names in container");
+      }
+
+      string name = strings::remove(
+          _names.get().values.front().as<JSON::String>().value,
+          "/",
+          strings::PREFIX);
+
+      // Inspect the containers that we are interested in depending on
+      // whether or not a 'prefix' was specified.
+      if (prefix.isNone() || strings::startsWith(name, prefix.get())) {
+        futures.push_back(inspect(name));
+      }
+    }
+
+    return collect(futures);
+  }
+
+  // Sends a request over the persistent connection. Requests are sent
+  // one at a time, each after the response to the previous one.
+  Future<Response> send(const string& method, const string& path)
+  {
+    Owned<Request> request(new Request(::request(method, path)));
+
+    requests.push(request);
+
+    if (requests.size() == 1) {
+      _send();
+    }
+
+    return request->promise.future();
+  }
+
+  void _send()
+  {
+    if (requests.empty()) {
+      return;
+    }
+
+    if (connection.isNone()) {
+      Try<int> fd = connect(socket);
+      if (fd.isError()) {
+        while (!requests.empty()) {
+          requests.front()->promise.fail(
+              "Failed to connect to the Docker daemon: " + fd.error());
+          requests.pop();
+        }
+        return;
+      }
+
+      connection = fd.get();
+    }
+
+    writing = io::write(connection.get(), requests.front()->data);
+    writing.onAny(defer(self(), &Self::__send, lambda::_1));
+  }
+
+  void __send(const Future<Nothing>& write)
+  {
+    if (!write.isReady()) {
+      disconnected(
+          "Failed to send request: " +
+          (write.isFailed() ? write.failure() : "discarded"));
+      return;
+    }
+
+    receive();
+  }
+
+  void receive()
+  {
+    CHECK_SOME(connection);
+
+    reading = io::read(connection.get(), data, sizeof(data));
+    reading.onAny(defer(self(), &Self::_receive, lambda::_1));
+  }
+
+  void _receive(const Future<size_t>& length)
+  {
+    if (!length.isReady()) {
+      disconnected(
+          "Failed to receive response: " +
+          (length.isFailed() ? length.failure() : "discarded"));
+      return;
+    } else if (length.get() == 0) {
+      disconnected("Connection closed by the Docker daemon");
+      return;
+    }
+
+    buffer.append(data, length.get());
+
+    Result<Response> response = decode();
+    if (response.isError()) {
+      disconnected("Failed to decode response: " + response.error());
+      return;
+    } else if (response.isNone()) {
+      receive();
+      return;
+    }
+
+    // Since requests are not pipelined there should not be anything
+    // following the response.
+    if (!buffer.empty()) {
+      disconnected("Unexpected data following the response");
+      return;
+    }
+
+    Owned<Request> request = requests.front();
+    requests.pop();
+
+    request->promise.set(response.get());
+
+    _send();
+  }
+
+  // Decodes the response to the request in flight from the data
+  // received so far. Returns None if it has not been received
+  // entirely yet.
+  Result<Response> decode()
+  {
+    if (header.isNone()) {
+      Result<Response> parse = ::parse(&buffer);
+      if (!parse.isSome()) {
+        return parse;
+      }
+
+      header = parse.get();
+    }
+
+    if (chunked(header.get())) {
+      while (true) {
+        Result<string> data = chunk(&buffer);
+        if (data.isError()) {
+          return Error(data.error());
+        } else if (data.isNone()) {
+          return None();
+        } else if (data.get().empty()) {
+          break;
+        }
+
+        body.append(data.get());
+      }
+    } else {
+      // Responses without a body (e.g., '204 No Content') do not
+      // carry a 'Content-Length' header.
+      Result<size_t> length =
+        numify<size_t>(header.get().headers.get("content-length"));
+
+      if (length.isError()) {
+        return Error("Malformed Content-Length: " + length.error());
+      }
+
+      size_t size = length.isSome() ? length.get() : 0;
+      if (buffer.size() < size) {
+        return None();
+      }
+
+      body = buffer.substr(0, size);
+      buffer.erase(0, size);
+    }
+
+    Response response = header.get();
+    response.body = body;
+
+    header = None();
+    body.clear();
+
+    return response;
+  }
+
+  void disconnected(const string& message)
+  {
+    CHECK(!requests.empty());
+
+    // The daemon may close a persistent connection that has been idle
+    // for a while, in which case the request is retried once on a new
+    // connection provided none of the response was received.
+    bool retry = !requests.front()->retried &&
+                 header.isNone() &&
+                 buffer.empty();
+
+    disconnect();
+
+    if (retry) {
+      VLOG(1) << "Retrying request to the Docker daemon: " << message;
+      requests.front()->retried = true;
+    } else {
+      requests.front()->promise.fail(message);
+      requests.pop();
+    }
+
+    _send();
+  }
+
+  void disconnect()
+  {
+    writing.discard();
+    reading.discard();
+
+    if (connection.isSome()) {
+      os::close(connection.get());
+      connection = None();
+    }
+
+    buffer.clear();
+    header = None();
+    body.clear();
+  }
+
+  // Connects to the event stream of the daemon, which is used to
+  // invalidate the cached containers.
+  void watch()
+  {
+    CHECK(events.isNone());
+
+    Try<int> fd = connect(socket);
+    if (fd.isError()) {
+      LOG(WARNING) << "Failed to connect to the event stream of the "
+                   << "Docker daemon: " << fd.error();
+
+      delay(EVENTS_RECONNECT_INTERVAL, self(), &Self::watch);
+      return;
+    }
+
+    events = fd.get();
+
+    eventsWriting = io::write(events.get(), ::request("GET", "/events"));
+    eventsWriting.onAny(defer(self(), &Self::_watch, lambda::_1));
+  }
+
+  void _watch(const Future<Nothing>& write)
+  {
+    if (!write.isReady()) {
+      rewatch(
+          "Failed to send request: " +
+          (write.isFailed() ? write.failure() : "discarded"));
+      return;
+    }
+
+    __watch();
+  }
+
+  void __watch()
+  {
+    CHECK_SOME(events);
+
+    eventsReading = io::read(events.get(), eventsData, sizeof(eventsData));
+    eventsReading.onAny(defer(self(), &Self::___watch, lambda::_1));
+  }
+
+  void ___watch(const Future<size_t>& length)
+  {
+    if (!length.isReady()) {
+      rewatch(
+          "Failed to receive events: " +
+          (length.isFailed() ? length.failure() : "discarded"));
+      return;
+    } else if (length.get() == 0) {
+      rewatch("Connection closed by the Docker daemon");
+      return;
+    }
+
+    eventsBuffer.append(eventsData, length.get());
+
+    if (watched.isNone()) {
+      Result<Response> response = parse(&eventsBuffer);
+      if (response.isError()) {
+        rewatch("Failed to decode response: " + response.error());
+        return;
+      } else if (response.isNone()) {
+        __watch();
+        return;
+      } else if (response.get().code != 200) {
+        rewatch("Unexpected status " + stringify(response.get().code));
+        return;
+      } else if (!chunked(response.get())) {
+        rewatch("Expecting a chunked event stream");
+        return;
+      }
+
+      // From now on all events get delivered, but anything that was
+      // inspected before might already be stale.
+      containers.clear();
+      names.clear();
+      watched = ++sequence;
+
+      LOG(INFO) << "Watching the events of the Docker daemon at " << socket;
+    }
+
+    while (true) {
+      Result<string> data = chunk(&eventsBuffer);
+      if (data.isError()) {
+        rewatch("Failed to decode event stream: " + data.error());
+        return;
+      } else if (data.isNone()) {
+        break;
+      } else if (data.get().empty()) {
+        rewatch("Event stream closed by the Docker daemon");
+        return;
+      }
+
+      eventsPayload.append(data.get());
+    }
+
+    // Each event is a JSON object followed by a newline.
+    size_t newline = eventsPayload.find('\n');
+    while (newline != string::npos) {
+      const string line = strings::trim(eventsPayload.substr(0, newline));
+      eventsPayload.erase(0, newline + 1);
+
+      if (!line.empty()) {
+        event(line);
+      }
+
+      newline = eventsPayload.find('\n');
+    }
+
+    // Older daemons do not always terminate an event with a newline.
+    if (!eventsPayload.empty() &&
+        JSON::parse<JSON::Object>(eventsPayload).isSome()) {
+      event(eventsPayload);
+      eventsPayload.clear();
+    }
+
+    __watch();
+  }
+
+  void event(const string& json)
+  {
+    Try<JSON::Object> object = JSON::parse<JSON::Object>(json);
+    if (object.isError()) {
+      LOG(WARNING) << "Ignoring malformed event from the Docker daemon '"
+                   << json << "': " << object.error();
+      return;
+    }
+
+    Result<JSON::String> id = object.get().find<JSON::String>("id");
+    if (!id.isSome()) {
+      return;
+    }
+
+    VLOG(1) << "Received event from the Docker daemon: " << json;
+
+    // Any event (e.g., 'die', 'destroy') may change the state of the
+    // container, so drop it from the cache.
+    ++sequence;
+
+    if (inspecting > 0) {
+      invalidated[id.get().value] = sequence;
+    }
+
+    if (containers.contains(id.get().value)) {
+      names.erase(strings::remove(
+          containers.get(id.get().value).get().name, "/", strings::PREFIX));
+      containers.erase(id.get().value);
+    }
+
+    // Prime the cache for containers that have just started, since
+    // the containerizer inspects a container right after running it.
+    Result<JSON::String> status = object.get().find<JSON::String>("status");
+    if (status.isSome() && status.get().value == "start") {
+      inspect(id.get().value);
+    }
+  }
+
+  void rewatch(const string& message)
+  {
+    LOG(WARNING) << "Disconnected from the event stream of the Docker "
+                 << "daemon: " << message;
+
+    unwatch();
+
+    delay(EVENTS_RECONNECT_INTERVAL, self(), &Self::watch);
+  }
+
+  void unwatch()
+  {
+    eventsWriting.discard();
+    eventsReading.discard();
+
+    if (events.isSome()) {
+      os::close(events.get());
+      events = None();
+    }
+
+    eventsBuffer.clear();
+    eventsPayload.clear();
+
+    // Without the event stream nothing can be cached.
+    watched = None();
+    containers.clear();
+    names.clear();
+  }
+
+  const string socket;
+
+  // The persistent connection for requests, along with the requests
+  // and the state of the response being received. The request at the
+  // front of the queue is the one in flight.
+  Option<int> connection;
+  queue<Owned<Request> > requests;
+  Future<Nothing> writing;
+  Future<size_t> reading;
+  char data[4096];
+  string buffer;
+  Option<Response> header;
+  string body;
+
+  // The connection for the event stream. The events are decoded from
+  // the chunks of the response as they are received.
+  Option<int> events;
+  Future<Nothing> eventsWriting;
+  Future<size_t> eventsReading;
+  char eventsData[4096];
+  string eventsBuffer;
+  string eventsPayload;
+
+  // Containers keyed by their ID, and IDs keyed by container name.
+  hashmap<string, Docker::Container> containers;
+  hashmap<string, string> names;
+
+  // Every (re)connection of the event stream and every event gets the
+  // next sequence number. A response to an inspect is only cached if
+  // the event stream was connected when the container was requested,
+  // i.e., the sequence number at the time is at least 'watched', and
+  // no event for the container was received since.
+  uint64_t sequence;
+  Option<uint64_t> watched;
+  hashmap<string, uint64_t> invalidated;
+
+  // The number of outstanding inspects.
+  size_t inspecting;
+};
+
+
+Try<Docker*> DockerDaemon::create(
+    const string& path,
+    const string& socket,
+    bool validate)
+{
+  if (validate) {
+    // The CLI is still used for everything but inspecting and listing
+    // containers, so validate its version as well.
+    Try<Docker*> docker = Docker::create(path, true);
+    if (docker.isError()) {
+      return Error(docker.error());
+    }
+
+    delete docker.get();
+
+    Try<int> fd = connect(socket);
+    if (fd.isError()) {
+      return Error("Failed to connect to the Docker daemon: " + fd.error());
+    }
+
+    os::close(fd.get());
+  }
+
+  return new DockerDaemon(path, socket);
+}
+
+
+DockerDaemon::DockerDaemon(const string& path, const string& socket)
+  : Docker(path),
+    process(new DockerDaemonProcess(socket))
+{
+  spawn(process.get());
+}
+
+
+DockerDaemon::~DockerDaemon()
+{
+  terminate(process.get());
+  wait(process.get());
+}
+
+
+Future<Docker::Container> DockerDaemon::inspect(const string& container) const
+{
+  return dispatch(process.get(), &DockerDaemonProcess::inspect, container);
+}
+
+
+Future<list<Docker::Container> > DockerDaemon::ps(
+    bool all,
+    const Option<string>& prefix) const
+{
+  return dispatch(process.get(), &DockerDaemonProcess::ps, all, prefix);
+}
@@ -0,0 +1,75 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DOCKER_DAEMON_HPP__
+#define __DOCKER_DAEMON_HPP__
+
+#include <list>
+#include <string>
+
+#include <process/future.hpp>
+#include <process/owned.hpp>
+
+#include <stout/none.hpp>
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+#include "docker/docker.hpp"
+
+// Forward declaration.
+class DockerDaemonProcess;
+
+
+// Abstraction for working with Docker that inspects and lists
+// containers through the remote API of the Docker daemon, reached
+// over its unix socket, instead of running the Docker CLI for every
+// call. All requests share a single persistent connection. The
+// results of inspect are cached until the event stream of the daemon
+// reports an event for the container, so repeatedly inspecting a
+// running container does not reach the daemon at all.
+//
+// The remaining operations (run, stop, rm, logs and pull) are still
+// performed through the Docker CLI.
+class DockerDaemon : public Docker
+{
+public:
+  // Create Docker abstraction using the CLI at 'path' and the daemon
+  // listening on 'socket', optionally validating both.
+  static Try<Docker*> create(
+      const std::string& path,
+      const std::string& socket,
+      bool validate = true);
+
+  virtual ~DockerDaemon();
+
+  // Performs 'GET /containers/CONTAINER/json', unless cached.
+  virtual process::Future<Container> inspect(
+      const std::string& container) const;
+
+  // Performs 'GET /containers/json(?all=1)'.
+  virtual process::Future<std::list<Container> > ps(
+      bool all = false,
+      const Option<std::string>& prefix = None()) const;
+
+private:
+  DockerDaemon(const std::string& path, const std::string& socket);
+
+  process::Owned<DockerDaemonProcess> process;
+};
+
+#endif // __DOCKER_DAEMON_HPP__
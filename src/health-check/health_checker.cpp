@@ -0,0 +1,492 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <mesos/type_utils.hpp>
+
+#include <process/address.hpp>
+#include <process/clock.hpp>
+#include <process/defer.hpp>
+#include <process/delay.hpp>
+#include <process/dispatch.hpp>
+#include <process/http.hpp>
+#include <process/id.hpp>
+#include <process/process.hpp>
+#include <process/socket.hpp>
+#include <process/subprocess.hpp>
+#include <process/timer.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/net.hpp>
+#include <stout/numify.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+
+#include "common/status_utils.hpp"
+
+#include "health-check/health_checker.hpp"
+
+using namespace process;
+
+using process::network::Address;
+using process::network::Socket;
+
+using std::map;
+using std::multimap;
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace internal {
+
+// Checks that are due within this amount of time of each other are
+// run together on the same expiration of the timer.
+static const Duration HEALTH_CHECK_RESOLUTION = Milliseconds(10);
+
+// The address that HTTP and TCP checks are sent to.
+static const string HEALTH_CHECK_HOST = "127.0.0.1";
+
+
+// Keeps the socket of a TCP check open until it is connected.
+static Nothing connected(const Socket& socket)
+{
+  return Nothing();
+}
+
+
+static Future<Nothing> tcpCheck(const HealthCheck::TCP& tcp)
+{
+  static Try<uint32_t> ip = net::getIP(HEALTH_CHECK_HOST, AF_INET);
+
+  if (ip.isError()) {
+    return Failure("Failed to determine IP of " + HEALTH_CHECK_HOST +
+                   ": " + ip.error());
+  }
+
+  Try<Socket> create = Socket::create();
+  if (create.isError()) {
+    return Failure("Failed to create socket: " + create.error());
+  }
+
+  Socket socket = create.get();
+
+  return socket.connect(Address(ip.get(), tcp.port()))
+    .then(lambda::bind(&connected, socket));
+}
+
+
+static Future<Nothing> _httpCheck(
+    const HealthCheck::HTTP& http,
+    const http::Response& response)
+{
+  // The status is of the form '200 OK'.
+  vector<string> tokens = strings::tokenize(response.status, " ");
+  if (tokens.empty()) {
+    return Failure("Unexpected status '" + response.status + "'");
+  }
+
+  Try<uint32_t> code = numify<uint32_t>(tokens.front());
+  if (code.isError()) {
+    return Failure("Unexpected status '" + response.status + "'");
+  }
+
+  // Not specifying any statuses implies that any status is acceptable.
+  if (http.statuses_size() == 0) {
+    return Nothing();
+  }
+
+  foreach (uint32_t status, http.statuses()) {
+    if (status == code.get()) {
+      return Nothing();
+    }
+  }
+
+  return Failure("Unexpected status '" + response.status + "'");
+}
+
+
+static Future<Nothing> httpCheck(const HealthCheck::HTTP& http)
+{
+  return http::get(
+      http::URL("http", HEALTH_CHECK_HOST, http.port(), http.path()))
+    .then(lambda::bind(&_httpCheck, http, lambda::_1));
+}
+
+
+static Future<Nothing> _commandCheck(const Option<int>& status)
+{
+  if (status.isNone()) {
+    return Failure("No status found for the command");
+  } else if (status.get() != 0) {
+    return Failure("Health command check " + WSTRINGIFY(status.get()));
+  }
+
+  return Nothing();
+}
+
+
+static void killCommand(pid_t pid)
+{
+  ::kill(pid, SIGKILL);
+}
+
+
+static Future<Nothing> commandCheck(const CommandInfo& command)
+{
+  if (!command.has_value()) {
+    return Failure("Command is not specified");
+  }
+
+  map<string, string> environment;
+  foreach (const Environment::Variable& variable,
+           command.environment().variables()) {
+    environment[variable.name()] = variable.value();
+  }
+
+  Try<Subprocess> external = Error("Not launched");
+
+  if (command.shell()) {
+    VLOG(2) << "Launching health command '" << command.value() << "'";
+
+    external = subprocess(
+        command.value(),
+        Subprocess::PATH("/dev/null"),
+        Subprocess::FD(STDERR_FILENO),
+        Subprocess::FD(STDERR_FILENO),
+        environment);
+  } else {
+    vector<string> argv;
+    foreach (const string& arg, command.arguments()) {
+      argv.push_back(arg);
+    }
+
+    VLOG(2) << "Launching health command [" << command.value() << ", "
+            << strings::join(", ", argv) << "]";
+
+    external = subprocess(
+        command.value(),
+        argv,
+        Subprocess::PATH("/dev/null"),
+        Subprocess::FD(STDERR_FILENO),
+        Subprocess::FD(STDERR_FILENO),
+        None(),
+        environment);
+  }
+
+  if (external.isError()) {
+    return Failure("Failed to launch health command: " + external.error());
+  }
+
+  // Kill the command if the check times out.
+  return external.get().status()
+    .then(lambda::bind(&_commandCheck, lambda::_1))
+    .onDiscard(lambda::bind(&killCommand, external.get().pid()));
+}
+
+
+static Future<Nothing> timedout(Future<Nothing> future, const Duration& timeout)
+{
+  future.discard();
+
+  return Failure("Health check timed out after " + stringify(timeout));
+}
+
+
+class HealthCheckerProcess : public Process<HealthCheckerProcess>
+{
+public:
+  explicit HealthCheckerProcess(const HealthChecker::Callback& _callback)
+    : ProcessBase(ID::generate("health-checker")),
+      callback(_callback),
+      added(0) {}
+
+  virtual ~HealthCheckerProcess() {}
+
+  Future<Nothing> add(const TaskID& taskId, const HealthCheck& check)
+  {
+    if (tasks.contains(taskId)) {
+      return Failure("Health of task " + stringify(taskId) +
+                     " is already being checked");
+    }
+
+    int strategies = check.has_command() + check.has_http() + check.has_tcp();
+    if (strategies == 0) {
+      return Failure("No check found in health check");
+    } else if (strategies > 1) {
+      return Failure("Only one check can be specified in a health check");
+    }
+
+    Owned<Task> task(new Task(++added, taskId, check, Clock::now()));
+    tasks[taskId] = task;
+
+    VLOG(2) << "Health checks of task " << taskId << " starting in "
+            << Seconds(check.delay_seconds()) << ", grace period "
+            << Seconds(check.grace_period_seconds());
+
+    schedule(task, task->start + Seconds(check.delay_seconds()));
+
+    return Nothing();
+  }
+
+  void remove(const TaskID& taskId)
+  {
+    // The scheduled checks and the checks in flight of the task are
+    // ignored once it is gone.
+    tasks.erase(taskId);
+  }
+
+protected:
+  virtual void finalize()
+  {
+    Clock::cancel(timer);
+  }
+
+private:
+  struct Task
+  {
+    Task(uint64_t _id,
+         const TaskID& _taskId,
+         const HealthCheck& _check,
+         const Time& _start)
+      : id(_id),
+        taskId(_taskId),
+        check(_check),
+        start(_start),
+        consecutiveFailures(0) {}
+
+    // Distinguishes the task from a task with the same ID that got
+    // added after this one was removed.
+    const uint64_t id;
+
+    const TaskID taskId;
+    const HealthCheck check;
+    const Time start;
+
+    // The health that was last reported, if any.
+    Option<bool> healthy;
+
+    uint32_t consecutiveFailures;
+  };
+
+  void schedule(const Owned<Task>& task, const Time& time)
+  {
+    schedules.insert(
+        std::make_pair(time, std::make_pair(task->taskId, task->id)));
+
+    // Re-arm the timer if the check is due before it expires.
+    if (deadline.isNone() || time < deadline.get()) {
+      Clock::cancel(timer);
+
+      deadline = time;
+      timer = delay(
+          std::max(time - Clock::now(), Duration::zero()),
+          self(),
+          &Self::expired);
+    }
+  }
+
+  void expired()
+  {
+    deadline = None();
+
+    const Time now = Clock::now() + HEALTH_CHECK_RESOLUTION;
+
+    while (!schedules.empty() && schedules.begin()->first <= now) {
+      const TaskID taskId = schedules.begin()->second.first;
+      const uint64_t id = schedules.begin()->second.second;
+
+      schedules.erase(schedules.begin());
+
+      Option<Owned<Task> > task = tasks.get(taskId);
+      if (task.isSome() && task.get()->id == id) {
+        check(task.get());
+      }
+    }
+
+    if (!schedules.empty()) {
+      deadline = schedules.begin()->first;
+      timer = delay(
+          std::max(deadline.get() - Clock::now(), HEALTH_CHECK_RESOLUTION),
+          self(),
+          &Self::expired);
+    }
+  }
+
+  void check(const Owned<Task>& task)
+  {
+    const HealthCheck& check = task->check;
+
+    Future<Nothing> result;
+    if (check.has_tcp()) {
+      result = tcpCheck(check.tcp());
+    } else if (check.has_http()) {
+      result = httpCheck(check.http());
+    } else {
+      result = commandCheck(check.command());
+    }
+
+    const Duration timeout = Seconds(check.timeout_seconds());
+
+    result
+      .after(timeout, lambda::bind(&timedout, lambda::_1, timeout))
+      .onAny(defer(self(), &Self::checked, task->taskId, task->id, lambda::_1));
+  }
+
+  void checked(
+      const TaskID& taskId,
+      uint64_t id,
+      const Future<Nothing>& result)
+  {
+    Option<Owned<Task> > _task = tasks.get(taskId);
+    if (_task.isNone() || _task.get()->id != id) {
+      return;
+    }
+
+    const Owned<Task>& task = _task.get();
+    const HealthCheck& check = task->check;
+
+    if (result.isReady()) {
+      VLOG(1) << "Health check of task " << taskId << " passed";
+
+      task->consecutiveFailures = 0;
+
+      // Report the first success, and the first success following
+      // failure(s).
+      if (task->healthy.isNone() || !task->healthy.get()) {
+        report(task, true, false);
+      }
+    } else {
+      const string message =
+        result.isFailed() ? result.failure() : "discarded";
+
+      if (check.grace_period_seconds() > 0 &&
+          Clock::now() - task->start <=
+            Seconds(check.grace_period_seconds())) {
+        VLOG(1) << "Ignoring failure of health check of task " << taskId
+                << " in grace period: " << message;
+      } else {
+        task->consecutiveFailures++;
+
+        VLOG(1) << "#" << task->consecutiveFailures << " health check of "
+                << "task " << taskId << " failed: " << message;
+
+        bool kill = task->consecutiveFailures >= check.consecutive_failures();
+
+        // Report the first failure following a success and the
+        // failure that gets the task killed.
+        if (task->healthy.isNone() || task->healthy.get() || kill) {
+          report(task, false, kill);
+        }
+
+        // The task is not checked anymore once it is to be killed.
+        if (kill) {
+          tasks.erase(taskId);
+          return;
+        }
+      }
+    }
+
+    schedule(task, Clock::now() + Seconds(check.interval_seconds()));
+  }
+
+  void report(const Owned<Task>& task, bool healthy, bool kill)
+  {
+    task->healthy = healthy;
+
+    TaskHealthStatus status;
+    status.mutable_task_id()->CopyFrom(task->taskId);
+    status.set_healthy(healthy);
+    status.set_kill_task(kill);
+    if (!healthy) {
+      status.set_consecutive_failures(task->consecutiveFailures);
+    }
+
+    // Any other changes that are already pending get reported in the
+    // same batch.
+    if (statuses.empty()) {
+      dispatch(self(), &Self::flush);
+    }
+
+    statuses.push_back(status);
+  }
+
+  void flush()
+  {
+    vector<TaskHealthStatus> _statuses;
+    _statuses.swap(statuses);
+
+    callback(_statuses);
+  }
+
+  const HealthChecker::Callback callback;
+
+  hashmap<TaskID, Owned<Task> > tasks;
+
+  // The checks that are due, ordered by time, along with the single
+  // timer that expires when the first one is due.
+  multimap<Time, std::pair<TaskID, uint64_t> > schedules;
+  Option<Time> deadline;
+  Timer timer;
+
+  // The health changes that are yet to be reported.
+  vector<TaskHealthStatus> statuses;
+
+  // The number of tasks that were ever added, used to tell apart
+  // tasks with the same ID.
+  uint64_t added;
+};
+
+
+HealthChecker::HealthChecker(const Callback& callback)
+  : process(new HealthCheckerProcess(callback))
+{
+  spawn(process.get());
+}
+
+
+HealthChecker::~HealthChecker()
+{
+  terminate(process.get());
+  wait(process.get());
+}
+
+
+Future<Nothing> HealthChecker::add(
+    const TaskID& taskId,
+    const HealthCheck& check)
+{
+  return dispatch(process.get(), &HealthCheckerProcess::add, taskId, check);
+}
+
+
+void HealthChecker::remove(const TaskID& taskId)
+{
+  dispatch(process.get(), &HealthCheckerProcess::remove, taskId);
+}
+
+} // namespace internal {
+} // namespace mesos {
@@ -0,0 +1,76 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HEALTH_CHECKER_HPP__
+#define __HEALTH_CHECKER_HPP__
+
+#include <vector>
+
+#include <mesos/mesos.hpp>
+
+#include <process/future.hpp>
+#include <process/owned.hpp>
+
+#include <stout/lambda.hpp>
+#include <stout/nothing.hpp>
+
+#include "messages/messages.hpp"
+
+namespace mesos {
+namespace internal {
+
+// Forward declaration.
+class HealthCheckerProcess;
+
+
+// Performs the health checks of any number of tasks from within the
+// calling process. All checks share a single timer: checks that are
+// due at about the same time are run together. HTTP and TCP checks
+// are performed natively while only command checks need to fork.
+//
+// The health of a task is only reported when it changes, i.e., on the
+// first success, on the first failure following a success (outside
+// of the grace period) and once the task has failed enough
+// consecutive checks that it should be killed, after which the task
+// is no longer checked. Changes that occur together are reported in
+// a single batch.
+class HealthChecker
+{
+public:
+  typedef lambda::function<void(const std::vector<TaskHealthStatus>&)>
+    Callback;
+
+  explicit HealthChecker(const Callback& callback);
+
+  ~HealthChecker();
+
+  // Starts checking the health of the task. Returns a failure if the
+  // health check is not supported.
+  process::Future<Nothing> add(const TaskID& taskId, const HealthCheck& check);
+
+  // Stops checking the health of the task.
+  void remove(const TaskID& taskId);
+
+private:
+  process::Owned<HealthCheckerProcess> process;
+};
+
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __HEALTH_CHECKER_HPP__
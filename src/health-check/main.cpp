@@ -28,13 +28,11 @@
 #include <mesos/mesos.hpp>
 
 #include <process/defer.hpp>
-#include <process/delay.hpp>
 #include <process/future.hpp>
-#include <process/io.hpp>
+#include <process/owned.hpp>
 #include <process/pid.hpp>
 #include <process/process.hpp>
 #include <process/protobuf.hpp>
-#include <process/subprocess.hpp>
 
 #include <stout/duration.hpp>
 #include <stout/flags.hpp>
@@ -44,7 +42,7 @@
 #include <stout/protobuf.hpp>
 #include <stout/strings.hpp>
 
-#include "common/status_utils.hpp"
+#include "health-check/health_checker.hpp"
 
 #include "messages/messages.hpp"
 
@@ -64,191 +62,57 @@ namespace internal {
 
 using namespace process;
 
-class HealthCheckerProcess : public ProtobufProcess<HealthCheckerProcess>
+// Forwards the health of the task, checked by a HealthChecker, to the
+// executor.
+class HealthCheckForwarderProcess
+  : public ProtobufProcess<HealthCheckForwarderProcess>
 {
 public:
-  HealthCheckerProcess(
+  HealthCheckForwarderProcess(
     const HealthCheck& _check,
     const UPID& _executor,
     const TaskID& _taskID)
     : check(_check),
-      initializing(true),
       executor(_executor),
-      taskID(_taskID),
-      consecutiveFailures(0) {}
+      taskID(_taskID) {}
 
-  virtual ~HealthCheckerProcess() {}
+  virtual ~HealthCheckForwarderProcess() {}
 
   Future<Nothing> healthCheck()
   {
-    VLOG(2) << "Health checks starting in "
-      << Seconds(check.delay_seconds()) << ", grace period "
-      << Seconds(check.grace_period_seconds());
+    checker.reset(new HealthChecker(
+        defer(self(), &Self::healthUpdated, lambda::_1)));
 
-    startTime = Clock::now();
+    checker->add(taskID, check)
+      .onFailed(defer(self(), &Self::failed, lambda::_1));
 
-    delay(Seconds(check.delay_seconds()), self(), &Self::_healthCheck);
     return promise.future();
   }
 
 private:
-  void failure(const string& message)
+  void healthUpdated(const vector<TaskHealthStatus>& statuses)
   {
-    if (check.grace_period_seconds() > 0 &&
-        (Clock::now() - startTime).secs() <= check.grace_period_seconds()) {
-      LOG(INFO) << "Ignoring failure as health check still in grace period";
-      reschedule();
-      return;
-    }
-
-    consecutiveFailures++;
-    VLOG(1) << "#" << consecutiveFailures << " check failed: " << message;
-
-    bool killTask = consecutiveFailures >= check.consecutive_failures();
-
-    TaskHealthStatus taskHealthStatus;
-    taskHealthStatus.set_healthy(false);
-    taskHealthStatus.set_consecutive_failures(consecutiveFailures);
-    taskHealthStatus.set_kill_task(killTask);
-    taskHealthStatus.mutable_task_id()->CopyFrom(taskID);
-    send(executor, taskHealthStatus);
-
-    if (killTask) {
-      promise.fail(message);
-    } else {
-      reschedule();
-    }
-  }
-
-  void success()
-  {
-    VLOG(1) << "Check passed";
-
-    // Send a healthy status update on the first success,
-    // and on the first success following failure(s).
-    if (initializing || consecutiveFailures > 0) {
-      TaskHealthStatus taskHealthStatus;
-      taskHealthStatus.set_healthy(true);
-      taskHealthStatus.mutable_task_id()->CopyFrom(taskID);
-      send(executor, taskHealthStatus);
-      initializing = false;
-    }
-    consecutiveFailures = 0;
-    reschedule();
-  }
-
-  void _healthCheck()
-  {
-    if (check.has_http()) {
-      promise.fail("HTTP health check is not supported");
-      return;
-    }
+    foreach (const TaskHealthStatus& status, statuses) {
+      send(executor, status);
 
-    if (!check.has_command()) {
-      promise.fail("No check found in health check");
-      return;
-    }
-
-    const CommandInfo& command = check.command();
-
-    map<string, string> environment;
-    foreach (const Environment_Variable& variable,
-             command.environment().variables()) {
-      environment[variable.name()] = variable.value();
-    }
-
-    // Launch the subprocess.
-    Option<Try<Subprocess> > external;
-
-    if (command.shell()) {
-      // Use the shell variant.
-      if (!command.has_value()) {
-        promise.fail("Shell command is not specified");
-        return;
+      if (status.kill_task()) {
+        promise.fail("Task failed " +
+                     stringify(status.consecutive_failures()) +
+                     " consecutive health checks");
       }
-
-      VLOG(2) << "Launching health command '" << command.value() << "'";
-
-      external = process::subprocess(
-          command.value(),
-          Subprocess::PATH("/dev/null"),
-          Subprocess::FD(STDERR_FILENO),
-          Subprocess::FD(STDERR_FILENO),
-          environment);
-    } else {
-      // Use the exec variant.
-      if (!command.has_value()) {
-        promise.fail("Executable path is not specified");
-        return;
-      }
-
-      vector<string> argv;
-      foreach (const string& arg, command.arguments()) {
-        argv.push_back(arg);
-      }
-
-      VLOG(2) << "Launching health command [" << command.value() << ", "
-              << strings::join(", ", argv) << "]";
-
-      external = process::subprocess(
-          command.value(),
-          argv,
-          Subprocess::PATH("/dev/null"),
-          Subprocess::FD(STDERR_FILENO),
-          Subprocess::FD(STDERR_FILENO),
-          None(),
-          environment);
-    }
-
-    CHECK_SOME(external);
-
-    if (external.get().isError()) {
-      promise.fail("Error creating subprocess for healthcheck");
-      return;
-    }
-
-    Future<Option<int> > status = external.get().get().status();
-    status.await(Seconds(check.timeout_seconds()));
-
-    if (!status.isReady()) {
-      string msg = "Command check failed with reason: ";
-      if (status.isFailed()) {
-        msg += "failed with error: " + status.failure();
-      } else if (status.isDiscarded()) {
-        msg += "status future discarded";
-      } else {
-        msg += "status still pending after timeout " +
-               stringify(Seconds(check.timeout_seconds()));
-      }
-
-      promise.fail(msg);
-      return;
-    }
-
-    int statusCode = status.get().get();
-    if (statusCode != 0) {
-      string message = "Health command check " + WSTRINGIFY(statusCode);
-      failure(message);
-    } else {
-      success();
     }
   }
 
-  void reschedule()
+  void failed(const string& message)
   {
-    VLOG(1) << "Rescheduling health check in "
-      << Seconds(check.interval_seconds());
-
-    delay(Seconds(check.interval_seconds()), self(), &Self::_healthCheck);
+    promise.fail(message);
   }
 
   Promise<Nothing> promise;
   HealthCheck check;
-  bool initializing;
   UPID executor;
   TaskID taskID;
-  uint32_t consecutiveFailures;
-  process::Time startTime;
+  Owned<HealthChecker> checker;
 };
 
 } // namespace internal {
@@ -340,12 +204,15 @@ int main(int argc, char** argv)
     return 0;
   }
 
-  if (check.get().has_http() && check.get().has_command()) {
-    LOG(WARNING) << "Both HTTP and Command check passed in";
+  if (check.get().has_http() + check.get().has_tcp() +
+      check.get().has_command() > 1) {
+    LOG(WARNING) << "More than one of HTTP, TCP and Command check passed in";
     return -1;
   }
 
-  if (!check.get().has_http() && !check.get().has_command()) {
+  if (!check.get().has_http() &&
+      !check.get().has_tcp() &&
+      !check.get().has_command()) {
     LOG(WARNING) << "No health check found";
     return -1;
   }
@@ -359,7 +226,7 @@ int main(int argc, char** argv)
   TaskID taskID;
   taskID.set_value(flags.task_id.get());
 
-  internal::HealthCheckerProcess process(
+  internal::HealthCheckForwarderProcess process(
     check.get(),
     flags.executor.get(),
     taskID);
@@ -368,7 +235,7 @@ int main(int argc, char** argv)
 
   process::Future<Nothing> checking =
     process::dispatch(
-      process, &internal::HealthCheckerProcess::healthCheck);
+      process, &internal::HealthCheckForwarderProcess::healthCheck);
 
   checking.await();
 
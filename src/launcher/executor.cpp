@@ -33,6 +33,7 @@
 #include <process/delay.hpp>
 #include <process/future.hpp>
 #include <process/io.hpp>
+#include <process/owned.hpp>
 #include <process/process.hpp>
 #include <process/protobuf.hpp>
 #include <process/subprocess.hpp>
@@ -51,6 +52,8 @@
 #include "common/http.hpp"
 #include "common/status_utils.hpp"
 
+#include "health-check/health_checker.hpp"
+
 #include "logging/logging.hpp"
 
 #include "messages/messages.hpp"
@@ -75,15 +78,13 @@ using namespace process;
 class CommandExecutorProcess : public ProtobufProcess<CommandExecutorProcess>
 {
 public:
-  CommandExecutorProcess(Option<char**> override, const string& _healthCheckDir)
+  CommandExecutorProcess(Option<char**> override)
     : launched(false),
       killed(false),
       killedByHealthCheck(false),
       pid(-1),
-      healthPid(-1),
       escalationTimeout(slave::EXECUTOR_SIGNAL_ESCALATION_TIMEOUT),
       driver(None()),
-      healthCheckDir(_healthCheckDir),
       override(override) {}
 
   virtual ~CommandExecutorProcess() {}
@@ -291,9 +292,9 @@ public:
   void killTask(ExecutorDriver* driver, const TaskID& taskId)
   {
     shutdown(driver);
-    if (healthPid != -1) {
-      // Cleanup health check process.
-      ::kill(healthPid, SIGKILL);
+    if (checker.get() != NULL) {
+      // Stop checking the health of the task.
+      checker->remove(taskId);
     }
   }
 
@@ -336,13 +337,11 @@ public:
   virtual void error(ExecutorDriver* driver, const string& message) {}
 
 protected:
-  virtual void initialize()
+  void healthUpdated(const vector<TaskHealthStatus>& statuses)
   {
-    install<TaskHealthStatus>(
-        &CommandExecutorProcess::taskHealthUpdated,
-        &TaskHealthStatus::task_id,
-        &TaskHealthStatus::healthy,
-        &TaskHealthStatus::kill_task);
+    foreach (const TaskHealthStatus& status, statuses) {
+      taskHealthUpdated(status.task_id(), status.healthy(), status.kill_task());
+    }
   }
 
   void taskHealthUpdated(
@@ -455,50 +454,32 @@ private:
   void launchHealthCheck(const TaskInfo& task)
   {
     if (task.has_health_check()) {
-      JSON::Object json = JSON::Protobuf(task.health_check());
-
-      // Launch the subprocess using 'exec' style so that quotes can
-      // be properly handled.
-      vector<string> argv(4);
-      argv[0] = "mesos-health-check";
-      argv[1] = "--executor=" + stringify(self());
-      argv[2] = "--health_check_json=" + stringify(json);
-      argv[3] = "--task_id=" + task.task_id().value();
-
-      cout << "Launching health check process: "
-           << path::join(healthCheckDir, "mesos-health-check")
-           << " " << argv[1] << " " << argv[2] << " " << argv[3] << endl;
-
-      Try<Subprocess> healthProcess =
-        process::subprocess(
-          path::join(healthCheckDir, "mesos-health-check"),
-          argv,
-          // Intentionally not sending STDIN to avoid health check
-          // commands that expect STDIN input to block.
-          Subprocess::PATH("/dev/null"),
-          Subprocess::FD(STDOUT_FILENO),
-          Subprocess::FD(STDERR_FILENO));
-
-      if (healthProcess.isError()) {
-        cerr << "Unable to launch health process: " << healthProcess.error();
-      } else {
-        healthPid = healthProcess.get().pid();
+      // The health of the task is checked from within the executor,
+      // so only command checks need to fork.
+      checker.reset(new HealthChecker(
+          defer(self(), &Self::healthUpdated, lambda::_1)));
 
-        cout << "Health check process launched at pid: "
-             << stringify(healthPid) << endl;
-      }
+      cout << "Checking the health of the task: "
+           << stringify(JSON::Protobuf(task.health_check())) << endl;
+
+      checker->add(task.task_id(), task.health_check())
+        .onFailed(defer(self(), &Self::healthCheckFailed, lambda::_1));
     }
   }
 
+  void healthCheckFailed(const string& message)
+  {
+    cerr << "Unable to check the health of the task: " << message << endl;
+  }
+
   bool launched;
   bool killed;
   bool killedByHealthCheck;
   pid_t pid;
-  pid_t healthPid;
+  Owned<HealthChecker> checker;
   Duration escalationTimeout;
   Timer escalationTimer;
   Option<ExecutorDriver*> driver;
-  string healthCheckDir;
   Option<char**> override;
 };
 
@@ -506,9 +487,9 @@ private:
 class CommandExecutor: public Executor
 {
 public:
-  CommandExecutor(Option<char**> override, string healthCheckDir)
+  CommandExecutor(Option<char**> override)
   {
-    process = new CommandExecutorProcess(override, healthCheckDir);
+    process = new CommandExecutorProcess(override);
     spawn(process);
   }
 
@@ -647,11 +628,7 @@ int main(int argc, char** argv)
     }
   }
 
-  string path = os::getenv("MESOS_LAUNCHER_DIR", false);
-  if (path.empty()) {
-    path = os::realpath(dirname(argv[0])).get();
-  }
-  mesos::internal::CommandExecutor executor(override, path);
+  mesos::internal::CommandExecutor executor(override);
   mesos::MesosExecutorDriver driver(&executor);
   return driver.run() == mesos::DRIVER_STOPPED ? 0 : 1;
 }
@@ -16,12 +16,25 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <list>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 #include <mesos/mesos.hpp>
 
 #include <mesos/fetcher/fetcher.hpp>
 
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
 #include <stout/json.hpp>
 #include <stout/net.hpp>
 #include <stout/option.hpp>
@@ -43,36 +56,112 @@ using std::cerr;
 using std::cout;
 using std::endl;
 using std::string;
+using std::vector;
 
 
 const char FILE_URI_PREFIX[] = "file://";
 const char FILE_URI_LOCALHOST[] = "file://localhost";
 
+// Name of the directory within a cache entry that holds the extracted
+// contents of a cached archive.
+const char EXTRACTED_DIRECTORY[] = ".extracted";
+
+// Maximum number of URIs that are fetched concurrently.
+const size_t MAX_CONCURRENT_FETCHES = 4;
+
+
+// Runs the command (looked up in the PATH) with the given arguments
+// and waits for it to exit. The command is executed directly rather
+// than through the shell, so the arguments (e.g., paths that contain
+// quotes) are passed verbatim. If 'quiet' is true the standard error
+// of the command is discarded.
+Try<Nothing> execute(const vector<string>& argv, bool quiet = false)
+{
+  CHECK(!argv.empty());
+
+  const string command = strings::join(" ", argv);
+
+  // Prepare the arguments before forking since we must not allocate
+  // memory in the child.
+  vector<char*> args;
+  foreach (const string& arg, argv) {
+    args.push_back(const_cast<char*>(arg.c_str()));
+  }
+  args.push_back(NULL);
+
+  pid_t pid = ::fork();
+  if (pid == -1) {
+    return ErrnoError("Failed to fork to run '" + command + "'");
+  }
+
+  if (pid == 0) {
+    if (quiet) {
+      int fd = ::open("/dev/null", O_WRONLY);
+      if (fd != -1) {
+        ::dup2(fd, STDERR_FILENO);
+        ::close(fd);
+      }
+    }
+
+    ::execvp(args[0], &args[0]);
+    ::_exit(127);
+  }
+
+  int status;
+  while (::waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR) {
+      return ErrnoError("Failed to wait for '" + command + "'");
+    }
+  }
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    return Error("Command '" + command + "' exited with status: " +
+                 stringify(status));
+  }
+
+  return Nothing();
+}
+
+
+// Returns true if the file is an archive that 'extract' recognizes.
+bool isArchive(const string& filename)
+{
+  return strings::endsWith(filename, ".tgz") ||
+    strings::endsWith(filename, ".tar.gz") ||
+    strings::endsWith(filename, ".tbz2") ||
+    strings::endsWith(filename, ".tar.bz2") ||
+    strings::endsWith(filename, ".txz") ||
+    strings::endsWith(filename, ".tar.xz") ||
+    strings::endsWith(filename, ".zip");
+}
+
+
 // Try to extract filename into directory. If filename is recognized as an
 // archive it will be extracted and true returned; if not recognized then false
 // will be returned. An Error is returned if the extraction command fails.
 Try<bool> extract(const string& filename, const string& directory)
 {
-  string command;
+  if (!isArchive(filename)) {
+    return false;
+  }
+
   // Extract any .tgz, tar.gz, tar.bz2 or zip files.
-  if (strings::endsWith(filename, ".tgz") ||
-      strings::endsWith(filename, ".tar.gz") ||
-      strings::endsWith(filename, ".tbz2") ||
-      strings::endsWith(filename, ".tar.bz2") ||
-      strings::endsWith(filename, ".txz") ||
-      strings::endsWith(filename, ".tar.xz")) {
-    command = "tar -C '" + directory + "' -xf";
-  } else if (strings::endsWith(filename, ".zip")) {
-    command = "unzip -d '" + directory + "'";
+  vector<string> argv;
+  if (strings::endsWith(filename, ".zip")) {
+    argv.push_back("unzip");
+    argv.push_back("-d");
+    argv.push_back(directory);
   } else {
-    return false;
+    argv.push_back("tar");
+    argv.push_back("-C");
+    argv.push_back(directory);
+    argv.push_back("-xf");
   }
+  argv.push_back(filename);
 
-  command += " '" + filename + "'";
-  int status = os::system(command);
-  if (status != 0) {
-    return Error("Failed to extract: command " + command +
-                 " exited with status: " + stringify(status));
+  Try<Nothing> execution = execute(argv);
+  if (execution.isError()) {
+    return Error("Failed to extract: " + execution.error());
   }
 
   LOG(INFO) << "Extracted resource '" << filename
@@ -189,15 +278,18 @@ Try<string> fetchWithLocalCopy(
 
     // Copy the resource to the directory.
     string path = path::join(directory, base.get());
-    std::ostringstream command;
-    command << "cp '" << local << "' '" << path << "'";
     LOG(INFO) << "Copying resource from '" << local
               << "' to '" << directory << "'";
 
-    int status = os::system(command.str());
-    if (status != 0) {
+    vector<string> argv;
+    argv.push_back("cp");
+    argv.push_back(local);
+    argv.push_back(path);
+
+    Try<Nothing> execution = execute(argv);
+    if (execution.isError()) {
         LOG(ERROR) << "Failed to copy '" << local
-                   << "' : Exit status " << status;
+                   << "': " << execution.error();
         return Error("Local copy failed");
     }
 
@@ -254,6 +346,336 @@ Try<string> fetch(
 }
 
 
+// Returns the path of the single file held by the given cache entry.
+Try<string> cached(const string& entry)
+{
+  Try<std::list<string> > ls = os::ls(entry);
+  if (ls.isError()) {
+    return Error("Failed to list cache entry: " + ls.error());
+  }
+
+  std::list<string> files = ls.get();
+  files.remove(EXTRACTED_DIRECTORY);
+
+  if (files.size() != 1) {
+    return Error("Unexpected number of files in cache entry: " +
+                 stringify(files.size()));
+  }
+
+  return path::join(entry, files.front());
+}
+
+
+// Copies 'source' to 'destination' (recursively if requested). The
+// data is cloned with reflinks where the filesystem supports them,
+// which shares the data until it is modified, and copied otherwise.
+// Either way the copy has its own inodes, so modifying it in place or
+// changing its ownership does not affect the source.
+Try<Nothing> copy(
+    const string& source,
+    const string& destination,
+    bool recursive)
+{
+  vector<string> argv;
+  argv.push_back("cp");
+  if (recursive) {
+    argv.push_back("-a");
+  }
+  argv.push_back("--reflink=always");
+  argv.push_back(source);
+  argv.push_back(destination);
+
+  if (execute(argv, true).isSome()) {
+    return Nothing();
+  }
+
+  // The filesystem doesn't support reflinks (or 'cp' doesn't know
+  // about them), so fall back to a regular copy.
+  argv.clear();
+  argv.push_back("cp");
+  if (recursive) {
+    argv.push_back("-a");
+  }
+  argv.push_back(source);
+  argv.push_back(destination);
+
+  return execute(argv);
+}
+
+
+// Populate the sandbox with the extracted contents of the archive
+// held by the given cache entry, extracting it into the entry first
+// if this has not been done yet, which avoids extracting the archive
+// again for every sandbox. The extracted tree is copied (see 'copy')
+// so tasks can't modify the cache through their sandboxes.
+Try<Nothing> extractCached(
+    const string& entry,
+    const string& directory)
+{
+  const string extracted = path::join(entry, EXTRACTED_DIRECTORY);
+
+  if (!os::exists(extracted)) {
+    Try<string> archive = cached(entry);
+    if (archive.isError()) {
+      return Error(archive.error());
+    }
+
+    // Extract into a temporary directory first so that a failed
+    // extraction does not leave a partial tree in the cache. Fetches
+    // of other containers might be extracting the same entry.
+    const string temporary = extracted + "." + stringify(::getpid());
+
+    Try<Nothing> mkdir = os::mkdir(temporary);
+    if (mkdir.isError()) {
+      return Error("Failed to create directory: " + mkdir.error());
+    }
+
+    Try<bool> extract_ = extract(archive.get(), temporary);
+    if (extract_.isError()) {
+      os::rmdir(temporary);
+      return Error(extract_.error());
+    }
+
+    Try<Nothing> rename = os::rename(temporary, extracted);
+    if (rename.isError()) {
+      os::rmdir(temporary);
+
+      // Another fetch finished extracting the entry first.
+      if (!os::exists(extracted)) {
+        return Error("Failed to rename directory: " + rename.error());
+      }
+    }
+  }
+
+  Try<Nothing> copy_ = copy(extracted + "/.", directory, true);
+  if (copy_.isError()) {
+    return Error("Failed to copy extracted archive: " + copy_.error());
+  }
+
+  LOG(INFO) << "Populated '" << directory << "' with the cached "
+            << "extracted archive '" << extracted << "'";
+
+  return Nothing();
+}
+
+
+// Populate the sandbox with a copy (see 'copy') of the file held by
+// the given cache entry.
+Try<string> retrieve(const string& entry, const string& directory)
+{
+  Try<string> source = cached(entry);
+  if (source.isError()) {
+    return Error(source.error());
+  }
+
+  Try<string> base = os::basename(source.get());
+  if (base.isError()) {
+    return Error(base.error());
+  }
+
+  string path = path::join(directory, base.get());
+
+  Try<Nothing> copy_ = copy(source.get(), path, false);
+  if (copy_.isError()) {
+    return Error("Failed to copy cached resource '" + source.get() +
+                 "': " + copy_.error());
+  }
+
+  LOG(INFO) << "Copied cached resource '" << source.get()
+            << "' into '" << directory << "'";
+
+  return path;
+}
+
+
+// Fetch the item into the sandbox, using the cache as instructed by
+// the slave.
+Try<string> fetch(
+    const FetcherInfo::Item& item,
+    const string& directory,
+    const Option<string>& cacheDirectory,
+    const Option<string>& frameworksHome)
+{
+  if (item.action() == FetcherInfo::Item::BYPASS_CACHE) {
+    return fetch(item.uri().value(), directory, frameworksHome);
+  }
+
+  if (cacheDirectory.isNone() || !item.has_cache_entry()) {
+    return Error("Missing cache entry");
+  }
+
+  const string entry = path::join(cacheDirectory.get(), item.cache_entry());
+
+  if (item.action() == FetcherInfo::Item::DOWNLOAD_AND_CACHE) {
+    LOG(INFO) << "Fetching URI '" << item.uri().value()
+              << "' into cache entry '" << entry << "'";
+
+    Try<Nothing> mkdir = os::mkdir(entry);
+    if (mkdir.isError()) {
+      return Error("Failed to create cache entry: " + mkdir.error());
+    }
+
+    Try<string> fetched = fetch(item.uri().value(), entry, frameworksHome);
+    if (fetched.isError()) {
+      return Error(fetched.error());
+    }
+  }
+
+  return retrieve(entry, directory);
+}
+
+
+// Fetch the item into the sandbox, then chmod it if it's executable,
+// else extract it if it's an archive.
+Try<Nothing> install(
+    const FetcherInfo::Item& item,
+    const string& directory,
+    const Option<string>& cacheDirectory,
+    const Option<string>& frameworksHome)
+{
+  const CommandInfo::URI& uri = item.uri();
+
+  // Archives held by the cache are extracted once within the cache
+  // rather than into each sandbox.
+  const bool cached = item.action() != FetcherInfo::Item::BYPASS_CACHE &&
+    !uri.executable() && uri.extract() && isArchive(uri.value());
+
+  // Fetch the URI to a local file.
+  Try<string> fetched =
+    fetch(item, directory, cacheDirectory, frameworksHome);
+
+  if (fetched.isError()) {
+    return Error("Failed to fetch " + uri.value() + ": " + fetched.error());
+  }
+
+  if (uri.executable()) {
+    Try<Nothing> chmod = os::chmod(
+        fetched.get(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+    if (chmod.isError()) {
+      return Error("Failed to chmod " + fetched.get() + ": " + chmod.error());
+    }
+  } else if (cached) {
+    Try<Nothing> extracted = extractCached(
+        path::join(cacheDirectory.get(), item.cache_entry()), directory);
+    if (extracted.isError()) {
+      return Error("Failed to extract " + fetched.get() + ": " +
+                   extracted.error());
+    }
+  } else if (uri.extract()) {
+    // TODO(idownes): Consider removing the archive once extracted.
+    // Try to extract the file if it's recognized as an archive.
+    Try<bool> extracted = extract(fetched.get(), directory);
+    if (extracted.isError()) {
+      return Error("Failed to extract " + fetched.get() + ":" +
+                   extracted.error());
+    }
+  } else {
+    LOG(INFO) << "Skipped extracting path '" << fetched.get() << "'";
+  }
+
+  return Nothing();
+}
+
+
+// Returns the name of the file that the URI is fetched to within the
+// sandbox, i.e., the last component of its path.
+string filename(const string& uri)
+{
+  return uri.substr(uri.find_last_of('/') + 1);
+}
+
+
+// Install the items in parallel, each in a forked child, and wait for
+// all of them. At most MAX_CONCURRENT_FETCHES items are installed at
+// a time, and items that are fetched to the same file are installed
+// one after the other, in order, rather than racing on the file. No
+// more items are started once one has failed. Returns false if any of
+// them failed.
+bool install(
+    const std::vector<FetcherInfo::Item>& items,
+    const string& directory,
+    const Option<string>& cacheDirectory,
+    const Option<string>& frameworksHome)
+{
+  std::list<FetcherInfo::Item> pending(items.begin(), items.end());
+
+  // The file fetched by each running child.
+  std::map<pid_t, string> running;
+
+  bool success = true;
+
+  while (!pending.empty() || !running.empty()) {
+    // The files that are either being fetched or are to be fetched by
+    // an earlier pending item.
+    std::set<string> files;
+    foreachvalue (const string& file, running) {
+      files.insert(file);
+    }
+
+    std::list<FetcherInfo::Item>::iterator item = pending.begin();
+    while (success &&
+           running.size() < MAX_CONCURRENT_FETCHES &&
+           item != pending.end()) {
+      const string file = filename(item->uri().value());
+
+      if (files.count(file) > 0) {
+        ++item;
+        continue;
+      }
+
+      files.insert(file);
+
+      pid_t pid = ::fork();
+
+      if (pid == -1) {
+        PLOG(ERROR) << "Failed to fork to fetch " << item->uri().value();
+        success = false;
+        break;
+      } else if (pid == 0) {
+        Try<Nothing> installed =
+          install(*item, directory, cacheDirectory, frameworksHome);
+
+        if (installed.isError()) {
+          LOG(ERROR) << installed.error();
+          ::_exit(1);
+        }
+
+        ::_exit(0);
+      }
+
+      running[pid] = file;
+      item = pending.erase(item);
+    }
+
+    if (running.empty()) {
+      break;
+    }
+
+    int status;
+    pid_t pid = ::waitpid(-1, &status, 0);
+
+    if (pid == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      PLOG(ERROR) << "Failed to wait for the fetches";
+      return false;
+    }
+
+    if (running.erase(pid) == 0) {
+      continue;
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      success = false;
+    }
+  }
+
+  return success && pending.empty();
+}
+
+
 int main(int argc, char* argv[])
 {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -301,40 +723,59 @@ int main(int argc, char* argv[])
     frameworksHome = fetcherInfo.get().frameworks_home();
   }
 
-  // Fetch each URI to a local file, chmod, then chown if a user is provided.
-  foreach (const CommandInfo::URI& uri, commandInfo.uris()) {
-    // Fetch the URI to a local file.
-    Try<string> fetched = fetch(uri.value(), directory, frameworksHome);
-    if (fetched.isError()) {
-      EXIT(1) << "Failed to fetch: " << uri.value();
+  Option<std::string> cacheDirectory = None();
+  if (fetcherInfo.get().has_cache_directory()) {
+    cacheDirectory = fetcherInfo.get().cache_directory();
+  }
+
+  // Without any items (i.e., from an older slave) all URIs are
+  // fetched bypassing the cache.
+  std::vector<FetcherInfo::Item> items;
+  if (fetcherInfo.get().items().size() > 0) {
+    foreach (const FetcherInfo::Item& item, fetcherInfo.get().items()) {
+      items.push_back(item);
+    }
+  } else {
+    foreach (const CommandInfo::URI& uri, commandInfo.uris()) {
+      FetcherInfo::Item item;
+      item.mutable_uri()->CopyFrom(uri);
+      item.set_action(FetcherInfo::Item::BYPASS_CACHE);
+      items.push_back(item);
     }
+  }
 
-    // Chmod the fetched URI if it's executable, else assume it's an archive
-    // that should be extracted.
-    if (uri.executable()) {
-      Try<Nothing> chmod = os::chmod(
-          fetched.get(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
-      if (chmod.isError()) {
-        EXIT(1) << "Failed to chmod " << fetched.get() << ": " << chmod.error();
-      }
-    } else if (uri.extract()) {
-      // TODO(idownes): Consider removing the archive once extracted.
-      // Try to extract the file if it's recognized as an archive.
-      Try<bool> extracted = extract(fetched.get(), directory);
-      if (extracted.isError()) {
-        EXIT(1) << "Failed to extract "
-                << fetched.get() << ":" << extracted.error();
-      }
+  // URIs are fetched (and extracted) in parallel. The only ordering
+  // constraint is that a URI which is retrieved from a cache entry
+  // that is downloaded by this same fetch has to wait for the
+  // download, hence those are installed in a second round.
+  std::set<string> downloads;
+  foreach (const FetcherInfo::Item& item, items) {
+    if (item.action() == FetcherInfo::Item::DOWNLOAD_AND_CACHE) {
+      downloads.insert(item.cache_entry());
+    }
+  }
+
+  std::vector<FetcherInfo::Item> first;
+  std::vector<FetcherInfo::Item> second;
+  foreach (const FetcherInfo::Item& item, items) {
+    if (item.action() == FetcherInfo::Item::RETRIEVE_FROM_CACHE &&
+        downloads.count(item.cache_entry()) > 0) {
+      second.push_back(item);
     } else {
-      LOG(INFO) << "Skipped extracting path '" << fetched.get() << "'";
+      first.push_back(item);
     }
+  }
 
-    // Recursively chown the directory if a user is provided.
-    if (user.isSome()) {
-      Try<Nothing> chowned = os::chown(user.get(), directory);
-      if (chowned.isError()) {
-        EXIT(1) << "Failed to chown " << directory << ": " << chowned.error();
-      }
+  if (!install(first, directory, cacheDirectory, frameworksHome) ||
+      !install(second, directory, cacheDirectory, frameworksHome)) {
+    EXIT(1) << "Failed to fetch all URIs into " << directory;
+  }
+
+  // Recursively chown the directory if a user is provided.
+  if (user.isSome()) {
+    Try<Nothing> chowned = os::chown(user.get(), directory);
+    if (chowned.isError()) {
+      EXIT(1) << "Failed to chown " << directory << ": " << chowned.error();
     }
   }
 
@@ -16,11 +16,14 @@
  * limitations under the License.
  */
 
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fts.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <sys/syscall.h>
@@ -28,6 +31,7 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <fstream>
 #include <list>
 #include <map>
@@ -55,6 +59,7 @@
 #include <stout/proc.hpp>
 #include <stout/stringify.hpp>
 #include <stout/strings.hpp>
+#include <stout/unreachable.hpp>
 
 #include "linux/cgroups.hpp"
 #include "linux/fs.hpp"
@@ -71,6 +76,7 @@ using std::istringstream;
 using std::list;
 using std::map;
 using std::ofstream;
+using std::ostream;
 using std::ostringstream;
 using std::set;
 using std::string;
@@ -358,26 +364,41 @@ static Try<string> read(
 {
   string path = path::join(hierarchy, cgroup, control);
 
-  // TODO(benh): Use os::read. Note that we do not use os::read
-  // currently because it cannot correctly read /proc or cgroups
-  // control files since lseek (in os::read) will return error.
-  ifstream file(path.c_str());
-
-  if (!file.is_open()) {
-    return Error("Failed to open file " + path);
+  // NOTE: We do not use os::read (or an ifstream) here: os::read
+  // cannot correctly read /proc or cgroups control files since the
+  // lseek it performs returns an error, and an ifstream copies the
+  // contents through an additional stream buffer. Control files are
+  // read frequently (e.g., for every container on every resource
+  // monitoring interval), so we read them directly into a fixed size
+  // buffer with a single open.
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return ErrnoError("Failed to open file " + path);
   }
 
-  ostringstream ss;
-  ss << file.rdbuf();
+  string result;
+  char buffer[4096];
 
-  if (file.fail()) {
-    ErrnoError error; // TODO(jieyu): Does ifstream actually set errno?
-    file.close();
-    return error;
+  while (true) {
+    ssize_t length = ::read(fd, buffer, sizeof(buffer));
+
+    if (length < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      ErrnoError error("Failed to read file " + path);
+      os::close(fd);
+      return error;
+    } else if (length == 0) {
+      break;
+    }
+
+    result.append(buffer, length);
   }
 
-  file.close();
-  return ss.str();
+  os::close(fd);
+  return result;
 }
 
 
@@ -1393,12 +1414,16 @@ public:
       const string& _cgroup)
     : hierarchy(_hierarchy),
       cgroup(_cgroup),
-      start(Clock::now()) {}
+      start(Clock::now()),
+      interval(FREEZER_POLL_MIN_INTERVAL),
+      attempts(0) {}
 
   virtual ~Freezer() {}
 
   void freeze()
   {
+    attempts++;
+
     Try<Nothing> freeze =
       internal::freezer::state(hierarchy, cgroup, "FROZEN");
     if (freeze.isError()) {
@@ -1417,18 +1442,21 @@ public:
     if (state.get() == "FROZEN") {
       LOG(INFO) << "Successfully froze cgroup "
                 << path::join(hierarchy, cgroup)
-                << " after " << (Clock::now() - start);
+                << " after " << (Clock::now() - start)
+                << " and " << attempts << " attempt(s)";
       promise.set(Nothing());
       terminate(self());
       return;
     }
 
     // Attempt to freeze the freezer cgroup again.
-    delay(Milliseconds(100), self(), &Self::freeze);
+    delay(backoff(), self(), &Self::freeze);
   }
 
   void thaw()
   {
+    attempts++;
+
     Try<Nothing> thaw = internal::freezer::state(hierarchy, cgroup, "THAWED");
     if (thaw.isError()) {
       promise.fail(thaw.error());
@@ -1446,14 +1474,15 @@ public:
     if (state.get() == "THAWED") {
       LOG(INFO) << "Successfullly thawed cgroup "
                 << path::join(hierarchy, cgroup)
-                << " after " << (Clock::now() - start);
+                << " after " << (Clock::now() - start)
+                << " and " << attempts << " attempt(s)";
       promise.set(Nothing());
       terminate(self());
       return;
     }
 
     // Attempt to thaw the freezer cgroup again.
-    delay(Milliseconds(100), self(), &Self::thaw);
+    delay(backoff(), self(), &Self::thaw);
   }
 
   Future<Nothing> future() { return promise.future(); }
@@ -1479,9 +1508,20 @@ protected:
   }
 
 private:
+  // Returns the delay before checking the freezer state again,
+  // doubling it for the next time (see FREEZER_POLL_MIN_INTERVAL).
+  Duration backoff()
+  {
+    const Duration current = interval;
+    interval = std::min(interval * 2, FREEZER_POLL_MAX_INTERVAL);
+    return current;
+  }
+
   const string hierarchy;
   const string cgroup;
   const Time start;
+  Duration interval;
+  unsigned int attempts;
   Promise<Nothing> promise;
 };
 
@@ -1847,24 +1887,64 @@ Try<hashmap<string, uint64_t> > stat(
 
   hashmap<string, uint64_t> result;
 
-  foreach (const string& line, strings::split(contents.get(), "\n")) {
-    // Skip empty lines.
-    if (strings::trim(line).empty()) {
+  // Expected line format: "%s %llu". The contents are parsed in place
+  // rather than splitting them into lines and tokenizing each line
+  // with a stream, which avoids a number of temporary allocations
+  // for files that are read on every resource monitoring interval.
+  const char* current = contents.get().c_str();
+  const char* end = current + contents.get().size();
+
+  while (current < end) {
+    const char* eol = static_cast<const char*>(
+        ::memchr(current, '\n', end - current));
+
+    if (eol == NULL) {
+      eol = end;
+    }
+
+    // Skip leading whitespace and empty lines.
+    while (current < eol && ::isspace(*current)) {
+      ++current;
+    }
+
+    if (current == eol) {
+      current = eol + 1;
       continue;
     }
 
-    string name;
-    uint64_t value;
+    const char* name = current;
+    while (current < eol && !::isspace(*current)) {
+      ++current;
+    }
 
-    // Expected line format: "%s %llu".
-    istringstream stream(line);
-    stream >> name >> value;
+    const char* nameEnd = current;
+    while (current < eol && ::isspace(*current)) {
+      ++current;
+    }
 
-    if (stream.fail()) {
-      return Error("Unexpected line format in " + file + ": " + line);
+    // Parse the value, which must consist solely of digits (followed
+    // by optional trailing whitespace).
+    uint64_t value = 0;
+    const char* digits = current;
+    while (current < eol && ::isdigit(*current)) {
+      value = value * 10 + (*current - '0');
+      ++current;
     }
 
-    result[name] = value;
+    bool valid = current > digits;
+    while (current < eol) {
+      valid = valid && ::isspace(*current);
+      ++current;
+    }
+
+    if (!valid) {
+      return Error("Unexpected line format in " + file + ": " +
+                   string(name, eol - name));
+    }
+
+    result[string(name, nameEnd - name)] = value;
+
+    current = eol + 1;
   }
 
   return result;
@@ -1995,6 +2075,30 @@ Try<Nothing> cfs_quota_us(
 } // namespace cpu {
 
 
+namespace cpuacct {
+
+Result<string> cgroup(pid_t pid)
+{
+  return internal::cgroup(pid, "cpuacct");
+}
+
+
+Try<Duration> usage(
+    const string& hierarchy,
+    const string& cgroup)
+{
+  Try<string> read = cgroups::read(hierarchy, cgroup, "cpuacct.usage");
+
+  if (read.isError()) {
+    return Error(read.error());
+  }
+
+  return Duration::parse(strings::trim(read.get()) + "ns");
+}
+
+} // namespace cpuacct {
+
+
 namespace memory {
 
 Result<string> cgroup(pid_t pid)
@@ -2239,6 +2343,129 @@ Try<Nothing> disable(const string& hierarchy, const string& cgroup)
 
 } // namespace oom {
 
+
+namespace pressure {
+
+ostream& operator<<(ostream& stream, Level level)
+{
+  switch (level) {
+    case LOW:
+      return stream << "low";
+    case MEDIUM:
+      return stream << "medium";
+    case CRITICAL:
+      return stream << "critical";
+  }
+
+  UNREACHABLE();
+}
+
+
+// The process backing a Counter. It keeps listening on a single
+// event listener and accumulates the values read from the eventfd.
+class CounterProcess : public Process<CounterProcess>
+{
+public:
+  CounterProcess(const string& hierarchy,
+                 const string& cgroup,
+                 Level level)
+    : count(0),
+      listener(new event::Listener(
+          hierarchy,
+          cgroup,
+          "memory.pressure_level",
+          stringify(level))) {}
+
+  virtual ~CounterProcess() {}
+
+  Future<uint64_t> value()
+  {
+    if (error.isSome()) {
+      return Failure(error.get());
+    }
+
+    return count;
+  }
+
+protected:
+  virtual void initialize()
+  {
+    spawn(CHECK_NOTNULL(listener.get()));
+
+    listen();
+  }
+
+  virtual void finalize()
+  {
+    terminate(listener.get());
+    wait(listener.get());
+  }
+
+private:
+  void listen()
+  {
+    dispatch(listener.get(), &event::Listener::listen)
+      .onAny(defer(self(), &CounterProcess::_listen, lambda::_1));
+  }
+
+  void _listen(const Future<uint64_t>& future)
+  {
+    if (!future.isReady()) {
+      error = Error("Failed to listen on the pressure events: " +
+                    (future.isFailed() ? future.failure() : "discarded"));
+      return;
+    }
+
+    // The eventfd is not in semaphore mode so a single read returns
+    // the number of events that have occurred since the last read.
+    count += future.get();
+
+    listen();
+  }
+
+  uint64_t count;
+  Option<Error> error;
+  Owned<event::Listener> listener;
+};
+
+
+Try<Owned<Counter>> Counter::create(
+    const string& hierarchy,
+    const string& cgroup,
+    Level level)
+{
+  Option<Error> error = verify(hierarchy, cgroup, "memory.pressure_level");
+  if (error.isSome()) {
+    return error.get();
+  }
+
+  return Owned<Counter>(new Counter(hierarchy, cgroup, level));
+}
+
+
+Counter::Counter(const string& hierarchy,
+                 const string& cgroup,
+                 Level level)
+  : process(new CounterProcess(hierarchy, cgroup, level))
+{
+  spawn(CHECK_NOTNULL(process.get()));
+}
+
+
+Counter::~Counter()
+{
+  terminate(process.get(), true);
+  wait(process.get());
+}
+
+
+Future<uint64_t> Counter::value() const
+{
+  return dispatch(process.get(), &CounterProcess::value);
+}
+
+} // namespace pressure {
+
 } // namespace memory {
 
 
@@ -22,6 +22,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <ostream>
 #include <set>
 #include <string>
 #include <vector>
@@ -29,6 +30,7 @@
 #include <sys/types.h>
 
 #include <process/future.hpp>
+#include <process/owned.hpp>
 #include <process/timeout.hpp>
 
 #include <stout/bytes.hpp>
@@ -52,6 +54,16 @@ const Duration DESTROY_TIMEOUT = Seconds(60);
 const Duration FREEZE_RETRY_INTERVAL = Seconds(10);
 
 
+// Freezing and thawing a cgroup completes asynchronously and the
+// kernel does not notify when it does, so the freezer state is polled
+// starting at the minimum interval and backing off exponentially up
+// to the maximum interval. Most cgroups freeze within a couple of
+// milliseconds while cgroups that are slow to freeze (e.g., with
+// tasks in uninterruptible sleep) are not polled excessively.
+const Duration FREEZER_POLL_MIN_INTERVAL = Milliseconds(1);
+const Duration FREEZER_POLL_MAX_INTERVAL = Milliseconds(100);
+
+
 // Default number of assign attempts when moving threads to a cgroup.
 const unsigned int THREAD_ASSIGN_RETRIES = 100;
 
@@ -432,6 +444,24 @@ Try<Nothing> cfs_quota_us(
 } // namespace cpu {
 
 
+// Cpuacct controls.
+namespace cpuacct {
+
+// Returns the cgroup that the specified pid is a member of within the
+// hierarchy that the 'cpuacct' subsytem is mounted or None if the
+// subsystem is not mounted or the pid is not a member of a cgroup.
+Result<std::string> cgroup(pid_t pid);
+
+
+// Returns the total cpu time consumed by the tasks of the cgroup (and
+// its descendants) from cpuacct.usage.
+Try<Duration> usage(
+    const std::string& hierarchy,
+    const std::string& cgroup);
+
+} // namespace cpuacct {
+
+
 // Memory controls.
 namespace memory {
 
@@ -528,6 +558,56 @@ Try<Nothing> disable(
 
 } // namespace oom {
 
+
+// Memory pressure controls.
+namespace pressure {
+
+// The memory pressure levels reported through the
+// 'memory.pressure_level' control, see the kernel documentation.
+enum Level
+{
+  LOW,
+  MEDIUM,
+  CRITICAL
+};
+
+
+std::ostream& operator<<(std::ostream& stream, Level level);
+
+
+// Forward declaration.
+class CounterProcess;
+
+
+// Counts the memory pressure events of a given level for a cgroup.
+// Unlike 'event::listen' the counter keeps its eventfd registered for
+// as long as it lives, so no event is missed between two reads.
+class Counter
+{
+public:
+  // Creates a counter and starts listening on the pressure events of
+  // the given level (events of a higher level are counted as well).
+  static Try<process::Owned<Counter>> create(
+      const std::string& hierarchy,
+      const std::string& cgroup,
+      Level level);
+
+  virtual ~Counter();
+
+  // Returns the number of events counted since the counter was
+  // created, or a failure if listening on the events failed.
+  process::Future<uint64_t> value() const;
+
+private:
+  Counter(const std::string& hierarchy,
+          const std::string& cgroup,
+          Level level);
+
+  process::Owned<CounterProcess> process;
+};
+
+} // namespace pressure {
+
 } // namespace memory {
 
 
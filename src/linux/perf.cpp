@@ -16,6 +16,14 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
 #include <list>
 #include <ostream>
 #include <vector>
@@ -27,12 +35,14 @@
 #include <process/process.hpp>
 #include <process/subprocess.hpp>
 
+#include <stout/numify.hpp>
 #include <stout/strings.hpp>
 
 #include "linux/perf.hpp"
 
 using std::list;
 using std::ostringstream;
+using std::pair;
 using std::set;
 using std::string;
 using std::vector;
@@ -408,4 +418,394 @@ Try<hashmap<string, mesos::PerfStatistics> > parse(const string& output)
   return statistics;
 }
 
+
+namespace internal {
+
+// Returns the perf_event_attr type and config of the events, keyed by
+// their normalized names (i.e., the names of the PerfStatistics
+// fields), following the event names used by 'perf list'.
+static hashmap<string, pair<uint32_t, uint64_t> > events()
+{
+  hashmap<string, pair<uint32_t, uint64_t> > events;
+
+#define HARDWARE(name, config) \
+  events[name] = std::make_pair(PERF_TYPE_HARDWARE, config)
+#define SOFTWARE(name, config) \
+  events[name] = std::make_pair(PERF_TYPE_SOFTWARE, config)
+
+  HARDWARE("cycles", PERF_COUNT_HW_CPU_CYCLES);
+  HARDWARE("stalled_cycles_frontend", PERF_COUNT_HW_STALLED_CYCLES_FRONTEND);
+  HARDWARE("stalled_cycles_backend", PERF_COUNT_HW_STALLED_CYCLES_BACKEND);
+  HARDWARE("instructions", PERF_COUNT_HW_INSTRUCTIONS);
+  HARDWARE("cache_references", PERF_COUNT_HW_CACHE_REFERENCES);
+  HARDWARE("cache_misses", PERF_COUNT_HW_CACHE_MISSES);
+  HARDWARE("branches", PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+  HARDWARE("branch_misses", PERF_COUNT_HW_BRANCH_MISSES);
+  HARDWARE("bus_cycles", PERF_COUNT_HW_BUS_CYCLES);
+  HARDWARE("ref_cycles", PERF_COUNT_HW_REF_CPU_CYCLES);
+
+  SOFTWARE("cpu_clock", PERF_COUNT_SW_CPU_CLOCK);
+  SOFTWARE("task_clock", PERF_COUNT_SW_TASK_CLOCK);
+  SOFTWARE("page_faults", PERF_COUNT_SW_PAGE_FAULTS);
+  SOFTWARE("minor_faults", PERF_COUNT_SW_PAGE_FAULTS_MIN);
+  SOFTWARE("major_faults", PERF_COUNT_SW_PAGE_FAULTS_MAJ);
+  SOFTWARE("context_switches", PERF_COUNT_SW_CONTEXT_SWITCHES);
+  SOFTWARE("cpu_migrations", PERF_COUNT_SW_CPU_MIGRATIONS);
+  SOFTWARE("alignment_faults", PERF_COUNT_SW_ALIGNMENT_FAULTS);
+  SOFTWARE("emulation_faults", PERF_COUNT_SW_EMULATION_FAULTS);
+
+#undef HARDWARE
+#undef SOFTWARE
+
+  // Hardware cache events are named <cache>_<operation>s for
+  // accesses and <cache>_<operation>_misses for misses.
+  hashmap<string, uint64_t> caches;
+  caches["l1_dcache"] = PERF_COUNT_HW_CACHE_L1D;
+  caches["l1_icache"] = PERF_COUNT_HW_CACHE_L1I;
+  caches["llc"] = PERF_COUNT_HW_CACHE_LL;
+  caches["dtlb"] = PERF_COUNT_HW_CACHE_DTLB;
+  caches["itlb"] = PERF_COUNT_HW_CACHE_ITLB;
+  caches["branch"] = PERF_COUNT_HW_CACHE_BPU;
+  caches["node"] = PERF_COUNT_HW_CACHE_NODE;
+
+  hashmap<string, uint64_t> operations;
+  operations["load"] = PERF_COUNT_HW_CACHE_OP_READ;
+  operations["store"] = PERF_COUNT_HW_CACHE_OP_WRITE;
+  operations["prefetch"] = PERF_COUNT_HW_CACHE_OP_PREFETCH;
+
+  foreachpair (const string& cache, uint64_t id, caches) {
+    foreachpair (const string& operation, uint64_t op, operations) {
+      const string name = cache + "_" + operation;
+
+      events[name + (operation == "prefetch" ? "es" : "s")] =
+        std::make_pair(
+            PERF_TYPE_HW_CACHE,
+            id | (op << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16));
+
+      events[name + "_misses"] =
+        std::make_pair(
+            PERF_TYPE_HW_CACHE,
+            id | (op << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    }
+  }
+
+  return events;
+}
+
+
+// Returns the perf_event_attr type and config of the event with the
+// given normalized name.
+Option<pair<uint32_t, uint64_t> > lookup(const string& event)
+{
+  // NOTE: The initialization of a local static is thread safe. The
+  // table is intentionally leaked to avoid destruction order issues.
+  static const hashmap<string, pair<uint32_t, uint64_t> >* table =
+    new hashmap<string, pair<uint32_t, uint64_t> >(events());
+
+  return table->get(normalize(event));
+}
+
+
+// Returns the online CPUs, as listed in the format of e.g. "0-3,6".
+Try<vector<int> > cpus()
+{
+  Try<string> read = os::read("/sys/devices/system/cpu/online");
+  if (read.isError()) {
+    return Error("Failed to read online CPUs: " + read.error());
+  }
+
+  vector<int> result;
+
+  foreach (const string& range, strings::tokenize(read.get(), ",\n")) {
+    vector<string> bounds = strings::tokenize(range, "-");
+
+    Try<int> first = numify<int>(bounds.front());
+    Try<int> last = numify<int>(bounds.back());
+
+    if (bounds.size() > 2 || first.isError() || last.isError()) {
+      return Error("Failed to parse online CPUs '" + read.get() + "'");
+    }
+
+    for (int cpu = first.get(); cpu <= last.get(); cpu++) {
+      result.push_back(cpu);
+    }
+  }
+
+  return result;
+}
+
+
+// Opens a group of counters for the events, counting the process or
+// cgroup (when 'flags' includes PERF_FLAG_PID_CGROUP) on the CPU.
+Try<vector<int> > open(
+    const vector<string>& events,
+    pid_t pid,
+    int cpu,
+    unsigned long flags)
+{
+  vector<int> group;
+
+  foreach (const string& event, events) {
+    Option<pair<uint32_t, uint64_t> > type = lookup(event);
+    CHECK_SOME(type);
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size = sizeof(attr);
+    attr.type = type.get().first;
+    attr.config = type.get().second;
+    attr.read_format = PERF_FORMAT_GROUP |
+                       PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // The group is enabled and disabled through its leader.
+    attr.disabled = group.empty() ? 1 : 0;
+
+    // Unprivileged users may only count user space events, like
+    // 'perf stat' does.
+    if (::geteuid() != 0) {
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+    }
+
+    int fd = ::syscall(
+        SYS_perf_event_open,
+        &attr,
+        pid,
+        cpu,
+        group.empty() ? -1 : group.front(),
+        flags);
+
+    if (fd < 0) {
+      ErrnoError error("Failed to open counter for '" + event + "'");
+      foreach (int fd, group) {
+        os::close(fd);
+      }
+      return error;
+    }
+
+    os::cloexec(fd);
+    group.push_back(fd);
+  }
+
+  return group;
+}
+
+} // namespace internal {
+
+
+bool native(const set<string>& events)
+{
+  foreach (const string& event, events) {
+    // The event must also be reported in the PerfStatistics.
+    if (internal::lookup(event).isNone() ||
+        mesos::PerfStatistics::descriptor()->FindFieldByName(
+            internal::normalize(event)) == NULL) {
+      return false;
+    }
+  }
+
+  return !events.empty();
+}
+
+
+Try<Owned<Counters> > Counters::open(
+    const set<string>& events,
+    const string& cgroup)
+{
+  if (!native(events)) {
+    return Error("Unsupported events: " + stringify(events));
+  }
+
+  Try<vector<int> > cpus = internal::cpus();
+  if (cpus.isError()) {
+    return Error(cpus.error());
+  }
+
+  // The cgroup is referred to by a file descriptor for its directory.
+  Try<int> fd = os::open(cgroup, O_RDONLY | O_CLOEXEC);
+  if (fd.isError()) {
+    return Error("Failed to open cgroup '" + cgroup + "': " + fd.error());
+  }
+
+  vector<string> names;
+  foreach (const string& event, events) {
+    names.push_back(internal::normalize(event));
+  }
+
+  vector<vector<int> > groups;
+
+  foreach (int cpu, cpus.get()) {
+    Try<vector<int> > group =
+      internal::open(names, fd.get(), cpu, PERF_FLAG_PID_CGROUP);
+
+    if (group.isError()) {
+      foreach (const vector<int>& group, groups) {
+        foreach (int fd, group) {
+          os::close(fd);
+        }
+      }
+
+      os::close(fd.get());
+      return Error(group.error());
+    }
+
+    groups.push_back(group.get());
+  }
+
+  os::close(fd.get());
+
+  return Owned<Counters>(new Counters(names, groups));
+}
+
+
+Try<Owned<Counters> > Counters::open(
+    const set<string>& events,
+    pid_t pid)
+{
+  if (!native(events)) {
+    return Error("Unsupported events: " + stringify(events));
+  }
+
+  vector<string> names;
+  foreach (const string& event, events) {
+    names.push_back(internal::normalize(event));
+  }
+
+  Try<vector<int> > group = internal::open(names, pid, -1, 0);
+  if (group.isError()) {
+    return Error(group.error());
+  }
+
+  return Owned<Counters>(
+      new Counters(names, vector<vector<int> >(1, group.get())));
+}
+
+
+Counters::Counters(
+    const vector<string>& _events,
+    const vector<vector<int> >& _groups)
+  : events(_events),
+    groups(_groups) {}
+
+
+Counters::~Counters()
+{
+  foreach (const vector<int>& group, groups) {
+    foreach (int fd, group) {
+      os::close(fd);
+    }
+  }
+}
+
+
+Try<Nothing> Counters::enable()
+{
+  foreach (const vector<int>& group, groups) {
+    int leader = group.front();
+
+    if (::ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) < 0) {
+      return ErrnoError("Failed to reset counters");
+    }
+
+    if (::ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0) {
+      return ErrnoError("Failed to enable counters");
+    }
+  }
+
+  return Nothing();
+}
+
+
+Try<Nothing> Counters::disable()
+{
+  foreach (const vector<int>& group, groups) {
+    int leader = group.front();
+
+    if (::ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP) < 0) {
+      return ErrnoError("Failed to disable counters");
+    }
+  }
+
+  return Nothing();
+}
+
+
+Try<mesos::PerfStatistics> Counters::read() const
+{
+  // The layout of a group read is: the number of counters, the time
+  // enabled, the time running, followed by the counter values.
+  vector<uint64_t> buffer(3 + events.size());
+  vector<double> counts(events.size(), 0.0);
+
+  foreach (const vector<int>& group, groups) {
+    const size_t size = buffer.size() * sizeof(uint64_t);
+
+    ssize_t length = ::read(group.front(), buffer.data(), size);
+    if (length < 0) {
+      return ErrnoError("Failed to read counters");
+    } else if (static_cast<size_t>(length) != size ||
+               buffer[0] != events.size()) {
+      return Error("Unexpected size of counters read");
+    }
+
+    const uint64_t enabled = buffer[1];
+    const uint64_t running = buffer[2];
+
+    // Counters which never ran (e.g., because the group did not fit
+    // onto the PMU) are reported as zero, like "<not counted>" by
+    // 'perf stat'.
+    if (running == 0) {
+      continue;
+    }
+
+    const double scale = static_cast<double>(enabled) / running;
+
+    for (size_t i = 0; i < events.size(); i++) {
+      counts[i] += buffer[3 + i] * scale;
+    }
+  }
+
+  mesos::PerfStatistics statistics;
+
+  // The required fields, to be set by the caller.
+  statistics.set_timestamp(0);
+  statistics.set_duration(0);
+
+  const google::protobuf::Reflection* reflection =
+    statistics.GetReflection();
+
+  for (size_t i = 0; i < events.size(); i++) {
+    const google::protobuf::FieldDescriptor* field =
+      statistics.GetDescriptor()->FindFieldByName(events[i]);
+
+    if (field == NULL) {
+      return Error("Unexpected perf event '" + events[i] + "'");
+    }
+
+    switch (field->type()) {
+      case google::protobuf::FieldDescriptor::TYPE_DOUBLE:
+        // The software clocks count nanoseconds while 'perf stat'
+        // (and thus the statistics) reports milliseconds.
+        reflection->SetDouble(&statistics, field, counts[i] / 1000000.0);
+        break;
+      case google::protobuf::FieldDescriptor::TYPE_UINT64:
+        reflection->SetUInt64(
+            &statistics, field, static_cast<uint64_t>(counts[i]));
+        break;
+      default:
+        return Error("Unsupported perf field type for '" + events[i] + "'");
+    }
+  }
+
+  return statistics;
+}
+
+
+size_t Counters::size() const
+{
+  return groups.size() * events.size();
+}
+
 } // namespace perf {
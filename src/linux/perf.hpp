@@ -23,11 +23,15 @@
 
 #include <set>
 #include <string>
+#include <vector>
 
 #include <process/future.hpp>
+#include <process/owned.hpp>
 
 #include <stout/duration.hpp>
 #include <stout/hashmap.hpp>
+#include <stout/nothing.hpp>
+#include <stout/try.hpp>
 
 // For PerfStatistics protobuf.
 #include "mesos/mesos.hpp"
@@ -78,6 +82,66 @@ bool supported();
 Try<hashmap<std::string, mesos::PerfStatistics> > parse(
     const std::string& output);
 
+
+// Counters for a set of perf events that are read directly from the
+// kernel with perf_event_open(2) rather than by running 'perf stat'.
+// Counters stay open and can be enabled, disabled and read repeatedly
+// which makes sampling cheap enough to be done for many cgroups at
+// short intervals. The counters of a set are read with a single read
+// per group (i.e., per CPU for a cgroup).
+class Counters
+{
+public:
+  // Opens counters for the process(es) in the perf_event cgroup at
+  // the given absolute path, counting on every online CPU.
+  static Try<process::Owned<Counters> > open(
+      const std::set<std::string>& events,
+      const std::string& cgroup);
+
+  // Opens counters for the given process.
+  static Try<process::Owned<Counters> > open(
+      const std::set<std::string>& events,
+      pid_t pid);
+
+  ~Counters();
+
+  // Resets the counters to zero and starts counting.
+  Try<Nothing> enable();
+
+  // Stops counting.
+  Try<Nothing> disable();
+
+  // Reads the counters, scaling counts of counters that did not run
+  // the whole time they were enabled (because the kernel multiplexed
+  // them). Note that the timestamp and duration are left for the
+  // caller to set.
+  Try<mesos::PerfStatistics> read() const;
+
+  // The number of kernel counters (i.e., file descriptors) in use.
+  size_t size() const;
+
+private:
+  Counters(
+      const std::vector<std::string>& events,
+      const std::vector<std::vector<int> >& groups);
+
+  Counters(const Counters&);              // No copying.
+  Counters& operator = (const Counters&); // No assigning.
+
+  // The normalized names of the events, in the order of the counters
+  // within each group.
+  const std::vector<std::string> events;
+
+  // The file descriptors of the counters, one group per CPU (or a
+  // single group for a process). The first counter of each group is
+  // the group leader.
+  const std::vector<std::vector<int> > groups;
+};
+
+
+// Returns whether all of the events can be counted with 'Counters'.
+bool native(const std::set<std::string>& events);
+
 } // namespace perf {
 
 #endif // __PERF_HPP__
@@ -378,15 +378,9 @@ Try<bool> setMTU(const string& _link, unsigned int mtu)
 }
 
 
-Result<hashmap<string, uint64_t>> statistics(const string& _link)
+// Returns the statistics of the given netlink link object.
+static hashmap<string, uint64_t> _statistics(struct rtnl_link* link)
 {
-  Result<Netlink<struct rtnl_link>> link = internal::get(_link);
-  if (link.isError()) {
-    return Error(link.error());
-  } else if (link.isNone()) {
-    return None();
-  }
-
   rtnl_link_stat_id_t stats[] = {
     // Statistics related to receiving.
     RTNL_LINK_RX_PACKETS,
@@ -423,7 +417,54 @@ Result<hashmap<string, uint64_t>> statistics(const string& _link)
 
   for (size_t i = 0; i < size; i++) {
     rtnl_link_stat2str(stats[i], buf, 32);
-    results[buf] = rtnl_link_get_stat(link.get().get(), stats[i]);
+    results[buf] = rtnl_link_get_stat(link, stats[i]);
+  }
+
+  return results;
+}
+
+
+Result<hashmap<string, uint64_t>> statistics(const string& _link)
+{
+  Result<Netlink<struct rtnl_link>> link = internal::get(_link);
+  if (link.isError()) {
+    return Error(link.error());
+  } else if (link.isNone()) {
+    return None();
+  }
+
+  return _statistics(link.get().get());
+}
+
+
+Try<hashmap<string, hashmap<string, uint64_t>>> statistics()
+{
+  Try<Netlink<struct nl_sock>> socket = routing::socket();
+  if (socket.isError()) {
+    return Error(socket.error());
+  }
+
+  // Dump all the netlink link objects from kernel. Note that the flag
+  // AF_UNSPEC means all available families.
+  struct nl_cache* c = NULL;
+  int error = rtnl_link_alloc_cache(socket.get().get(), AF_UNSPEC, &c);
+  if (error != 0) {
+    return Error(nl_geterror(error));
+  }
+
+  Netlink<struct nl_cache> cache(c);
+
+  hashmap<string, hashmap<string, uint64_t>> results;
+
+  for (struct nl_object* o = nl_cache_get_first(cache.get());
+       o != NULL;
+       o = nl_cache_get_next(o)) {
+    struct rtnl_link* link = (struct rtnl_link*) o;
+
+    const char* name = rtnl_link_get_name(link);
+    if (name != NULL) {
+      results[name] = _statistics(link);
+    }
   }
 
   return results;
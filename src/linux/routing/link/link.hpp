@@ -113,6 +113,13 @@ Try<bool> setMTU(const std::string& link, unsigned int mtu);
 // Returns the statistics of the link.
 Result<hashmap<std::string, uint64_t> > statistics(const std::string& link);
 
+
+// Returns the statistics of all the links, keyed by the link names.
+// All the links are dumped with a single netlink request, which is
+// much cheaper than asking for the links one by one when statistics
+// of many links are needed.
+Try<hashmap<std::string, hashmap<std::string, uint64_t> > > statistics();
+
 } // namespace link {
 } // namespace routing {
 
@@ -0,0 +1,353 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/dqblk_xfs.h>
+
+#include <sys/ioctl.h>
+#include <sys/quota.h>
+#include <sys/vfs.h>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/none.hpp>
+#include <stout/os.hpp>
+#include <stout/strings.hpp>
+
+#include "linux/fs.hpp"
+#include "linux/xfs.hpp"
+
+using std::string;
+
+// The magic number of XFS (see statfs(2)).
+#define XFS_SUPER_MAGIC 0x58465342
+
+// Quota limits and usage are reported in units of 512 byte "basic
+// blocks" by the XFS quota interface.
+#define BASIC_BLOCK_SIZE 512
+
+
+namespace mesos {
+namespace internal {
+namespace xfs {
+namespace internal {
+
+// NOTE: We define the structure and the ioctls used to get and set
+// the project ID ourselves rather than including <linux/fs.h> (which
+// conflicts with <sys/mount.h> on some platforms, and only defines
+// them since Linux 4.5) or requiring the xfsprogs headers. The layout
+// matches 'struct fsxattr'.
+struct FsXattr
+{
+  uint32_t xflags;
+  uint32_t extsize;
+  uint32_t nextents;
+  uint32_t projid;
+  uint32_t cowextsize;
+  unsigned char pad[8];
+};
+
+#define FS_IOC_GETXATTR _IOR('X', 31, struct FsXattr)
+#define FS_IOC_SETXATTR _IOW('X', 32, struct FsXattr)
+
+// Children inherit the project ID of the directory.
+#define FS_XFLAG_INHERIT 0x00000200
+
+
+// Returns the block device of the filesystem on which 'path' resides,
+// which is what quotactl(2) operates on.
+static Try<string> device(const string& path)
+{
+  Result<string> realpath = os::realpath(path);
+  if (!realpath.isSome()) {
+    return Error(
+        "Failed to determine the real path of '" + path + "': " +
+        (realpath.isError() ? realpath.error() : "No such path"));
+  }
+
+  Try<fs::MountTable> table = fs::MountTable::read("/proc/mounts");
+  if (table.isError()) {
+    return Error("Failed to read mount table: " + table.error());
+  }
+
+  // Find the longest mount point that is a prefix of the path. Later
+  // entries shadow earlier ones for the same mount point.
+  Option<fs::MountTable::Entry> mount;
+  foreach (const fs::MountTable::Entry& entry, table.get().entries) {
+    if (entry.dir == "/" ||
+        realpath.get() == entry.dir ||
+        strings::startsWith(realpath.get(), entry.dir + "/")) {
+      if (mount.isNone() || entry.dir.size() >= mount.get().dir.size()) {
+        mount = entry;
+      }
+    }
+  }
+
+  if (mount.isNone()) {
+    return Error("Failed to find the mount point of '" + path + "'");
+  }
+
+  if (mount.get().type != "xfs") {
+    return Error(
+        "'" + path + "' resides on a '" + mount.get().type +
+        "' filesystem rather than XFS");
+  }
+
+  return mount.get().fsname;
+}
+
+
+static Try<FsXattr> getAttributes(const string& path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return ErrnoError("Failed to open '" + path + "'");
+  }
+
+  FsXattr attributes;
+  memset(&attributes, 0, sizeof(attributes));
+
+  if (::ioctl(fd, FS_IOC_GETXATTR, &attributes) < 0) {
+    ErrnoError error("Failed to get attributes of '" + path + "'");
+    os::close(fd);
+    return error;
+  }
+
+  os::close(fd);
+  return attributes;
+}
+
+
+static Try<Nothing> setAttributes(const string& path, FsXattr& attributes)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return ErrnoError("Failed to open '" + path + "'");
+  }
+
+  if (::ioctl(fd, FS_IOC_SETXATTR, &attributes) < 0) {
+    ErrnoError error("Failed to set attributes of '" + path + "'");
+    os::close(fd);
+    return error;
+  }
+
+  os::close(fd);
+  return Nothing();
+}
+
+
+static Try<Nothing> setQuota(
+    const string& path,
+    uint32_t projectId,
+    const Bytes& limit)
+{
+  Try<string> dev = device(path);
+  if (dev.isError()) {
+    return Error(dev.error());
+  }
+
+  fs_disk_quota_t quota;
+  memset(&quota, 0, sizeof(quota));
+
+  quota.d_version = FS_DQUOT_VERSION;
+  quota.d_flags = FS_PROJ_QUOTA;
+  quota.d_id = projectId;
+  quota.d_fieldmask = FS_DQ_BSOFT | FS_DQ_BHARD;
+
+  // A limit of zero removes the limit. We round the limit up to the
+  // next basic block.
+  quota.d_blk_hardlimit =
+    (limit.bytes() + BASIC_BLOCK_SIZE - 1) / BASIC_BLOCK_SIZE;
+  quota.d_blk_softlimit = quota.d_blk_hardlimit;
+
+  if (::quotactl(QCMD(Q_XSETQLIM, XQM_PRJQUOTA),
+                 dev.get().c_str(),
+                 projectId,
+                 reinterpret_cast<caddr_t>(&quota)) < 0) {
+    return ErrnoError(
+        "Failed to set quota for project " + stringify(projectId) +
+        " on '" + dev.get() + "'");
+  }
+
+  return Nothing();
+}
+
+
+// Returns the project quota flags ('FS_QUOTA_PDQ_*') of the XFS
+// filesystem on which the given path resides, or None if the path
+// does not reside on XFS or project quotas are not enabled.
+static Result<uint16_t> getQuotaFlags(const string& path)
+{
+  struct statfs buf;
+  if (::statfs(path.c_str(), &buf) < 0) {
+    return ErrnoError("Failed to statfs '" + path + "'");
+  }
+
+  if (buf.f_type != XFS_SUPER_MAGIC) {
+    return None();
+  }
+
+  Try<string> dev = device(path);
+  if (dev.isError()) {
+    return Error(dev.error());
+  }
+
+  fs_quota_stat_t stat;
+  memset(&stat, 0, sizeof(stat));
+
+  if (::quotactl(QCMD(Q_XGETQSTAT, XQM_PRJQUOTA),
+                 dev.get().c_str(),
+                 0,
+                 reinterpret_cast<caddr_t>(&stat)) < 0) {
+    // Quota support is not compiled in or not enabled at all.
+    if (errno == ENOSYS || errno == ENOTSUP || errno == ESRCH) {
+      return None();
+    }
+
+    return ErrnoError("Failed to get quota status of '" + dev.get() + "'");
+  }
+
+  return stat.qs_flags;
+}
+
+} // namespace internal {
+
+
+Try<bool> isQuotaEnabled(const string& path)
+{
+  Result<uint16_t> flags = internal::getQuotaFlags(path);
+  if (flags.isError()) {
+    return Error(flags.error());
+  }
+
+  return flags.isSome() && (flags.get() & FS_QUOTA_PDQ_ACCT) != 0;
+}
+
+
+Try<bool> isQuotaEnforced(const string& path)
+{
+  Result<uint16_t> flags = internal::getQuotaFlags(path);
+  if (flags.isError()) {
+    return Error(flags.error());
+  }
+
+  return flags.isSome() && (flags.get() & FS_QUOTA_PDQ_ENFD) != 0;
+}
+
+
+Try<uint32_t> getProjectId(const string& path)
+{
+  Try<internal::FsXattr> attributes = internal::getAttributes(path);
+  if (attributes.isError()) {
+    return Error(attributes.error());
+  }
+
+  return attributes.get().projid;
+}
+
+
+Try<Nothing> setProjectId(const string& directory, uint32_t projectId)
+{
+  Try<internal::FsXattr> attributes = internal::getAttributes(directory);
+  if (attributes.isError()) {
+    return Error(attributes.error());
+  }
+
+  internal::FsXattr update = attributes.get();
+  update.projid = projectId;
+  update.xflags |= FS_XFLAG_INHERIT;
+
+  return internal::setAttributes(directory, update);
+}
+
+
+Try<Nothing> clearProjectId(const string& directory)
+{
+  Try<internal::FsXattr> attributes = internal::getAttributes(directory);
+  if (attributes.isError()) {
+    return Error(attributes.error());
+  }
+
+  internal::FsXattr update = attributes.get();
+  update.projid = 0;
+  update.xflags &= ~FS_XFLAG_INHERIT;
+
+  return internal::setAttributes(directory, update);
+}
+
+
+Result<QuotaInfo> getProjectQuota(const string& path, uint32_t projectId)
+{
+  Try<string> dev = internal::device(path);
+  if (dev.isError()) {
+    return Error(dev.error());
+  }
+
+  fs_disk_quota_t quota;
+  memset(&quota, 0, sizeof(quota));
+
+  if (::quotactl(QCMD(Q_XGETQUOTA, XQM_PRJQUOTA),
+                 dev.get().c_str(),
+                 projectId,
+                 reinterpret_cast<caddr_t>(&quota)) < 0) {
+    // The kernel has no quota record for projects without any usage
+    // and without any limit.
+    if (errno == ENOENT) {
+      return None();
+    }
+
+    return ErrnoError(
+        "Failed to get quota for project " + stringify(projectId) +
+        " on '" + dev.get() + "'");
+  }
+
+  QuotaInfo info;
+  info.limit = Bytes(quota.d_blk_hardlimit * BASIC_BLOCK_SIZE);
+  info.used = Bytes(quota.d_bcount * BASIC_BLOCK_SIZE);
+  info.inodes = quota.d_icount;
+
+  return info;
+}
+
+
+Try<Nothing> setProjectQuota(
+    const string& path,
+    uint32_t projectId,
+    const Bytes& limit)
+{
+  // A limit of zero would remove the limit altogether.
+  if (limit == Bytes(0)) {
+    return Error("Quota limit must be greater than zero");
+  }
+
+  return internal::setQuota(path, projectId, limit);
+}
+
+
+Try<Nothing> clearProjectQuota(const string& path, uint32_t projectId)
+{
+  return internal::setQuota(path, projectId, Bytes(0));
+}
+
+} // namespace xfs {
+} // namespace internal {
+} // namespace mesos {
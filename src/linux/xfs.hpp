@@ -0,0 +1,108 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __XFS_HPP__
+#define __XFS_HPP__
+
+#include <stdint.h>
+
+#include <string>
+
+#include <stout/bytes.hpp>
+#include <stout/nothing.hpp>
+#include <stout/result.hpp>
+#include <stout/try.hpp>
+
+
+namespace mesos {
+namespace internal {
+namespace xfs {
+
+// Helpers for the XFS project quota accounting. Every file and
+// directory on an XFS filesystem carries a project ID, and the kernel
+// maintains the disk usage (and optionally enforces a limit) for each
+// project. Tagging a directory with a project ID (and the inherit
+// flag) means that everything subsequently created underneath it is
+// accounted to that project, which gives us the disk usage of a
+// directory tree without having to walk it.
+
+
+// Structure describing the quota of a project.
+struct QuotaInfo
+{
+  Bytes limit; // Zero if no limit is set.
+  Bytes used;
+  uint64_t inodes; // Number of files and directories accounted.
+};
+
+
+// Returns whether the given path resides on an XFS filesystem that
+// is mounted with project quota accounting enabled (i.e., with the
+// 'prjquota' or 'pquota' mount option).
+Try<bool> isQuotaEnabled(const std::string& path);
+
+
+// Returns whether the given path resides on an XFS filesystem on
+// which project quota limits are enforced (i.e., mounted with the
+// 'prjquota' option rather than 'pqnoenforce').
+Try<bool> isQuotaEnforced(const std::string& path);
+
+
+// Returns the project ID of the given file or directory.
+Try<uint32_t> getProjectId(const std::string& path);
+
+
+// Sets the project ID of the given directory and marks it such that
+// files and directories created underneath it inherit the project ID.
+// NOTE: This does not change the project ID of existing files and
+// directories underneath the given directory.
+Try<Nothing> setProjectId(const std::string& directory, uint32_t projectId);
+
+
+// Resets the project ID of the given directory to the default project
+// and clears the inherit flag.
+Try<Nothing> clearProjectId(const std::string& directory);
+
+
+// Returns the quota of the given project on the filesystem on which
+// 'path' resides, or None if the project has not accounted any usage.
+Result<QuotaInfo> getProjectQuota(
+    const std::string& path,
+    uint32_t projectId);
+
+
+// Sets the hard limit of the given project on the filesystem on which
+// 'path' resides. The kernel fails writes (with EDQUOT) that would
+// take the usage of the project over the limit.
+Try<Nothing> setProjectQuota(
+    const std::string& path,
+    uint32_t projectId,
+    const Bytes& limit);
+
+
+// Removes any limit for the given project on the filesystem on which
+// 'path' resides. Usage continues to be accounted.
+Try<Nothing> clearProjectQuota(
+    const std::string& path,
+    uint32_t projectId);
+
+} // namespace xfs {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __XFS_HPP__
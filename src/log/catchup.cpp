@@ -18,7 +18,10 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <deque>
 #include <list>
+#include <set>
 
 #include <process/collect.hpp>
 #include <process/id.hpp>
@@ -35,7 +38,9 @@
 
 using namespace process;
 
+using std::deque;
 using std::list;
+using std::set;
 
 namespace mesos {
 namespace internal {
@@ -167,10 +172,203 @@ static Future<uint64_t> catchup(
 }
 
 
-// TODO(jieyu): Our current implementation catches-up each position in
-// the set sequentially. In the future, we may want to parallelize it
-// to improve the performance. Also, we may want to implement rate
-// control here so that we don't saturate the network or disk.
+// Transfers the actions learned by the other replicas in the network
+// within the specified interval into the local replica, in chunks
+// (see ReplicaProcess::transfer). This is much cheaper than running
+// Paxos for each position since every chunk takes a single round trip
+// and a single sync. The replicas are asked one after the other; we
+// move on to the next replica once a replica fails to respond in time
+// or has nothing more to transfer. Positions that are not learned by
+// the replica being asked are skipped, and are left for the caller to
+// fill using Paxos.
+class TransferProcess : public Process<TransferProcess>
+{
+public:
+  TransferProcess(
+      const Shared<Replica>& _replica,
+      const Shared<Network>& _network,
+      const Interval<uint64_t>& _positions,
+      const Duration& _timeout)
+    : ProcessBase(ID::generate("log-transfer")),
+      replica(_replica),
+      network(_network),
+      positions(_positions),
+      timeout(_timeout) {}
+
+  virtual ~TransferProcess() {}
+
+  Future<Nothing> future() { return promise.future(); }
+
+protected:
+  virtual void initialize()
+  {
+    // Stop when no one cares.
+    promise.future().onDiscard(lambda::bind(
+        static_cast<void(*)(const UPID&, bool)>(terminate), self(), true));
+
+    current = positions.lower();
+
+    members = network->members();
+    members.onAny(defer(self(), &Self::listed));
+  }
+
+  virtual void finalize()
+  {
+    members.discard();
+    transferring.discard();
+    learning.discard();
+
+    // TODO(benh): Discard our promise only after 'members',
+    // 'transferring' and 'learning' have completed (ready, failed, or
+    // discarded).
+    promise.discard();
+  }
+
+private:
+  static void timedout(Future<TransferResponse> transferring)
+  {
+    transferring.discard();
+  }
+
+  void listed()
+  {
+    // The future 'members' can only be discarded in 'finalize'.
+    CHECK(!members.isDiscarded());
+
+    if (members.isFailed()) {
+      promise.fail("Failed to get the replicas: " + members.failure());
+      terminate(self());
+      return;
+    }
+
+    foreach (const UPID& pid, members.get()) {
+      if (pid != replica->pid()) {
+        replicas.push_back(pid);
+      }
+    }
+
+    // Spread the load of concurrent catch-ups across the replicas.
+    std::random_shuffle(replicas.begin(), replicas.end());
+
+    transfer();
+  }
+
+  void transfer()
+  {
+    if (current >= positions.upper() || replicas.empty()) {
+      // Whatever is still missing has to be filled using Paxos.
+      promise.set(Nothing());
+      terminate(self());
+      return;
+    }
+
+    TransferRequest request;
+    request.set_from(current);
+    request.set_to(positions.upper() - 1);
+
+    transferring = protocol::transfer(replicas.front(), request);
+    transferring.onAny(defer(self(), &Self::transferred));
+
+    Clock::timer(timeout, lambda::bind(&Self::timedout, transferring));
+  }
+
+  void transferred()
+  {
+    if (transferring.isDiscarded()) {
+      LOG(INFO) << "Unable to transfer positions from " << replicas.front()
+                << " in " << timeout << ", trying another replica";
+      next();
+    } else if (transferring.isFailed()) {
+      LOG(INFO) << "Failed to transfer positions from " << replicas.front()
+                << ": " << transferring.failure();
+      next();
+    } else if (!transferring.get().okay() ||
+               transferring.get().position() <= current) {
+      // The replica is not able to transfer anything more.
+      next();
+    } else {
+      current = transferring.get().position();
+
+      const list<Action> actions(
+          transferring.get().actions().begin(),
+          transferring.get().actions().end());
+
+      VLOG(2) << "Transferred " << actions.size() << " learned action(s) "
+              << "before position " << current << " from "
+              << replicas.front();
+
+      learning = replica->learn(actions);
+      learning.onAny(defer(self(), &Self::learned));
+    }
+  }
+
+  void learned()
+  {
+    // The future 'learning' can only be discarded in 'finalize'.
+    CHECK(!learning.isDiscarded());
+
+    if (learning.isFailed()) {
+      promise.fail(
+          "Failed to learn the transferred actions: " + learning.failure());
+      terminate(self());
+    } else if (!learning.get()) {
+      promise.fail("Failed to persist the transferred actions");
+      terminate(self());
+    } else {
+      transfer();
+    }
+  }
+
+  void next()
+  {
+    replicas.pop_front();
+    transfer();
+  }
+
+  const Shared<Replica> replica;
+  const Shared<Network> network;
+  const Interval<uint64_t> positions;
+  const Duration timeout;
+
+  uint64_t current;
+
+  // The replicas that have not been given up on yet.
+  deque<UPID> replicas;
+
+  process::Promise<Nothing> promise;
+  Future<set<UPID> > members;
+  Future<TransferResponse> transferring;
+  Future<bool> learning;
+};
+
+
+static Future<Nothing> transfer(
+    const Shared<Replica>& replica,
+    const Shared<Network>& network,
+    const Interval<uint64_t>& positions,
+    const Duration& timeout)
+{
+  TransferProcess* process =
+    new TransferProcess(
+        replica,
+        network,
+        positions,
+        timeout);
+
+  Future<Nothing> future = process->future();
+  spawn(process, true);
+  return future;
+}
+
+
+// Catches-up the positions in the interval by first transferring the
+// actions learned by the other replicas (see TransferProcess) and then
+// filling the positions that are still missing using Paxos.
+//
+// TODO(jieyu): Our current implementation fills each missing position
+// sequentially. In the future, we may want to parallelize it to
+// improve the performance. Also, we may want to implement rate control
+// here so that we don't saturate the network or disk.
 class BulkCatchUpProcess : public Process<BulkCatchUpProcess>
 {
 public:
@@ -200,18 +398,26 @@ protected:
     promise.future().onDiscard(lambda::bind(
         static_cast<void(*)(const UPID&, bool)>(terminate), self(), true));
 
-    // Catch-up sequentially.
-    current = positions.lower();
+    if (positions.lower() >= positions.upper()) {
+      // Nothing to catch-up (i.e., the input interval is empty).
+      promise.set(Nothing());
+      terminate(self());
+      return;
+    }
 
-    catchup();
+    transferring = transfer(replica, network, positions, timeout);
+    transferring.onAny(defer(self(), &Self::transferred));
   }
 
   virtual void finalize()
   {
+    transferring.discard();
+    checking.discard();
     catching.discard();
 
-    // TODO(benh): Discard our promise only after 'catching' has
-    // completed (ready, failed, or discarded).
+    // TODO(benh): Discard our promise only after 'transferring',
+    // 'checking' and 'catching' have completed (ready, failed, or
+    // discarded).
     promise.discard();
   }
 
@@ -221,16 +427,53 @@ private:
     catching.discard();
   }
 
+  void transferred()
+  {
+    // The future 'transferring' can only be discarded in 'finalize'.
+    CHECK(!transferring.isDiscarded());
+
+    if (transferring.isFailed()) {
+      promise.fail(
+          "Failed to transfer learned actions: " + transferring.failure());
+      terminate(self());
+      return;
+    }
+
+    checking = replica->missing(positions.lower(), positions.upper() - 1);
+    checking.onAny(defer(self(), &Self::checked));
+  }
+
+  void checked()
+  {
+    // The future 'checking' can only be discarded in 'finalize'.
+    CHECK(!checking.isDiscarded());
+
+    if (checking.isFailed()) {
+      promise.fail("Failed to get missing positions: " + checking.failure());
+      terminate(self());
+      return;
+    }
+
+    VLOG(2) << "Filling " << checking.get().size() << " missing position(s) "
+            << "using Paxos";
+
+    // Catch-up sequentially.
+    missing = checking.get();
+
+    catchup();
+  }
+
   void catchup()
   {
-    if (current >= positions.upper()) {
-      // Stop the process if there is nothing left to catch-up. This
-      // also handles the case where the input interval is empty.
+    if (missing.empty()) {
+      // Stop the process if there is nothing left to catch-up.
       promise.set(Nothing());
       terminate(self());
       return;
     }
 
+    current = missing.begin()->lower();
+
     // Store the future so that we can discard it if the user wants to
     // cancel the catch-up operation.
     catching = log::catchup(quorum, replica, network, proposal, current)
@@ -261,7 +504,7 @@ private:
 
   void succeeded()
   {
-    ++current;
+    missing -= current;
 
     // The single position catch-up function: 'log::catchup' will
     // return the highest proposal number seen so far. We use this
@@ -282,7 +525,12 @@ private:
   uint64_t proposal;
   uint64_t current;
 
+  // The positions that are left to be filled using Paxos.
+  IntervalSet<uint64_t> missing;
+
   process::Promise<Nothing> promise;
+  Future<Nothing> transferring;
+  Future<IntervalSet<uint64_t> > checking;
   Future<uint64_t> catching;
 };
 
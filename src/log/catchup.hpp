@@ -43,7 +43,9 @@ namespace log {
 // use, he can just use none. We also allow the user to specify a
 // timeout for the catch-up operation on each position and retry the
 // operation if timeout happens. This can help us tolerate network
-// blips.
+// blips. The actions that other replicas have already learned are
+// transferred in bulk first, so only the positions that none of them
+// has learned need to be filled using Paxos.
 extern process::Future<Nothing> catchup(
     size_t quorum,
     const process::Shared<Replica>& replica,
@@ -19,15 +19,19 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <deque>
 
 #include <mesos/type_utils.hpp>
 
 #include <process/defer.hpp>
 #include <process/dispatch.hpp>
 #include <process/id.hpp>
+#include <process/owned.hpp>
 #include <process/process.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/none.hpp>
+#include <stout/stringify.hpp>
 
 #include "log/catchup.hpp"
 #include "log/consensus.hpp"
@@ -37,6 +41,7 @@
 
 using namespace process;
 
+using std::deque;
 using std::string;
 
 namespace mesos {
@@ -49,11 +54,13 @@ public:
   CoordinatorProcess(
       size_t _quorum,
       const Shared<Replica>& _replica,
-      const Shared<Network>& _network)
+      const Shared<Network>& _network,
+      size_t _window)
     : ProcessBase(ID::generate("log-coordinator")),
       quorum(_quorum),
       replica(_replica),
       network(_network),
+      window(_window),
       state(INITIAL),
       proposal(0),
       index(0) {}
@@ -63,14 +70,19 @@ public:
   // See comments in 'coordinator.hpp'.
   Future<Option<uint64_t> > elect();
   Future<uint64_t> demote();
-  Future<Option<uint64_t> > append(const string& bytes);
+  Future<Option<uint64_t> > append(const Action::Append& append);
   Future<Option<uint64_t> > truncate(uint64_t to);
 
 protected:
   virtual void finalize()
   {
     electing.discard();
-    writing.discard();
+
+    foreach (Write& write, writes) {
+      write.future.discard();
+      write.promise->discard();
+    }
+    writes.clear();
   }
 
 private:
@@ -101,15 +113,16 @@ private:
       const WriteResponse& response);
   Future<Nothing> runLearnPhase(const Action& action);
   Future<bool> checkLearnPhase(const Action& action);
-  Future<Option<uint64_t> > updateIndexAfterWritten(bool missing);
-  void writingFinished();
-  void writingFailed();
-  void writingAborted();
+  Future<Option<uint64_t> > checkLearned(const Action& action, bool missing);
+  void written();
 
   const size_t quorum;
   const Shared<Replica> replica;
   const Shared<Network> network;
 
+  // The maximum number of writes that can be in progress.
+  const size_t window;
+
   // The current state of the coordinator. A coordinator needs to be
   // elected first to perform append and truncate operations. If one
   // tries to do an append or a truncate while the coordinator is not
@@ -117,7 +130,8 @@ private:
   // coordinator does not declare itself as elected until it wins the
   // election and has filled all existing positions. A coordinator is
   // put in electing state after it decides to go for an election and
-  // before it is elected.
+  // before it is elected. An elected coordinator is in writing state
+  // as long as at least one write is in progress.
   enum {
     INITIAL,
     ELECTING,
@@ -132,10 +146,29 @@ private:
   uint64_t index;
 
   Future<Option<uint64_t> > electing;
-  Future<Option<uint64_t> > writing;
+
+  // A write in progress. The result of the write is only exposed
+  // (through 'promise') once all writes to lower positions are done.
+  struct Write
+  {
+    uint64_t position;
+    Future<Option<uint64_t> > future;
+    Owned<process::Promise<Option<uint64_t> > > promise;
+  };
+
+  // The writes in progress, ordered by their positions.
+  deque<Write> writes;
 };
 
 
+// Helper for propagating the discard of a write's result to the
+// write itself.
+static void discard(Future<Option<uint64_t> > future)
+{
+  future.discard();
+}
+
+
 /////////////////////////////////////////////////
 // Handles elect/demote in CoordinatorProcess.
 /////////////////////////////////////////////////
@@ -295,11 +328,12 @@ Future<uint64_t> CoordinatorProcess::demote()
 /////////////////////////////////////////////////
 
 
-Future<Option<uint64_t> > CoordinatorProcess::append(const string& bytes)
+Future<Option<uint64_t> > CoordinatorProcess::append(
+    const Action::Append& append)
 {
   if (state == INITIAL || state == ELECTING) {
     return None();
-  } else if (state == WRITING) {
+  } else if (writes.size() >= window) {
     return Failure("Coordinator is currently writing");
   }
 
@@ -308,8 +342,7 @@ Future<Option<uint64_t> > CoordinatorProcess::append(const string& bytes)
   action.set_promised(proposal);
   action.set_performed(proposal);
   action.set_type(Action::APPEND);
-  Action::Append* append = action.mutable_append();
-  append->set_bytes(bytes);
+  action.mutable_append()->CopyFrom(append);
 
   return write(action);
 }
@@ -319,7 +352,7 @@ Future<Option<uint64_t> > CoordinatorProcess::truncate(uint64_t to)
 {
   if (state == INITIAL || state == ELECTING) {
     return None();
-  } else if (state == WRITING) {
+  } else if (writes.size() >= window) {
     return Failure("Coordinator is currently writing");
   }
 
@@ -340,18 +373,29 @@ Future<Option<uint64_t> > CoordinatorProcess::write(const Action& action)
   LOG(INFO) << "Coordinator attempting to write " << action.type()
             << " action at position " << action.position();
 
-  CHECK_EQ(state, ELECTED);
+  CHECK(state == ELECTED || state == WRITING);
+  CHECK_LT(writes.size(), window);
   CHECK(action.has_performed() && action.has_type());
+  CHECK_EQ(action.position(), index);
 
   state = WRITING;
 
-  writing = runWritePhase(action)
-    .then(defer(self(), &Self::checkWritePhase, action, lambda::_1))
-    .onReady(defer(self(), &Self::writingFinished))
-    .onFailed(defer(self(), &Self::writingFailed))
-    .onDiscarded(defer(self(), &Self::writingAborted));
+  // The position is taken as soon as the write starts so that the
+  // next write can be started before this one is done.
+  index++;
+
+  Write write;
+  write.position = action.position();
+  write.future = runWritePhase(action)
+    .then(defer(self(), &Self::checkWritePhase, action, lambda::_1));
+  write.promise.reset(new process::Promise<Option<uint64_t> >());
 
-  return writing;
+  write.future.onAny(defer(self(), &Self::written));
+  write.promise->future().onDiscard(lambda::bind(&discard, write.future));
+
+  writes.push_back(write);
+
+  return write.promise->future();
 }
 
 
@@ -366,16 +410,18 @@ Future<Option<uint64_t> > CoordinatorProcess::checkWritePhase(
     const WriteResponse& response)
 {
   if (!response.okay()) {
-    // Received a NACK. Save the proposal number.
-    CHECK_LE(proposal, response.proposal());
-    proposal = response.proposal();
+    // Received a NACK. Save the proposal number. Notice that another
+    // write in progress might have already received a NACK with a
+    // higher proposal number.
+    CHECK_LE(action.performed(), response.proposal());
+    proposal = std::max(proposal, response.proposal());
 
     return None();
   }
 
   return runLearnPhase(action)
     .then(defer(self(), &Self::checkLearnPhase, action))
-    .then(defer(self(), &Self::updateIndexAfterWritten, lambda::_1));
+    .then(defer(self(), &Self::checkLearned, action, lambda::_1));
 }
 
 
@@ -394,39 +440,60 @@ Future<bool> CoordinatorProcess::checkLearnPhase(const Action& action)
 }
 
 
-Future<Option<uint64_t> > CoordinatorProcess::updateIndexAfterWritten(
+Future<Option<uint64_t> > CoordinatorProcess::checkLearned(
+    const Action& action,
     bool missing)
 {
   CHECK(!missing) << "Not expecting local replica to be missing position "
-                  << index << " after the writing is done";
+                  << action.position() << " after the writing is done";
 
-  return index++;
+  return action.position();
 }
 
 
-void CoordinatorProcess::writingFinished()
+void CoordinatorProcess::written()
 {
-  CHECK_EQ(state, WRITING);
-  state = ELECTED;
-}
+  // Complete the writes in the order of their positions.
+  while (!writes.empty() && !writes.front().future.isPending()) {
+    Write write = writes.front();
+    writes.pop_front();
+
+    if (write.future.isReady() && write.future.get().isSome()) {
+      write.promise->set(write.future.get());
+      continue;
+    }
+
+    // Demote the coordinator if a write operation fails, is NACKed
+    // or is discarded. In the last case we don't actually know the
+    // write was successful or not and we really need to "catch-up"
+    // that position before we try and do another write (see
+    // MESOS-1038 for more details). The writes that follow are
+    // abandoned, their positions get caught up by the next election.
+    state = INITIAL;
 
+    write.promise->associate(write.future);
 
-void CoordinatorProcess::writingFailed()
-{
-  CHECK_EQ(state, WRITING);
-  state = INITIAL;
-}
+    while (!writes.empty()) {
+      Write next = writes.front();
+      writes.pop_front();
 
+      next.future.discard();
 
-void CoordinatorProcess::writingAborted()
-{
-  CHECK_EQ(state, WRITING);
+      if (write.future.isReady()) {
+        next.promise->set(Option<uint64_t>::none());
+      } else {
+        next.promise->fail(
+            "Coordinator demoted after failing to write position " +
+            stringify(write.position));
+      }
+    }
 
-  // Demote the coordinator if a write operation is discarded since we
-  // don't actually know the write was successful or not and we really
-  // need to "catch-up" that position before we try and do another
-  // write (see MESOS-1038 for more details).
-  state = INITIAL;
+    return;
+  }
+
+  if (writes.empty() && state == WRITING) {
+    state = ELECTED;
+  }
 }
 
 
@@ -438,9 +505,12 @@ void CoordinatorProcess::writingAborted()
 Coordinator::Coordinator(
     size_t quorum,
     const Shared<Replica>& replica,
-    const Shared<Network>& network)
+    const Shared<Network>& network,
+    size_t window)
 {
-  process = new CoordinatorProcess(quorum, replica, network);
+  CHECK_GT(window, 0u);
+
+  process = new CoordinatorProcess(quorum, replica, network, window);
   spawn(process);
 }
 
@@ -467,7 +537,15 @@ Future<uint64_t> Coordinator::demote()
 
 Future<Option<uint64_t> > Coordinator::append(const string& bytes)
 {
-  return dispatch(process, &CoordinatorProcess::append, bytes);
+  Action::Append append;
+  append.set_bytes(bytes);
+  return this->append(append);
+}
+
+
+Future<Option<uint64_t> > Coordinator::append(const Action::Append& append)
+{
+  return dispatch(process, &CoordinatorProcess::append, append);
 }
 
 
@@ -31,6 +31,8 @@
 #include "log/network.hpp"
 #include "log/replica.hpp"
 
+#include "messages/log.hpp"
+
 namespace mesos {
 namespace internal {
 namespace log {
@@ -42,10 +44,17 @@ class CoordinatorProcess;
 class Coordinator
 {
 public:
+  // Creates a coordinator that allows up to 'window' writes (appends
+  // or truncates) to be in progress at the same time. Each write is
+  // assigned the next log position as soon as it is requested and
+  // the writes are completed in the order of their positions, so a
+  // window larger than one only hides the round trips to the quorum
+  // (a.k.a., Multi-Paxos pipelining).
   Coordinator(
       size_t _quorum,
       const process::Shared<Replica>& _replica,
-      const process::Shared<Network>& _network);
+      const process::Shared<Network>& _network,
+      size_t _window = 1);
 
   ~Coordinator();
 
@@ -62,9 +71,16 @@ public:
 
   // Appends the specified bytes to the end of the log. Returns the
   // position of the appended entry if the operation succeeds or none
-  // if the coordinator was demoted.
+  // if the coordinator was demoted. Fails if the window of in
+  // progress writes is full. If a write fails (or returns none), the
+  // coordinator is demoted and all the writes that follow it fail
+  // (or return none) as well.
   process::Future<Option<uint64_t> > append(const std::string& bytes);
 
+  // Appends the specified (already encoded) entry, e.g., one that is
+  // compressed or checksummed. See 'append' above.
+  process::Future<Option<uint64_t> > append(const Action::Append& append);
+
   // Removes all log entries preceding the log entry at the given
   // position (to). Returns the position at which the truncate
   // operation is written if the operation succeeds or none if the
@@ -23,6 +23,8 @@
 
 #include <stdint.h>
 
+#include <list>
+
 #include <stout/option.hpp>
 
 #include "log/storage.hpp"
@@ -43,7 +45,16 @@ public:
   virtual Try<Nothing> persist(const Action& action);
   virtual Try<Action> read(uint64_t position);
 
+  // Writes all the actions with a single (synced) leveldb write.
+  virtual Try<Nothing> persist(const std::list<Action>& actions);
+
+  // Returns true if a log stored by this storage exists at 'path'.
+  static bool exists(const std::string& path);
+
 private:
+  // Deletes the positions preceding the given position (best effort).
+  void truncate(uint64_t to);
+
   leveldb::DB* db;
 
   // First position still in leveldb, used during truncation.
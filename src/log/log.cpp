@@ -17,6 +17,10 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <arpa/inet.h>
 
 #include <process/defer.hpp>
 #include <process/dispatch.hpp>
@@ -29,9 +33,12 @@
 #include <stout/check.hpp>
 #include <stout/error.hpp>
 #include <stout/foreach.hpp>
+#include <stout/gzip.hpp>
 #include <stout/lambda.hpp>
 #include <stout/nothing.hpp>
 #include <stout/set.hpp>
+#include <stout/stringify.hpp>
+#include <stout/try.hpp>
 
 #include "log/coordinator.hpp"
 #include "log/log.hpp"
@@ -56,7 +63,8 @@ public:
       size_t _quorum,
       const string& path,
       const set<UPID>& pids,
-      bool _autoInitialize);
+      bool _autoInitialize,
+      const string& storage);
 
   LogProcess(
       size_t _quorum,
@@ -65,7 +73,8 @@ public:
       const Duration& timeout,
       const string& znode,
       const Option<zookeeper::Authentication>& auth,
-      bool _autoInitialize);
+      bool _autoInitialize,
+      const string& storage);
 
   // Recovers the log by catching up if needed. Returns a shared
   // pointer to the local replica if the recovery succeeds.
@@ -119,6 +128,12 @@ public:
       const Log::Position& from,
       const Log::Position& to);
 
+  Future<Nothing> stream(
+      const Log::Position& from,
+      const Log::Position& to,
+      const lambda::function<Future<Nothing>(const list<Log::Entry>&)>& f,
+      size_t batch);
+
 protected:
   virtual void initialize();
   virtual void finalize();
@@ -146,6 +161,32 @@ private:
       const Log::Position& to,
       const list<Action>& actions);
 
+  Future<Nothing> _stream(
+      const Log::Position& from,
+      const Log::Position& to,
+      const lambda::function<Future<Nothing>(const list<Log::Entry>&)>& f,
+      size_t batch);
+
+  Future<Nothing> __stream(
+      const list<Log::Entry>& entries,
+      const Log::Position& last,
+      const Log::Position& to,
+      const lambda::function<Future<Nothing>(const list<Log::Entry>&)>& f,
+      size_t batch);
+
+  Future<Nothing> ___stream(
+      const Future<list<Log::Entry> >& reading,
+      const Log::Position& last,
+      const Log::Position& to,
+      const lambda::function<Future<Nothing>(const list<Log::Entry>&)>& f,
+      size_t batch);
+
+  // Returns the last position of the batch that starts at 'from'.
+  static Log::Position limit(
+      const Log::Position& from,
+      const Log::Position& to,
+      size_t batch);
+
   Future<Shared<Replica> > recovering;
   list<process::Promise<Nothing>*> promises;
 };
@@ -154,7 +195,7 @@ private:
 class LogWriterProcess : public Process<LogWriterProcess>
 {
 public:
-  explicit LogWriterProcess(Log* log);
+  LogWriterProcess(Log* log, size_t _window, bool _compress);
 
   Future<Option<Log::Position> > start();
   Future<Option<Log::Position> > append(const string& bytes);
@@ -183,6 +224,8 @@ private:
 
   const size_t quorum;
   const Shared<Network> network;
+  const size_t window;
+  const bool compress;
 
   Future<Shared<Replica> > recovering;
   list<process::Promise<Nothing>*> promises;
@@ -192,6 +235,76 @@ private:
 };
 
 
+/////////////////////////////////////////////////
+// Encoding and decoding of log entries.
+/////////////////////////////////////////////////
+
+
+static string checksum(const string& data)
+{
+  uint32_t checksum = htonl(
+      ::crc32(0, (const Bytef*) data.data(), data.size()));
+
+  return string((const char*) &checksum, sizeof(checksum));
+}
+
+
+// Returns the append for the specified data, compressed if requested
+// and if that actually makes it smaller.
+static Try<Action::Append> encode(const string& data, bool compress)
+{
+  Action::Append append;
+  append.set_cksum(checksum(data));
+
+  if (compress) {
+    Try<string> compressed = gzip::compress(data);
+    if (compressed.isError()) {
+      return Error("Failed to compress: " + compressed.error());
+    }
+
+    if (compressed.get().size() < data.size()) {
+      append.set_bytes(compressed.get());
+      append.set_compression(Action::Append::GZIP);
+      return append;
+    }
+  }
+
+  append.set_bytes(data);
+  return append;
+}
+
+
+// Returns the data of the specified append after decompressing it
+// and verifying its checksum (if it has one, entries written by older
+// versions don't).
+static Try<string> decode(const Action::Append& append)
+{
+  string data;
+
+  switch (append.compression()) {
+    case Action::Append::NONE:
+      data = append.bytes();
+      break;
+    case Action::Append::GZIP: {
+      Try<string> decompressed = gzip::decompress(append.bytes());
+      if (decompressed.isError()) {
+        return Error("Failed to decompress: " + decompressed.error());
+      }
+      data = decompressed.get();
+      break;
+    }
+    default:
+      return Error("Unknown compression " + stringify(append.compression()));
+  }
+
+  if (append.has_cksum() && append.cksum() != checksum(data)) {
+    return Error("Checksum mismatch");
+  }
+
+  return data;
+}
+
+
 /////////////////////////////////////////////////
 // Implementation of LogProcess.
 /////////////////////////////////////////////////
@@ -201,10 +314,11 @@ LogProcess::LogProcess(
     size_t _quorum,
     const string& path,
     const set<UPID>& pids,
-    bool _autoInitialize)
+    bool _autoInitialize,
+    const string& storage)
   : ProcessBase(ID::generate("log")),
     quorum(_quorum),
-    replica(new Replica(path)),
+    replica(new Replica(path, storage)),
     network(new Network(pids + (UPID) replica->pid())),
     autoInitialize(_autoInitialize),
     group(NULL) {}
@@ -217,10 +331,11 @@ LogProcess::LogProcess(
     const Duration& timeout,
     const string& znode,
     const Option<zookeeper::Authentication>& auth,
-    bool _autoInitialize)
+    bool _autoInitialize,
+    const string& storage)
   : ProcessBase(ID::generate("log")),
     quorum(_quorum),
-    replica(new Replica(path)),
+    replica(new Replica(path, storage)),
     network(new ZooKeeperNetwork(
         servers,
         timeout,
@@ -547,7 +662,14 @@ Future<list<Log::Entry> > LogReaderProcess::__read(
     // And only return appends.
     CHECK(action.has_type());
     if (action.type() == Action::APPEND) {
-      entries.push_back(Log::Entry(action.position(), action.append().bytes()));
+      Try<string> data = decode(action.append());
+      if (data.isError()) {
+        return Failure(
+            "Failed to read entry at position " +
+            stringify(action.position()) + ": " + data.error());
+      }
+
+      entries.push_back(Log::Entry(action.position(), data.get()));
     }
   }
 
@@ -555,6 +677,85 @@ Future<list<Log::Entry> > LogReaderProcess::__read(
 }
 
 
+Future<Nothing> LogReaderProcess::stream(
+    const Log::Position& from,
+    const Log::Position& to,
+    const lambda::function<Future<Nothing>(const list<Log::Entry>&)>& f,
+    size_t batch)
+{
+  if (to < from) {
+    return Failure("Bad read range (to < from)");
+  } else if (batch == 0) {
+    return Failure("Bad batch size (0)");
+  }
+
+  return recover().then(defer(self(), &Self::_stream, from, to, f, batch));
+}
+
+
+Future<Nothing> LogReaderProcess::_stream(
+    const Log::Position& from,
+    const Log::Position& to,
+    const lambda::function<Future<Nothing>(const list<Log::Entry>&)>& f,
+    size_t batch)
+{
+  const Log::Position end = limit(from, to, batch);
+
+  return _read(from, end)
+    .then(defer(self(), &Self::__stream, lambda::_1, end, to, f, batch));
+}
+
+
+Future<Nothing> LogReaderProcess::__stream(
+    const list<Log::Entry>& entries,
+    const Log::Position& last,
+    const Log::Position& to,
+    const lambda::function<Future<Nothing>(const list<Log::Entry>&)>& f,
+    size_t batch)
+{
+  if (last == to) {
+    return f(entries);
+  }
+
+  // Read ahead the next batch while the current one is consumed.
+  const Log::Position from(last.value + 1);
+  const Log::Position end = limit(from, to, batch);
+
+  Future<list<Log::Entry> > reading = _read(from, end);
+
+  return f(entries)
+    .then(defer(self(), &Self::___stream, reading, end, to, f, batch));
+}
+
+
+Future<Nothing> LogReaderProcess::___stream(
+    const Future<list<Log::Entry> >& reading,
+    const Log::Position& last,
+    const Log::Position& to,
+    const lambda::function<Future<Nothing>(const list<Log::Entry>&)>& f,
+    size_t batch)
+{
+  return reading
+    .then(defer(self(), &Self::__stream, lambda::_1, last, to, f, batch));
+}
+
+
+Log::Position LogReaderProcess::limit(
+    const Log::Position& from,
+    const Log::Position& to,
+    size_t batch)
+{
+  CHECK(from <= to);
+  CHECK_GT(batch, 0u);
+
+  if (to.value - from.value < batch) {
+    return to;
+  }
+
+  return Log::Position(from.value + batch - 1);
+}
+
+
 Log::Position LogReaderProcess::position(uint64_t value)
 {
   return Log::Position(value);
@@ -566,10 +767,15 @@ Log::Position LogReaderProcess::position(uint64_t value)
 /////////////////////////////////////////////////
 
 
-LogWriterProcess::LogWriterProcess(Log* log)
+LogWriterProcess::LogWriterProcess(
+    Log* log,
+    size_t _window,
+    bool _compress)
   : ProcessBase(ID::generate("log-writer")),
     quorum(log->process->quorum),
     network(log->process->network),
+    window(_window),
+    compress(_compress),
     recovering(dispatch(log->process, &LogProcess::recover)),
     coordinator(NULL),
     error(None()) {}
@@ -655,7 +861,7 @@ Future<Option<Log::Position> > LogWriterProcess::_start()
 
   CHECK_READY(recovering);
 
-  coordinator = new Coordinator(quorum, recovering.get(), network);
+  coordinator = new Coordinator(quorum, recovering.get(), network, window);
 
   LOG(INFO) << "Attempting to start the writer";
 
@@ -691,7 +897,12 @@ Future<Option<Log::Position> > LogWriterProcess::append(const string& bytes)
     return Failure(error.get());
   }
 
-  return coordinator->append(bytes)
+  Try<Action::Append> encoded = encode(bytes, compress);
+  if (encoded.isError()) {
+    return Failure(encoded.error());
+  }
+
+  return coordinator->append(encoded.get())
     .then(lambda::bind(&Self::position, lambda::_1))
     .onFailed(defer(self(), &Self::failed, "Failed to append", lambda::_1));
 }
@@ -742,7 +953,8 @@ Log::Log(
     int quorum,
     const string& path,
     const set<UPID>& pids,
-    bool autoInitialize)
+    bool autoInitialize,
+    const string& storage)
 {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
@@ -751,7 +963,8 @@ Log::Log(
         quorum,
         path,
         pids,
-        autoInitialize);
+        autoInitialize,
+        storage);
 
   spawn(process);
 }
@@ -763,7 +976,8 @@ Log::Log(
     const Duration& timeout,
     const string& znode,
     const Option<zookeeper::Authentication>& auth,
-    bool autoInitialize)
+    bool autoInitialize,
+    const string& storage)
 {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
@@ -775,7 +989,8 @@ Log::Log(
         timeout,
         znode,
         auth,
-        autoInitialize);
+        autoInitialize,
+        storage);
 
   spawn(process);
 }
@@ -817,6 +1032,22 @@ Future<list<Log::Entry> > Log::Reader::read(
 }
 
 
+Future<Nothing> Log::Reader::stream(
+    const Log::Position& from,
+    const Log::Position& to,
+    const lambda::function<Future<Nothing>(const list<Log::Entry>&)>& consumer,
+    size_t batch)
+{
+  return dispatch(
+      process,
+      &LogReaderProcess::stream,
+      from,
+      to,
+      consumer,
+      batch);
+}
+
+
 Future<Log::Position> Log::Reader::beginning()
 {
   return dispatch(process, &LogReaderProcess::beginning);
@@ -834,9 +1065,9 @@ Future<Log::Position> Log::Reader::ending()
 /////////////////////////////////////////////////
 
 
-Log::Writer::Writer(Log* log)
+Log::Writer::Writer(Log* log, size_t window, bool compress)
 {
-  process = new LogWriterProcess(log);
+  process = new LogWriterProcess(log, window, compress);
   spawn(process);
 }
 
@@ -32,7 +32,9 @@
 #include <process/timeout.hpp>
 
 #include <stout/duration.hpp>
+#include <stout/lambda.hpp>
 #include <stout/none.hpp>
+#include <stout/nothing.hpp>
 #include <stout/option.hpp>
 
 #include "zookeeper/group.hpp"
@@ -135,6 +137,21 @@ public:
         const Position& from,
         const Position& to);
 
+    // Reads the entries between the specified positions in batches
+    // of (at most) 'batch' entries and passes each batch to
+    // 'consumer' in order. The next batch is read from the local
+    // replica while the consumer processes the current one, and only
+    // these two batches are kept in memory, which makes this suitable
+    // for reading large portions of the log. The returned future is
+    // set once the consumer has processed the last batch and failed
+    // if a read (see above) or the consumer fails.
+    process::Future<Nothing> stream(
+        const Position& from,
+        const Position& to,
+        const lambda::function<
+            process::Future<Nothing>(const std::list<Entry>&)>& consumer,
+        size_t batch = 1024);
+
     // Returns the beginning position of the log from the perspective
     // of the local replica (which may be out of date if the log has
     // been opened and truncated while this replica was partitioned).
@@ -157,8 +174,17 @@ public:
     // one writer (local or remote) can be valid at any point in
     // time. A writer becomes invalid if either Writer::append or
     // Writer::truncate return None, in which case, the writer (or
-    // another writer) must be restarted.
-    explicit Writer(Log* log);
+    // another writer) must be restarted. Up to 'window' appends and
+    // truncates can be in progress at the same time, their results
+    // are returned in the order in which they were requested.
+    //
+    // If 'compress' is true, entries are compressed (if that makes
+    // them smaller) before they are written. Replicas store compressed
+    // entries as is but only readers of this version (or later) can
+    // decompress them, so it should only be enabled once all readers
+    // of the log have been upgraded. Every entry is checksummed and
+    // the checksum is verified when the entry is read.
+    explicit Writer(Log* log, size_t window = 1, bool compress = false);
     ~Writer();
 
     // Attempts to get a promise (from the log's replicas) for
@@ -186,11 +212,14 @@ public:
 
   // Creates a new replicated log that assumes the specified quorum
   // size, is backed by a file at the specified path, and coordinates
-  // with other replicas via the set of process PIDs.
+  // with other replicas via the set of process PIDs. The local
+  // replica stores the log using the specified storage ("leveldb" or
+  // "segment"), see Replica.
   Log(int quorum,
       const std::string& path,
       const std::set<process::UPID>& pids,
-      bool autoInitialize = false);
+      bool autoInitialize = false,
+      const std::string& storage = "leveldb");
 
   // Creates a new replicated log that assumes the specified quorum
   // size, is backed by a file at the specified path, and coordinates
@@ -202,7 +231,8 @@ public:
       const Duration& timeout,
       const std::string& znode,
       const Option<zookeeper::Authentication>& auth = None(),
-      bool autoInitialize = false);
+      bool autoInitialize = false,
+      const std::string& storage = "leveldb");
 
   ~Log();
 
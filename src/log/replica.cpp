@@ -24,23 +24,26 @@
 
 #include <process/dispatch.hpp>
 #include <process/id.hpp>
+#include <process/owned.hpp>
 
+#include <stout/bytes.hpp>
 #include <stout/check.hpp>
 #include <stout/error.hpp>
 #include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
 #include <stout/none.hpp>
 #include <stout/nothing.hpp>
 #include <stout/result.hpp>
 #include <stout/try.hpp>
 #include <stout/utils.hpp>
 
-#include "log/leveldb.hpp"
 #include "log/replica.hpp"
 #include "log/storage.hpp"
 
 using namespace process;
 
 using std::list;
+using std::pair;
 using std::string;
 
 namespace mesos {
@@ -53,16 +56,26 @@ namespace protocol {
 Protocol<PromiseRequest, PromiseResponse> promise;
 Protocol<WriteRequest, WriteResponse> write;
 Protocol<RecoverRequest, RecoverResponse> recover;
+Protocol<TransferRequest, TransferResponse> transfer;
 
 } // namespace protocol {
 
 
+// The (approximate) maximum size of the actions sent back in a single
+// transfer response.
+static const Bytes TRANSFER_CHUNK_SIZE = Megabytes(4);
+
+
 class ReplicaProcess : public ProtobufProcess<ReplicaProcess>
 {
 public:
   // Constructs a new replica process using specified path to a
   // directory for storing the underlying log.
-  explicit ReplicaProcess(const string& path);
+  ReplicaProcess(const string& path, const string& type);
+
+  // Constructs a new replica process using the given storage, which
+  // it takes ownership of.
+  ReplicaProcess(const string& path, Storage* storage);
 
   virtual ~ReplicaProcess();
 
@@ -102,23 +115,51 @@ public:
   // the disk. Returns true on success and false otherwise.
   bool update(const Metadata::Status& status);
 
+  // Persists the specified learned actions, skipping the positions
+  // that are not missing, and commits them right away. Returns true
+  // on success and false otherwise.
+  bool learn(const list<Action>& actions);
+
+protected:
+  virtual void finalize();
+
 private:
   // Handles a request from a proposer to promise not to accept writes
   // from any other proposer with lower proposal number.
-  void promise(const PromiseRequest& request);
+  void promise(const UPID& from, const PromiseRequest& request);
 
   // Handles a request from a proposer to write an action.
-  void write(const WriteRequest& request);
+  void write(const UPID& from, const WriteRequest& request);
 
   // Handles a request from a recover process.
-  void recover(const RecoverRequest& request);
+  void recover(const UPID& from, const RecoverRequest& request);
+
+  // Handles a request from a lagging replica to transfer the learned
+  // actions within a range of positions.
+  void transfer(const UPID& from, const TransferRequest& request);
 
   // Handles a message notifying of a learned action.
   void learned(const Action& action);
 
-  // Helper routines that write a record corresponding to the
-  // specified argument. Returns true on success and false otherwise.
-  bool persist(const Action& action);
+  // Helper routine that adds a record corresponding to the specified
+  // argument to the current batch (see 'commit' below). The in-memory
+  // state of the log is updated right away, since the requests
+  // handled before the batch is committed must see it.
+  void persist(const Action& action);
+
+  // Writes the current batch of actions to the storage at once and
+  // then sends the responses that were waiting for it. Requests that
+  // arrive close together (i.e., before the batch is committed) thus
+  // share a single sync (a.k.a., group commit). Failing to write the
+  // batch is fatal because the in-memory state of the log is already
+  // ahead of the storage (see 'persist').
+  void commit();
+
+  // Sends the response once the current batch, if any, is committed
+  // so that no response is sent before the actions it acknowledges
+  // (or any action written before) are durable. This also preserves
+  // the order of the responses.
+  void respond(const UPID& to, const google::protobuf::Message& message);
 
   // Helper routines that update metadata corresponding to the
   // specified argument. The update will be persisted on the disk.
@@ -128,6 +169,10 @@ private:
   // Helper routine to restore log (e.g., on restart).
   void restore(const string& path);
 
+  // Restores the log and installs the protobuf handlers (shared by
+  // the constructors).
+  void setup(const string& path);
+
   // Underlying storage for the log.
   Storage* storage;
 
@@ -146,17 +191,44 @@ private:
 
   // Unlearned positions in the log.
   IntervalSet<uint64_t> unlearned;
+
+  // The actions that are not committed yet, in the order in which
+  // they were persisted, and the latest action for each of their
+  // positions (for reads).
+  list<Action> batch;
+  hashmap<uint64_t, Action> uncommitted;
+
+  // The responses waiting for the current batch to be committed.
+  list<pair<UPID, Owned<google::protobuf::Message> > > responses;
 };
 
 
-ReplicaProcess::ReplicaProcess(const string& path)
+ReplicaProcess::ReplicaProcess(const string& path, const string& type)
   : ProcessBase(ID::generate("log-replica")),
     begin(0),
     end(0)
 {
   // TODO(benh): Factor out and expose storage.
-  storage = new LevelDBStorage();
+  Try<Storage*> storage_ = Storage::create(path, type);
+  CHECK_SOME(storage_) << "Failed to create the log storage";
+  storage = storage_.get();
+
+  setup(path);
+}
+
+
+ReplicaProcess::ReplicaProcess(const string& path, Storage* _storage)
+  : ProcessBase(ID::generate("log-replica")),
+    storage(CHECK_NOTNULL(_storage)),
+    begin(0),
+    end(0)
+{
+  setup(path);
+}
 
+
+void ReplicaProcess::setup(const string& path)
+{
   restore(path);
 
   // Install protobuf handlers.
@@ -169,6 +241,9 @@ ReplicaProcess::ReplicaProcess(const string& path)
   install<RecoverRequest>(
       &ReplicaProcess::recover);
 
+  install<TransferRequest>(
+      &ReplicaProcess::transfer);
+
   install<LearnedMessage>(
       &ReplicaProcess::learned,
       &LearnedMessage::action);
@@ -181,6 +256,12 @@ ReplicaProcess::~ReplicaProcess()
 }
 
 
+void ReplicaProcess::finalize()
+{
+  commit();
+}
+
+
 Result<Action> ReplicaProcess::read(uint64_t position)
 {
   if (position < begin) {
@@ -189,6 +270,8 @@ Result<Action> ReplicaProcess::read(uint64_t position)
     return None(); // These semantics are assumed above!
   } else if (holes.contains(position)) {
     return None();
+  } else if (uncommitted.contains(position)) {
+    return uncommitted[position];
   }
 
   // Must exist in storage ...
@@ -309,6 +392,10 @@ uint64_t ReplicaProcess::promised()
 
 bool ReplicaProcess::update(const Metadata::Status& status)
 {
+  // Make sure the metadata is never persisted ahead of the actions
+  // that were written before it.
+  commit();
+
   Metadata metadata_;
   metadata_.set_status(status);
   metadata_.set_promised(promised());
@@ -331,6 +418,10 @@ bool ReplicaProcess::update(const Metadata::Status& status)
 
 bool ReplicaProcess::update(uint64_t promised)
 {
+  // Make sure the metadata is never persisted ahead of the actions
+  // that were written before it.
+  commit();
+
   Metadata metadata_;
   metadata_.set_status(status());
   metadata_.set_promised(promised);
@@ -351,6 +442,25 @@ bool ReplicaProcess::update(uint64_t promised)
 }
 
 
+bool ReplicaProcess::learn(const list<Action>& actions)
+{
+  foreach (const Action& action, actions) {
+    CHECK(action.has_learned() && action.learned());
+
+    // A position that is already learned (or truncated) is left
+    // untouched, e.g., it might have been truncated since it was
+    // transferred.
+    if (missing(action.position())) {
+      persist(action);
+    }
+  }
+
+  commit();
+
+  return true;
+}
+
+
 // Note that certain failures that occur result in returning from the
 // current function but *NOT* sending a NACK back to the proposer
 // because that implies a proposer has been demoted. Not sending
@@ -365,7 +475,7 @@ bool ReplicaProcess::update(uint64_t promised)
 // procedure.
 
 
-void ReplicaProcess::promise(const PromiseRequest& request)
+void ReplicaProcess::promise(const UPID& from, const PromiseRequest& request)
 {
   // Ignore promise requests if this replica is not in VOTING status.
   if (status() != Metadata::VOTING) {
@@ -404,7 +514,7 @@ void ReplicaProcess::promise(const PromiseRequest& request)
       response.set_okay(true);
       response.set_proposal(request.proposal());
       response.mutable_action()->MergeFrom(action);
-      reply(response);
+      respond(from, response);
       return;
     }
 
@@ -436,19 +546,19 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         PromiseResponse response;
         response.set_okay(false);
         response.set_proposal(promised());
-        reply(response);
+        respond(from, response);
       } else {
         Action action;
         action.set_position(request.position());
         action.set_promised(request.proposal());
 
-        if (persist(action)) {
-          PromiseResponse response;
-          response.set_okay(true);
-          response.set_proposal(request.proposal());
-          response.set_position(request.position());
-          reply(response);
-        }
+        persist(action);
+
+        PromiseResponse response;
+        response.set_okay(true);
+        response.set_proposal(request.proposal());
+        response.set_position(request.position());
+        respond(from, response);
       }
     } else {
       CHECK_SOME(result);
@@ -459,18 +569,18 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         PromiseResponse response;
         response.set_okay(false);
         response.set_proposal(action.promised());
-        reply(response);
+        respond(from, response);
       } else {
         Action original = action;
         action.set_promised(request.proposal());
 
-        if (persist(action)) {
-          PromiseResponse response;
-          response.set_okay(true);
-          response.set_proposal(request.proposal());
-          response.mutable_action()->MergeFrom(original);
-          reply(response);
-        }
+        persist(action);
+
+        PromiseResponse response;
+        response.set_okay(true);
+        response.set_proposal(request.proposal());
+        response.mutable_action()->MergeFrom(original);
+        respond(from, response);
       }
     }
   } else {
@@ -484,7 +594,7 @@ void ReplicaProcess::promise(const PromiseRequest& request)
       PromiseResponse response;
       response.set_okay(false);
       response.set_proposal(promised());
-      reply(response);
+      respond(from, response);
     } else {
       if (update(request.proposal())) {
         // Return the last position written.
@@ -492,14 +602,14 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         response.set_okay(true);
         response.set_proposal(request.proposal());
         response.set_position(end);
-        reply(response);
+        respond(from, response);
       }
     }
   }
 }
 
 
-void ReplicaProcess::write(const WriteRequest& request)
+void ReplicaProcess::write(const UPID& from, const WriteRequest& request)
 {
   // Ignore write requests if this replica is not in VOTING status.
   if (status() != Metadata::VOTING) {
@@ -522,7 +632,7 @@ void ReplicaProcess::write(const WriteRequest& request)
       response.set_okay(false);
       response.set_proposal(promised());
       response.set_position(request.position());
-      reply(response);
+      respond(from, response);
     } else {
       Action action;
       action.set_position(request.position());
@@ -548,13 +658,13 @@ void ReplicaProcess::write(const WriteRequest& request)
           LOG(FATAL) << "Unknown Action::Type!";
       }
 
-      if (persist(action)) {
-        WriteResponse response;
-        response.set_okay(true);
-        response.set_proposal(request.proposal());
-        response.set_position(request.position());
-        reply(response);
-      }
+      persist(action);
+
+      WriteResponse response;
+      response.set_okay(true);
+      response.set_proposal(request.proposal());
+      response.set_position(request.position());
+      respond(from, response);
     }
   } else if (result.isSome()) {
     Action action = result.get();
@@ -565,7 +675,7 @@ void ReplicaProcess::write(const WriteRequest& request)
       response.set_okay(false);
       response.set_proposal(action.promised());
       response.set_position(request.position());
-      reply(response);
+      respond(from, response);
     } else {
       if (action.has_learned() && action.learned()) {
         // We ignore the write request if this position has already
@@ -623,20 +733,20 @@ void ReplicaProcess::write(const WriteRequest& request)
             LOG(FATAL) << "Unknown Action::Type!";
         }
 
-        if (persist(action)) {
-          WriteResponse response;
-          response.set_okay(true);
-          response.set_proposal(request.proposal());
-          response.set_position(request.position());
-          reply(response);
-        }
+        persist(action);
+
+        WriteResponse response;
+        response.set_okay(true);
+        response.set_proposal(request.proposal());
+        response.set_position(request.position());
+        respond(from, response);
       }
     }
   }
 }
 
 
-void ReplicaProcess::recover(const RecoverRequest& request)
+void ReplicaProcess::recover(const UPID& from, const RecoverRequest& request)
 {
   LOG(INFO) << "Replica in " << status()
             << " status received a broadcasted recover request";
@@ -649,7 +759,80 @@ void ReplicaProcess::recover(const RecoverRequest& request)
     response.set_end(end);
   }
 
-  reply(response);
+  respond(from, response);
+}
+
+
+void ReplicaProcess::transfer(
+    const UPID& from,
+    const TransferRequest& request)
+{
+  TransferResponse response;
+  response.set_position(request.from());
+
+  // Only a VOTING replica can tell which of its positions have been
+  // learned. We reply (rather than ignore the request) so that the
+  // lagging replica can move on to another replica right away.
+  if (status() != Metadata::VOTING) {
+    LOG(INFO) << "Replica ignoring transfer request as it is in "
+              << status() << " status";
+
+    response.set_okay(false);
+    respond(from, response);
+    return;
+  }
+
+  LOG(INFO) << "Replica received transfer request for positions "
+            << request.from() << " -> " << request.to();
+
+  response.set_okay(true);
+
+  // There is nothing to transfer beyond the end of the log.
+  const uint64_t to = std::min(request.to(), end);
+
+  uint64_t position = request.from();
+  size_t size = 0;
+
+  for (; position <= to && size < TRANSFER_CHUNK_SIZE.bytes(); position++) {
+    Action* action = NULL;
+
+    if (position < begin) {
+      // Like for explicit promise requests, a truncated position is
+      // sent as a learned no-op (see the comments in 'promise').
+      action = response.add_actions();
+      action->set_position(position);
+      action->set_promised(promised());
+      action->set_performed(promised());
+      action->set_learned(true);
+      action->set_type(Action::NOP);
+      action->mutable_nop()->MergeFrom(Action::Nop());
+    } else if (missing(position)) {
+      continue; // Must be filled using Paxos.
+    } else {
+      Result<Action> result = read(position);
+
+      if (result.isError()) {
+        // Stop here, the lagging replica will ask another replica.
+        LOG(ERROR) << "Error getting log record at " << position
+                   << ": " << result.error();
+        break;
+      }
+
+      CHECK_SOME(result);
+
+      action = response.add_actions();
+      action->CopyFrom(result.get());
+    }
+
+    size += action->ByteSize();
+  }
+
+  response.set_position(position);
+
+  VLOG(1) << "Replica transferring " << response.actions_size()
+          << " learned action(s) before position " << position;
+
+  respond(from, response);
 }
 
 
@@ -660,23 +843,25 @@ void ReplicaProcess::learned(const Action& action)
 
   CHECK(action.learned());
 
-  if (persist(action)) {
-    LOG(INFO) << "Replica learned " << action.type()
-              << " action at position " << action.position();
-  }
+  persist(action);
+
+  LOG(INFO) << "Replica learned " << action.type()
+            << " action at position " << action.position();
 }
 
 
-bool ReplicaProcess::persist(const Action& action)
+void ReplicaProcess::persist(const Action& action)
 {
-  Try<Nothing> persisted = storage->persist(action);
-
-  if (persisted.isError()) {
-    LOG(ERROR) << "Error writing to log: " << persisted.error();
-    return false;
+  // Start a new batch which gets committed once the requests that
+  // are already queued for this process have been handled.
+  if (batch.empty()) {
+    dispatch(self(), &ReplicaProcess::commit);
   }
 
-  LOG(INFO) << "Persisted action at " << action.position();
+  batch.push_back(action);
+  uncommitted[action.position()] = action;
+
+  VLOG(2) << "Batched action at " << action.position();
 
   // No longer a hole here (if there even was one).
   holes -= action.position();
@@ -712,8 +897,56 @@ bool ReplicaProcess::persist(const Action& action)
 
   // And update the end position.
   end = std::max(end, action.position());
+}
 
-  return true;
+
+void ReplicaProcess::commit()
+{
+  if (batch.empty()) {
+    return; // Already committed (e.g., before a metadata update).
+  }
+
+  Try<Nothing> persisted = storage->persist(batch);
+
+  // The holes, unlearned positions and ending position of the log
+  // already account for the batch and have been used to handle the
+  // requests since (e.g., the ending position sent to a recovering
+  // replica). Rather than carrying on with state the storage doesn't
+  // have, we abort and restore the log from the storage on restart.
+  if (persisted.isError()) {
+    LOG(FATAL) << "Failed to persist " << batch.size() << " action(s)"
+               << " at positions " << batch.front().position() << " -> "
+               << batch.back().position() << ": " << persisted.error();
+  }
+
+  LOG(INFO) << "Persisted " << batch.size() << " action(s) at positions "
+            << batch.front().position() << " -> "
+            << batch.back().position();
+
+  typedef pair<UPID, Owned<google::protobuf::Message> > Response;
+  foreach (const Response& response, responses) {
+    send(response.first, *response.second);
+  }
+
+  batch.clear();
+  uncommitted.clear();
+  responses.clear();
+}
+
+
+void ReplicaProcess::respond(
+    const UPID& to,
+    const google::protobuf::Message& message)
+{
+  if (batch.empty()) {
+    send(to, message);
+    return;
+  }
+
+  Owned<google::protobuf::Message> response(message.New());
+  response->CopyFrom(message);
+
+  responses.push_back(std::make_pair(to, response));
 }
 
 
@@ -748,9 +981,16 @@ void ReplicaProcess::restore(const string& path)
 }
 
 
-Replica::Replica(const string& path)
+Replica::Replica(const string& path, const string& storage)
+{
+  process = new ReplicaProcess(path, storage);
+  spawn(process);
+}
+
+
+Replica::Replica(const string& path, Storage* storage)
 {
-  process = new ReplicaProcess(path);
+  process = new ReplicaProcess(path, storage);
   spawn(process);
 }
 
@@ -816,6 +1056,12 @@ Future<bool> Replica::update(const Metadata::Status& status)
 }
 
 
+Future<bool> Replica::learn(const list<Action>& actions) const
+{
+  return dispatch(process, &ReplicaProcess::learn, actions);
+}
+
+
 PID<ReplicaProcess> Replica::pid() const
 {
   return process->self();
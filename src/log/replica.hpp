@@ -42,12 +42,14 @@ namespace protocol {
 extern Protocol<PromiseRequest, PromiseResponse> promise;
 extern Protocol<WriteRequest, WriteResponse> write;
 extern Protocol<RecoverRequest, RecoverResponse> recover;
+extern Protocol<TransferRequest, TransferResponse> transfer;
 
 } // namespace protocol {
 
 
-// Forward declaration.
+// Forward declarations.
 class ReplicaProcess;
+class Storage;
 
 
 class Replica
@@ -58,8 +60,18 @@ public:
   // with an empty log, it will not be allowed to vote (i.e., cannot
   // reply to any request except the recover request). The recover
   // process will later decide if this replica can be re-allowed to
-  // vote depending on the status of other replicas.
-  explicit Replica(const std::string& path);
+  // vote depending on the status of other replicas. The log is
+  // stored using the specified storage ("leveldb" or "segment")
+  // unless it already exists (see Storage::create).
+  explicit Replica(
+      const std::string& path,
+      const std::string& storage = "leveldb");
+
+  // Constructs a new replica which stores the log at the specified
+  // path using the given storage, which the replica takes ownership
+  // of (used for testing).
+  Replica(const std::string& path, Storage* storage);
+
   ~Replica();
 
   // Returns all the actions between the specified positions, unless
@@ -94,6 +106,12 @@ public:
   // Updates the status of this replica.
   process::Future<bool> update(const Metadata::Status& status);
 
+  // Persists the specified learned actions (e.g., transferred from
+  // another replica during catch-up), skipping the positions that are
+  // not missing in the log. Returns true once the actions are durable
+  // and false if they could not be persisted.
+  process::Future<bool> learn(const std::list<Action>& actions) const;
+
   // Returns the PID associated with this replica.
   process::PID<ReplicaProcess> pid() const;
 
@@ -0,0 +1,718 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <set>
+
+#include <stout/check.hpp>
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/numify.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/result.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+
+#include "log/segment.hpp"
+
+using std::list;
+using std::map;
+using std::set;
+using std::string;
+
+namespace mesos {
+namespace internal {
+namespace log {
+
+// Each record is framed by its length and the CRC32 of its bytes,
+// both in network byte order.
+static const size_t HEADER_SIZE = 2 * sizeof(uint32_t);
+
+static const string METADATA = "metadata";
+static const string SEGMENT_SUFFIX = ".segment";
+
+
+// Returns the name of the segment with the given sequence number.
+static string segment(uint64_t sequence)
+{
+  Try<string> s = strings::format("%.*llu", 10, sequence);
+  CHECK_SOME(s);
+  return s.get() + SEGMENT_SUFFIX;
+}
+
+
+static string frame(const string& bytes)
+{
+  uint32_t length = htonl(bytes.size());
+  uint32_t checksum = htonl(
+      ::crc32(0, (const Bytef*) bytes.data(), bytes.size()));
+
+  string record;
+  record.reserve(HEADER_SIZE + bytes.size());
+  record.append((const char*) &length, sizeof(length));
+  record.append((const char*) &checksum, sizeof(checksum));
+  record.append(bytes);
+
+  return record;
+}
+
+
+// Returns the length of the bytes of the record at 'offset', none if
+// there is no record at 'offset' (i.e., the rest of the segment is
+// still zeroed) or an error if the record is corrupted (e.g., due to
+// a torn write).
+static Result<size_t> unframe(const char* data, size_t size, size_t offset)
+{
+  if (offset + HEADER_SIZE > size) {
+    return None();
+  }
+
+  uint32_t length;
+  uint32_t checksum;
+  memcpy(&length, data + offset, sizeof(length));
+  memcpy(&checksum, data + offset + sizeof(length), sizeof(checksum));
+
+  length = ntohl(length);
+  checksum = ntohl(checksum);
+
+  if (length == 0) {
+    return None();
+  } else if (offset + HEADER_SIZE + length > size) {
+    return Error("Record at offset " + stringify(offset) +
+                 " exceeds the segment");
+  }
+
+  const char* bytes = data + offset + HEADER_SIZE;
+
+  if (::crc32(0, (const Bytef*) bytes, length) != checksum) {
+    return Error("Checksum mismatch for record at offset " +
+                 stringify(offset));
+  }
+
+  return length;
+}
+
+
+static Try<Record> parse(const char* data, size_t size)
+{
+  google::protobuf::io::ArrayInputStream stream(data, size);
+
+  Record record;
+
+  if (!record.ParseFromZeroCopyStream(&stream)) {
+    return Error("Failed to deserialize record");
+  }
+
+  return record;
+}
+
+
+// Writes the data at the given offset of the file and syncs it.
+static Try<Nothing> write(int fd, size_t offset, const string& data)
+{
+  size_t written = 0;
+
+  while (written < data.size()) {
+    ssize_t length = ::pwrite(
+        fd,
+        data.data() + written,
+        data.size() - written,
+        offset + written);
+
+    if (length < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return ErrnoError();
+    }
+
+    written += length;
+  }
+
+  if (::fdatasync(fd) < 0) {
+    return ErrnoError();
+  }
+
+  return Nothing();
+}
+
+
+// Syncs the directory so that files created in (or renamed into) it
+// are durable.
+static Try<Nothing> fsyncDirectory(const string& directory)
+{
+  Try<int> fd = os::open(directory, O_RDONLY | O_CLOEXEC);
+  if (fd.isError()) {
+    return Error(fd.error());
+  }
+
+  if (::fsync(fd.get()) < 0) {
+    ErrnoError error;
+    os::close(fd.get());
+    return error;
+  }
+
+  os::close(fd.get());
+
+  return Nothing();
+}
+
+
+SegmentStorage::SegmentStorage(const Bytes& _segmentSize)
+  : segmentSize(_segmentSize),
+    begin(0) {}
+
+
+SegmentStorage::~SegmentStorage()
+{
+  while (!segments.empty()) {
+    close(segments.begin()->first, false);
+  }
+}
+
+
+bool SegmentStorage::exists(const string& path)
+{
+  if (os::exists(path::join(path, METADATA))) {
+    return true;
+  }
+
+  Try<list<string> > entries = os::ls(path);
+  if (entries.isError()) {
+    return false;
+  }
+
+  foreach (const string& entry, entries.get()) {
+    if (strings::endsWith(entry, SEGMENT_SUFFIX)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+Try<Storage::State> SegmentStorage::restore(const string& _path)
+{
+  path = _path;
+
+  Try<Nothing> mkdir = os::mkdir(path);
+  if (mkdir.isError()) {
+    return Error("Failed to create directory: " + mkdir.error());
+  }
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  State state;
+  state.begin = 0;
+  state.end = 0;
+
+  if (os::exists(path::join(path, METADATA))) {
+    Try<string> contents = os::read(path::join(path, METADATA));
+    if (contents.isError()) {
+      return Error("Failed to read metadata: " + contents.error());
+    }
+
+    Result<size_t> length =
+      unframe(contents.get().data(), contents.get().size(), 0);
+
+    if (!length.isSome()) {
+      return Error("Failed to read metadata: " +
+                   (length.isError() ? length.error() : "empty file"));
+    }
+
+    Try<Record> record =
+      parse(contents.get().data() + HEADER_SIZE, length.get());
+
+    if (record.isError()) {
+      return Error(record.error());
+    } else if (record.get().type() != Record::METADATA) {
+      return Error("Bad record");
+    }
+
+    CHECK(record.get().has_metadata());
+    state.metadata.CopyFrom(record.get().metadata());
+  }
+
+  Try<list<string> > entries = os::ls(path);
+  if (entries.isError()) {
+    return Error("Failed to list segments: " + entries.error());
+  }
+
+  set<uint64_t> sequences;
+  foreach (const string& entry, entries.get()) {
+    if (!strings::endsWith(entry, SEGMENT_SUFFIX)) {
+      continue;
+    }
+
+    Try<uint64_t> sequence = numify<uint64_t>(
+        entry.substr(0, entry.size() - SEGMENT_SUFFIX.size()));
+
+    if (sequence.isError()) {
+      return Error("Unexpected segment '" + entry + "'");
+    }
+
+    sequences.insert(sequence.get());
+  }
+
+  if (sequences.empty()) {
+    sequences.insert(0); // Start with an empty segment.
+  }
+
+  uint64_t records = 0;
+
+  foreach (uint64_t sequence, sequences) {
+    Try<Nothing> open = SegmentStorage::open(sequence, segmentSize.bytes());
+    if (open.isError()) {
+      return Error(open.error());
+    }
+
+    Segment& segment = segments[sequence];
+
+    while (true) {
+      Result<size_t> length =
+        unframe(segment.data, segment.size, segment.offset);
+
+      if (length.isNone()) {
+        break;
+      } else if (length.isError()) {
+        // Only the last segment can end with a torn write since a
+        // segment is synced before the next one is started.
+        if (sequence != *sequences.rbegin()) {
+          return Error("Corrupted segment '" + segment.path + "': " +
+                       length.error());
+        }
+
+        LOG(WARNING) << "Discarding the end of segment '" << segment.path
+                     << "' which is most likely a torn write: "
+                     << length.error();
+
+        // Zero the rest of the segment (up to the last byte written)
+        // since the next records are written from here on. Otherwise
+        // the remains of the torn record following a shorter record
+        // would be mistaken for a corrupted record once this segment
+        // is no longer the last one.
+        size_t end = segment.size;
+        while (end > segment.offset && segment.data[end - 1] == '\0') {
+          end--;
+        }
+
+        Try<Nothing> zero = log::write(
+            segment.fd,
+            segment.offset,
+            string(end - segment.offset, '\0'));
+
+        if (zero.isError()) {
+          return Error("Failed to zero the end of segment '" +
+                       segment.path + "': " + zero.error());
+        }
+
+        break;
+      }
+
+      Try<Record> record =
+        parse(segment.data + segment.offset + HEADER_SIZE, length.get());
+
+      if (record.isError()) {
+        return Error(record.error());
+      } else if (record.get().type() != Record::ACTION) {
+        return Error("Bad record");
+      }
+
+      records++;
+
+      CHECK(record.get().has_action());
+      const Action& action = record.get().action();
+
+      if (action.has_learned() && action.learned()) {
+        state.learned.insert(action.position());
+        state.unlearned.erase(action.position());
+        if (action.has_type() && action.type() == Action::TRUNCATE) {
+          state.begin = std::max(state.begin, action.truncate().to());
+        }
+      } else {
+        state.learned.erase(action.position());
+        state.unlearned.insert(action.position());
+      }
+      state.end = std::max(state.end, action.position());
+
+      Location location;
+      location.segment = sequence;
+      location.offset = segment.offset;
+      location.length = HEADER_SIZE + length.get();
+
+      index[action.position()] = location;
+
+      segment.last = max(segment.last, action.position());
+      segment.offset += location.length;
+    }
+  }
+
+  // Unlike deleting keys from leveldb, dropping the truncated
+  // positions is done lazily (a segment is only dropped once all its
+  // positions are truncated), hence we need to filter them out here.
+  if (state.begin > 0) {
+    state.learned -=
+      (Bound<uint64_t>::closed(0), Bound<uint64_t>::open(state.begin));
+    state.unlearned -=
+      (Bound<uint64_t>::closed(0), Bound<uint64_t>::open(state.begin));
+
+    truncate(state.begin);
+  }
+
+  LOG(INFO) << "Restored " << records << " records from "
+            << segments.size() << " segments in " << stopwatch.elapsed();
+
+  return state;
+}
+
+
+Try<Nothing> SegmentStorage::persist(const Metadata& metadata)
+{
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  Record record;
+  record.set_type(Record::METADATA);
+  record.mutable_metadata()->CopyFrom(metadata);
+
+  string value;
+
+  if (!record.SerializeToString(&value)) {
+    return Error("Failed to serialize record");
+  }
+
+  // Write the metadata to a temporary file first and then rename it
+  // so that a crash never leaves a partially written metadata.
+  const string temporary = path::join(path, METADATA + ".tmp");
+
+  Try<int> fd = os::open(
+      temporary,
+      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+  if (fd.isError()) {
+    return Error("Failed to open '" + temporary + "': " + fd.error());
+  }
+
+  Try<Nothing> write = os::write(fd.get(), frame(value));
+  if (write.isError()) {
+    os::close(fd.get());
+    return Error("Failed to write '" + temporary + "': " + write.error());
+  }
+
+  if (::fsync(fd.get()) < 0) {
+    ErrnoError error("Failed to sync '" + temporary + "'");
+    os::close(fd.get());
+    return error;
+  }
+
+  os::close(fd.get());
+
+  Try<Nothing> rename = os::rename(temporary, path::join(path, METADATA));
+  if (rename.isError()) {
+    return Error("Failed to rename '" + temporary + "': " + rename.error());
+  }
+
+  Try<Nothing> sync = fsyncDirectory(path);
+  if (sync.isError()) {
+    return Error("Failed to sync '" + path + "': " + sync.error());
+  }
+
+  LOG(INFO) << "Persisting metadata (" << value.size()
+            << " bytes) to segment storage took " << stopwatch.elapsed();
+
+  return Nothing();
+}
+
+
+Try<Nothing> SegmentStorage::persist(const Action& action)
+{
+  return persist(list<Action>(1, action));
+}
+
+
+Try<Nothing> SegmentStorage::persist(const list<Action>& actions)
+{
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  CHECK(!segments.empty());
+
+  // The records that go to the active segment, and their locations.
+  string buffer;
+  map<uint64_t, Location> locations;
+
+  size_t size = 0;
+
+  foreach (const Action& action, actions) {
+    Record record;
+    record.set_type(Record::ACTION);
+    record.mutable_action()->MergeFrom(action);
+
+    string value;
+
+    if (!record.SerializeToString(&value)) {
+      return Error("Failed to serialize record");
+    }
+
+    const string bytes = frame(value);
+    size += bytes.size();
+
+    uint64_t sequence = segments.rbegin()->first;
+    Segment* segment = &segments.rbegin()->second;
+
+    if (segment->offset + buffer.size() + bytes.size() > segment->size) {
+      // Switch to a new segment. The records written so far are
+      // synced first so that only the last segment can ever end
+      // with a torn write.
+      Try<Nothing> write = log::write(segment->fd, segment->offset, buffer);
+      if (write.isError()) {
+        return Error("Failed to write segment '" + segment->path + "': " +
+                     write.error());
+      }
+
+      segment->offset += buffer.size();
+      buffer.clear();
+
+      Try<Nothing> open = SegmentStorage::open(
+          sequence + 1,
+          std::max(segmentSize.bytes(), (uint64_t) bytes.size()));
+
+      if (open.isError()) {
+        return Error(open.error());
+      }
+
+      sequence = segments.rbegin()->first;
+      segment = &segments.rbegin()->second;
+    }
+
+    Location location;
+    location.segment = sequence;
+    location.offset = segment->offset + buffer.size();
+    location.length = bytes.size();
+
+    // Later actions for the same position win.
+    locations[action.position()] = location;
+
+    buffer.append(bytes);
+  }
+
+  Segment& segment = segments.rbegin()->second;
+
+  // Note that we write at the end of the last record rather than at
+  // the end of the file (the segments are preallocated). The sync
+  // covers all the records at once (i.e., group commit).
+  Try<Nothing> write = log::write(segment.fd, segment.offset, buffer);
+  if (write.isError()) {
+    return Error("Failed to write segment '" + segment.path + "': " +
+                 write.error());
+  }
+
+  segment.offset += buffer.size();
+
+  foreachpair (uint64_t position, const Location& location, locations) {
+    index[position] = location;
+    segments[location.segment].last =
+      max(segments[location.segment].last, position);
+  }
+
+  LOG(INFO) << "Persisting " << actions.size() << " action(s) (" << size
+            << " bytes) to segment storage took " << stopwatch.elapsed();
+
+  // Drop positions if a truncate action has been *learned*.
+  foreach (const Action& action, actions) {
+    if (action.has_type() && action.type() == Action::TRUNCATE &&
+        action.has_learned() && action.learned()) {
+      CHECK(action.has_truncate());
+      truncate(action.truncate().to());
+    }
+  }
+
+  return Nothing();
+}
+
+
+Try<Action> SegmentStorage::read(uint64_t position)
+{
+  if (position < begin) {
+    return Error("Attempted to read truncated position");
+  } else if (index.count(position) == 0) {
+    return Error("Position " + stringify(position) + " not found");
+  }
+
+  const Location& location = index[position];
+
+  CHECK(segments.count(location.segment) > 0);
+  const Segment& segment = segments[location.segment];
+
+  // Verify the checksum again in case the record got corrupted since
+  // it was written.
+  Result<size_t> length = unframe(segment.data, segment.size, location.offset);
+
+  if (!length.isSome()) {
+    return Error("Failed to read position " + stringify(position) + ": " +
+                 (length.isError() ? length.error() : "missing record"));
+  }
+
+  Try<Record> record =
+    parse(segment.data + location.offset + HEADER_SIZE, length.get());
+
+  if (record.isError()) {
+    return Error(record.error());
+  } else if (record.get().type() != Record::ACTION) {
+    return Error("Bad record");
+  }
+
+  return record.get().action();
+}
+
+
+Try<Nothing> SegmentStorage::open(uint64_t sequence, size_t size)
+{
+  const string file = path::join(path, segment(sequence));
+
+  bool created = !os::exists(file);
+
+  Try<int> fd = os::open(
+      file,
+      O_RDWR | O_CREAT | O_CLOEXEC,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+  if (fd.isError()) {
+    return Error("Failed to open segment '" + file + "': " + fd.error());
+  }
+
+  struct stat s;
+  if (::fstat(fd.get(), &s) < 0) {
+    ErrnoError error("Failed to stat segment '" + file + "'");
+    os::close(fd.get());
+    return error;
+  }
+
+  // A segment that was created right before a crash might not have
+  // been preallocated yet.
+  if (s.st_size == 0) {
+    int error = ::posix_fallocate(fd.get(), 0, size);
+    if (error != 0) {
+      os::close(fd.get());
+      return Error("Failed to preallocate segment '" + file + "': " +
+                   strerror(error));
+    }
+  } else {
+    size = s.st_size;
+  }
+
+  if (created) {
+    Try<Nothing> sync = fsyncDirectory(path);
+    if (sync.isError()) {
+      os::close(fd.get());
+      return Error("Failed to sync '" + path + "': " + sync.error());
+    }
+  }
+
+  void* data = ::mmap(NULL, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+  if (data == MAP_FAILED) {
+    ErrnoError error("Failed to map segment '" + file + "'");
+    os::close(fd.get());
+    return error;
+  }
+
+  Segment segment;
+  segment.path = file;
+  segment.fd = fd.get();
+  segment.data = (char*) data;
+  segment.size = size;
+  segment.offset = 0;
+
+  segments[sequence] = segment;
+
+  return Nothing();
+}
+
+
+void SegmentStorage::close(uint64_t sequence, bool remove)
+{
+  CHECK(segments.count(sequence) > 0);
+  const Segment& segment = segments[sequence];
+
+  ::munmap(segment.data, segment.size);
+  os::close(segment.fd);
+
+  if (remove) {
+    Try<Nothing> rm = os::rm(segment.path);
+    if (rm.isError()) {
+      LOG(WARNING) << "Failed to remove segment '" << segment.path
+                   << "': " << rm.error();
+    }
+  }
+
+  segments.erase(sequence);
+}
+
+
+void SegmentStorage::truncate(uint64_t to)
+{
+  if (to <= begin) {
+    return;
+  }
+
+  begin = to;
+
+  index.erase(index.begin(), index.lower_bound(to));
+
+  // Drop all the segments, except for the active one, which no
+  // longer contain any position in the log. This is what makes
+  // truncation cheap: no record is ever rewritten.
+  const uint64_t active = segments.rbegin()->first;
+
+  set<uint64_t> truncated;
+  foreachpair (uint64_t sequence, const Segment& segment, segments) {
+    if (sequence != active &&
+        (segment.last.isNone() || segment.last.get() < to)) {
+      truncated.insert(sequence);
+    }
+  }
+
+  foreach (uint64_t sequence, truncated) {
+    LOG(INFO) << "Dropping truncated segment '"
+              << segments[sequence].path << "'";
+    close(sequence, true);
+  }
+}
+
+} // namespace log {
+} // namespace internal {
+} // namespace mesos {
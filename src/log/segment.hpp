@@ -0,0 +1,116 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LOG_SEGMENT_HPP__
+#define __LOG_SEGMENT_HPP__
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <string>
+
+#include <stout/bytes.hpp>
+#include <stout/nothing.hpp>
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+#include "log/storage.hpp"
+
+namespace mesos {
+namespace internal {
+namespace log {
+
+// Concrete implementation of the storage interface which appends the
+// actions to preallocated segment files. Since an action at a
+// position gets written several times (promised, performed, learned),
+// the last record for a position wins. An in-memory index maps each
+// position to its last record, which is read from the memory mapped
+// segment. A learned truncation drops all the segments that only
+// contain truncated positions. Every record is checksummed (CRC32) so
+// that a torn write at the end of the log is detected on restore.
+//
+// The metadata is small and rewritten in place (atomically, through
+// a rename), so it lives in its own file rather than in the segments.
+class SegmentStorage : public Storage
+{
+public:
+  explicit SegmentStorage(const Bytes& segmentSize = Megabytes(64));
+  virtual ~SegmentStorage();
+
+  virtual Try<State> restore(const std::string& path);
+  virtual Try<Nothing> persist(const Metadata& metadata);
+  virtual Try<Nothing> persist(const Action& action);
+  virtual Try<Action> read(uint64_t position);
+
+  // Appends all the actions and syncs the segments only once.
+  virtual Try<Nothing> persist(const std::list<Action>& actions);
+
+  // Returns true if a log stored by this storage exists at 'path'.
+  static bool exists(const std::string& path);
+
+private:
+  struct Segment
+  {
+    std::string path;
+    int fd;
+    char* data; // The memory mapped segment.
+    size_t size; // The preallocated size of the segment.
+    size_t offset; // The end of the last record in the segment.
+    Option<uint64_t> last; // The highest position in the segment.
+  };
+
+  // The location of the last record of a position.
+  struct Location
+  {
+    uint64_t segment;
+    size_t offset;
+    size_t length;
+  };
+
+  // Opens (and maps) the segment with the given sequence number,
+  // creating and preallocating it if it does not exist.
+  Try<Nothing> open(uint64_t sequence, size_t size);
+
+  // Closes the segment and deletes it if requested.
+  void close(uint64_t sequence, bool remove);
+
+  // Drops the positions preceding the given position along with all
+  // the (inactive) segments which only contain such positions.
+  void truncate(uint64_t to);
+
+  const Bytes segmentSize;
+
+  std::string path;
+
+  // The segments ordered by their sequence numbers. The segment with
+  // the highest sequence number is the active one, i.e., the one the
+  // records are appended to.
+  std::map<uint64_t, Segment> segments;
+
+  std::map<uint64_t, Location> index;
+
+  // Positions preceding this one have been truncated.
+  uint64_t begin;
+};
+
+} // namespace log {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __LOG_SEGMENT_HPP__
@@ -0,0 +1,64 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+
+#include <stout/error.hpp>
+
+#include "log/leveldb.hpp"
+#include "log/segment.hpp"
+#include "log/storage.hpp"
+
+using std::string;
+
+namespace mesos {
+namespace internal {
+namespace log {
+
+Try<Storage*> Storage::create(const string& path, const string& type)
+{
+  if (type != "leveldb" && type != "segment") {
+    return Error("Unknown log storage '" + type + "'");
+  }
+
+  if (LevelDBStorage::exists(path)) {
+    LOG_IF(WARNING, type != "leveldb")
+      << "Using the existing leveldb storage for the log at '" << path
+      << "' rather than the " << type << " storage, use 'mesos-log"
+      << " convert' to convert the log";
+
+    return new LevelDBStorage();
+  } else if (SegmentStorage::exists(path)) {
+    LOG_IF(WARNING, type != "segment")
+      << "Using the existing segment storage for the log at '" << path
+      << "' rather than the " << type << " storage, use 'mesos-log"
+      << " convert' to convert the log";
+
+    return new SegmentStorage();
+  }
+
+  if (type == "segment") {
+    return new SegmentStorage();
+  }
+
+  return new LevelDBStorage();
+}
+
+} // namespace log {
+} // namespace internal {
+} // namespace mesos {
@@ -21,8 +21,10 @@
 
 #include <stdint.h>
 
+#include <list>
 #include <string>
 
+#include <stout/foreach.hpp>
 #include <stout/interval.hpp>
 #include <stout/nothing.hpp>
 #include <stout/try.hpp>
@@ -50,12 +52,35 @@ public:
     IntervalSet<uint64_t> unlearned;
   };
 
+  // Returns the storage for the log at the specified path. An
+  // existing log is always opened with the storage it was written
+  // with, otherwise the storage of the given type ("leveldb" or
+  // "segment") is used.
+  static Try<Storage*> create(
+      const std::string& path,
+      const std::string& type);
+
   virtual ~Storage() {}
 
   virtual Try<State> restore(const std::string& path) = 0;
   virtual Try<Nothing> persist(const Metadata& metadata) = 0;
   virtual Try<Nothing> persist(const Action& action) = 0;
   virtual Try<Action> read(uint64_t position) = 0;
+
+  // Persists the actions in the given order. Storages that can make
+  // several actions durable at once (e.g., with a single sync) should
+  // override this to amortize the cost across the actions.
+  virtual Try<Nothing> persist(const std::list<Action>& actions)
+  {
+    foreach (const Action& action, actions) {
+      Try<Nothing> persisted = persist(action);
+      if (persisted.isError()) {
+        return persisted;
+      }
+    }
+
+    return Nothing();
+  }
 };
 
 } // namespace log {
@@ -19,23 +19,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <deque>
 #include <iostream>
 #include <fstream>
+#include <set>
 #include <sstream>
 
 #include <process/clock.hpp>
 #include <process/future.hpp>
+#include <process/owned.hpp>
+#include <process/pid.hpp>
 #include <process/process.hpp>
 #include <process/time.hpp>
 
 #include <stout/bytes.hpp>
 #include <stout/error.hpp>
 #include <stout/foreach.hpp>
+#include <stout/numify.hpp>
+#include <stout/os.hpp>
 #include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
 #include <stout/strings.hpp>
 #include <stout/os/read.hpp>
 
 #include "log/log.hpp"
+#include "log/replica.hpp"
 #include "log/tool/initialize.hpp"
 #include "log/tool/benchmark.hpp"
 
@@ -44,10 +53,12 @@
 using namespace process;
 
 using std::cout;
+using std::deque;
 using std::endl;
 using std::ifstream;
 using std::ofstream;
 using std::ostringstream;
+using std::set;
 using std::string;
 using std::vector;
 
@@ -68,7 +79,9 @@ Benchmark::Flags::Flags()
 
   add(&Flags::servers,
       "servers",
-      "ZooKeeper servers");
+      "ZooKeeper servers. If not specified, the log is benchmarked\n"
+      "against local replicas (2 * quorum - 1 in total) which are\n"
+      "stored next to the log at '--path'");
 
   add(&Flags::znode,
       "znode",
@@ -91,6 +104,26 @@ Benchmark::Flags::Flags()
       "  random: all bits are randomly chosen\n",
       "random");
 
+  add(&Flags::windows,
+      "windows",
+      "Comma separated list of the numbers of appends that are allowed\n"
+      "to be in progress at the same time. The trace is replayed once\n"
+      "for each of them",
+      "1,2,4,8,16,32,64");
+
+  add(&Flags::compressions,
+      "compressions",
+      "Comma separated list of the compressions of the appended\n"
+      "entries (none, gzip). The trace is replayed once for each\n"
+      "of them (and each window), reporting the bytes written to\n"
+      "the disk at '--path' besides the throughput",
+      "none");
+
+  add(&Flags::storage,
+      "storage",
+      "Storage used for a new log (leveldb, segment)",
+      "leveldb");
+
   add(&Flags::initialize,
       "initialize",
       "Whether to initialize the log",
@@ -113,7 +146,12 @@ string Benchmark::usage(const string& argv0) const
       << "replicated log. It takes a trace file of write sizes" << endl
       << "and replay that trace to measure the latency of each" << endl
       << "write. The data to be written for each write can be" << endl
-      << "specified using the '--type' flag." << endl
+      << "specified using the '--type' flag. The trace is replayed" << endl
+      << "once for each of the windows specified using the" << endl
+      << "'--windows' flag, reporting the throughput and latency" << endl
+      << "percentiles of the appends, and for each of the" << endl
+      << "compressions specified using the '--compressions' flag," << endl
+      << "reporting the bytes written to the disk as well." << endl
       << endl
       << "Supported OPTIONS:" << endl
       << flags.usage();
@@ -141,18 +179,16 @@ Try<Nothing> Benchmark::execute(int argc, char** argv)
 
   if (flags.quorum.isNone()) {
     return Error("Missing flag '--quorum'");
+  } else if (flags.quorum.get() == 0) {
+    return Error("Flag '--quorum' must be positive");
   }
 
   if (flags.path.isNone()) {
     return Error("Missing flag '--path'");
   }
 
-  if (flags.servers.isNone()) {
-    return Error("Missing flag '--servers'");
-  }
-
-  if (flags.znode.isNone()) {
-    return Error("Missing flag '--znode'");
+  if (flags.servers.isSome() != flags.znode.isSome()) {
+    return Error("Flags '--servers' and '--znode' must be used together");
   }
 
   if (flags.input.isNone()) {
@@ -163,45 +199,92 @@ Try<Nothing> Benchmark::execute(int argc, char** argv)
     return Error("Missing flag '--output'");
   }
 
-  // Initialize the log.
-  if (flags.initialize) {
-    Initialize initialize;
-    initialize.flags.path = flags.path;
+  vector<size_t> windows;
+  foreach (const string& token, strings::tokenize(flags.windows, ",")) {
+    Try<size_t> window = numify<size_t>(strings::trim(token));
+    if (window.isError() || window.get() == 0) {
+      return Error("Invalid window '" + token + "' in flag '--windows'");
+    }
+
+    windows.push_back(window.get());
+  }
+
+  if (windows.empty()) {
+    return Error("Missing windows in flag '--windows'");
+  }
+
+  vector<string> compressions;
+  foreach (const string& token, strings::tokenize(flags.compressions, ",")) {
+    const string compression = strings::trim(token);
+    if (compression != "none" && compression != "gzip") {
+      return Error(
+          "Invalid compression '" + token + "' in flag '--compressions'");
+    }
+
+    compressions.push_back(compression);
+  }
+
+  if (compressions.empty()) {
+    return Error("Missing compressions in flag '--compressions'");
+  }
+
+  // The paths of the local replicas, if any, besides the log itself.
+  vector<string> paths;
+  if (flags.servers.isNone()) {
+    for (size_t i = 1; i < 2 * flags.quorum.get() - 1; i++) {
+      paths.push_back(flags.path.get() + "." + stringify(i));
+    }
+  }
 
-    Try<Nothing> execution = initialize.execute();
-    if (execution.isError()) {
-      return Error(execution.error());
+  // Initialize the log (and the local replicas).
+  if (flags.initialize) {
+    vector<string> initializing = paths;
+    initializing.push_back(flags.path.get());
+
+    foreach (const string& path, initializing) {
+      Initialize initialize;
+      initialize.flags.path = path;
+      initialize.flags.storage = flags.storage;
+
+      Try<Nothing> execution = initialize.execute();
+      if (execution.isError()) {
+        return Error(execution.error());
+      }
     }
   }
 
+  vector<Owned<Replica> > replicas;
+  set<UPID> pids;
+  foreach (const string& path, paths) {
+    Owned<Replica> replica(new Replica(path, flags.storage));
+    replicas.push_back(replica);
+    pids.insert(replica->pid());
+  }
+
   // Create the log.
-  Log log(
-      flags.quorum.get(),
-      flags.path.get(),
-      flags.servers.get(),
-      Seconds(10),
-      flags.znode.get());
-
-  // Create the log writer.
-  Log::Writer writer(&log);
-
-  Future<Option<Log::Position> > position = writer.start();
-
-  if (!position.await(Seconds(15))) {
-    return Error("Failed to start a log writer: timed out");
-  } else if (!position.isReady()) {
-    return Error("Failed to start a log writer: " +
-                 (position.isFailed()
-                  ? position.failure()
-                  : "Discarded future"));
+  Owned<Log> log;
+  if (flags.servers.isSome()) {
+    log.reset(new Log(
+        flags.quorum.get(),
+        flags.path.get(),
+        flags.servers.get(),
+        Seconds(10),
+        flags.znode.get(),
+        None(),
+        false,
+        flags.storage));
+  } else {
+    log.reset(new Log(
+        flags.quorum.get(),
+        flags.path.get(),
+        pids,
+        false,
+        flags.storage));
   }
 
-  // Statistics to output.
+  // Read sizes from the input trace file.
   vector<Bytes> sizes;
-  vector<Duration> durations;
-  vector<Time> timestamps;
 
-  // Read sizes from the input trace file.
   ifstream input(flags.input.get().c_str());
   if (!input.is_open()) {
     return Error("Failed to open the trace file " + flags.input.get());
@@ -220,55 +303,137 @@ Try<Nothing> Benchmark::execute(int argc, char** argv)
 
   input.close();
 
+  if (sizes.empty()) {
+    return Error("The trace file " + flags.input.get() + " is empty");
+  }
+
   // Generate the data to be written.
   vector<string> data;
   for (size_t i = 0; i < sizes.size(); i++) {
     if (flags.type == "one") {
       data.push_back(string(sizes[i].bytes(), 255));
     } else if (flags.type == "random") {
-      data.push_back(string(sizes[i].bytes(), ::random() % 256));
+      string bytes(sizes[i].bytes(), 0);
+      for (size_t j = 0; j < bytes.size(); j++) {
+        bytes[j] = ::random() % 256;
+      }
+      data.push_back(bytes);
     } else {
       data.push_back(string(sizes[i].bytes(), 0));
     }
   }
 
-  Stopwatch stopwatch;
-  stopwatch.start();
-
-  for (size_t i = 0; i < sizes.size(); i++) {
-    Stopwatch stopwatch;
-    stopwatch.start();
-
-    position = writer.append(data[i]);
-
-    if (position.await(Seconds(10))) {
-      return Error("Failed to append: timed out");
-    } else if (!position.isReady()) {
-      return Error("Failed to append: " +
-                   (position.isFailed()
-                    ? position.failure()
-                    : "Discarded future"));
-    } else if (position.get().isNone()) {
-      return Error("Failed to append: exclusive write promise lost");
-    }
-
-    durations.push_back(stopwatch.elapsed());
-    timestamps.push_back(Clock::now());
+  // The total number of bytes appended by each replay of the trace.
+  Bytes total;
+  foreach (const Bytes& size, sizes) {
+    total += size;
   }
 
-  cout << "Total number of appends: " << sizes.size() << endl;
-  cout << "Total time used: " << stopwatch.elapsed() << endl;
-
-  // Ouput statistics.
   ofstream output(flags.output.get().c_str());
   if (!output.is_open()) {
     return Error("Failed to open the output file " + flags.output.get());
   }
 
-  for (size_t i = 0; i < sizes.size(); i++) {
-    output << timestamps[i]
-           << " Appended " << sizes[i].bytes() << " bytes"
-           << " in " << durations[i].ms() << " ms" << endl;
+  foreach (const string& compression, compressions) {
+    foreach (size_t window, windows) {
+      // Create the log writer. A new writer is elected for each window.
+      Log::Writer writer(log.get(), window, compression == "gzip");
+
+      Future<Option<Log::Position> > position = writer.start();
+
+      if (!position.await(Seconds(15))) {
+        return Error("Failed to start a log writer: timed out");
+      } else if (!position.isReady()) {
+        return Error("Failed to start a log writer: " +
+                     (position.isFailed()
+                      ? position.failure()
+                      : "Discarded future"));
+      } else if (position.get().isNone()) {
+        return Error("Failed to start a log writer: exclusive write promise"
+                     " not attained");
+      }
+
+      // Statistics to output.
+      vector<Duration> durations;
+      vector<Time> timestamps;
+
+      // Used to report how much the log grows on the disk.
+      Try<Bytes> before = os::du(flags.path.get());
+      if (before.isError()) {
+        return Error(
+            "Failed to get the disk usage of the log: " + before.error());
+      }
+
+      // The appends in progress along with the time they were started.
+      // The writer completes the appends in order so waiting for the
+      // oldest append is enough to make room in the window.
+      deque<std::pair<Future<Option<Log::Position> >, Stopwatch> > appends;
+
+      Stopwatch stopwatch;
+      stopwatch.start();
+
+      for (size_t i = 0; i < sizes.size() || !appends.empty();) {
+        if (i < sizes.size() && appends.size() < window) {
+          Stopwatch watch;
+          watch.start();
+
+          appends.push_back(std::make_pair(writer.append(data[i++]), watch));
+          continue;
+        }
+
+        position = appends.front().first;
+
+        if (!position.await(Seconds(10))) {
+          return Error("Failed to append: timed out");
+        } else if (!position.isReady()) {
+          return Error("Failed to append: " +
+                       (position.isFailed()
+                        ? position.failure()
+                        : "Discarded future"));
+        } else if (position.get().isNone()) {
+          return Error("Failed to append: exclusive write promise lost");
+        }
+
+        durations.push_back(appends.front().second.elapsed());
+        timestamps.push_back(Clock::now());
+
+        appends.pop_front();
+      }
+
+      Duration elapsed = stopwatch.elapsed();
+
+      Try<Bytes> after = os::du(flags.path.get());
+      if (after.isError()) {
+        return Error(
+            "Failed to get the disk usage of the log: " + after.error());
+      }
+
+      // Ouput statistics.
+      for (size_t i = 0; i < sizes.size(); i++) {
+        output << timestamps[i]
+               << " Appended " << sizes[i].bytes() << " bytes"
+               << " in " << durations[i].ms() << " ms"
+               << " with window " << window
+               << " and compression " << compression << endl;
+      }
+
+      std::sort(durations.begin(), durations.end());
+
+      // Note that the disk usage can shrink (e.g., when the storage
+      // compacts its files) so we don't report negative growth.
+      const Bytes written =
+        after.get() > before.get() ? after.get() - before.get() : Bytes(0);
+
+      cout << "Window " << window << ", compression " << compression << ": "
+           << sizes.size() << " appends in " << elapsed << ", "
+           << sizes.size() / elapsed.secs() << " appends/sec, "
+           << total / elapsed.secs() << "/sec"
+           << ", " << total << " appended, " << written << " on disk"
+           << ", latency p50 " << durations[durations.size() * 50 / 100]
+           << ", p90 " << durations[durations.size() * 90 / 100]
+           << ", p99 " << durations[durations.size() * 99 / 100]
+           << ", max " << durations.back() << endl;
+    }
   }
 
   output.close();
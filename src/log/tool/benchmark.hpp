@@ -46,6 +46,9 @@ public:
     Option<std::string> input;
     Option<std::string> output;
     std::string type;
+    std::string windows;
+    std::string compressions;
+    std::string storage;
     bool initialize;
     bool help;
   };
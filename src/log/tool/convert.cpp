@@ -0,0 +1,224 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <iostream>
+#include <list>
+#include <sstream>
+
+#include <process/owned.hpp>
+#include <process/process.hpp>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/interval.hpp>
+#include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+
+#include "log/leveldb.hpp"
+#include "log/segment.hpp"
+#include "log/storage.hpp"
+#include "log/tool/convert.hpp"
+
+#include "logging/logging.hpp"
+
+using namespace process;
+
+using std::cout;
+using std::endl;
+using std::list;
+using std::ostringstream;
+using std::string;
+
+namespace mesos {
+namespace internal {
+namespace log {
+namespace tool {
+
+// The number of actions that are written to the new log at once.
+static const size_t BATCH_SIZE = 1024;
+
+
+Convert::Flags::Flags()
+{
+  add(&Flags::from,
+      "from",
+      "Path to the existing log");
+
+  add(&Flags::to,
+      "to",
+      "Path to the new log (must not exist)");
+
+  add(&Flags::storage,
+      "storage",
+      "Storage used for the new log (leveldb, segment)",
+      "segment");
+
+  add(&Flags::help,
+      "help",
+      "Prints the help message",
+      false);
+}
+
+
+string Convert::usage(const string& argv0) const
+{
+  ostringstream out;
+
+  out << "Usage: " << argv0 << " " << name() << " [OPTIONS]" << endl
+      << endl
+      << "This command is used to copy the log of a replica to a" << endl
+      << "new log which uses the specified storage. The replica" << endl
+      << "must not be running. The new log can then be used in" << endl
+      << "place of the existing one." << endl
+      << endl
+      << "Supported OPTIONS:" << endl
+      << flags.usage();
+
+  return out.str();
+}
+
+
+Try<Nothing> Convert::execute(int argc, char** argv)
+{
+  // Configure the tool by parsing command line arguments.
+  if (argc > 0 && argv != NULL) {
+    Try<Nothing> load = flags.load(None(), argc, argv);
+    if (load.isError()) {
+      return Error(load.error() + "\n\n" + usage(argv[0]));
+    }
+
+    if (flags.help) {
+      return Error(usage(argv[0]));
+    }
+
+    process::initialize();
+    logging::initialize(argv[0], flags);
+  }
+
+  if (flags.from.isNone()) {
+    return Error("Missing flag: '--from'");
+  }
+
+  if (flags.to.isNone()) {
+    return Error("Missing flag: '--to'");
+  }
+
+  if (flags.storage != "leveldb" && flags.storage != "segment") {
+    return Error("Unknown storage '" + flags.storage + "'");
+  }
+
+  if (!LevelDBStorage::exists(flags.from.get()) &&
+      !SegmentStorage::exists(flags.from.get())) {
+    return Error("No log found at '" + flags.from.get() + "'");
+  }
+
+  if (os::exists(flags.to.get())) {
+    return Error("'" + flags.to.get() + "' already exists");
+  }
+
+  // The storage of the existing log is determined by its contents.
+  Try<Storage*> create = Storage::create(flags.from.get(), "leveldb");
+  if (create.isError()) {
+    return Error(create.error());
+  }
+
+  Owned<Storage> from(create.get());
+
+  Try<Storage::State> state = from->restore(flags.from.get());
+  if (state.isError()) {
+    return Error("Failed to restore the existing log: " + state.error());
+  }
+
+  create = Storage::create(flags.to.get(), flags.storage);
+  if (create.isError()) {
+    return Error(create.error());
+  }
+
+  Owned<Storage> to(create.get());
+
+  Try<Storage::State> restore = to->restore(flags.to.get());
+  if (restore.isError()) {
+    return Error("Failed to create the new log: " + restore.error());
+  }
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  Try<Nothing> persist = to->persist(state.get().metadata);
+  if (persist.isError()) {
+    return Error("Failed to write the metadata: " + persist.error());
+  }
+
+  // Copy all the positions that have been written (learned or not)
+  // and not truncated. Note that we iterate over the intervals rather
+  // than the positions since the log might have many holes.
+  IntervalSet<uint64_t> positions = state.get().learned;
+  positions += state.get().unlearned;
+  positions -= (Bound<uint64_t>::closed(0),
+                Bound<uint64_t>::open(state.get().begin));
+
+  uint64_t copied = 0;
+  list<Action> actions;
+
+  foreach (const Interval<uint64_t>& interval, positions) {
+    for (uint64_t position = interval.lower();
+         position < interval.upper();
+         position++) {
+      Try<Action> action = from->read(position);
+      if (action.isError()) {
+        return Error("Failed to read position " + stringify(position) +
+                     ": " + action.error());
+      }
+
+      actions.push_back(action.get());
+
+      if (actions.size() == BATCH_SIZE) {
+        persist = to->persist(actions);
+        if (persist.isError()) {
+          return Error("Failed to write: " + persist.error());
+        }
+
+        copied += actions.size();
+        actions.clear();
+      }
+    }
+  }
+
+  if (!actions.empty()) {
+    persist = to->persist(actions);
+    if (persist.isError()) {
+      return Error("Failed to write: " + persist.error());
+    }
+
+    copied += actions.size();
+  }
+
+  cout << "Copied " << copied << " positions (" << state.get().begin
+       << " -> " << state.get().end << ") to the " << flags.storage
+       << " storage in " << stopwatch.elapsed() << endl;
+
+  return Nothing();
+}
+
+} // namespace tool {
+} // namespace log {
+} // namespace internal {
+} // namespace mesos {
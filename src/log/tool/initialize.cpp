@@ -51,6 +51,11 @@ Initialize::Flags::Flags()
       "Maximum time allowed for the command to finish\n"
       "(e.g., 500ms, 1sec, etc.)");
 
+  add(&Flags::storage,
+      "storage",
+      "Storage used for a new log (leveldb, segment)",
+      "leveldb");
+
   add(&Flags::help,
       "help",
       "Prints the help message",
@@ -100,7 +105,11 @@ Try<Nothing> Initialize::execute(int argc, char** argv)
     timeout = Timeout::in(flags.timeout.get());
   }
 
-  Replica replica(flags.path.get());
+  if (flags.storage != "leveldb" && flags.storage != "segment") {
+    return Error("Unknown storage '" + flags.storage + "'");
+  }
+
+  Replica replica(flags.path.get(), flags.storage);
 
   // Get the current status of the replica.
   Future<Metadata::Status> status = replica.status();
@@ -42,6 +42,7 @@ public:
 
     Option<std::string> path;
     Option<Duration> timeout;
+    std::string storage;
     bool help;
   };
 
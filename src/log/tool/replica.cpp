@@ -59,6 +59,11 @@ Replica::Flags::Flags()
       "znode",
       "ZooKeeper znode");
 
+  add(&Flags::storage,
+      "storage",
+      "Storage used for a new log (leveldb, segment)",
+      "leveldb");
+
   add(&Flags::initialize,
       "initialize",
       "Whether to initialize the log",
@@ -123,6 +128,7 @@ Try<Nothing> Replica::execute(int argc, char** argv)
   if (flags.initialize) {
     Initialize initialize;
     initialize.flags.path = flags.path;
+    initialize.flags.storage = flags.storage;
 
     Try<Nothing> execution = initialize.execute();
     if (execution.isError()) {
@@ -136,7 +142,10 @@ Try<Nothing> Replica::execute(int argc, char** argv)
       flags.path.get(),
       flags.servers.get(),
       Seconds(10),
-      flags.znode.get());
+      flags.znode.get(),
+      None(),
+      false,
+      flags.storage);
 
   // Loop forever.
   Future<Nothing>().get();
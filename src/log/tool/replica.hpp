@@ -46,6 +46,7 @@ public:
     Option<std::string> path;
     Option<std::string> servers;
     Option<std::string> znode;
+    std::string storage;
     bool initialize;
     bool help;
   };
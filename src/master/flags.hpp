@@ -117,6 +117,15 @@ public:
         "after which the operation is considered a failure.",
         Seconds(5));
 
+    add(&Flags::registry_max_deltas,
+        "registry_max_deltas",
+        "Maximum number of registry updates that are stored as deltas (only\n"
+        "the changes) before the entire registry is stored again. Setting\n"
+        "this to 0 stores the entire registry on every update, which is\n"
+        "required before downgrading to a master that does not know about\n"
+        "deltas.",
+        1000);
+
     add(&Flags::log_auto_initialize,
         "log_auto_initialize",
         "Whether to automatically initialize the replicated log used for the\n"
@@ -124,6 +133,14 @@ public:
         "initialized when used for the very first time.",
         true);
 
+    add(&Flags::log_storage,
+        "log_storage",
+        "The storage used by the replicated log for the registry, either\n"
+        "'leveldb' or 'segment' (append-only segment files). This only\n"
+        "applies to new logs, an existing log keeps using the storage it\n"
+        "was written with (see 'mesos-log convert').",
+        "leveldb");
+
     add(&Flags::slave_reregister_timeout,
         "slave_reregister_timeout",
         "The timeout within which all slaves are expected to re-register\n"
@@ -387,7 +404,9 @@ public:
   bool registry_strict;
   Duration registry_fetch_timeout;
   Duration registry_store_timeout;
+  size_t registry_max_deltas;
   bool log_auto_initialize;
+  std::string log_storage;
   Duration slave_reregister_timeout;
   std::string recovery_slave_removal_limit;
   Option<std::string> slave_removal_rate_limit;
@@ -209,6 +209,11 @@ int main(int argc, char** argv)
       EXIT(1) << "--work_dir needed for replicated log based registry";
     }
 
+    if (flags.log_storage != "leveldb" && flags.log_storage != "segment") {
+      EXIT(1) << "'" << flags.log_storage << "' is not a supported"
+              << " option for --log_storage";
+    }
+
     Try<Nothing> mkdir = os::mkdir(flags.work_dir.get());
     if (mkdir.isError()) {
       EXIT(1) << "Failed to create work directory '" << flags.work_dir.get()
@@ -234,14 +239,16 @@ int main(int argc, char** argv)
           flags.zk_session_timeout,
           path::join(url.get().path, "log_replicas"),
           url.get().authentication,
-          flags.log_auto_initialize);
+          flags.log_auto_initialize,
+          flags.log_storage);
     } else {
       // Use replicated log without ZooKeeper.
       log = new Log(
           1,
           path::join(flags.work_dir.get(), "replicated_log"),
           set<UPID>(),
-          flags.log_auto_initialize);
+          flags.log_auto_initialize,
+          flags.log_storage);
     }
     storage = new state::LogStorage(log);
   } else {
@@ -16,11 +16,16 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <deque>
+#include <list>
+#include <set>
 #include <string>
+#include <vector>
 
 #include <mesos/type_utils.hpp>
 
+#include <process/collect.hpp>
 #include <process/defer.hpp>
 #include <process/dispatch.hpp>
 #include <process/future.hpp>
@@ -34,12 +39,15 @@
 #include <process/metrics/metrics.hpp>
 #include <process/metrics/timer.hpp>
 
+#include <stout/foreach.hpp>
+#include <stout/hashset.hpp>
 #include <stout/lambda.hpp>
 #include <stout/none.hpp>
 #include <stout/nothing.hpp>
 #include <stout/option.hpp>
 #include <stout/protobuf.hpp>
 #include <stout/stopwatch.hpp>
+#include <stout/strings.hpp>
 
 #include "master/registrar.hpp"
 #include "master/registry.hpp"
@@ -70,7 +78,10 @@ using process::metrics::Gauge;
 using process::metrics::Timer;
 
 using std::deque;
+using std::list;
+using std::set;
 using std::string;
+using std::vector;
 
 namespace mesos {
 namespace internal {
@@ -79,6 +90,11 @@ namespace master {
 using process::http::Response;
 using process::http::Request;
 
+// The deltas are stored in the variables named with this prefix
+// followed by their sequence number.
+static const string DELTA_PREFIX = "registry.delta.";
+
+
 class RegistrarProcess : public Process<RegistrarProcess>
 {
 public:
@@ -87,7 +103,9 @@ public:
       metrics(*this),
       updating(false),
       flags(_flags),
-      state(_state) {}
+      state(_state),
+      sequence(0),
+      expunging(Nothing()) {}
 
   virtual ~RegistrarProcess() {}
 
@@ -171,8 +189,8 @@ private:
 
   Future<double> _registry_size_bytes()
   {
-    if (variable.isSome()) {
-      return variable.get().get().ByteSize();
+    if (current.isSome()) {
+      return current.get().ByteSize();
     }
 
     return Failure("Not recovered yet");
@@ -181,29 +199,78 @@ private:
   // Continuations.
   void _recover(
       const MasterInfo& info,
-      const Future<Variable<Registry> >& recovery);
+      const Future<Nothing>& recovery);
   void __recover(const Future<bool>& recover);
   Future<bool> _apply(Owned<Operation> operation);
 
+  // Helpers for fetching the snapshot of the registry along with the
+  // deltas stored since, which are replayed on top of it.
+  Future<Nothing> fetch(const Variable<Registry>& snapshot);
+  Future<Nothing> _fetch(const set<string>& names);
+  Future<Nothing> __fetch(const list<Variable<RegistryDelta> >& deltas);
+
   // Helper for updating state (performing store).
   void update();
   void _update(
-      const Future<Option<Variable<Registry> > >& store,
+      const Future<bool>& store,
+      const Registry& registry,
       deque<Owned<Operation> > operations);
 
+  // Returns false if another registrar has replaced this one, i.e.,
+  // has stored a snapshot past the deltas of this registrar (see
+  // 'fence').
+  Future<bool> fence();
+
+  // Helpers for storing the entire registry, after which the deltas
+  // that are now part of it get expunged. The registry is only stored
+  // if this registrar was not replaced and the variable of the next
+  // delta is empty, otherwise another registrar has stored it.
+  Future<bool> snapshot(const Registry& registry);
+  Future<bool> _snapshot(const Registry& registry, bool fenced);
+  Future<bool> __snapshot(
+      const Registry& registry,
+      const Variable<RegistryDelta>& next);
+  Future<bool> ___snapshot(const Option<Variable<Registry> >& variable);
+
+  // Helpers for storing a delta. A delta is only stored if this
+  // registrar was not replaced and if its variable is empty,
+  // otherwise another registrar has stored it already.
+  Future<bool> store(const RegistryDelta& delta);
+  Future<bool> _store(const RegistryDelta& delta, bool fenced);
+  Future<bool> __store(
+      const RegistryDelta& delta,
+      const Variable<RegistryDelta>& variable);
+  Future<bool> ___store(const Option<Variable<RegistryDelta> >& variable);
+
   // Fails all pending operations and transitions the Registrar
   // into an error state in which all subsequent operations will fail.
   // This ensures we don't attempt to re-acquire log leadership by
   // performing more State storage operations.
   void abort(const string& message);
 
-  Option<Variable<Registry> > variable;
+  // The current registry, i.e., the last snapshot with the deltas
+  // stored since applied.
+  Option<Registry> current;
+
+  Option<Variable<Registry> > variable; // The last snapshot.
+  list<Variable<RegistryDelta> > deltas; // Stored since the snapshot.
+
   deque<Owned<Operation> > operations;
   bool updating; // Used to signify fetching (recovering) or storing.
 
   const Flags flags;
   State* state;
 
+  // The sequence number of the last stored delta, or of the last
+  // delta that is part of the snapshot if none were stored since.
+  uint64_t sequence;
+
+  // Expunges the deltas that are part of a snapshot one after the
+  // other. The deltas that are not expunged (e.g., because this fails
+  // or the master fails over) are skipped when recovering since the
+  // snapshot records the last delta it covers.
+  Future<Nothing> expunging;
+
   // Used to compose our operations with recovery.
   Option<Owned<Promise<Registry> > > recovered;
 
@@ -227,6 +294,96 @@ Future<T> timeout(
 }
 
 
+// Helper for replaying a delta on top of the registry (and the
+// accumulator of slave IDs in the registry).
+void replay(
+    const RegistryDelta& delta,
+    Registry* registry,
+    hashset<SlaveID>* slaveIDs)
+{
+  if (delta.has_master()) {
+    registry->mutable_master()->CopyFrom(delta.master());
+  }
+
+  // An admitted slave replaces the slave with the same ID, if any.
+  hashset<SlaveID> removed;
+
+  foreach (const SlaveID& slaveId, delta.removed()) {
+    if (slaveIDs->contains(slaveId)) {
+      removed.insert(slaveId);
+    }
+  }
+
+  foreach (const Registry::Slave& slave, delta.admitted()) {
+    if (slaveIDs->contains(slave.info().id())) {
+      removed.insert(slave.info().id());
+    }
+  }
+
+  if (!removed.empty()) {
+    // Remove the slaves in a single pass, preserving the order.
+    google::protobuf::RepeatedPtrField<Registry::Slave>* slaves =
+      registry->mutable_slaves()->mutable_slaves();
+
+    int size = 0;
+    for (int i = 0; i < slaves->size(); i++) {
+      if (!removed.contains(slaves->Get(i).info().id())) {
+        slaves->SwapElements(i, size++);
+      }
+    }
+
+    while (slaves->size() > size) {
+      slaves->RemoveLast();
+    }
+
+    foreach (const SlaveID& slaveId, removed) {
+      slaveIDs->erase(slaveId);
+    }
+  }
+
+  foreach (const Registry::Slave& slave, delta.admitted()) {
+    registry->mutable_slaves()->add_slaves()->CopyFrom(slave);
+    slaveIDs->insert(slave.info().id());
+  }
+}
+
+
+// Helpers for expunging a delta (see RegistrarProcess::expunging). A
+// delta that is already gone has been expunged by another registrar.
+Nothing _expunge(bool expunged)
+{
+  return Nothing();
+}
+
+
+Future<Nothing> expunge(State* state, const Variable<RegistryDelta>& delta)
+{
+  return state->expunge(delta)
+    .then(lambda::bind(&_expunge, lambda::_1));
+}
+
+
+// Logs a failure to expunge the deltas and recovers from it, so that
+// the deltas of the next snapshot get expunged. The deltas that are
+// left behind are skipped when recovering.
+Future<Nothing> expungeFailed(const Future<Nothing>& future)
+{
+  LOG(WARNING) << "Failed to expunge the registry deltas that are part of "
+               << "the snapshot: " << future.failure();
+
+  return Nothing();
+}
+
+
+// Helper for ordering deltas by their sequence numbers.
+bool sequenced(
+    const Variable<RegistryDelta>& left,
+    const Variable<RegistryDelta>& right)
+{
+  return left.get().sequence() < right.get().sequence();
+}
+
+
 // Helper for failing a deque of operations.
 void fail(deque<Owned<Operation> >* operations, const string& message)
 {
@@ -243,8 +400,8 @@ Future<Response> RegistrarProcess::registry(const Request& request)
 {
   JSON::Object result;
 
-  if (variable.isSome()) {
-    result = JSON::Protobuf(variable.get().get());
+  if (current.isSome()) {
+    result = JSON::Protobuf(current.get());
   }
 
   return OK(result, request.query.get("jsonp"));
@@ -314,9 +471,10 @@ Future<Registry> RegistrarProcess::recover(const MasterInfo& info)
 
     metrics.state_fetch.start();
     state->fetch<Registry>("registry")
+      .then(defer(self(), &Self::fetch, lambda::_1))
       .after(flags.registry_fetch_timeout,
              lambda::bind(
-                 &timeout<Variable<Registry> >,
+                 &timeout<Nothing>,
                  "fetch",
                  flags.registry_fetch_timeout,
                  lambda::_1))
@@ -329,9 +487,80 @@ Future<Registry> RegistrarProcess::recover(const MasterInfo& info)
 }
 
 
+Future<Nothing> RegistrarProcess::fetch(const Variable<Registry>& snapshot)
+{
+  variable = snapshot;
+
+  return state->names()
+    .then(defer(self(), &Self::_fetch, lambda::_1));
+}
+
+
+Future<Nothing> RegistrarProcess::_fetch(const set<string>& names)
+{
+  list<Future<Variable<RegistryDelta> > > futures;
+
+  foreach (const string& name, names) {
+    if (strings::startsWith(name, DELTA_PREFIX)) {
+      futures.push_back(state->fetch<RegistryDelta>(name));
+    }
+  }
+
+  return collect(futures)
+    .then(defer(self(), &Self::__fetch, lambda::_1));
+}
+
+
+Future<Nothing> RegistrarProcess::__fetch(
+    const list<Variable<RegistryDelta> >& _deltas)
+{
+  vector<Variable<RegistryDelta> > sorted(_deltas.begin(), _deltas.end());
+  std::sort(sorted.begin(), sorted.end(), sequenced);
+
+  Registry registry = variable.get().get();
+
+  // Continue numbering the deltas after those that are part of the
+  // snapshot, even if they have all been expunged.
+  sequence = registry.sequence();
+
+  hashset<SlaveID> slaveIDs;
+  foreach (const Registry::Slave& slave, registry.slaves().slaves()) {
+    slaveIDs.insert(slave.info().id());
+  }
+
+  foreach (const Variable<RegistryDelta>& delta, sorted) {
+    if (!delta.get().has_sequence()) {
+      continue; // Expunged since we got its name.
+    }
+
+    // A delta that is part of the snapshot has not been expunged yet
+    // or was stored by a registrar that had been replaced (see
+    // 'store'); either way it must not be replayed.
+    if (delta.get().sequence() <= registry.sequence()) {
+      expunging = expunging
+        .then(lambda::bind(&expunge, state, delta));
+      continue;
+    }
+
+    replay(delta.get(), &registry, &slaveIDs);
+
+    // Keep the delta around to expunge it with the next snapshot.
+    deltas.push_back(delta);
+    sequence = delta.get().sequence();
+  }
+
+  expunging = expunging
+    .repair(lambda::bind(&expungeFailed, lambda::_1));
+
+  current = registry;
+
+  return Nothing();
+}
+
+
 void RegistrarProcess::_recover(
     const MasterInfo& info,
-    const Future<Variable<Registry> >& recovery)
+    const Future<Nothing>& recovery)
 {
   updating = false;
 
@@ -344,11 +573,8 @@ void RegistrarProcess::_recover(
     Duration elapsed = metrics.state_fetch.stop();
 
     LOG(INFO) << "Successfully fetched the registry"
-              << " (" << Bytes(recovery.get().get().ByteSize()) << ")"
-              << " in " << elapsed;
-
-    // Save the registry.
-    variable = recovery.get();
+              << " (" << Bytes(current.get().ByteSize()) << ")"
+              << " with " << deltas.size() << " deltas in " << elapsed;
 
     // Perform the Recover operation to add the new MasterInfo.
     Owned<Operation> operation(new Recover(info));
@@ -375,11 +601,11 @@ void RegistrarProcess::__recover(const Future<bool>& recover)
   } else {
     LOG(INFO) << "Successfully recovered registrar";
 
-    // At this point _update() has updated 'variable' to contain
+    // At this point _update() has updated 'current' to contain
     // the Registry with the latest MasterInfo.
     // Set the promise and un-gate any pending operations.
-    CHECK_SOME(variable);
-    recovered.get()->set(variable.get().get());
+    CHECK_SOME(current);
+    recovered.get()->set(current.get());
   }
 }
 
@@ -401,7 +627,7 @@ Future<bool> RegistrarProcess::_apply(Owned<Operation> operation)
     return Failure(error.get());
   }
 
-  CHECK_SOME(variable);
+  CHECK_SOME(current);
 
   operations.push_back(operation);
   Future<bool> future = operation->future();
@@ -420,7 +646,7 @@ void RegistrarProcess::update()
 
   CHECK(!updating);
   CHECK(error.isNone());
-  CHECK_SOME(variable);
+  CHECK_SOME(current);
 
   // Time how long it takes to apply the operations.
   Stopwatch stopwatch;
@@ -429,7 +655,8 @@ void RegistrarProcess::update()
   updating = true;
 
   // Create a snapshot of the current registry.
-  Registry registry = variable.get().get();
+  const Registry& original = current.get();
+  Registry registry = original;
 
   // Create the 'slaveIDs' accumulator.
   hashset<SlaveID> slaveIDs;
@@ -437,9 +664,53 @@ void RegistrarProcess::update()
     slaveIDs.insert(slave.info().id());
   }
 
+  // Operations only ever append slaves to the registry or remove
+  // slaves from it, which lets us determine the delta without
+  // comparing the slaves: we remember which slaves got appended.
+  hashset<SlaveID> appended;
+  bool removed = false;
+
   foreach (Owned<Operation> operation, operations) {
+    const int size = registry.slaves().slaves().size();
+
     // No need to process the result of the operation.
     (*operation)(&registry, &slaveIDs, flags.registry_strict);
+
+    for (int i = size; i < registry.slaves().slaves().size(); i++) {
+      appended.insert(registry.slaves().slaves(i).info().id());
+    }
+
+    removed = removed || registry.slaves().slaves().size() < size;
+  }
+
+  RegistryDelta delta;
+
+  if (registry.master().SerializeAsString() !=
+      original.master().SerializeAsString()) {
+    delta.mutable_master()->CopyFrom(registry.master());
+  }
+
+  // The slaves of the original registry that are still in the
+  // registry come first, in the same order.
+  int kept = original.slaves().slaves().size();
+
+  if (removed) {
+    kept = 0;
+    foreach (const Registry::Slave& slave, original.slaves().slaves()) {
+      const SlaveID& slaveId = slave.info().id();
+
+      if (kept < registry.slaves().slaves().size() &&
+          registry.slaves().slaves(kept).info().id() == slaveId &&
+          !appended.contains(slaveId)) {
+        kept++;
+      } else {
+        delta.add_removed()->CopyFrom(slaveId);
+      }
+    }
+  }
+
+  for (int i = kept; i < registry.slaves().slaves().size(); i++) {
+    delta.add_admitted()->CopyFrom(registry.slaves().slaves(i));
   }
 
   LOG(INFO) << "Applied " << operations.size() << " operations in "
@@ -447,14 +718,25 @@ void RegistrarProcess::update()
 
   // Perform the store, and time the operation.
   metrics.state_store.start();
-  state->store(variable.get().mutate(registry))
+
+  Future<bool> store;
+
+  if (deltas.size() >= flags.registry_max_deltas) {
+    registry.set_sequence(sequence);
+    store = snapshot(registry);
+  } else {
+    delta.set_sequence(sequence + 1);
+    store = this->store(delta);
+  }
+
+  store
     .after(flags.registry_store_timeout,
            lambda::bind(
-               &timeout<Option<Variable<Registry> > >,
+               &timeout<bool>,
                "store",
                flags.registry_store_timeout,
                lambda::_1))
-    .onAny(defer(self(), &Self::_update, lambda::_1, operations));
+    .onAny(defer(self(), &Self::_update, lambda::_1, registry, operations));
 
   // Clear the operations, _update will transition the Promises!
   operations.clear();
@@ -462,13 +744,14 @@ void RegistrarProcess::update()
 
 
 void RegistrarProcess::_update(
-    const Future<Option<Variable<Registry> > >& store,
+    const Future<bool>& store,
+    const Registry& registry,
     deque<Owned<Operation> > applied)
 {
   updating = false;
 
   // Abort if the storage operation did not succeed.
-  if (!store.isReady() || store.get().isNone()) {
+  if (!store.isReady() || !store.get()) {
     string message = "Failed to update 'registry': ";
 
     if (store.isFailed()) {
@@ -489,7 +772,7 @@ void RegistrarProcess::_update(
 
   LOG(INFO) << "Successfully updated the 'registry' in " << elapsed;
 
-  variable = store.get().get();
+  current = registry;
 
   // Remove the operations.
   while (!applied.empty()) {
@@ -505,6 +788,150 @@ void RegistrarProcess::_update(
 }
 
 
+// Helpers for checking that the snapshot (respectively the last delta)
+// of a registrar has not been replaced by another registrar.
+bool snapshotted(uint64_t sequence, const Variable<Registry>& snapshot)
+{
+  return snapshot.get().sequence() == sequence;
+}
+
+
+bool stored(uint64_t sequence, const Variable<RegistryDelta>& delta)
+{
+  return delta.get().has_sequence() && delta.get().sequence() == sequence;
+}
+
+
+Future<bool> RegistrarProcess::fence()
+{
+  // Another registrar that took over from this one (e.g., while the
+  // master does not know yet that it lost its leadership) stores its
+  // own deltas, which makes this one fail to store the next delta or
+  // snapshot, until it stores a snapshot and expunges the deltas. The
+  // slot of the next delta might be empty again then, so check that
+  // the last delta of this registrar is still there or, if there is
+  // none since the snapshot, that the snapshot was not replaced. Note
+  // that this only costs fetching the snapshot once every
+  // 'registry_max_deltas' updates.
+  if (deltas.empty()) {
+    CHECK_SOME(current);
+
+    return state->fetch<Registry>("registry")
+      .then(lambda::bind(&snapshotted, current.get().sequence(), lambda::_1));
+  }
+
+  return state->fetch<RegistryDelta>(DELTA_PREFIX + stringify(sequence))
+    .then(lambda::bind(&stored, sequence, lambda::_1));
+}
+
+
+Future<bool> RegistrarProcess::snapshot(const Registry& registry)
+{
+  return fence()
+    .then(defer(self(), &Self::_snapshot, registry, lambda::_1));
+}
+
+
+Future<bool> RegistrarProcess::_snapshot(
+    const Registry& registry,
+    bool fenced)
+{
+  if (!fenced) {
+    return false; // Replaced by another registrar.
+  }
+
+  // The version of the snapshot doesn't change when another registrar
+  // only stores deltas (e.g., its Recover operation), so we also need
+  // to check that the next delta has not been stored.
+  return state->fetch<RegistryDelta>(DELTA_PREFIX + stringify(sequence + 1))
+    .then(defer(self(), &Self::__snapshot, registry, lambda::_1));
+}
+
+
+Future<bool> RegistrarProcess::__snapshot(
+    const Registry& registry,
+    const Variable<RegistryDelta>& next)
+{
+  if (next.get().has_sequence()) {
+    return false; // Stored by another registrar.
+  }
+
+  CHECK_SOME(variable);
+
+  return state->store(variable.get().mutate(registry))
+    .then(defer(self(), &Self::___snapshot, lambda::_1));
+}
+
+
+Future<bool> RegistrarProcess::___snapshot(
+    const Option<Variable<Registry> >& _variable)
+{
+  if (_variable.isNone()) {
+    return false; // Version mismatch.
+  }
+
+  variable = _variable.get();
+
+  // The deltas are part of the snapshot now.
+  foreach (const Variable<RegistryDelta>& delta, deltas) {
+    expunging = expunging
+      .then(lambda::bind(&expunge, state, delta));
+  }
+
+  expunging = expunging
+    .repair(lambda::bind(&expungeFailed, lambda::_1));
+
+  deltas.clear();
+
+  return true;
+}
+
+
+Future<bool> RegistrarProcess::store(const RegistryDelta& delta)
+{
+  return fence()
+    .then(defer(self(), &Self::_store, delta, lambda::_1));
+}
+
+
+Future<bool> RegistrarProcess::_store(const RegistryDelta& delta, bool fenced)
+{
+  if (!fenced) {
+    return false; // Replaced by another registrar.
+  }
+
+  return state->fetch<RegistryDelta>(DELTA_PREFIX + stringify(delta.sequence()))
+    .then(defer(self(), &Self::__store, delta, lambda::_1));
+}
+
+
+Future<bool> RegistrarProcess::__store(
+    const RegistryDelta& delta,
+    const Variable<RegistryDelta>& variable)
+{
+  if (variable.get().has_sequence()) {
+    return false; // Stored by another registrar.
+  }
+
+  return state->store(variable.mutate(delta))
+    .then(defer(self(), &Self::___store, lambda::_1));
+}
+
+
+Future<bool> RegistrarProcess::___store(
+    const Option<Variable<RegistryDelta> >& variable)
+{
+  if (variable.isNone()) {
+    return false; // Version mismatch.
+  }
+
+  deltas.push_back(variable.get());
+  sequence = variable.get().get().sequence();
+
+  return true;
+}
+
+
 void RegistrarProcess::abort(const string& message)
 {
   error = Error(message);
@@ -36,6 +36,8 @@ const Duration REGISTRATION_BACKOFF_FACTOR = Seconds(1);
 const Duration REGISTER_RETRY_INTERVAL_MAX = Minutes(1);
 const Duration GC_DELAY = Weeks(1);
 const double GC_DISK_HEADROOM = 0.1;
+const size_t GC_MAX_CONCURRENT_REMOVALS = 2;
+const Bytes GC_REMOVAL_RATE = Megabytes(512);
 const Duration DISK_WATCH_INTERVAL = Minutes(1);
 const Duration RECOVERY_TIMEOUT = Minutes(15);
 const Duration RESOURCE_MONITORING_INTERVAL = Seconds(1);
@@ -50,6 +52,7 @@ const std::string DEFAULT_PORTS = "[31000-32000]";
 const uint16_t DEFAULT_EPHEMERAL_PORTS_PER_CONTAINER = 1024;
 #endif
 const Duration DOCKER_REMOVE_DELAY = Hours(6);
+const Bytes DEFAULT_FETCHER_CACHE_SIZE = Gigabytes(2);
 const std::string DEFAULT_AUTHENTICATEE = "crammd5";
 
 Duration MASTER_PING_TIMEOUT()
@@ -61,6 +61,15 @@ extern const Duration REGISTER_RETRY_INTERVAL_MAX;
 // Minimum free disk capacity enforced by the garbage collector.
 extern const double GC_DISK_HEADROOM;
 
+// Default maximum number of paths the garbage collector removes
+// concurrently.
+extern const size_t GC_MAX_CONCURRENT_REMOVALS;
+
+// Default maximum rate, per second, at which the garbage collector
+// reclaims disk space. This smooths out the I/O of removing many
+// paths that are due at the same time.
+extern const Bytes GC_REMOVAL_RATE;
+
 // Maximum number of completed frameworks to store in memory.
 extern const uint32_t MAX_COMPLETED_FRAMEWORKS;
 
@@ -97,6 +106,9 @@ extern const uint16_t DEFAULT_EPHEMERAL_PORTS_PER_CONTAINER;
 // Default duration that docker containers will be removed after exit.
 extern const Duration DOCKER_REMOVE_DELAY;
 
+// Default maximum size of the fetcher cache.
+extern const Bytes DEFAULT_FETCHER_CACHE_SIZE;
+
 // Name of the default, CRAM-MD5 authenticatee.
 extern const std::string DEFAULT_AUTHENTICATEE;
 
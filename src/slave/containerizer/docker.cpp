@@ -35,6 +35,7 @@
 
 #include "common/status_utils.hpp"
 
+#include "docker/daemon.hpp"
 #include "docker/docker.hpp"
 
 #ifdef __linux__
@@ -103,11 +104,125 @@ Option<ContainerID> parse(const Docker::Container& container)
 }
 
 
+// Returns the resource usage of a container read from the cgroups its
+// root process is a member of, or None if the process is not a member
+// of a (non-root) cgroup where the 'cpuacct' and the 'memory'
+// subsystems are mounted.
+static Result<ResourceStatistics> cgroupsStatistics(pid_t pid)
+{
+#ifndef __linux__
+  return None();
+#else
+  // Determine the cgroups hierarchies where the 'cpuacct' and
+  // 'memory' subsystems are mounted (they may be the same). Note that
+  // we make these static so we can reuse the result for subsequent
+  // calls.
+  static Result<string> cpuacctHierarchy = cgroups::hierarchy("cpuacct");
+  static Result<string> memoryHierarchy = cgroups::hierarchy("memory");
+
+  if (cpuacctHierarchy.isError()) {
+    return Error("Failed to determine the cgroup hierarchy "
+                 "where the 'cpuacct' subsystem is mounted: " +
+                 cpuacctHierarchy.error());
+  } else if (memoryHierarchy.isError()) {
+    return Error("Failed to determine the cgroup hierarchy "
+                 "where the 'memory' subsystem is mounted: " +
+                 memoryHierarchy.error());
+  } else if (cpuacctHierarchy.isNone() || memoryHierarchy.isNone()) {
+    return None();
+  }
+
+  Result<string> cpuacctCgroup = cgroups::cpuacct::cgroup(pid);
+  if (cpuacctCgroup.isError()) {
+    return Error("Failed to determine cgroup for the 'cpuacct' subsystem: " +
+                 cpuacctCgroup.error());
+  }
+
+  Result<string> memoryCgroup = cgroups::memory::cgroup(pid);
+  if (memoryCgroup.isError()) {
+    return Error("Failed to determine cgroup for the 'memory' subsystem: " +
+                 memoryCgroup.error());
+  }
+
+  // The root cgroups account for the entire host.
+  if (cpuacctCgroup.isNone() || cpuacctCgroup.get() == "/" ||
+      memoryCgroup.isNone() || memoryCgroup.get() == "/") {
+    return None();
+  }
+
+  ResourceStatistics result;
+
+  // The timestamp is the only required field.
+  result.set_timestamp(Clock::now().secs());
+
+  // Get the number of clock ticks, used for cpu accounting.
+  static long ticks = sysconf(_SC_CLK_TCK);
+
+  PCHECK(ticks > 0) << "Failed to get sysconf(_SC_CLK_TCK)";
+
+  Try<hashmap<string, uint64_t> > stat = cgroups::stat(
+      cpuacctHierarchy.get(),
+      cpuacctCgroup.get(),
+      "cpuacct.stat");
+
+  if (stat.isError()) {
+    return Error("Failed to read cpuacct.stat: " + stat.error());
+  }
+
+  Option<uint64_t> user = stat.get().get("user");
+  Option<uint64_t> system = stat.get().get("system");
+
+  if (user.isSome() && system.isSome()) {
+    result.set_cpus_user_time_secs((double) user.get() / (double) ticks);
+    result.set_cpus_system_time_secs((double) system.get() / (double) ticks);
+  }
+
+  Try<Bytes> usage = cgroups::memory::usage_in_bytes(
+      memoryHierarchy.get(), memoryCgroup.get());
+
+  if (usage.isError()) {
+    return Error("Failed to parse memory.usage_in_bytes: " + usage.error());
+  }
+
+  result.set_mem_rss_bytes(usage.get().bytes());
+
+  stat = cgroups::stat(
+      memoryHierarchy.get(),
+      memoryCgroup.get(),
+      "memory.stat");
+
+  if (stat.isError()) {
+    return Error("Failed to read memory.stat: " + stat.error());
+  }
+
+  Option<uint64_t> total_cache = stat.get().get("total_cache");
+  if (total_cache.isSome()) {
+    result.set_mem_file_bytes(total_cache.get());
+  }
+
+  Option<uint64_t> total_rss = stat.get().get("total_rss");
+  if (total_rss.isSome()) {
+    result.set_mem_anon_bytes(total_rss.get());
+  }
+
+  Option<uint64_t> total_mapped_file = stat.get().get("total_mapped_file");
+  if (total_mapped_file.isSome()) {
+    result.set_mem_mapped_file_bytes(total_mapped_file.get());
+  }
+
+  return result;
+#endif // __linux__
+}
+
+
 Try<DockerContainerizer*> DockerContainerizer::create(
     const Flags& flags,
     Fetcher* fetcher)
 {
-  Try<Docker*> docker = Docker::create(flags.docker);
+  Try<Docker*> docker = flags.docker_socket.isSome()
+    ? DockerDaemon::create(flags.docker, flags.docker_socket.get())
+    : Docker::create(flags.docker);
+
   if (docker.isError()) {
     return Error(docker.error());
   }
@@ -1083,15 +1198,32 @@ Future<ResourceStatistics> DockerContainerizerProcess::__usage(
 {
   Container* container = containers_[containerId];
 
-  // Note that here getting the root pid is enough because
-  // the root process acts as an 'init' process in the docker
-  // container, so no other child processes will escape it.
-  Try<ResourceStatistics> statistics = mesos::internal::usage(pid, true, true);
+  ResourceStatistics result;
+
+  // Docker puts each container into cgroups of its own, so prefer
+  // reading the statistics from those over walking the process tree
+  // of the container in /proc. Like talking to the daemon directly,
+  // this is only done when --docker_socket is set.
+  Result<ResourceStatistics> statistics = None();
+  if (flags.docker_socket.isSome()) {
+    statistics = cgroupsStatistics(pid);
+  }
+
   if (statistics.isError()) {
     return Failure(statistics.error());
-  }
+  } else if (statistics.isSome()) {
+    result = statistics.get();
+  } else {
+    // Note that here getting the root pid is enough because
+    // the root process acts as an 'init' process in the docker
+    // container, so no other child processes will escape it.
+    Try<ResourceStatistics> usage = mesos::internal::usage(pid, true, true);
+    if (usage.isError()) {
+      return Failure(usage.error());
+    }
 
-  ResourceStatistics result = statistics.get();
+    result = usage.get();
+  }
 
   // Set the resource allocations.
   const Resources& resource = container->resources;
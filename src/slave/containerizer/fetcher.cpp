@@ -16,20 +16,33 @@
  * limitations under the License.
  */
 
+#include <sys/stat.h>
+
 #include <mesos/fetcher/fetcher.hpp>
 
+#include <process/async.hpp>
+#include <process/collect.hpp>
 #include <process/dispatch.hpp>
 #include <process/process.hpp>
 
+#include <process/metrics/metrics.hpp>
+
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
+#include <stout/uuid.hpp>
+
 #include "slave/slave.hpp"
 
 #include "slave/containerizer/fetcher.hpp"
 
+using std::list;
 using std::map;
 using std::string;
 using std::vector;
 
+using process::Failure;
 using process::Future;
+using process::Owned;
 
 using mesos::fetcher::FetcherInfo;
 
@@ -71,6 +84,14 @@ map<string, string> Fetcher::environment(
     fetcherInfo.set_frameworks_home(flags.frameworks_home);
   }
 
+  return environment(fetcherInfo, flags);
+}
+
+
+map<string, string> Fetcher::environment(
+    const FetcherInfo& fetcherInfo,
+    const Flags& flags)
+{
   map<string, string> result;
 
   if (!flags.hadoop_home.empty()) {
@@ -155,31 +176,238 @@ Future<Nothing> FetcherProcess::fetch(
   VLOG(1) << "Starting to fetch URIs for container: " << containerId
         << ", directory: " << directory;
 
-  Try<Subprocess> subprocess =
-    run(commandInfo, directory, user, flags, stdout, stderr);
+  list<Owned<CacheEntry>> entries;
+  list<Future<Nothing>> downloads;
+
+  const FetcherInfo fetcherInfo =
+    prepare(commandInfo, directory, user, flags, &entries, &downloads);
+
+  // Wait for the URIs that other containers are currently fetching
+  // into the cache. If any of those fetches fail the URI is fetched
+  // bypassing the cache instead (see '_fetch').
+  Future<hashmap<string, Bytes>> sizes = await(downloads)
+    .then(defer(self(),
+                &Self::_fetch,
+                containerId,
+                fetcherInfo,
+                flags,
+                entries,
+                stdout,
+                stderr));
+
+  // The cache entries are released however the fetch ends, including
+  // when it fails or gets discarded, as other containers might be
+  // waiting for the entries this fetch was to populate.
+  sizes
+    .onAny(defer(self(),
+                 &Self::___fetch,
+                 containerId,
+                 fetcherInfo,
+                 flags,
+                 entries,
+                 lambda::_1));
+
+  return sizes.then(defer(self(), &Self::____fetch));
+}
 
-  if (subprocess.isError()) {
-    return Failure("Failed to execute mesos-fetcher: " + subprocess.error());
+
+Future<Nothing> FetcherProcess::fetch(
+    const ContainerID& containerId,
+    const CommandInfo& commandInfo,
+    const string& directory,
+    const Option<string>& user,
+    const Flags& flags)
+{
+  // Before we fetch let's make sure we create 'stdout' and 'stderr'
+  // files into which we can redirect the output of the mesos-fetcher
+  // (and later redirect the child's stdout/stderr).
+
+  // TODO(tillt): Considering updating fetcher::run to take paths
+  // instead of file descriptors and then use Subprocess::PATH()
+  // instead of Subprocess::FD(). The reason this can't easily be done
+  // today is because we not only need to open the files but also
+  // chown them.
+  Try<int> out = os::open(
+      path::join(directory, "stdout"),
+      O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+  if (out.isError()) {
+    return Failure("Failed to create 'stdout' file: " + out.error());
   }
 
-  subprocessPids[containerId] = subprocess.get().pid();
+  // Repeat for stderr.
+  Try<int> err = os::open(
+      path::join(directory, "stderr"),
+      O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 
-  return subprocess.get().status()
-    .then(defer(self(), &Self::_fetch, containerId, lambda::_1));
+  if (err.isError()) {
+    os::close(out.get());
+    return Failure("Failed to create 'stderr' file: " + err.error());
+  }
+
+  if (user.isSome()) {
+    Try<Nothing> chown = os::chown(user.get(), directory);
+    if (chown.isError()) {
+      os::close(out.get());
+      os::close(err.get());
+      return Failure("Failed to chown work directory");
+    }
+  }
+
+  return fetch(
+      containerId,
+      commandInfo,
+      directory,
+      user,
+      flags,
+      out.get(),
+      err.get())
+    .onAny(lambda::bind(&os::close, out.get()))
+    .onAny(lambda::bind(&os::close, err.get()));
 }
 
 
-Future<Nothing> FetcherProcess::fetch(
-    const ContainerID& containerId,
+FetcherInfo FetcherProcess::prepare(
     const CommandInfo& commandInfo,
     const string& directory,
     const Option<string>& user,
-    const Flags& flags)
+    const Flags& flags,
+    list<Owned<CacheEntry>>* entries,
+    list<Future<Nothing>>* downloads)
 {
-  VLOG(1) << "Starting to fetch URIs for container: " << containerId
-        << ", directory: " << directory;
+  FetcherInfo fetcherInfo;
+
+  fetcherInfo.mutable_command_info()->CopyFrom(commandInfo);
+
+  fetcherInfo.set_work_directory(directory);
+
+  if (user.isSome()) {
+    fetcherInfo.set_user(user.get());
+  }
+
+  if (!flags.frameworks_home.empty()) {
+    fetcherInfo.set_frameworks_home(flags.frameworks_home);
+  }
+
+  // The cache is not recovered across slave restarts, so anything
+  // left over in the cache directory is removed when it is first used.
+  if (cacheDirectory.isNone()) {
+    bool cacheable = false;
+    foreach (const CommandInfo::URI& uri, commandInfo.uris()) {
+      cacheable = cacheable || uri.cache();
+    }
+
+    if (cacheable) {
+      if (os::exists(flags.fetcher_cache_dir)) {
+        Try<Nothing> rmdir = os::rmdir(flags.fetcher_cache_dir);
+        if (rmdir.isError()) {
+          LOG(WARNING) << "Failed to clean up fetcher cache directory '"
+                       << flags.fetcher_cache_dir << "': " << rmdir.error();
+        }
+      }
+
+      Try<Nothing> mkdir = os::mkdir(flags.fetcher_cache_dir);
+      if (mkdir.isError()) {
+        LOG(WARNING) << "Failed to create fetcher cache directory '"
+                     << flags.fetcher_cache_dir << "', fetching bypassing"
+                     << " the cache: " << mkdir.error();
+      } else {
+        cacheDirectory = flags.fetcher_cache_dir;
+      }
+    }
+  }
+
+  if (cacheDirectory.isSome()) {
+    fetcherInfo.set_cache_directory(cacheDirectory.get());
+  }
+
+  // The entries created for this fetch; a URI listed more than once
+  // is only fetched into the cache once.
+  hashset<string> created;
+
+  foreach (const CommandInfo::URI& uri, commandInfo.uris()) {
+    FetcherInfo::Item* item = fetcherInfo.add_items();
+    item->mutable_uri()->CopyFrom(uri);
+
+    if (!uri.cache() || cacheDirectory.isNone()) {
+      item->set_action(FetcherInfo::Item::BYPASS_CACHE);
+      continue;
+    }
 
-  Try<Subprocess> subprocess = run(commandInfo, directory, user, flags);
+    // Entries are only shared by fetches of one user so that a user
+    // can't get hold of a file that only another user could fetch.
+    const string key = user.get("") + "@" + uri.value();
+
+    Owned<CacheEntry> entry;
+
+    if (cache.contains(key)) {
+      entry = cache[key];
+
+      item->set_action(FetcherInfo::Item::RETRIEVE_FROM_CACHE);
+
+      if (!created.contains(key)) {
+        ++metrics.cache_hits;
+
+        if (entry->promise.future().isPending()) {
+          downloads->push_back(entry->promise.future());
+        }
+      }
+
+      lru.remove(key);
+    } else {
+      ++metrics.cache_misses;
+
+      entry = Owned<CacheEntry>(
+          new CacheEntry(key, UUID::random().toString()));
+
+      cache[key] = entry;
+      created.insert(key);
+
+      item->set_action(FetcherInfo::Item::DOWNLOAD_AND_CACHE);
+    }
+
+    lru.push_back(key);
+
+    item->set_cache_entry(entry->directory);
+
+    entry->references++;
+    entries->push_back(entry);
+  }
+
+  return fetcherInfo;
+}
+
+
+Future<hashmap<string, Bytes>> FetcherProcess::_fetch(
+    const ContainerID& containerId,
+    const FetcherInfo& _fetcherInfo,
+    const Flags& flags,
+    const list<Owned<CacheEntry>>& entries,
+    const Option<int>& stdout,
+    const Option<int>& stderr)
+{
+  FetcherInfo fetcherInfo = _fetcherInfo;
+
+  // Fall back to fetching directly for the URIs that failed to be
+  // fetched into the cache by another container.
+  foreach (FetcherInfo::Item& item, *fetcherInfo.mutable_items()) {
+    if (item.action() != FetcherInfo::Item::RETRIEVE_FROM_CACHE) {
+      continue;
+    }
+
+    foreach (const Owned<CacheEntry>& entry, entries) {
+      if (entry->directory == item.cache_entry() &&
+          !entry->promise.future().isPending() &&
+          !entry->promise.future().isReady()) {
+        item.set_action(FetcherInfo::Item::BYPASS_CACHE);
+        item.clear_cache_entry();
+      }
+    }
+  }
+
+  Try<Subprocess> subprocess = run(fetcherInfo, flags, stdout, stderr);
 
   if (subprocess.isError()) {
     return Failure("Failed to execute mesos-fetcher: " + subprocess.error());
@@ -188,12 +416,36 @@ Future<Nothing> FetcherProcess::fetch(
   subprocessPids[containerId] = subprocess.get().pid();
 
   return subprocess.get().status()
-    .then(defer(self(), &Self::_fetch, containerId, lambda::_1));
+    .then(defer(self(), &Self::__fetch, containerId, fetcherInfo, lambda::_1));
+}
+
+
+// Returns the disk usage of those of the given cache entry
+// directories for which it could be determined. Walking the entries
+// blocks on the filesystem, hence this is run asynchronously rather
+// than within the fetcher process.
+static hashmap<string, Bytes> du(const hashmap<string, string>& paths)
+{
+  hashmap<string, Bytes> sizes;
+
+  foreachpair (const string& directory, const string& path, paths) {
+    Try<Bytes> size = os::du(path);
+    if (size.isError()) {
+      LOG(WARNING) << "Failed to determine the size of fetcher cache entry '"
+                   << path << "': " << size.error();
+      continue;
+    }
+
+    sizes[directory] = size.get();
+  }
+
+  return sizes;
 }
 
 
-Future<Nothing> FetcherProcess::_fetch(
+Future<hashmap<string, Bytes>> FetcherProcess::__fetch(
     const ContainerID& containerId,
+    const FetcherInfo& fetcherInfo,
     const Option<int>& status)
 {
   subprocessPids.erase(containerId);
@@ -206,14 +458,139 @@ Future<Nothing> FetcherProcess::_fetch(
                    stringify(status.get()));
   }
 
+  // The cache entries populated by this fetch, keyed by directory.
+  hashmap<string, string> paths;
+
+  foreach (const FetcherInfo::Item& item, fetcherInfo.items()) {
+    if (item.action() == FetcherInfo::Item::DOWNLOAD_AND_CACHE) {
+      paths[item.cache_entry()] =
+        path::join(cacheDirectory.get(), item.cache_entry());
+    }
+  }
+
+  if (paths.empty()) {
+    return hashmap<string, Bytes>();
+  }
+
+  return async(lambda::bind(&du, paths));
+}
+
+
+void FetcherProcess::___fetch(
+    const ContainerID& containerId,
+    const FetcherInfo& fetcherInfo,
+    const Flags& flags,
+    const list<Owned<CacheEntry>>& entries,
+    const Future<hashmap<string, Bytes>>& sizes)
+{
+  // The status of the mesos-fetcher is not known if it was discarded.
+  subprocessPids.erase(containerId);
+
+  // NOTE: The mesos-fetcher exits as soon as one URI fails, hence a
+  // failed fetch might still have populated some of its entries but
+  // they are discarded regardless.
+  release(
+      fetcherInfo,
+      entries,
+      sizes.isReady() ? sizes.get() : hashmap<string, Bytes>());
+
+  evict(flags.fetcher_cache_size);
+}
+
+
+Nothing FetcherProcess::____fetch()
+{
   return Nothing();
 }
 
 
+void FetcherProcess::release(
+    const FetcherInfo& fetcherInfo,
+    const list<Owned<CacheEntry>>& entries,
+    const hashmap<string, Bytes>& sizes)
+{
+  foreach (const FetcherInfo::Item& item, fetcherInfo.items()) {
+    if (item.action() != FetcherInfo::Item::DOWNLOAD_AND_CACHE) {
+      continue;
+    }
+
+    foreach (const Owned<CacheEntry>& entry, entries) {
+      if (entry->directory != item.cache_entry() ||
+          !entry->promise.future().isPending()) {
+        continue;
+      }
+
+      // Archives in the cache are kept alongside their extracted
+      // contents, hence entries are accounted as directory trees.
+      Option<Bytes> size = sizes.get(entry->directory);
+
+      if (size.isSome()) {
+        entry->size = size.get();
+        cacheSize += entry->size;
+
+        entry->promise.set(Nothing());
+        continue;
+      }
+
+      entry->promise.fail("Failed to fetch '" + item.uri().value() + "'");
+
+      cache.erase(entry->key);
+      lru.remove(entry->key);
+
+      const string path = path::join(cacheDirectory.get(), entry->directory);
+
+      if (os::exists(path)) {
+        Try<Nothing> rmdir = os::rmdir(path);
+        if (rmdir.isError()) {
+          LOG(WARNING) << "Failed to remove fetcher cache entry '" << path
+                       << "': " << rmdir.error();
+        }
+      }
+    }
+  }
+
+  foreach (const Owned<CacheEntry>& entry, entries) {
+    CHECK_GT(entry->references, 0u);
+    entry->references--;
+  }
+}
+
+
+void FetcherProcess::evict(const Bytes& capacity)
+{
+  list<string>::iterator iterator = lru.begin();
+
+  while (cacheSize > capacity && iterator != lru.end()) {
+    const Owned<CacheEntry>& entry = cache[*iterator];
+
+    if (entry->references > 0 || !entry->promise.future().isReady()) {
+      ++iterator;
+      continue;
+    }
+
+    const string path = path::join(cacheDirectory.get(), entry->directory);
+
+    VLOG(1) << "Evicting fetcher cache entry '" << path << "' for '"
+            << entry->key << "'";
+
+    // Sandboxes hold copies of the cached file so they are unaffected.
+    Try<Nothing> rmdir = os::rmdir(path);
+    if (rmdir.isError()) {
+      LOG(WARNING) << "Failed to remove fetcher cache entry '" << path
+                   << "': " << rmdir.error();
+    }
+
+    cacheSize -= entry->size;
+    ++metrics.cache_evictions;
+
+    cache.erase(*iterator);
+    iterator = lru.erase(iterator);
+  }
+}
+
+
 Try<Subprocess> FetcherProcess::run(
-    const CommandInfo& commandInfo,
-    const string& directory,
-    const Option<string>& user,
+    const FetcherInfo& fetcherInfo,
     const Flags& flags,
     const Option<int>& stdout,
     const Option<int>& stderr)
@@ -246,7 +623,7 @@ Try<Subprocess> FetcherProcess::run(
     stderr.isSome()
       ? Subprocess::FD(stderr.get())
       : Subprocess::PIPE(),
-    Fetcher::environment(commandInfo, directory, user, flags));
+    Fetcher::environment(fetcherInfo, flags));
 
   if (fetcherSubprocess.isError()) {
     return Error(
@@ -257,66 +634,6 @@ Try<Subprocess> FetcherProcess::run(
 }
 
 
-Try<Subprocess> FetcherProcess::run(
-    const CommandInfo& commandInfo,
-    const string& directory,
-    const Option<string>& user,
-    const Flags& flags)
-{
-  // Before we fetch let's make sure we create 'stdout' and 'stderr'
-  // files into which we can redirect the output of the mesos-fetcher
-  // (and later redirect the child's stdout/stderr).
-
-  // TODO(tillt): Considering updating fetcher::run to take paths
-  // instead of file descriptors and then use Subprocess::PATH()
-  // instead of Subprocess::FD(). The reason this can't easily be done
-  // today is because we not only need to open the files but also
-  // chown them.
-  Try<int> out = os::open(
-      path::join(directory, "stdout"),
-      O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC,
-      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-
-  if (out.isError()) {
-    return Error("Failed to create 'stdout' file: " + out.error());
-  }
-
-  // Repeat for stderr.
-  Try<int> err = os::open(
-      path::join(directory, "stderr"),
-      O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC,
-      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-
-  if (err.isError()) {
-    os::close(out.get());
-    return Error("Failed to create 'stderr' file: " + err.error());
-  }
-
-  if (user.isSome()) {
-    Try<Nothing> chown = os::chown(user.get(), directory);
-    if (chown.isError()) {
-      os::close(out.get());
-      os::close(err.get());
-      return Error("Failed to chown work directory");
-    }
-  }
-
-  Try<Subprocess> subprocess = run(
-      commandInfo,
-      directory,
-      user,
-      flags,
-      out.get(),
-      err.get());
-
-  subprocess.get().status()
-    .onAny(lambda::bind(&os::close, out.get()))
-    .onAny(lambda::bind(&os::close, err.get()));
-
-  return subprocess;
-}
-
-
 void FetcherProcess::kill(const ContainerID& containerId)
 {
   if (subprocessPids.contains(containerId)) {
@@ -328,6 +645,28 @@ void FetcherProcess::kill(const ContainerID& containerId)
   }
 }
 
+
+FetcherProcess::Metrics::Metrics()
+  : cache_hits(
+        "containerizer/fetcher/cache_hits"),
+    cache_misses(
+        "containerizer/fetcher/cache_misses"),
+    cache_evictions(
+        "containerizer/fetcher/cache_evictions")
+{
+  process::metrics::add(cache_hits);
+  process::metrics::add(cache_misses);
+  process::metrics::add(cache_evictions);
+}
+
+
+FetcherProcess::Metrics::~Metrics()
+{
+  process::metrics::remove(cache_hits);
+  process::metrics::remove(cache_misses);
+  process::metrics::remove(cache_evictions);
+}
+
 } // namespace slave {
 } // namespace internal {
 } // namespace mesos {
@@ -19,15 +19,23 @@
 #ifndef __SLAVE_FETCHER_HPP__
 #define __SLAVE_FETCHER_HPP__
 
+#include <list>
+#include <map>
 #include <string>
 #include <vector>
 
 #include <mesos/mesos.hpp>
 
+#include <mesos/fetcher/fetcher.hpp>
+
 #include <process/future.hpp>
+#include <process/owned.hpp>
 #include <process/process.hpp>
 #include <process/subprocess.hpp>
 
+#include <process/metrics/counter.hpp>
+
+#include <stout/bytes.hpp>
 #include <stout/hashmap.hpp>
 
 #include "slave/flags.hpp"
@@ -40,12 +48,13 @@ namespace slave {
 class FetcherProcess;
 
 // Argument passing to and invocation of the external fetcher program.
-// TODO(bernd-mesos) : Orchestration and synchronization of fetching
-// phases. Bookkeeping of executor files that are cached after
-// downloading from a URI by the fetcher program. Cache eviction.
-// There has to be exactly one fetcher with a distinct cache dir per
-// active slave. This means that the cache dir can only be fixed
-// after the slave ID has been determined by registration or recovery.
+// URIs that request caching are fetched once into a cache directory
+// (--fetcher_cache_dir) and subsequently retrieved from there into
+// sandboxes by the fetcher program. The slave keeps the bookkeeping
+// of the cache: it deduplicates concurrent fetches of the same URI
+// and evicts the least recently used files to keep the cache within
+// --fetcher_cache_size. There has to be exactly one fetcher with a
+// distinct cache dir per active slave.
 class Fetcher
 {
 public:
@@ -59,6 +68,12 @@ public:
       const Option<std::string>& user,
       const Flags& flags);
 
+  // Same as above, for the given FetcherInfo (which might include
+  // instructions on how to use the cache).
+  static std::map<std::string, std::string> environment(
+      const mesos::fetcher::FetcherInfo& fetcherInfo,
+      const Flags& flags);
+
   Fetcher();
 
   virtual ~Fetcher();
@@ -96,7 +111,7 @@ private:
 class FetcherProcess : public process::Process<FetcherProcess>
 {
 public:
-  FetcherProcess() : ProcessBase("__fetcher__") {}
+  FetcherProcess() : ProcessBase("__fetcher__"), cacheSize(0) {}
 
   virtual ~FetcherProcess();
 
@@ -120,35 +135,115 @@ public:
   void kill(const ContainerID& containerId);
 
 private:
+  // A file in the fetcher cache. Each entry is a directory in the
+  // cache directory holding the fetched file (under its original
+  // name, which is how it is named in sandboxes).
+  struct CacheEntry
+  {
+    CacheEntry(const std::string& _key, const std::string& _directory)
+      : key(_key), directory(_directory), size(0), references(0) {}
+
+    const std::string key;
+    const std::string directory;
+
+    // Completes once the URI has been fetched into the cache. Fetches
+    // of the same URI that arrive while it is being fetched wait on
+    // this rather than fetching the URI again.
+    process::Promise<Nothing> promise;
+
+    // The size of the cached file, known once it has been fetched.
+    Bytes size;
+
+    // The number of fetches using this entry. Referenced entries are
+    // never evicted.
+    size_t references;
+  };
+
+  // Determines, for each URI, whether it is fetched bypassing the
+  // cache, fetched into the cache, or retrieved from the cache.
+  mesos::fetcher::FetcherInfo prepare(
+      const CommandInfo& commandInfo,
+      const std::string& directory,
+      const Option<std::string>& user,
+      const Flags& flags,
+      std::list<process::Owned<CacheEntry>>* entries,
+      std::list<process::Future<Nothing>>* downloads);
+
+  // Runs the mesos-fetcher once the URIs that are being fetched into
+  // the cache on behalf of other containers are available. Returns
+  // the sizes of the cache entries it populated, keyed by directory.
+  process::Future<hashmap<std::string, Bytes>> _fetch(
+      const ContainerID& containerId,
+      const mesos::fetcher::FetcherInfo& fetcherInfo,
+      const Flags& flags,
+      const std::list<process::Owned<CacheEntry>>& entries,
+      const Option<int>& stdout,
+      const Option<int>& stderr);
+
   // Check status and return an error if any.
-  process::Future<Nothing> _fetch(
+  process::Future<hashmap<std::string, Bytes>> __fetch(
       const ContainerID& containerId,
+      const mesos::fetcher::FetcherInfo& fetcherInfo,
       const Option<int>& status);
 
+  // Releases the cache entries of a fetch whatever its outcome.
+  void ___fetch(
+      const ContainerID& containerId,
+      const mesos::fetcher::FetcherInfo& fetcherInfo,
+      const Flags& flags,
+      const std::list<process::Owned<CacheEntry>>& entries,
+      const process::Future<hashmap<std::string, Bytes>>& sizes);
+
+  Nothing ____fetch();
+
+  // Releases the references to the given cache entries, completing
+  // the entries fetched by this fetch whose sizes (keyed by the entry
+  // directory) are given and discarding the others.
+  void release(
+      const mesos::fetcher::FetcherInfo& fetcherInfo,
+      const std::list<process::Owned<CacheEntry>>& entries,
+      const hashmap<std::string, Bytes>& sizes);
+
+  // Evicts the least recently used unreferenced entries until the
+  // cache fits into the given size.
+  void evict(const Bytes& capacity);
+
   // Run the mesos-fetcher with custom output redirection. If
   // 'stdout' and 'stderr' file descriptors are provided then respective
   // output from the mesos-fetcher will be redirected to the file
   // descriptors. The file descriptors are duplicated (via dup) because
   // redirecting might still be occuring even after the mesos-fetcher has
   // terminated since there still might be data to be read.
-  // This method is only "public" for test purposes.
   Try<process::Subprocess> run(
-      const CommandInfo& commandInfo,
-      const std::string& directory,
-      const Option<std::string>& user,
+      const mesos::fetcher::FetcherInfo& fetcherInfo,
       const Flags& flags,
       const Option<int>& stdout,
       const Option<int>& stderr);
 
-  // Run the mesos-fetcher, creating a "stdout" and "stderr" file
-  // in the given directory and using these for output.
-  Try<process::Subprocess> run(
-      const CommandInfo& commandInfo,
-      const std::string& directory,
-      const Option<std::string>& user,
-      const Flags& flags);
-
   hashmap<ContainerID, pid_t> subprocessPids;
+
+  // The cache entries keyed by user and URI.
+  hashmap<std::string, process::Owned<CacheEntry>> cache;
+
+  // The keys of the cache entries, least recently used first.
+  std::list<std::string> lru;
+
+  // The total size of the cached files.
+  Bytes cacheSize;
+
+  // The cache directory is cleaned up when it is first used, since
+  // the cache is not recovered across slave restarts.
+  Option<std::string> cacheDirectory;
+
+  struct Metrics
+  {
+    Metrics();
+    ~Metrics();
+
+    process::metrics::Counter cache_hits;
+    process::metrics::Counter cache_misses;
+    process::metrics::Counter cache_evictions;
+  } metrics;
 };
 
 } // namespace slave {
@@ -32,6 +32,15 @@ const uint64_t MIN_CPU_SHARES = 10;
 const Duration CPU_CFS_PERIOD = Milliseconds(100); // Linux default.
 const Duration MIN_CPU_CFS_QUOTA = Milliseconds(1);
 
+// Adaptive CFS quota constants (see --cgroups_adaptive_cfs).
+// How often the quota of the containers is adjusted.
+const Duration CPU_CFS_ADAPTIVE_INTERVAL = Seconds(1);
+// The maximum quota of a container as a multiple of its allocation.
+const double CPU_CFS_MAX_BURST_RATIO = 4.0;
+// The fraction of the host's cpus that must be idle for containers
+// to be allowed to burst above their allocation.
+const double CPU_CFS_MIN_IDLE_RATIO = 0.2;
+
 
 // Memory subsystem constants.
 const Bytes MIN_MEMORY = Megabytes(32);
@@ -24,8 +24,10 @@
 #include <mesos/type_utils.hpp>
 #include <mesos/values.hpp>
 
+#include <process/clock.hpp>
 #include <process/collect.hpp>
 #include <process/defer.hpp>
+#include <process/delay.hpp>
 #include <process/pid.hpp>
 
 #include <stout/bytes.hpp>
@@ -67,10 +69,12 @@ static Future<Option<T> > none() { return None(); }
 CgroupsCpushareIsolatorProcess::CgroupsCpushareIsolatorProcess(
     const Flags& _flags,
     const hashmap<string, string>& _hierarchies,
-    const vector<string>& _subsystems)
+    const vector<string>& _subsystems,
+    long _cpus)
   : flags(_flags),
     hierarchies(_hierarchies),
-    subsystems(_subsystems) {}
+    subsystems(_subsystems),
+    cpus(_cpus) {}
 
 
 CgroupsCpushareIsolatorProcess::~CgroupsCpushareIsolatorProcess() {}
@@ -165,8 +169,19 @@ Try<Isolator*> CgroupsCpushareIsolatorProcess::create(const Flags& flags)
     }
   }
 
+  if (flags.cgroups_adaptive_cfs && !flags.cgroups_enable_cfs) {
+    return Error(
+        "The adaptive CFS quota requires --cgroups_enable_cfs");
+  }
+
+  Try<long> cpus = os::cpus();
+  if (cpus.isError()) {
+    return Error("Failed to get the number of cpus: " + cpus.error());
+  }
+
   process::Owned<IsolatorProcess> process(
-      new CgroupsCpushareIsolatorProcess(flags, hierarchies, subsystems));
+      new CgroupsCpushareIsolatorProcess(
+          flags, hierarchies, subsystems, cpus.get()));
 
   return new Isolator(process);
 }
@@ -200,8 +215,39 @@ Future<Nothing> CgroupsCpushareIsolatorProcess::recover(
       continue;
     }
 
-    infos[containerId] = new Info(containerId, cgroup);;
+    Info* info = new Info(containerId, cgroup);
+    infos[containerId] = info;
     cgroups.insert(cgroup);
+
+    // The quota in effect might be a burst, hence the allocation of a
+    // recovered container is derived from its 'cpu.shares' (which only
+    // changes with the allocation) and its quota is reset to match.
+    if (flags.cgroups_adaptive_cfs) {
+      Try<uint64_t> shares =
+        cgroups::cpu::shares(hierarchies["cpu"], cgroup);
+
+      if (shares.isError()) {
+        LOG(WARNING) << "Failed to read 'cpu.shares' for container "
+                     << containerId << ": " << shares.error();
+        continue;
+      }
+
+      double cpus = shares.get() / (double) CPU_SHARES_PER_CPU;
+
+      Duration quota = std::max(CPU_CFS_PERIOD * cpus, MIN_CPU_CFS_QUOTA);
+
+      Try<Nothing> write =
+        cgroups::cpu::cfs_quota_us(hierarchies["cpu"], cgroup, quota);
+
+      if (write.isError()) {
+        LOG(WARNING) << "Failed to update 'cpu.cfs_quota_us' for container "
+                     << containerId << ": " << write.error();
+        continue;
+      }
+
+      info->quota = quota;
+      info->effectiveQuota = quota;
+    }
   }
 
   // Remove orphans.
@@ -400,6 +446,10 @@ Future<Nothing> CgroupsCpushareIsolatorProcess::update(
               << " and 'cpu.cfs_quota_us' to " << quota
               << " (cpus " << cpus << ")"
               << " for container " << containerId;
+
+    // Any burst ends with a new allocation.
+    info->quota = quota;
+    info->effectiveQuota = quota;
   }
 
   return Nothing();
@@ -470,6 +520,109 @@ Future<ResourceStatistics> CgroupsCpushareIsolatorProcess::usage(
 }
 
 
+void CgroupsCpushareIsolatorProcess::initialize()
+{
+  if (flags.cgroups_adaptive_cfs) {
+    adapt();
+  }
+}
+
+
+void CgroupsCpushareIsolatorProcess::adapt()
+{
+  // Estimate the number of idle cpus since the last adaptation from
+  // the cpu time consumed by all the tasks on the host, i.e., by the
+  // root cgroup of the cpuacct hierarchy.
+  Try<Duration> usage = cgroups::cpuacct::usage(hierarchies["cpuacct"], "");
+  Time now = Clock::now();
+
+  Option<double> idle;
+
+  if (usage.isError()) {
+    LOG(ERROR) << "Failed to read the cpu usage of the host: "
+               << usage.error();
+  } else {
+    if (hostUsage.isSome() && now > hostSampled.get()) {
+      double busy =
+        (usage.get() - hostUsage.get()).secs() /
+        (now - hostSampled.get()).secs();
+
+      idle = std::max(cpus - busy, 0.0);
+    }
+
+    hostUsage = usage.get();
+    hostSampled = now;
+  }
+
+  // Without an estimate we assume contention, which keeps (or puts)
+  // every container at its allocation.
+  bool contended = idle.isNone() || idle.get() < CPU_CFS_MIN_IDLE_RATIO * cpus;
+
+  foreachvalue (Info* info, infos) {
+    if (info->quota.isNone() || info->effectiveQuota.isNone()) {
+      continue;
+    }
+
+    Try<hashmap<string, uint64_t> > stat =
+      cgroups::stat(hierarchies["cpu"], info->cgroup, "cpu.stat");
+
+    if (stat.isError()) {
+      LOG(ERROR) << "Failed to read cpu.stat for container "
+                 << info->containerId << ": " << stat.error();
+      continue;
+    }
+
+    Option<uint64_t> throttled = stat.get().get("nr_throttled");
+
+    bool wasThrottled = throttled.isSome() &&
+      info->throttled.isSome() &&
+      throttled.get() > info->throttled.get();
+
+    info->throttled = throttled;
+
+    const Duration& quota = info->quota.get();
+    Duration effectiveQuota = info->effectiveQuota.get();
+
+    if (contended) {
+      effectiveQuota = quota;
+    } else if (wasThrottled) {
+      // Double the quota of a throttled container but never hand it
+      // more than the idle cpus. Several containers may burst into
+      // the same idle cpus; the resulting contention is detected on
+      // the next adaptation, which then clamps them back.
+      effectiveQuota = std::min(
+          std::min(effectiveQuota * 2, quota * CPU_CFS_MAX_BURST_RATIO),
+          quota + CPU_CFS_PERIOD * idle.get());
+
+      effectiveQuota = std::max(effectiveQuota, quota);
+    }
+
+    if (effectiveQuota == info->effectiveQuota.get()) {
+      continue;
+    }
+
+    Try<Nothing> write = cgroups::cpu::cfs_quota_us(
+        hierarchies["cpu"], info->cgroup, effectiveQuota);
+
+    if (write.isError()) {
+      LOG(ERROR) << "Failed to update 'cpu.cfs_quota_us' for container "
+                 << info->containerId << ": " << write.error();
+      continue;
+    }
+
+    VLOG(1) << "Updated 'cpu.cfs_quota_us' to " << effectiveQuota
+            << " (allocated " << quota << ") for container "
+            << info->containerId;
+
+    info->effectiveQuota = effectiveQuota;
+  }
+
+  delay(CPU_CFS_ADAPTIVE_INTERVAL,
+        PID<CgroupsCpushareIsolatorProcess>(this),
+        &CgroupsCpushareIsolatorProcess::adapt);
+}
+
+
 namespace {
 
 Future<Nothing> _nothing() { return Nothing(); }
@@ -23,6 +23,9 @@
 
 #include <mesos/slave/isolator.hpp>
 
+#include <process/time.hpp>
+
+#include <stout/duration.hpp>
 #include <stout/hashmap.hpp>
 
 #include "slave/flags.hpp"
@@ -70,11 +73,22 @@ public:
   virtual process::Future<Nothing> cleanup(
       const ContainerID& containerId);
 
+protected:
+  virtual void initialize();
+
 private:
   CgroupsCpushareIsolatorProcess(
       const Flags& flags,
       const hashmap<std::string, std::string>& hierarchies,
-      const std::vector<std::string>& subsystems);
+      const std::vector<std::string>& subsystems,
+      long cpus);
+
+  // Periodically adjusts the CFS quota of the containers to the load
+  // of the host when --cgroups_adaptive_cfs is set. A container that
+  // got throttled may burst above its allocation while enough of the
+  // host's cpus are idle; all containers are clamped back to their
+  // allocation once the host is under contention.
+  void adapt();
 
   virtual process::Future<std::list<Nothing> > _cleanup(
       const ContainerID& containerId,
@@ -90,6 +104,16 @@ private:
     Option<pid_t> pid;
 
     process::Promise<mesos::slave::Limitation> limitation;
+
+    // The CFS quota matching the container's cpus allocation and the
+    // quota currently in effect, which differ while the container is
+    // bursting. Only used with --cgroups_adaptive_cfs.
+    Option<Duration> quota;
+    Option<Duration> effectiveQuota;
+
+    // The value of 'nr_throttled' from cpu.stat when the quota was
+    // last adapted.
+    Option<uint64_t> throttled;
   };
 
   const Flags flags;
@@ -103,6 +127,14 @@ private:
   // will be only one element in the vector which is 'cpu,cpuacct'.
   std::vector<std::string> subsystems;
 
+  // The number of cpus of the host.
+  const long cpus;
+
+  // The cpu time consumed by all the tasks on the host and when it
+  // was sampled, used to determine how idle the host is.
+  Option<Duration> hostUsage;
+  Option<process::Time> hostSampled;
+
   // TODO(bmahler): Use Owned<Info>.
   hashmap<ContainerID, Info*> infos;
 };
@@ -60,17 +60,31 @@ using mesos::slave::Isolator;
 using mesos::slave::IsolatorProcess;
 using mesos::slave::Limitation;
 
+using cgroups::memory::pressure::CRITICAL;
+using cgroups::memory::pressure::Counter;
+using cgroups::memory::pressure::Level;
+using cgroups::memory::pressure::LOW;
+using cgroups::memory::pressure::MEDIUM;
+
 
 template<class T>
 static Future<Option<T> > none() { return None(); }
 
+
+static const vector<Level> levels()
+{
+  return {LOW, MEDIUM, CRITICAL};
+}
+
 CgroupsMemIsolatorProcess::CgroupsMemIsolatorProcess(
     const Flags& _flags,
     const string& _hierarchy,
-    const bool _limitSwap)
+    const bool _limitSwap,
+    const Option<Level>& _pressureLimit)
   : flags(_flags),
     hierarchy(_hierarchy),
-    limitSwap(_limitSwap) {}
+    limitSwap(_limitSwap),
+    pressureLimit(_pressureLimit) {}
 
 
 CgroupsMemIsolatorProcess::~CgroupsMemIsolatorProcess() {}
@@ -128,8 +142,35 @@ Try<Isolator*> CgroupsMemIsolatorProcess::create(const Flags& flags)
     limitSwap = true;
   }
 
+  // Determine the pressure level at which containers are limited.
+  Option<Level> pressureLimit;
+
+  if (flags.cgroups_memory_pressure_limit.isSome()) {
+    const string& level = flags.cgroups_memory_pressure_limit.get();
+
+    if (level == "low") {
+      pressureLimit = LOW;
+    } else if (level == "medium") {
+      pressureLimit = MEDIUM;
+    } else if (level == "critical") {
+      pressureLimit = CRITICAL;
+    } else {
+      return Error("Unknown memory pressure level '" + level + "'");
+    }
+
+    Try<bool> exists = cgroups::exists(
+        hierarchy.get(), flags.cgroups_root, "memory.pressure_level");
+
+    if (exists.isError() || !exists.get()) {
+      return Error(
+          "Failed to find 'memory.pressure_level': " +
+          (exists.isError() ? exists.error() : "does not exist"));
+    }
+  }
+
   process::Owned<IsolatorProcess> process(
-      new CgroupsMemIsolatorProcess(flags, hierarchy.get(), limitSwap));
+      new CgroupsMemIsolatorProcess(
+          flags, hierarchy.get(), limitSwap, pressureLimit));
 
   return new Isolator(process);
 }
@@ -167,6 +208,7 @@ Future<Nothing> CgroupsMemIsolatorProcess::recover(
     cgroups.insert(cgroup);
 
     oomListen(containerId);
+    pressureListen(containerId);
   }
 
   Try<vector<string> > orphans = cgroups::get(
@@ -245,6 +287,7 @@ Future<Option<CommandInfo> > CgroupsMemIsolatorProcess::prepare(
   }
 
   oomListen(containerId);
+  pressureListen(containerId);
 
   return update(containerId, executorInfo.resources())
     .then(lambda::bind(none<CommandInfo>));
@@ -417,6 +460,61 @@ Future<ResourceStatistics> CgroupsMemIsolatorProcess::usage(
     result.set_mem_mapped_file_bytes(total_mapped_file.get());
   }
 
+  // Get the number of memory pressure events of each level.
+  list<Level> levels;
+  list<Future<uint64_t>> values;
+  foreachpair (Level level,
+               const process::Owned<Counter>& counter,
+               info->pressureCounters) {
+    levels.push_back(level);
+    values.push_back(counter->value());
+  }
+
+  return await(values)
+    .then(defer(PID<CgroupsMemIsolatorProcess>(this),
+                &CgroupsMemIsolatorProcess::_usage,
+                containerId,
+                result,
+                levels,
+                lambda::_1));
+}
+
+
+Future<ResourceStatistics> CgroupsMemIsolatorProcess::_usage(
+    const ContainerID& containerId,
+    ResourceStatistics result,
+    const list<Level>& levels,
+    const list<Future<uint64_t>>& values)
+{
+  if (!infos.contains(containerId)) {
+    return Failure("Unknown container");
+  }
+
+  list<Level>::const_iterator iterator = levels.begin();
+  foreach (const Future<uint64_t>& value, values) {
+    Level level = *iterator++;
+
+    if (!value.isReady()) {
+      LOG(ERROR) << "Failed to get the number of " << level
+                 << " memory pressure events for container "
+                 << containerId << ": "
+                 << (value.isFailed() ? value.failure() : "discarded");
+      continue;
+    }
+
+    switch (level) {
+      case LOW:
+        result.set_mem_low_pressure_counter(value.get());
+        break;
+      case MEDIUM:
+        result.set_mem_medium_pressure_counter(value.get());
+        break;
+      case CRITICAL:
+        result.set_mem_critical_pressure_counter(value.get());
+        break;
+    }
+  }
+
   return result;
 }
 
@@ -437,6 +535,13 @@ Future<Nothing> CgroupsMemIsolatorProcess::cleanup(
     info->oomNotifier.discard();
   }
 
+  if (info->pressureNotifier.isPending()) {
+    info->pressureNotifier.discard();
+  }
+
+  // Stop counting before the cgroup is destroyed.
+  info->pressureCounters.clear();
+
   return cgroups::destroy(hierarchy, info->cgroup, cgroups::DESTROY_TIMEOUT)
     .onAny(defer(PID<CgroupsMemIsolatorProcess>(this),
                  &CgroupsMemIsolatorProcess::_cleanup,
@@ -580,6 +685,127 @@ void CgroupsMemIsolatorProcess::oom(const ContainerID& containerId)
   info->limitation.set(Limitation(mem, message.str()));
 }
 
+
+void CgroupsMemIsolatorProcess::pressureListen(
+    const ContainerID& containerId)
+{
+  CHECK(infos.contains(containerId));
+  Info* info = CHECK_NOTNULL(infos[containerId]);
+
+  // Counting the pressure events is best effort since the
+  // 'memory.pressure_level' control requires a 3.10+ kernel.
+  foreach (Level level, levels()) {
+    Try<process::Owned<Counter>> counter =
+      Counter::create(hierarchy, info->cgroup, level);
+
+    if (counter.isError()) {
+      LOG(ERROR) << "Failed to listen for " << level
+                 << " memory pressure events for container "
+                 << containerId << ": " << counter.error();
+      continue;
+    }
+
+    info->pressureCounters[level] = counter.get();
+  }
+
+  if (pressureLimit.isNone()) {
+    return;
+  }
+
+  info->pressureNotifier = cgroups::event::listen(
+      hierarchy,
+      info->cgroup,
+      "memory.pressure_level",
+      stringify(pressureLimit.get()));
+
+  // The control was verified to exist when the isolator was created
+  // so, as with OOM events, failing here is unexpected.
+  if (info->pressureNotifier.isFailed()) {
+    LOG(FATAL) << "Failed to listen for " << pressureLimit.get()
+               << " memory pressure events for container "
+               << containerId << ": "
+               << info->pressureNotifier.failure();
+  }
+
+  LOG(INFO) << "Started listening for " << pressureLimit.get()
+            << " memory pressure events for container " << containerId;
+
+  info->pressureNotifier.onAny(defer(
+      PID<CgroupsMemIsolatorProcess>(this),
+      &CgroupsMemIsolatorProcess::pressureWaited,
+      containerId,
+      lambda::_1));
+}
+
+
+void CgroupsMemIsolatorProcess::pressureWaited(
+    const ContainerID& containerId,
+    const Future<uint64_t>& future)
+{
+  if (future.isDiscarded()) {
+    LOG(INFO) << "Discarded memory pressure notifier for container "
+              << containerId;
+  } else if (future.isFailed()) {
+    LOG(ERROR) << "Listening on memory pressure events failed for "
+               << "container " << containerId << ": " << future.failure();
+  } else {
+    LOG(INFO) << "Memory pressure notifier is triggered for container "
+              << containerId;
+    pressure(containerId);
+  }
+}
+
+
+void CgroupsMemIsolatorProcess::pressure(const ContainerID& containerId)
+{
+  if (!infos.contains(containerId)) {
+    LOG(INFO) << "Memory pressure detected for an already terminated "
+              << "executor";
+    return;
+  }
+
+  Info* info = CHECK_NOTNULL(infos[containerId]);
+
+  CHECK_SOME(pressureLimit);
+
+  LOG(INFO) << "Memory pressure level " << pressureLimit.get()
+            << " reached for container " << containerId;
+
+  // Unlike an OOM, the limitation is raised before the kernel has
+  // killed any of the container's processes, so the executor gets
+  // destroyed while the rest of the slave still has memory to spare.
+  ostringstream message;
+  message << "Memory pressure level '" << pressureLimit.get()
+          << "' reached: ";
+
+  Try<Bytes> limit = cgroups::memory::limit_in_bytes(hierarchy, info->cgroup);
+
+  if (limit.isError()) {
+    LOG(ERROR) << "Failed to read 'memory.limit_in_bytes': "
+               << limit.error();
+  } else {
+    message << "Requested: " << limit.get() << " ";
+  }
+
+  Try<Bytes> usage = cgroups::memory::usage_in_bytes(hierarchy, info->cgroup);
+
+  if (usage.isError()) {
+    LOG(ERROR) << "Failed to read 'memory.usage_in_bytes': "
+               << usage.error();
+  } else {
+    message << "Used: " << usage.get();
+  }
+
+  LOG(INFO) << message.str();
+
+  Resources mem = Resources::parse(
+      "mem",
+      stringify(usage.isSome() ? usage.get().megabytes() : 0),
+      "*").get();
+
+  info->limitation.set(Limitation(mem, message.str()));
+}
+
 } // namespace slave {
 } // namespace internal {
 } // namespace mesos {
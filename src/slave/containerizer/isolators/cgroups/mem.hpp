@@ -21,8 +21,12 @@
 
 #include <mesos/slave/isolator.hpp>
 
+#include <process/owned.hpp>
+
 #include <stout/hashmap.hpp>
 
+#include "linux/cgroups.hpp"
+
 #include "slave/flags.hpp"
 
 #include "slave/containerizer/isolators/cgroups/constants.hpp"
@@ -68,7 +72,14 @@ private:
   CgroupsMemIsolatorProcess(
       const Flags& flags,
       const std::string& hierarchy,
-      bool limitSwap);
+      bool limitSwap,
+      const Option<cgroups::memory::pressure::Level>& pressureLimit);
+
+  process::Future<ResourceStatistics> _usage(
+      const ContainerID& containerId,
+      ResourceStatistics result,
+      const std::list<cgroups::memory::pressure::Level>& levels,
+      const std::list<process::Future<uint64_t>>& values);
 
   virtual process::Future<Nothing> _cleanup(
       const ContainerID& containerId,
@@ -87,6 +98,15 @@ private:
 
     // Used to cancel the OOM listening.
     process::Future<Nothing> oomNotifier;
+
+    // Counters of the memory pressure events of each level.
+    hashmap<cgroups::memory::pressure::Level,
+            process::Owned<cgroups::memory::pressure::Counter>>
+      pressureCounters;
+
+    // Used to cancel the listening on the pressure level that limits
+    // the container, if any (see --cgroups_memory_pressure_limit).
+    process::Future<uint64_t> pressureNotifier;
   };
 
   // Start listening on OOM events. This function will create an
@@ -102,6 +122,20 @@ private:
   // This function is invoked when the OOM event happens.
   void oom(const ContainerID& containerId);
 
+  // Start counting the memory pressure events and, if a pressure
+  // limit is set, listening for the limiting pressure level.
+  void pressureListen(const ContainerID& containerId);
+
+  // This function is invoked when the listening on the limiting
+  // pressure level has a result.
+  void pressureWaited(
+      const ContainerID& containerId,
+      const process::Future<uint64_t>& future);
+
+  // This function is invoked when the limiting pressure level is
+  // reached.
+  void pressure(const ContainerID& containerId);
+
   const Flags flags;
 
   // The path to the cgroups subsystem hierarchy root.
@@ -109,6 +143,9 @@ private:
 
   const bool limitSwap;
 
+  // The pressure level at which a container is limited, if any.
+  const Option<cgroups::memory::pressure::Level> pressureLimit;
+
   // TODO(bmahler): Use Owned<Info>.
   hashmap<ContainerID, Info*> infos;
 };
@@ -18,6 +18,9 @@
 
 #include <stdint.h>
 
+#include <sys/resource.h>
+
+#include <limits>
 #include <vector>
 #include <set>
 
@@ -31,9 +34,12 @@
 #include <process/defer.hpp>
 #include <process/delay.hpp>
 #include <process/io.hpp>
+#include <process/owned.hpp>
 #include <process/pid.hpp>
 #include <process/subprocess.hpp>
 
+#include <process/metrics/metrics.hpp>
+
 #include <stout/bytes.hpp>
 #include <stout/check.hpp>
 #include <stout/error.hpp>
@@ -92,11 +98,6 @@ Try<Isolator*> CgroupsPerfEventIsolatorProcess::create(const Flags& flags)
     events.insert(event);
   }
 
-  if (!perf::valid(events)) {
-    return Error("Failed to create PerfEvent isolator, invalid events: " +
-                 stringify(events));
-  }
-
   Try<string> hierarchy = cgroups::prepare(
       flags.cgroups_hierarchy,
       "perf_event",
@@ -106,12 +107,55 @@ Try<Isolator*> CgroupsPerfEventIsolatorProcess::create(const Flags& flags)
     return Error("Failed to create perf_event cgroup: " + hierarchy.error());
   }
 
+  // Prefer counting the events with perf_event_open(2) directly,
+  // which avoids forking 'perf stat' for every sample. Check that
+  // the counters can actually be opened (e.g., the events are
+  // supported by this CPU) on the root cgroup, otherwise fall back to
+  // the 'perf' tool.
+  bool native = false;
+  size_t limit = 0;
+  if (perf::native(events)) {
+    Try<process::Owned<perf::Counters> > counters = perf::Counters::open(
+        events,
+        path::join(hierarchy.get(), flags.cgroups_root));
+
+    if (counters.isError()) {
+      LOG(WARNING) << "Failed to open perf counters, falling back to "
+                   << "sampling with the perf tool: " << counters.error();
+    } else {
+      native = true;
+    }
+
+    // Every container keeps a counter (i.e., a file descriptor) open
+    // per event per CPU, so bound the total to half of the slave's
+    // file descriptor limit to leave room for everything else.
+    struct rlimit rlimit;
+    if (::getrlimit(RLIMIT_NOFILE, &rlimit) != 0) {
+      return ErrnoError("Failed to get the file descriptor limit");
+    }
+
+    limit = rlimit.rlim_cur == RLIM_INFINITY
+      ? std::numeric_limits<size_t>::max()
+      : rlimit.rlim_cur / 2;
+  }
+
+  // The perf tool is still used for containers whose counters can not
+  // be opened when sampling natively.
+  const bool tool = perf::valid(events);
+
+  if (!native && !tool) {
+    return Error("Failed to create PerfEvent isolator, invalid events: " +
+                 stringify(events));
+  }
+
   LOG(INFO) << "PerfEvent isolator will profile for " << flags.perf_duration
             << " every " << flags.perf_interval
-            << " for events: " << stringify(events);
+            << " for events: " << stringify(events)
+            << (native ? " using perf_event_open" : " using the perf tool");
 
   process::Owned<IsolatorProcess> process(
-      new CgroupsPerfEventIsolatorProcess(flags, hierarchy.get()));
+      new CgroupsPerfEventIsolatorProcess(
+          flags, hierarchy.get(), native, tool, limit));
 
   return new Isolator(process);
 }
@@ -119,9 +163,17 @@ Try<Isolator*> CgroupsPerfEventIsolatorProcess::create(const Flags& flags)
 
 CgroupsPerfEventIsolatorProcess::CgroupsPerfEventIsolatorProcess(
     const Flags& _flags,
-    const string& _hierarchy)
+    const string& _hierarchy,
+    bool _native,
+    bool _tool,
+    size_t _limit)
   : flags(_flags),
-    hierarchy(_hierarchy)
+    hierarchy(_hierarchy),
+    native(_native),
+    tool(_tool),
+    limit(_limit),
+    sampling(false),
+    metrics(*this)
 {
   CHECK_SOME(flags.perf_events);
 
@@ -138,7 +190,11 @@ CgroupsPerfEventIsolatorProcess::~CgroupsPerfEventIsolatorProcess() {}
 void CgroupsPerfEventIsolatorProcess::initialize()
 {
   // Start sampling.
-  sample();
+  if (native) {
+    sampleNative();
+  } else {
+    sample();
+  }
 }
 
 
@@ -179,6 +235,15 @@ Future<Nothing> CgroupsPerfEventIsolatorProcess::recover(
 
     infos[containerId] = new Info(containerId, cgroup);
     cgroups.insert(cgroup);
+
+    if (native) {
+      Try<Nothing> open = this->open(infos[containerId]);
+      if (open.isError()) {
+        LOG(WARNING) << "Failed to open perf counters for container "
+                     << containerId << ", falling back to sampling with "
+                     << "the perf tool: " << open.error();
+      }
+    }
   }
 
   Try<vector<string> > orphans = cgroups::get(hierarchy, flags.cgroups_root);
@@ -257,10 +322,53 @@ Future<Option<CommandInfo> > CgroupsPerfEventIsolatorProcess::prepare(
     }
   }
 
+  // The counters are opened once and kept open for the lifetime of
+  // the container; they only count while a sample is being taken.
+  if (native) {
+    Try<Nothing> open = this->open(info);
+    if (open.isError()) {
+      LOG(WARNING) << "Failed to open perf counters for container "
+                   << containerId << ", falling back to sampling with "
+                   << "the perf tool: " << open.error();
+    }
+  }
+
   return None();
 }
 
 
+Try<Nothing> CgroupsPerfEventIsolatorProcess::open(Info* info)
+{
+  CHECK_NOTNULL(info);
+
+  // A counter is opened for each event on each CPU.
+  Try<long> cpus = os::cpus();
+  if (cpus.isError()) {
+    return Error("Failed to get the number of CPUs: " + cpus.error());
+  }
+
+  const size_t size = events.size() * cpus.get();
+  const size_t used = static_cast<size_t>(_counters());
+
+  if (used + size > limit) {
+    return Error("Opening " + stringify(size) + " counters would exceed "
+                 "the limit of " + stringify(limit) + " open counters");
+  }
+
+  Try<process::Owned<perf::Counters> > counters = perf::Counters::open(
+      events,
+      path::join(hierarchy, info->cgroup));
+
+  if (counters.isError()) {
+    return Error(counters.error());
+  }
+
+  info->counters = counters.get();
+
+  return Nothing();
+}
+
+
 Future<Nothing> CgroupsPerfEventIsolatorProcess::isolate(
     const ContainerID& containerId,
     pid_t pid)
@@ -333,6 +441,10 @@ Future<Nothing> CgroupsPerfEventIsolatorProcess::cleanup(
 
   info->destroying = true;
 
+  // Release the counters, and with them the kernel's references to
+  // the cgroup, before destroying it.
+  info->counters.reset();
+
   return cgroups::destroy(hierarchy, info->cgroup)
     .then(defer(PID<CgroupsPerfEventIsolatorProcess>(this),
                 &CgroupsPerfEventIsolatorProcess::_cleanup,
@@ -393,7 +505,8 @@ void CgroupsPerfEventIsolatorProcess::sample()
     // halt all sampling.
     Duration timeout = flags.perf_duration + Seconds(2);
 
-    perf::sample(events, cgroups, flags.perf_duration)
+    metrics.sample_latency.time(
+        perf::sample(events, cgroups, flags.perf_duration))
       .after(timeout,
              lambda::bind(&discardSample,
                           lambda::_1,
@@ -419,6 +532,8 @@ void CgroupsPerfEventIsolatorProcess::_sample(
   if (!statistics.isReady()) {
     // Failure can occur for many reasons but all are unexpected and
     // indicate something is not right so we'll stop sampling.
+    ++metrics.sample_failures;
+
     LOG(ERROR) << "Failed to get perf sample, sampling will be halted: "
                << (statistics.isFailed() ? statistics.failure() : "discarded");
     return;
@@ -442,6 +557,196 @@ void CgroupsPerfEventIsolatorProcess::_sample(
         &CgroupsPerfEventIsolatorProcess::sample);
 }
 
+
+void CgroupsPerfEventIsolatorProcess::sampleNative()
+{
+  const Time start = Clock::now();
+
+  metrics.sample_latency.start();
+
+  list<ContainerID> containerIds;
+  set<string> cgroups;
+  foreachvalue (Info* info, infos) {
+    CHECK_NOTNULL(info);
+
+    if (info->destroying) {
+      continue;
+    }
+
+    if (info->counters.get() == NULL) {
+      // The counters could not be opened for this container so it is
+      // sampled with the perf tool instead.
+      cgroups.insert(info->cgroup);
+      continue;
+    }
+
+    Try<Nothing> enable = info->counters->enable();
+    if (enable.isError()) {
+      ++metrics.sample_failures;
+
+      LOG(WARNING) << "Failed to enable perf counters for container "
+                   << info->containerId << ": " << enable.error();
+      continue;
+    }
+
+    containerIds.push_back(info->containerId);
+  }
+
+  // Skip the perf tool sample if the previous one is still running
+  // rather than piling up 'perf stat' processes.
+  if (!cgroups.empty() && tool && !sampling) {
+    sampling = true;
+
+    Duration timeout = flags.perf_duration + Seconds(2);
+
+    perf::sample(events, cgroups, flags.perf_duration)
+      .after(timeout,
+             lambda::bind(&discardSample,
+                          lambda::_1,
+                          flags.perf_duration,
+                          timeout))
+      .onAny(defer(PID<CgroupsPerfEventIsolatorProcess>(this),
+                   &CgroupsPerfEventIsolatorProcess::__sampleNative,
+                   lambda::_1));
+  }
+
+  delay(flags.perf_duration,
+        PID<CgroupsPerfEventIsolatorProcess>(this),
+        &CgroupsPerfEventIsolatorProcess::_sampleNative,
+        containerIds,
+        start,
+        start + flags.perf_interval);
+}
+
+
+void CgroupsPerfEventIsolatorProcess::_sampleNative(
+    const list<ContainerID>& containerIds,
+    const Time& start,
+    const Time& next)
+{
+  metrics.read_latency.start();
+
+  foreach (const ContainerID& containerId, containerIds) {
+    // Only containers whose counters were enabled for this sample
+    // are read; the others either have been cleaned up since or will
+    // be included in the next sample.
+    if (!infos.contains(containerId)) {
+      continue;
+    }
+
+    Info* info = CHECK_NOTNULL(infos[containerId]);
+
+    if (info->destroying || info->counters.get() == NULL) {
+      continue;
+    }
+
+    const Duration duration = Clock::now() - start;
+
+    Try<Nothing> disable = info->counters->disable();
+    if (disable.isError()) {
+      ++metrics.sample_failures;
+
+      LOG(WARNING) << "Failed to disable perf counters for container "
+                   << containerId << ": " << disable.error();
+      continue;
+    }
+
+    Try<PerfStatistics> statistics = info->counters->read();
+    if (statistics.isError()) {
+      ++metrics.sample_failures;
+
+      LOG(WARNING) << "Failed to read perf counters for container "
+                   << containerId << ": " << statistics.error();
+      continue;
+    }
+
+    info->statistics = statistics.get();
+    info->statistics.set_timestamp(start.secs());
+    info->statistics.set_duration(duration.secs());
+  }
+
+  metrics.read_latency.stop();
+  metrics.sample_latency.stop();
+
+  // Schedule sample for the next time.
+  delay(next - Clock::now(),
+        PID<CgroupsPerfEventIsolatorProcess>(this),
+        &CgroupsPerfEventIsolatorProcess::sampleNative);
+}
+
+
+void CgroupsPerfEventIsolatorProcess::__sampleNative(
+    const Future<hashmap<string, PerfStatistics> >& statistics)
+{
+  sampling = false;
+
+  if (!statistics.isReady()) {
+    // Unlike when sampling only with the perf tool, the counters of
+    // the other containers are still sampled so keep going.
+    ++metrics.sample_failures;
+
+    LOG(WARNING) << "Failed to get perf sample: "
+                 << (statistics.isFailed()
+                     ? statistics.failure()
+                     : "discarded");
+    return;
+  }
+
+  foreachvalue (Info* info, infos) {
+    CHECK_NOTNULL(info);
+
+    if (info->counters.get() != NULL ||
+        !statistics.get().contains(info->cgroup)) {
+      continue;
+    }
+
+    info->statistics = statistics.get().get(info->cgroup).get();
+  }
+}
+
+
+double CgroupsPerfEventIsolatorProcess::_counters()
+{
+  size_t counters = 0;
+
+  foreachvalue (Info* info, infos) {
+    if (info->counters.get() != NULL) {
+      counters += info->counters->size();
+    }
+  }
+
+  return counters;
+}
+
+
+CgroupsPerfEventIsolatorProcess::Metrics::Metrics(
+    const CgroupsPerfEventIsolatorProcess& isolator)
+  : counters(
+        "containerizer/perf_event/counters",
+        defer(PID<CgroupsPerfEventIsolatorProcess>(isolator),
+              &CgroupsPerfEventIsolatorProcess::_counters)),
+    sample_failures(
+        "containerizer/perf_event/sample_failures"),
+    sample_latency(
+        "containerizer/perf_event/sample_latency"),
+    read_latency(
+        "containerizer/perf_event/read_latency")
+{
+  process::metrics::add(counters);
+  process::metrics::add(sample_failures);
+  process::metrics::add(sample_latency);
+  process::metrics::add(read_latency);
+}
+
+
+CgroupsPerfEventIsolatorProcess::Metrics::~Metrics()
+{
+  process::metrics::remove(counters);
+  process::metrics::remove(sample_failures);
+  process::metrics::remove(sample_latency);
+  process::metrics::remove(read_latency);
+}
+
 } // namespace slave {
 } // namespace internal {
 } // namespace mesos {
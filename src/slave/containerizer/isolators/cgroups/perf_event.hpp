@@ -19,12 +19,18 @@
 #ifndef __PERF_EVENT_ISOLATOR_HPP__
 #define __PERF_EVENT_ISOLATOR_HPP__
 
+#include <list>
 #include <set>
 
 #include <mesos/slave/isolator.hpp>
 
+#include <process/owned.hpp>
 #include <process/time.hpp>
 
+#include <process/metrics/counter.hpp>
+#include <process/metrics/gauge.hpp>
+#include <process/metrics/timer.hpp>
+
 #include <stout/hashmap.hpp>
 
 #include "linux/perf.hpp"
@@ -74,7 +80,10 @@ protected:
 private:
   CgroupsPerfEventIsolatorProcess(
       const Flags& flags,
-      const std::string& hierarchy);
+      const std::string& hierarchy,
+      bool native,
+      bool tool,
+      size_t limit);
 
   void sample();
 
@@ -82,6 +91,21 @@ private:
       const process::Time& next,
       const process::Future<hashmap<std::string, PerfStatistics> >& statistics);
 
+  // Samples using the counters kept open for each container rather
+  // than running 'perf stat': the counters are enabled for the
+  // duration and then read.
+  void sampleNative();
+
+  void _sampleNative(
+      const std::list<ContainerID>& containerIds,
+      const process::Time& start,
+      const process::Time& next);
+
+  // Stores the perf tool sample of the containers whose counters
+  // could not be opened.
+  void __sampleNative(
+      const process::Future<hashmap<std::string, PerfStatistics> >& statistics);
+
   virtual process::Future<Nothing> _cleanup(const ContainerID& containerId);
 
   struct Info
@@ -100,6 +124,9 @@ private:
     const ContainerID containerId;
     const std::string cgroup;
     PerfStatistics statistics;
+    // The counters for the cgroup when sampling natively, or NULL if
+    // they could not be opened and the perf tool is used instead.
+    process::Owned<perf::Counters> counters;
     // Mark a container when we start destruction so we stop sampling it.
     bool destroying;
   };
@@ -111,7 +138,39 @@ private:
   // Set of events to sample.
   std::set<std::string> events;
 
+  // Whether to sample using perf_event_open(2) counters directly
+  // instead of the 'perf' tool.
+  const bool native;
+
+  // Whether the 'perf' tool can sample the events, which is used for
+  // containers whose counters could not be opened when sampling
+  // natively.
+  const bool tool;
+
+  // The maximum number of counters kept open across all containers.
+  const size_t limit;
+
+  // Whether a perf tool sample is in progress when sampling natively.
+  bool sampling;
+
   hashmap<ContainerID, Info*> infos;
+
+  // Opens the counters for the container's cgroup when sampling
+  // natively, unless that would exceed the limit of open counters.
+  Try<Nothing> open(Info* info);
+
+  struct Metrics
+  {
+    explicit Metrics(const CgroupsPerfEventIsolatorProcess& isolator);
+    ~Metrics();
+
+    process::metrics::Gauge counters;
+    process::metrics::Counter sample_failures;
+    process::metrics::Timer<Milliseconds> sample_latency;
+    process::metrics::Timer<Microseconds> read_latency;
+  } metrics;
+
+  double _counters();
 };
 
 } // namespace slave {
@@ -113,6 +113,10 @@ const std::string VETH_PREFIX = "mesos";
 // network namespace. This is very useful for debugging purposes.
 const string BIND_MOUNT_ROOT = "/var/run/netns";
 
+// How long a dump of the statistics of all the links is used to
+// serve the 'usage' calls for the containers.
+static const Duration LINK_STATISTICS_MAX_AGE = Milliseconds(200);
+
 
 // The minimum number of ephemeral ports a container should have.
 static const uint16_t MIN_EPHEMERAL_PORTS_SIZE = 16;
@@ -2051,8 +2055,7 @@ Future<ResourceStatistics> PortMappingIsolatorProcess::usage(
     return result;
   }
 
-  Result<hashmap<string, uint64_t> > stat =
-    link::statistics(veth(info->pid.get()));
+  Result<hashmap<string, uint64_t> > stat = vethStatistics(info->pid.get());
 
   if (stat.isError()) {
     return Failure(
@@ -2457,6 +2460,37 @@ Try<Nothing> PortMappingIsolatorProcess::_cleanup(Info* _info)
 }
 
 
+Result<hashmap<string, uint64_t>> PortMappingIsolatorProcess::vethStatistics(
+    pid_t pid)
+{
+  const string link = veth(pid);
+
+  // NOTE: We also dump again if the link is missing from a recent
+  // dump since the container may have been created after it.
+  if (links.isNone() ||
+      linksAge.elapsed() > LINK_STATISTICS_MAX_AGE ||
+      !links.get().contains(link)) {
+    Try<hashmap<string, hashmap<string, uint64_t>>> statistics =
+      link::statistics();
+
+    if (statistics.isError()) {
+      links = None();
+      return Error(statistics.error());
+    }
+
+    links = statistics.get();
+    linksAge.start();
+  }
+
+  Option<hashmap<string, uint64_t>> stat = links.get().get(link);
+  if (stat.isNone()) {
+    return None();
+  }
+
+  return stat.get();
+}
+
+
 // Helper function to set up IP filters on the host side for a given
 // port range.
 Try<Nothing> PortMappingIsolatorProcess::addHostIPFilters(
@@ -42,6 +42,7 @@
 #include <stout/mac.hpp>
 #include <stout/none.hpp>
 #include <stout/option.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/subcommand.hpp>
 
 #include "linux/routing/filter/ip.hpp"
@@ -261,6 +262,13 @@ private:
       ResourceStatistics result,
       const process::Future<std::string>& out);
 
+  // Returns the statistics of the host end of the veth of the
+  // container with the given pid. The statistics of all the links are
+  // dumped at once and the dump is shared by the calls made within
+  // LINK_STATISTICS_MAX_AGE, so that collecting the usage of all the
+  // containers takes a single netlink request rather than one each.
+  Result<hashmap<std::string, uint64_t>> vethStatistics(pid_t pid);
+
   // Helper functions.
   Try<Nothing> addHostIPFilters(
       const routing::filter::ip::PortRange& range,
@@ -302,6 +310,11 @@ private:
   // Recovered containers from a previous run that weren't managed by
   // the network isolator.
   hashset<ContainerID> unmanaged;
+
+  // The last dump of the statistics of all the links, keyed by link
+  // name, and the time since it was taken (see 'vethStatistics').
+  Option<hashmap<std::string, hashmap<std::string, uint64_t>>> links;
+  Stopwatch linksAge;
 };
 
 
@@ -0,0 +1,377 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <list>
+#include <string>
+
+#include <glog/logging.h>
+
+#include <mesos/values.hpp>
+
+#include <process/defer.hpp>
+
+#include <stout/check.hpp>
+#include <stout/foreach.hpp>
+#include <stout/os.hpp>
+#include <stout/stringify.hpp>
+
+#include "linux/xfs.hpp"
+
+#include "slave/containerizer/isolators/xfs/disk.hpp"
+
+using namespace process;
+
+using std::list;
+using std::string;
+
+namespace mesos {
+namespace internal {
+namespace slave {
+
+using mesos::slave::ExecutorRunState;
+using mesos::slave::Isolator;
+using mesos::slave::IsolatorProcess;
+using mesos::slave::Limitation;
+
+
+// Converts from value ranges to interval set.
+static IntervalSet<uint32_t> getIntervalSet(const Value::Ranges& ranges)
+{
+  IntervalSet<uint32_t> set;
+
+  for (int i = 0; i < ranges.range_size(); i++) {
+    set += (Bound<uint32_t>::closed(ranges.range(i).begin()),
+            Bound<uint32_t>::closed(ranges.range(i).end()));
+  }
+
+  return set;
+}
+
+
+Try<Isolator*> XfsDiskIsolatorProcess::create(const Flags& flags)
+{
+  Try<bool> enabled = xfs::isQuotaEnabled(flags.work_dir);
+  if (enabled.isError()) {
+    return Error(
+        "Failed to check XFS project quotas for '" + flags.work_dir +
+        "': " + enabled.error());
+  } else if (!enabled.get()) {
+    return Error(
+        "Work directory '" + flags.work_dir + "' must reside on an XFS "
+        "filesystem mounted with project quotas enabled ('prjquota')");
+  }
+
+  if (flags.enforce_container_disk_quota) {
+    Try<bool> enforced = xfs::isQuotaEnforced(flags.work_dir);
+    if (enforced.isError()) {
+      return Error(
+          "Failed to check XFS project quotas for '" + flags.work_dir +
+          "': " + enforced.error());
+    } else if (!enforced.get()) {
+      return Error(
+          "Project quotas are only accounted but not enforced on the "
+          "filesystem of work directory '" + flags.work_dir + "' (mounted "
+          "with 'pqnoenforce'), which --enforce_container_disk_quota "
+          "requires");
+    }
+  }
+
+  Try<Value> projects = values::parse(flags.xfs_project_range);
+  if (projects.isError()) {
+    return Error(
+        "Failed to parse --xfs_project_range: " + projects.error());
+  } else if (projects.get().type() != Value::RANGES) {
+    return Error(
+        "Expecting --xfs_project_range to be a range, e.g., '[5000-10000]'");
+  }
+
+  IntervalSet<uint32_t> projectIds = getIntervalSet(projects.get().ranges());
+
+  // Project ID 0 is the default project of all files.
+  if (projectIds.contains(0)) {
+    return Error("Project ID 0 is reserved and must not be in "
+                 "--xfs_project_range");
+  }
+
+  if (projectIds.empty()) {
+    return Error("No project IDs specified in --xfs_project_range");
+  }
+
+  return new Isolator(Owned<IsolatorProcess>(
+      new XfsDiskIsolatorProcess(flags, projectIds)));
+}
+
+
+XfsDiskIsolatorProcess::XfsDiskIsolatorProcess(
+    const Flags& _flags,
+    const IntervalSet<uint32_t>& projectIds)
+  : flags(_flags),
+    freeProjectIds(projectIds) {}
+
+
+XfsDiskIsolatorProcess::~XfsDiskIsolatorProcess() {}
+
+
+Future<Nothing> XfsDiskIsolatorProcess::recover(
+    const list<ExecutorRunState>& states)
+{
+  foreach (const ExecutorRunState& state, states) {
+    // Since we checkpoint the executor after we create its working
+    // directory, the working directory should definitely exist.
+    CHECK(os::exists(state.directory))
+      << "Executor work directory " << state.directory << " doesn't exist";
+
+    Try<uint32_t> projectId = xfs::getProjectId(state.directory);
+    if (projectId.isError()) {
+      return Failure(
+          "Failed to get project ID for container " +
+          stringify(state.id) + ": " + projectId.error());
+    }
+
+    // The container might have been launched without this isolator.
+    // We do not account its disk usage since the files that exist in
+    // the working directory would not be accounted to the project.
+    if (!freeProjectIds.contains(projectId.get())) {
+      LOG(WARNING) << "Not accounting disk usage of container " << state.id
+                   << " since its working directory has project ID "
+                   << projectId.get() << " which is not a free project ID";
+      continue;
+    }
+
+    freeProjectIds -= projectId.get();
+
+    infos.put(state.id, Owned<Info>(
+        new Info(state.directory, projectId.get())));
+  }
+
+  return Nothing();
+}
+
+
+Future<Option<CommandInfo>> XfsDiskIsolatorProcess::prepare(
+    const ContainerID& containerId,
+    const ExecutorInfo& executorInfo,
+    const string& directory,
+    const Option<string>& user)
+{
+  if (infos.contains(containerId)) {
+    return Failure("Container has already been prepared");
+  }
+
+  Option<uint32_t> projectId = allocateProjectId();
+  if (projectId.isNone()) {
+    return Failure("Failed to assign project ID, range exhausted");
+  }
+
+  // NOTE: The working directory is empty at this point (the fetcher
+  // and the executor run after 'prepare'), so all of its contents
+  // will inherit the project ID.
+  Try<Nothing> set = xfs::setProjectId(directory, projectId.get());
+  if (set.isError()) {
+    freeProjectIds += projectId.get();
+
+    return Failure(
+        "Failed to set project ID " + stringify(projectId.get()) +
+        " on '" + directory + "': " + set.error());
+  }
+
+  LOG(INFO) << "Assigned project ID " << projectId.get()
+            << " to container " << containerId
+            << " with working directory '" << directory << "'";
+
+  infos.put(containerId, Owned<Info>(new Info(directory, projectId.get())));
+
+  return None();
+}
+
+
+Future<Nothing> XfsDiskIsolatorProcess::isolate(
+    const ContainerID& containerId,
+    pid_t pid)
+{
+  if (!infos.contains(containerId)) {
+    return Failure("Unknown container");
+  }
+
+  return Nothing();
+}
+
+
+Future<Limitation> XfsDiskIsolatorProcess::watch(
+    const ContainerID& containerId)
+{
+  if (!infos.contains(containerId)) {
+    return Failure("Unknown container");
+  }
+
+  // NOTE: The limitation is never satisfied. The quota is enforced by
+  // the kernel which fails writes beyond it, so a container can not
+  // exceed its quota (and is not destroyed for reaching it), and
+  // without --enforce_container_disk_quota the usage is only
+  // accounted (as done by the 'posix/disk' isolator).
+  return infos[containerId]->limitation.future();
+}
+
+
+Future<Nothing> XfsDiskIsolatorProcess::update(
+    const ContainerID& containerId,
+    const Resources& resources)
+{
+  if (!infos.contains(containerId)) {
+    LOG(WARNING) << "Ignoring update for unknown container " << containerId;
+    return Nothing();
+  }
+
+  const Owned<Info>& info = infos[containerId];
+
+  Resources quota;
+
+  foreach (const Resource& resource, resources) {
+    if (resource.name() != "disk") {
+      continue;
+    }
+
+    // NOTE: We do not allow the case where has_disk() is true but
+    // with nothing set inside DiskInfo. The master will enforce it.
+    if (resource.has_disk()) {
+      // TODO(jieyu): Support persistent volmes as well.
+      LOG(ERROR) << "Enforcing disk quota unsupported for " << resource;
+      continue;
+    }
+
+    quota += resource;
+  }
+
+  info->quota = quota;
+
+  if (!flags.enforce_container_disk_quota) {
+    return Nothing();
+  }
+
+  LOG(INFO) << "Updating the disk quota of project " << info->projectId
+            << " for container " << containerId << " to " << quota;
+
+  Option<Bytes> limit = quota.disk();
+
+  Try<Nothing> result = (limit.isSome() && limit.get() > Bytes(0))
+    ? xfs::setProjectQuota(info->directory, info->projectId, limit.get())
+    : xfs::clearProjectQuota(info->directory, info->projectId);
+
+  if (result.isError()) {
+    return Failure(
+        "Failed to update the disk quota of project " +
+        stringify(info->projectId) + ": " + result.error());
+  }
+
+  return Nothing();
+}
+
+
+Future<ResourceStatistics> XfsDiskIsolatorProcess::usage(
+    const ContainerID& containerId)
+{
+  if (!infos.contains(containerId)) {
+    return Failure("Unknown container");
+  }
+
+  const Owned<Info>& info = infos[containerId];
+
+  ResourceStatistics result;
+
+  Option<Bytes> limit = info->quota.disk();
+  if (limit.isSome()) {
+    result.set_disk_limit_bytes(limit.get().bytes());
+  }
+
+  Result<xfs::QuotaInfo> quota =
+    xfs::getProjectQuota(info->directory, info->projectId);
+
+  if (quota.isError()) {
+    return Failure(
+        "Failed to get disk usage of project " +
+        stringify(info->projectId) + ": " + quota.error());
+  }
+
+  result.set_disk_used_bytes(quota.isSome() ? quota.get().used.bytes() : 0);
+
+  return result;
+}
+
+
+Future<Nothing> XfsDiskIsolatorProcess::cleanup(
+    const ContainerID& containerId)
+{
+  if (!infos.contains(containerId)) {
+    LOG(WARNING) << "Ignoring cleanup for unknown container " << containerId;
+    return Nothing();
+  }
+
+  const Owned<Info>& info = infos[containerId];
+
+  // Remove the limit (if any) so that the files left in the working
+  // directory do not count against a future quota of this project.
+  Try<Nothing> clear =
+    xfs::clearProjectQuota(info->directory, info->projectId);
+
+  if (clear.isError()) {
+    LOG(ERROR) << "Failed to clear the disk quota of project "
+               << info->projectId << " for container " << containerId
+               << ": " << clear.error();
+  }
+
+  freeProjectIds += info->projectId;
+
+  infos.erase(containerId);
+
+  return Nothing();
+}
+
+
+Option<uint32_t> XfsDiskIsolatorProcess::allocateProjectId()
+{
+  foreach (const Interval<uint32_t>& interval, freeProjectIds) {
+    for (uint32_t projectId = interval.lower();
+         projectId < interval.upper();
+         projectId++) {
+      // Skip project IDs that still account files, e.g., those of the
+      // working directories of terminated containers that have not
+      // been garbage collected yet.
+      Result<xfs::QuotaInfo> quota =
+        xfs::getProjectQuota(flags.work_dir, projectId);
+
+      if (quota.isError()) {
+        LOG(WARNING) << "Failed to check usage of project " << projectId
+                     << ": " << quota.error();
+        continue;
+      }
+
+      if (quota.isSome() && quota.get().inodes > 0) {
+        continue;
+      }
+
+      freeProjectIds -= projectId;
+      return projectId;
+    }
+  }
+
+  return None();
+}
+
+} // namespace slave {
+} // namespace internal {
+} // namespace mesos {
@@ -0,0 +1,131 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __XFS_DISK_ISOLATOR_HPP__
+#define __XFS_DISK_ISOLATOR_HPP__
+
+#include <stdint.h>
+
+#include <string>
+
+#include <mesos/resources.hpp>
+
+#include <mesos/slave/isolator.hpp>
+
+#include <process/owned.hpp>
+
+#include <stout/bytes.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/interval.hpp>
+
+#include "slave/flags.hpp"
+
+namespace mesos {
+namespace internal {
+namespace slave {
+
+// This isolator accounts (and optionally enforces) the disk usage of
+// the executor working directory using XFS project quotas. Each
+// container is assigned a project ID from '--xfs_project_range' and
+// its working directory is tagged with that project ID, so the kernel
+// maintains the disk usage of the sandbox as it is written to. This
+// makes usage collection a single quotactl(2) call rather than a 'du'
+// walk of the sandbox (see the 'posix/disk' isolator), and when
+// '--enforce_container_disk_quota' is set the quota is enforced by
+// the kernel as a hard limit: writes beyond the quota fail with
+// EDQUOT rather than the container being destroyed. Hence this
+// isolator never reports a limitation.
+//
+// NOTE: The slave work directory must reside on an XFS filesystem
+// mounted with the 'prjquota' option ('pqnoenforce' only accounts
+// the usage and can not be used to enforce the quota).
+class XfsDiskIsolatorProcess : public mesos::slave::IsolatorProcess
+{
+public:
+  static Try<mesos::slave::Isolator*> create(const Flags& flags);
+
+  virtual ~XfsDiskIsolatorProcess();
+
+  virtual process::Future<Nothing> recover(
+      const std::list<mesos::slave::ExecutorRunState>& states);
+
+  virtual process::Future<Option<CommandInfo>> prepare(
+      const ContainerID& containerId,
+      const ExecutorInfo& executorInfo,
+      const std::string& directory,
+      const Option<std::string>& user);
+
+  virtual process::Future<Nothing> isolate(
+      const ContainerID& containerId,
+      pid_t pid);
+
+  virtual process::Future<mesos::slave::Limitation> watch(
+      const ContainerID& containerId);
+
+  virtual process::Future<Nothing> update(
+      const ContainerID& containerId,
+      const Resources& resources);
+
+  virtual process::Future<ResourceStatistics> usage(
+      const ContainerID& containerId);
+
+  virtual process::Future<Nothing> cleanup(
+      const ContainerID& containerId);
+
+private:
+  XfsDiskIsolatorProcess(
+      const Flags& flags,
+      const IntervalSet<uint32_t>& projectIds);
+
+  // Allocates a project ID that is not accounting any files, or
+  // returns None if all project IDs are in use.
+  Option<uint32_t> allocateProjectId();
+
+  const Flags flags;
+
+  // The project IDs that are not assigned to any running container.
+  // NOTE: The working directory of a terminated container is only
+  // removed once it is garbage collected, and until then its files
+  // are still accounted to its project ID. Rather than tracking these
+  // directories (across slave restarts) we skip any free project ID
+  // for which the kernel still accounts files when allocating.
+  IntervalSet<uint32_t> freeProjectIds;
+
+  struct Info
+  {
+    Info(const std::string& _directory, uint32_t _projectId)
+      : directory(_directory), projectId(_projectId) {}
+
+    const std::string directory;
+    const uint32_t projectId;
+
+    // The disk resources of the executor working directory.
+    Resources quota;
+
+    // Never satisfied, see 'watch'.
+    process::Promise<mesos::slave::Limitation> limitation;
+  };
+
+  hashmap<ContainerID, process::Owned<Info>> infos;
+};
+
+} // namespace slave {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __XFS_DISK_ISOLATOR_HPP__
@@ -43,9 +43,39 @@ namespace slave {
 using mesos::slave::ExecutorRunState;
 
 
+#ifdef __linux__
+Try<Owned<Zygote> > Launcher::spawnZygote(const Flags& flags)
+{
+  if (!flags.launcher_zygote) {
+    return Owned<Zygote>();
+  }
+
+  Try<Owned<Zygote> > zygote = Zygote::create(flags.launcher_dir);
+  if (zygote.isError()) {
+    return Error("Failed to create zygote: " + zygote.error());
+  }
+
+  return zygote.get();
+}
+#endif // __linux__
+
+
 Try<Launcher*> PosixLauncher::create(const Flags& flags)
 {
+#ifdef __linux__
+  Try<Owned<Zygote> > zygote = Launcher::spawnZygote(flags);
+  if (zygote.isError()) {
+    return Error(zygote.error());
+  }
+
+  return new PosixLauncher(zygote.get());
+#else
+  if (flags.launcher_zygote) {
+    return Error("The launcher zygote is only supported on Linux");
+  }
+
   return new PosixLauncher();
+#endif // __linux__
 }
 
 
@@ -113,6 +143,39 @@ Try<pid_t> PosixLauncher::fork(
                  stringify(containerId));
   }
 
+#ifdef __linux__
+  // NOTE: This blocks the calling (i.e., containerizer) actor on the
+  // zygote's socket until the process has exec'ed, just as forking
+  // the slave below blocks it until the fork returns. The zygote
+  // only waits for the process to exec, never for it to exit.
+  if (zygote.get() != NULL && setup.isNone()) {
+    Try<pid_t> pid = zygote->fork(
+        path,
+        argv,
+        in,
+        out,
+        err,
+        flags,
+        environment,
+        0,
+        vector<string>());
+
+    if (pid.isSome()) {
+      LOG(INFO) << "Forked child with pid '" << pid.get()
+                << "' for container '" << containerId
+                << "' using the zygote";
+
+      pids.put(containerId, pid.get());
+
+      return pid.get();
+    }
+
+    LOG(WARNING) << "Failed to fork child for container '" << containerId
+                 << "' using the zygote, forking the slave instead: "
+                 << pid.error();
+  }
+#endif // __linux__
+
   Try<Subprocess> child = subprocess(
       path,
       argv,
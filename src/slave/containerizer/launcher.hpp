@@ -26,6 +26,7 @@
 #include <mesos/slave/isolator.hpp>
 
 #include <process/future.hpp>
+#include <process/owned.hpp>
 #include <process/subprocess.hpp>
 
 #include <stout/flags.hpp>
@@ -35,6 +36,10 @@
 
 #include "slave/flags.hpp"
 
+#ifdef __linux__
+#include "slave/containerizer/mesos/zygote.hpp"
+#endif // __linux__
+
 namespace mesos {
 namespace internal {
 namespace slave {
@@ -68,6 +73,13 @@ public:
 
   // Kill all processes in the containerized context.
   virtual process::Future<Nothing> destroy(const ContainerID& containerId) = 0;
+
+#ifdef __linux__
+protected:
+  // Returns a zygote for the launcher to fork with, if enabled (see
+  // the --launcher_zygote flag), and NULL otherwise.
+  static Try<process::Owned<Zygote> > spawnZygote(const Flags& flags);
+#endif // __linux__
 };
 
 
@@ -99,11 +111,22 @@ public:
   virtual process::Future<Nothing> destroy(const ContainerID& containerId);
 
 private:
+#ifdef __linux__
+  explicit PosixLauncher(const process::Owned<Zygote>& _zygote)
+    : zygote(_zygote) {}
+#else
   PosixLauncher() {}
+#endif // __linux__
 
   // The 'pid' is the process id of the first process and also the
   // process group id and session id.
   hashmap<ContainerID, pid_t> pids;
+
+#ifdef __linux__
+  // Used to fork, if not NULL, when no 'setup' function needs to be
+  // run in the child.
+  const process::Owned<Zygote> zygote;
+#endif // __linux__
 };
 
 } // namespace slave {
@@ -56,10 +56,12 @@ using mesos::slave::ExecutorRunState;
 LinuxLauncher::LinuxLauncher(
     const Flags& _flags,
     int _namespaces,
-    const string& _hierarchy)
+    const string& _hierarchy,
+    const Owned<Zygote>& _zygote)
   : flags(_flags),
     namespaces(_namespaces),
-    hierarchy(_hierarchy) {}
+    hierarchy(_hierarchy),
+    zygote(_zygote) {}
 
 
 // An old glibc might not have this symbol.
@@ -115,7 +117,12 @@ Try<Launcher*> LinuxLauncher::create(const Flags& flags)
     namespaces |= CLONE_NEWNS;
   }
 
-  return new LinuxLauncher(flags, namespaces, hierarchy.get());
+  Try<Owned<Zygote> > zygote = Launcher::spawnZygote(flags);
+  if (zygote.isError()) {
+    return Error(zygote.error());
+  }
+
+  return new LinuxLauncher(flags, namespaces, hierarchy.get(), zygote.get());
 }
 
 
@@ -286,6 +293,37 @@ Try<pid_t> LinuxLauncher::fork(
     }
   }
 
+  // The zygote clones the child into the namespaces and the child
+  // moves itself into the freezer cgroup before it execs.
+  if (zygote.get() != NULL && setup.isNone()) {
+    Try<pid_t> pid = zygote->fork(
+        path,
+        argv,
+        in,
+        out,
+        err,
+        flags,
+        environment,
+        namespaces,
+        vector<string>(1, path::join(hierarchy, cgroup(containerId))));
+
+    if (pid.isSome()) {
+      LOG(INFO) << "Cloned child with pid '" << pid.get()
+                << "' for container '" << containerId
+                << "' using the zygote";
+
+      if (!pids.contains(containerId)) {
+        pids.put(containerId, pid.get());
+      }
+
+      return pid.get();
+    }
+
+    LOG(WARNING) << "Failed to clone child for container '" << containerId
+                 << "' using the zygote, cloning the slave instead: "
+                 << pid.error();
+  }
+
   // Use a pipe to block the child until it's been moved into the
   // freezer cgroup.
   int pipes[2];
@@ -54,13 +54,18 @@ private:
   LinuxLauncher(
       const Flags& flags,
       int namespaces,
-      const std::string& hierarchy);
+      const std::string& hierarchy,
+      const process::Owned<Zygote>& zygote);
 
   static const std::string subsystem;
   const Flags flags;
   const int namespaces;
   const std::string hierarchy;
 
+  // Used to fork, if not NULL, when no 'setup' function needs to be
+  // run in the child.
+  const process::Owned<Zygote> zygote;
+
   std::string cgroup(const ContainerID& containerId);
 
   // The 'pid' is the process id of the child process and also the
@@ -51,6 +51,7 @@
 #include "slave/containerizer/isolators/cgroups/perf_event.hpp"
 #include "slave/containerizer/isolators/filesystem/shared.hpp"
 #include "slave/containerizer/isolators/namespaces/pid.hpp"
+#include "slave/containerizer/isolators/xfs/disk.hpp"
 #endif // __linux__
 #ifdef WITH_NETWORK_ISOLATOR
 #include "slave/containerizer/isolators/network/port_mapping.hpp"
@@ -124,6 +125,7 @@ Try<MesosContainerizer*> MesosContainerizer::create(
   creators["cgroups/perf_event"] = &CgroupsPerfEventIsolatorProcess::create;
   creators["filesystem/shared"] = &SharedFilesystemIsolatorProcess::create;
   creators["namespaces/pid"] = &NamespacesPidIsolatorProcess::create;
+  creators["xfs/disk"] = &XfsDiskIsolatorProcess::create;
 #endif // __linux__
 #ifdef WITH_NETWORK_ISOLATOR
   creators["network/port_mapping"] = &PortMappingIsolatorProcess::create;
@@ -418,11 +420,13 @@ Future<Nothing> MesosContainerizerProcess::__recover(
 
 // Launching an executor involves the following steps:
 // 1. Call prepare on each isolator.
-// 2. Fork the executor. The forked child is blocked from exec'ing until it has
+// 2. Start fetching the executor. The fetch proceeds in the background
+//    while the following steps are performed.
+// 3. Fork the executor. The forked child is blocked from exec'ing until it has
 //    been isolated.
-// 3. Isolate the executor. Call isolate with the pid for each isolator.
-// 4. Fetch the executor.
-// 4. Exec the executor. The forked child is signalled to continue. It will
+// 4. Isolate the executor. Call isolate with the pid for each isolator.
+// 5. Wait for the fetch to complete.
+// 6. Exec the executor. The forked child is signalled to continue. It will
 //    first execute any preparation commands from isolators and then exec the
 //    executor.
 Future<bool> MesosContainerizerProcess::launch(
@@ -479,7 +483,9 @@ Future<bool> MesosContainerizerProcess::launch(
   // container resources.
   container->resources = executorInfo.resources();
 
-  return prepare(containerId, executorInfo, directory, user)
+  Future<bool> future =
+    metrics.launch_prepare_latency.time(
+        prepare(containerId, executorInfo, directory, user))
     .then(defer(self(),
                 &Self::_launch,
                 containerId,
@@ -495,6 +501,8 @@ Future<bool> MesosContainerizerProcess::launch(
                     containerId,
                     executorInfo,
                     lambda::_1));
+
+  return metrics.launch_latency.time(future);
 }
 
 
@@ -607,6 +615,28 @@ Future<Nothing> MesosContainerizerProcess::fetch(
 }
 
 
+Future<Nothing> MesosContainerizerProcess::_fetch(
+    const ContainerID& containerId)
+{
+  if (!containers_.contains(containerId)) {
+    return Failure("Container has been destroyed");
+  }
+
+  Container* container = containers_[containerId].get();
+
+  if (container->state == DESTROYING) {
+    return Failure("Container is currently being destroyed");
+  }
+
+  container->state = FETCHING;
+
+  // The fetch was started before forking the executor so it may have
+  // completed by now; the wait here is the part of the fetch that was
+  // not hidden behind forking and isolating.
+  return metrics.launch_fetch_wait_latency.time(container->fetching);
+}
+
+
 Future<bool> MesosContainerizerProcess::_launch(
     const ContainerID& containerId,
     const ExecutorInfo& executorInfo,
@@ -625,6 +655,16 @@ Future<bool> MesosContainerizerProcess::_launch(
     return Failure("Container is currently being destroyed");
   }
 
+  // Fetch the URIs into the sandbox while the executor is forked and
+  // isolated. The fetch must not start before the isolators have been
+  // prepared because some of them expect an empty sandbox, e.g., the
+  // 'xfs/disk' isolator sets the project ID of the sandbox so that
+  // the files created in it are accounted to the container. None of
+  // the isolators touch the sandbox when isolating. The executor is
+  // not exec'ed until the fetch has completed, see '_fetch'.
+  containers_[containerId]->fetching = metrics.launch_fetch_latency.time(
+      fetch(containerId, executorInfo.command(), directory, user));
+
   // Prepare environment variables for the executor.
   map<string, string> env = executorEnvironment(
       executorInfo,
@@ -674,6 +714,8 @@ Future<bool> MesosContainerizerProcess::_launch(
   argv[0] = "mesos-containerizer";
   argv[1] = MesosContainerizerLaunch::NAME;
 
+  metrics.launch_fork_latency.start();
+
   Try<pid_t> forked = launcher->fork(
       containerId,
       path::join(flags.launcher_dir, "mesos-containerizer"),
@@ -687,6 +729,8 @@ Future<bool> MesosContainerizerProcess::_launch(
       env,
       None());
 
+  metrics.launch_fork_latency.stop();
+
   if (forked.isError()) {
     return Failure("Failed to fork executor: " + forked.error());
   }
@@ -721,13 +765,8 @@ Future<bool> MesosContainerizerProcess::_launch(
   status.onAny(defer(self(), &Self::reaped, containerId));
   containers_[containerId]->status = status;
 
-  return isolate(containerId, pid)
-    .then(defer(self(),
-                &Self::fetch,
-                containerId,
-                executorInfo.command(),
-                directory,
-                user))
+  return metrics.launch_isolate_latency.time(isolate(containerId, pid))
+    .then(defer(self(), &Self::_fetch, containerId))
     .then(defer(self(), &Self::exec, containerId, pipes[1]))
     .onAny(lambda::bind(&os::close, pipes[0]))
     .onAny(lambda::bind(&os::close, pipes[1]));
@@ -937,6 +976,14 @@ void MesosContainerizerProcess::destroy(const ContainerID& containerId)
 
   LOG(INFO) << "Destroying container '" << containerId << "'";
 
+  // The fetch is started once the isolators are prepared and runs
+  // alongside forking and isolating the container, so it may still
+  // be in progress in any state but RUNNING (e.g., if forking failed
+  // while the container was still PREPARING).
+  if (container->state != RUNNING) {
+    fetcher->kill(containerId);
+  }
+
   if (container->state == PREPARING) {
     // We cannot simply terminate the container if it's preparing
     // since isolator's prepare doesn't need any cleanup.
@@ -950,10 +997,6 @@ void MesosContainerizerProcess::destroy(const ContainerID& containerId)
     return;
   }
 
-  if (container->state == FETCHING) {
-    fetcher->kill(containerId);
-  }
-
   if (container->state == ISOLATING) {
     VLOG(1) << "Waiting for the isolators to complete for container '"
             << containerId << "'";
@@ -1187,15 +1230,39 @@ Future<hashset<ContainerID>> MesosContainerizerProcess::containers()
 
 MesosContainerizerProcess::Metrics::Metrics()
   : container_destroy_errors(
-        "containerizer/mesos/container_destroy_errors")
+        "containerizer/mesos/container_destroy_errors"),
+    launch_latency(
+        "containerizer/mesos/launch_latency"),
+    launch_prepare_latency(
+        "containerizer/mesos/launch_prepare_latency"),
+    launch_fetch_latency(
+        "containerizer/mesos/launch_fetch_latency"),
+    launch_fork_latency(
+        "containerizer/mesos/launch_fork_latency"),
+    launch_isolate_latency(
+        "containerizer/mesos/launch_isolate_latency"),
+    launch_fetch_wait_latency(
+        "containerizer/mesos/launch_fetch_wait_latency")
 {
   process::metrics::add(container_destroy_errors);
+  process::metrics::add(launch_latency);
+  process::metrics::add(launch_prepare_latency);
+  process::metrics::add(launch_fetch_latency);
+  process::metrics::add(launch_fork_latency);
+  process::metrics::add(launch_isolate_latency);
+  process::metrics::add(launch_fetch_wait_latency);
 }
 
 
 MesosContainerizerProcess::Metrics::~Metrics()
 {
   process::metrics::remove(container_destroy_errors);
+  process::metrics::remove(launch_latency);
+  process::metrics::remove(launch_prepare_latency);
+  process::metrics::remove(launch_fetch_latency);
+  process::metrics::remove(launch_fork_latency);
+  process::metrics::remove(launch_isolate_latency);
+  process::metrics::remove(launch_fetch_wait_latency);
 }
 
 
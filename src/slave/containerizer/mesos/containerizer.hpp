@@ -25,6 +25,7 @@
 #include <mesos/slave/isolator.hpp>
 
 #include <process/metrics/counter.hpp>
+#include <process/metrics/timer.hpp>
 
 #include <stout/hashmap.hpp>
 #include <stout/multihashmap.hpp>
@@ -179,6 +180,10 @@ private:
       const std::string& directory,
       const Option<std::string>& user);
 
+  // Waits for the fetch started by 'launch' once the executor has
+  // been isolated.
+  process::Future<Nothing> _fetch(const ContainerID& containerId);
+
   process::Future<bool> _launch(
       const ContainerID& containerId,
       const ExecutorInfo& executorInfo,
@@ -264,6 +269,10 @@ private:
     // cleanup after all isolators has finished isolating.
     process::Future<std::list<Nothing>> isolation;
 
+    // The fetch of the executor's URIs, which is started once the
+    // isolators are prepared and awaited before exec'ing the executor.
+    process::Future<Nothing> fetching;
+
     // We keep track of any limitations received from each isolator so we can
     // determine the cause of an executor termination.
     std::vector<mesos::slave::Limitation> limitations;
@@ -290,6 +299,17 @@ private:
     ~Metrics();
 
     process::metrics::Counter container_destroy_errors;
+
+    // Latencies of the container launch as a whole and of each of
+    // its stages. The fetch overlaps forking and isolating so
+    // 'launch_fetch_wait_latency' is the part of the fetch that
+    // still delays the launch.
+    process::metrics::Timer<Milliseconds> launch_latency;
+    process::metrics::Timer<Milliseconds> launch_prepare_latency;
+    process::metrics::Timer<Milliseconds> launch_fetch_latency;
+    process::metrics::Timer<Milliseconds> launch_fork_latency;
+    process::metrics::Timer<Milliseconds> launch_isolate_latency;
+    process::metrics::Timer<Milliseconds> launch_fetch_wait_latency;
   } metrics;
 };
 
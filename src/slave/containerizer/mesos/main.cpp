@@ -20,15 +20,25 @@
 #include <stout/subcommand.hpp>
 
 #include "slave/containerizer/mesos/launch.hpp"
+#include "slave/containerizer/mesos/zygote.hpp"
 
 using namespace mesos::internal::slave;
 
 
 int main(int argc, char** argv)
 {
+#ifdef __linux__
+  return Subcommand::dispatch(
+      None(),
+      argc,
+      argv,
+      new MesosContainerizerLaunch(),
+      new MesosContainerizerZygote());
+#else
   return Subcommand::dispatch(
       None(),
       argc,
       argv,
       new MesosContainerizerLaunch());
+#endif // __linux__
 }
@@ -0,0 +1,794 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <process/reap.hpp>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/json.hpp>
+#include <stout/none.hpp>
+#include <stout/nothing.hpp>
+#include <stout/numify.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/result.hpp>
+#include <stout/stringify.hpp>
+
+#include "slave/containerizer/mesos/zygote.hpp"
+
+using namespace process;
+
+using std::cerr;
+using std::endl;
+using std::list;
+using std::map;
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace internal {
+namespace slave {
+
+const string MesosContainerizerZygote::NAME = "zygote";
+
+
+MesosContainerizerZygote::Flags::Flags()
+{
+  add(&socket,
+      "socket",
+      "The file descriptor of the socket connected to the slave.");
+}
+
+
+// The most file descriptors that can be passed in a single message
+// (SCM_MAX_FD).
+static const size_t MAX_FDS = 253;
+
+
+// Messages are sent as their length followed by their data. Any file
+// descriptors are sent along with the first part of the message.
+static Try<Nothing> send(
+    int socket,
+    const string& data,
+    const vector<int>& fds)
+{
+  if (fds.size() > MAX_FDS) {
+    return Error("Too many file descriptors: " + stringify(fds.size()));
+  }
+
+  const uint32_t length = data.size();
+  const string buffer = string((const char*) &length, sizeof(length)) + data;
+
+  struct iovec iov;
+  iov.iov_base = (void*) buffer.data();
+  iov.iov_len = buffer.size();
+
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+
+  vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+
+  if (!fds.empty()) {
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+  }
+
+  ssize_t sent;
+  while ((sent = ::sendmsg(socket, &message, MSG_NOSIGNAL)) == -1 &&
+         errno == EINTR);
+
+  if (sent == -1) {
+    return ErrnoError("Failed to send");
+  }
+
+  // Send the rest of a message that did not fit into the socket
+  // buffer at once.
+  size_t offset = sent;
+  while (offset < buffer.size()) {
+    sent = ::send(
+        socket,
+        buffer.data() + offset,
+        buffer.size() - offset,
+        MSG_NOSIGNAL);
+
+    if (sent == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return ErrnoError("Failed to send");
+    }
+
+    offset += sent;
+  }
+
+  return Nothing();
+}
+
+
+static Try<Nothing> receive(int socket, char* buffer, size_t size)
+{
+  while (size > 0) {
+    ssize_t length = ::read(socket, buffer, size);
+
+    if (length == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return ErrnoError("Failed to receive");
+    } else if (length == 0) {
+      return Error("Unexpected end of file");
+    }
+
+    buffer += length;
+    size -= length;
+  }
+
+  return Nothing();
+}
+
+
+// Receives a message and the file descriptors sent along with it
+// (which are close-on-exec). Returns None if the peer has closed its
+// end of the socket.
+static Result<string> receive(int socket, vector<int>* fds)
+{
+  uint32_t length;
+
+  struct iovec iov;
+  iov.iov_base = &length;
+  iov.iov_len = sizeof(length);
+
+  vector<char> control(CMSG_SPACE(sizeof(int) * MAX_FDS));
+
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = control.size();
+
+  ssize_t received;
+  while ((received = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC)) == -1 &&
+         errno == EINTR);
+
+  if (received == -1) {
+    return ErrnoError("Failed to receive");
+  } else if (received == 0) {
+    return None();
+  }
+
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+       cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&message, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      const int* data = (const int*) CMSG_DATA(cmsg);
+      fds->insert(fds->end(), data, data + count);
+    }
+  }
+
+  Try<Nothing> receive = Nothing();
+
+  if (message.msg_flags & MSG_CTRUNC) {
+    receive = Error("Truncated file descriptors");
+  } else {
+    // Receive the rest of the length, if necessary, and the data.
+    receive = slave::receive(
+        socket,
+        (char*) &length + received,
+        sizeof(length) - received);
+  }
+
+  string data;
+
+  if (receive.isSome()) {
+    data.resize(length);
+    receive = slave::receive(socket, &data[0], length);
+  }
+
+  if (receive.isError()) {
+    foreach (int fd, *fds) {
+      os::close(fd);
+    }
+    fds->clear();
+    return Error(receive.error());
+  }
+
+  return data;
+}
+
+
+Try<process::Owned<Zygote> > Zygote::create(const string& directory)
+{
+  int sockets[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) == -1) {
+    return ErrnoError("Failed to create socket pair");
+  }
+
+  // The zygote's end has to be inherited by the zygote.
+  if (::fcntl(sockets[1], F_SETFD, 0) == -1) {
+    ErrnoError error("Failed to unset close-on-exec");
+    os::close(sockets[0]);
+    os::close(sockets[1]);
+    return error;
+  }
+
+  MesosContainerizerZygote::Flags flags;
+  flags.socket = sockets[1];
+
+  vector<string> argv(2);
+  argv[0] = "mesos-containerizer";
+  argv[1] = MesosContainerizerZygote::NAME;
+
+  Try<Subprocess> zygote = subprocess(
+      path::join(directory, "mesos-containerizer"),
+      argv,
+      Subprocess::FD(STDIN_FILENO),
+      Subprocess::FD(STDOUT_FILENO),
+      Subprocess::FD(STDERR_FILENO),
+      flags);
+
+  os::close(sockets[1]);
+
+  if (zygote.isError()) {
+    os::close(sockets[0]);
+    return Error("Failed to spawn the zygote: " + zygote.error());
+  }
+
+  LOG(INFO) << "Spawned zygote with pid " << zygote.get().pid();
+
+  return process::Owned<Zygote>(new Zygote(zygote.get(), sockets[0]));
+}
+
+
+Zygote::Zygote(const Subprocess& _process, int _socket)
+  : process(_process),
+    socket(_socket) {}
+
+
+Zygote::~Zygote()
+{
+  os::close(socket);
+}
+
+
+Try<pid_t> Zygote::fork(
+    const string& path,
+    const vector<string>& argv,
+    const Subprocess::IO& in,
+    const Subprocess::IO& out,
+    const Subprocess::IO& err,
+    const Option<flags::FlagsBase>& flags,
+    const Option<map<string, string> >& environment,
+    int namespaces,
+    const vector<string>& cgroups)
+{
+  if (in.isPipe() || out.isPipe() || err.isPipe()) {
+    return Error("Redirecting I/O to pipes is not supported");
+  }
+
+  // The file descriptors to pass and the numbers to install them at
+  // in the process, starting with stdin, stdout and stderr.
+  vector<int> fds;
+  vector<int> targets;
+
+  // The files opened here, to be closed once sent.
+  vector<int> opened;
+
+  const Subprocess::IO* ios[] = { &in, &out, &err };
+
+  for (int i = 0; i < 3; i++) {
+    if (ios[i]->isFd()) {
+      fds.push_back(ios[i]->descriptor().get());
+    } else {
+      // The same semantics as Subprocess::PATH.
+      Try<int> open = os::open(
+          ios[i]->file().get(),
+          i == STDIN_FILENO
+            ? O_RDONLY | O_CLOEXEC
+            : O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+          S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+      if (open.isError()) {
+        foreach (int fd, opened) {
+          os::close(fd);
+        }
+        return Error("Failed to open '" + ios[i]->file().get() + "': " +
+                     open.error());
+      }
+
+      fds.push_back(open.get());
+      opened.push_back(open.get());
+    }
+
+    targets.push_back(i);
+  }
+
+  // Pass the file descriptors the process would have inherited had
+  // the slave forked it, i.e., those which are not close-on-exec.
+  Try<list<string> > entries = os::ls("/proc/self/fd");
+  if (entries.isError()) {
+    foreach (int fd, opened) {
+      os::close(fd);
+    }
+    return Error("Failed to list file descriptors: " + entries.error());
+  }
+
+  foreach (const string& entry, entries.get()) {
+    Try<int> fd = numify<int>(entry);
+    if (fd.isError() || fd.get() <= STDERR_FILENO) {
+      continue;
+    }
+
+    int descriptor = ::fcntl(fd.get(), F_GETFD);
+    if (descriptor == -1 || (descriptor & FD_CLOEXEC)) {
+      continue;
+    }
+
+    fds.push_back(fd.get());
+    targets.push_back(fd.get());
+  }
+
+  JSON::Object request;
+  request.values["path"] = path;
+  request.values["namespaces"] = namespaces;
+
+  JSON::Array arguments;
+  foreach (const string& argument, argv) {
+    arguments.values.push_back(argument);
+  }
+
+  // Pass the flags as arguments, like 'subprocess'.
+  if (flags.isSome()) {
+    foreachpair (const string& name, const flags::Flag& flag, flags.get()) {
+      Option<string> value = flag.stringify(flags.get());
+      if (value.isSome()) {
+        arguments.values.push_back("--" + name + "=" + value.get());
+      }
+    }
+  }
+
+  request.values["argv"] = arguments;
+
+  // Like 'subprocess', the environment is the slave's environment
+  // with any of the given variables added or overridden.
+  hashmap<string, string> variables = os::environment();
+  if (environment.isSome()) {
+    foreachpair (const string& name, const string& value, environment.get()) {
+      variables[name] = value;
+    }
+  }
+
+  JSON::Object _environment;
+  foreachpair (const string& name, const string& value, variables) {
+    _environment.values[name] = value;
+  }
+
+  request.values["environment"] = _environment;
+
+  JSON::Array _targets;
+  foreach (int target, targets) {
+    _targets.values.push_back(target);
+  }
+
+  request.values["fds"] = _targets;
+
+  JSON::Array _cgroups;
+  foreach (const string& cgroup, cgroups) {
+    _cgroups.values.push_back(cgroup);
+  }
+
+  request.values["cgroups"] = _cgroups;
+
+  Try<Nothing> send = slave::send(socket, stringify(request), fds);
+
+  foreach (int fd, opened) {
+    os::close(fd);
+  }
+
+  if (send.isError()) {
+    return Error("Failed to send request to the zygote: " + send.error());
+  }
+
+  vector<int> received;
+  Result<string> receive = slave::receive(socket, &received);
+
+  foreach (int fd, received) {
+    os::close(fd);
+  }
+
+  if (!receive.isSome()) {
+    return Error("Failed to receive response from the zygote: " +
+                 (receive.isError() ? receive.error() : "end of file"));
+  }
+
+  Try<JSON::Object> response = JSON::parse<JSON::Object>(receive.get());
+  if (response.isError()) {
+    return Error("Failed to parse response from the zygote: " +
+                 response.error());
+  }
+
+  Result<JSON::Number> pid = response.get().find<JSON::Number>("pid");
+  Result<JSON::String> error = response.get().find<JSON::String>("error");
+
+  if (error.isSome()) {
+    // The process (a child of the slave) failed before it exec'ed;
+    // make sure it gets reaped.
+    if (pid.isSome()) {
+      process::reap(static_cast<pid_t>(pid.get().value));
+    }
+
+    return Error(error.get().value);
+  }
+
+  if (!pid.isSome()) {
+    return Error("Unexpected response from the zygote: " + receive.get());
+  }
+
+  return static_cast<pid_t>(pid.get().value);
+}
+
+
+// The steps after the clone, in the cloned process, which may fail.
+enum Step
+{
+  INSTALL,
+  SETSID,
+  JOIN,
+  EXEC,
+};
+
+
+static const char* DESCRIPTIONS[] = {
+  "install file descriptors",
+  "create a new session",
+  "join cgroup",
+  "exec",
+};
+
+
+// What the cloned process needs, prepared before the clone. The
+// process gets its own copy of the zygote's memory.
+struct Child
+{
+  const char* path;
+  char** argv;
+  char** envp;
+
+  // The received file descriptors and the numbers to install them at.
+  vector<int> fds;
+  vector<int> targets;
+
+  // The 'cgroup.procs' control files of the cgroups to join.
+  vector<string> cgroups;
+
+  // The lowest number that is neither a received file descriptor nor
+  // a target number, nor the pipe.
+  int base;
+
+  // The write end of the pipe to report a failure to the zygote.
+  int pipe;
+};
+
+
+// Reports the step that failed to the zygote and exits.
+static void fail(int pipe, Step step)
+{
+  int failure[2] = { step, errno };
+
+  while (::write(pipe, failure, sizeof(failure)) == -1 && errno == EINTR);
+
+  _exit(1);
+}
+
+
+static int childMain(void* _child)
+{
+  Child* child = static_cast<Child*>(_child);
+
+  // Move the pipe and the received file descriptors out of the way
+  // of the numbers they are installed at.
+  int pipe = ::fcntl(child->pipe, F_DUPFD_CLOEXEC, child->base);
+  if (pipe == -1) {
+    fail(child->pipe, INSTALL);
+  }
+
+  for (size_t i = 0; i < child->fds.size(); i++) {
+    child->fds[i] = ::fcntl(child->fds[i], F_DUPFD_CLOEXEC, child->base);
+    if (child->fds[i] == -1) {
+      fail(pipe, INSTALL);
+    }
+  }
+
+  // The installed file descriptors are not close-on-exec.
+  for (size_t i = 0; i < child->fds.size(); i++) {
+    if (::dup2(child->fds[i], child->targets[i]) == -1) {
+      fail(pipe, INSTALL);
+    }
+  }
+
+  // Move to a different session (and new process group) so we're
+  // independent from the slave's session, as the launchers do.
+  if (::setsid() == -1) {
+    fail(pipe, SETSID);
+  }
+
+  // Writing 0 to 'cgroup.procs' moves the writing process.
+  foreach (const string& cgroup, child->cgroups) {
+    int fd = ::open(cgroup.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+      fail(pipe, JOIN);
+    }
+
+    ssize_t length;
+    while ((length = ::write(fd, "0", 1)) == -1 && errno == EINTR);
+
+    if (length != 1) {
+      fail(pipe, JOIN);
+    }
+
+    ::close(fd);
+  }
+
+  os::execvpe(child->path, child->argv, child->envp);
+
+  fail(pipe, EXEC);
+
+  return 1;
+}
+
+
+// Launches the process requested by the slave and returns the
+// response: its pid and, if the process failed before it exec'ed,
+// the error.
+static JSON::Object launch(const string& data, const vector<int>& fds)
+{
+  JSON::Object response;
+
+  Try<JSON::Object> request = JSON::parse<JSON::Object>(data);
+  if (request.isError()) {
+    response.values["error"] = "Failed to parse request: " + request.error();
+    return response;
+  }
+
+  Result<JSON::String> path = request.get().find<JSON::String>("path");
+  Result<JSON::Array> argv = request.get().find<JSON::Array>("argv");
+  Result<JSON::Object> environment =
+    request.get().find<JSON::Object>("environment");
+  Result<JSON::Array> targets = request.get().find<JSON::Array>("fds");
+  Result<JSON::Number> namespaces =
+    request.get().find<JSON::Number>("namespaces");
+  Result<JSON::Array> cgroups = request.get().find<JSON::Array>("cgroups");
+
+  if (!path.isSome() ||
+      !argv.isSome() ||
+      !environment.isSome() ||
+      !targets.isSome() ||
+      !namespaces.isSome() ||
+      !cgroups.isSome() ||
+      targets.get().values.size() != fds.size()) {
+    response.values["error"] = "Malformed request";
+    return response;
+  }
+
+  Child child;
+  child.path = path.get().value.c_str();
+  child.fds = fds;
+
+  int base = 0;
+
+  foreach (const JSON::Value& target, targets.get().values) {
+    if (!target.is<JSON::Number>()) {
+      response.values["error"] = "Malformed request";
+      return response;
+    }
+
+    const int fd = static_cast<int>(target.as<JSON::Number>().value);
+
+    child.targets.push_back(fd);
+    base = std::max(base, fd);
+  }
+
+  foreach (int fd, fds) {
+    base = std::max(base, fd);
+  }
+
+  vector<string> arguments;
+  foreach (const JSON::Value& argument, argv.get().values) {
+    if (!argument.is<JSON::String>()) {
+      response.values["error"] = "Malformed request";
+      return response;
+    }
+
+    arguments.push_back(argument.as<JSON::String>().value);
+  }
+
+  vector<string> variables;
+  foreachpair (const string& name,
+               const JSON::Value& value,
+               environment.get().values) {
+    if (!value.is<JSON::String>()) {
+      response.values["error"] = "Malformed request";
+      return response;
+    }
+
+    variables.push_back(name + "=" + value.as<JSON::String>().value);
+  }
+
+  foreach (const JSON::Value& cgroup, cgroups.get().values) {
+    if (!cgroup.is<JSON::String>()) {
+      response.values["error"] = "Malformed request";
+      return response;
+    }
+
+    child.cgroups.push_back(
+        path::join(cgroup.as<JSON::String>().value, "cgroup.procs"));
+  }
+
+  vector<char*> _argv;
+  foreach (const string& argument, arguments) {
+    _argv.push_back(const_cast<char*>(argument.c_str()));
+  }
+  _argv.push_back(NULL);
+
+  vector<char*> envp;
+  foreach (const string& variable, variables) {
+    envp.push_back(const_cast<char*>(variable.c_str()));
+  }
+  envp.push_back(NULL);
+
+  child.argv = _argv.data();
+  child.envp = envp.data();
+
+  // The pipe is closed when the process execs, or carries the step
+  // that failed and the errno.
+  int pipes[2];
+  if (::pipe2(pipes, O_CLOEXEC) == -1) {
+    response.values["error"] = ErrnoError("Failed to create pipe").message;
+    return response;
+  }
+
+  child.pipe = pipes[1];
+  child.base = std::max(base, std::max(pipes[0], pipes[1])) + 1;
+
+  // Stack for the child.
+  // - unsigned long long used for best alignment.
+  // - static is ok because each child gets their own copy after the clone.
+  // - 8 MiB appears to be the default for "ulimit -s" on OSX and Linux.
+  static unsigned long long stack[(8*1024*1024)/sizeof(unsigned long long)];
+
+  // CLONE_PARENT makes the process a child of the slave rather than
+  // of the zygote, so the slave gets SIGCHLD and reaps it.
+  pid_t pid = ::clone(
+      childMain,
+      &stack[sizeof(stack)/sizeof(stack[0]) - 1],  // stack grows down.
+      static_cast<int>(namespaces.get().value) | CLONE_PARENT | SIGCHLD,
+      &child);
+
+  if (pid == -1) {
+    ErrnoError error("Failed to clone");
+    os::close(pipes[0]);
+    os::close(pipes[1]);
+    response.values["error"] = error.message;
+    return response;
+  }
+
+  os::close(pipes[1]);
+
+  response.values["pid"] = pid;
+
+  int failure[2];
+  ssize_t length;
+  while ((length = ::read(pipes[0], failure, sizeof(failure))) == -1 &&
+         errno == EINTR);
+
+  os::close(pipes[0]);
+
+  if (length == sizeof(failure) &&
+      failure[0] >= INSTALL &&
+      failure[0] <= EXEC) {
+    response.values["error"] =
+      "Failed to " + string(DESCRIPTIONS[failure[0]]) + " in child: " +
+      strerror(failure[1]);
+  } else if (length != 0) {
+    response.values["error"] = "Failed to synchronize with child";
+  }
+
+  return response;
+}
+
+
+int MesosContainerizerZygote::execute()
+{
+  if (flags.socket.isNone()) {
+    cerr << "Flag --socket is not specified" << endl;
+    return 1;
+  }
+
+  const int socket = flags.socket.get();
+
+  // Don't leak the socket into the launched processes.
+  Try<Nothing> cloexec = os::cloexec(socket);
+  if (cloexec.isError()) {
+    cerr << "Failed to set close-on-exec on the socket: "
+         << cloexec.error() << endl;
+    return 1;
+  }
+
+  while (true) {
+    vector<int> fds;
+    Result<string> request = slave::receive(socket, &fds);
+
+    if (request.isNone()) {
+      // The slave has closed its end of the socket.
+      return 0;
+    } else if (request.isError()) {
+      cerr << "Failed to receive request: " << request.error() << endl;
+      return 1;
+    }
+
+    JSON::Object response = launch(request.get(), fds);
+
+    foreach (int fd, fds) {
+      os::close(fd);
+    }
+
+    Try<Nothing> send = slave::send(socket, stringify(response), vector<int>());
+    if (send.isError()) {
+      cerr << "Failed to send response: " << send.error() << endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+} // namespace slave {
+} // namespace internal {
+} // namespace mesos {
@@ -0,0 +1,116 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MESOS_CONTAINERIZER_ZYGOTE_HPP__
+#define __MESOS_CONTAINERIZER_ZYGOTE_HPP__
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <process/owned.hpp>
+#include <process/subprocess.hpp>
+
+#include <stout/flags.hpp>
+#include <stout/option.hpp>
+#include <stout/subcommand.hpp>
+#include <stout/try.hpp>
+
+namespace mesos {
+namespace internal {
+namespace slave {
+
+// A small helper process, spawned once by a launcher, which forks
+// container processes on behalf of the slave. Forking the slave
+// itself has to copy the page tables of its large address space,
+// which dominates the latency of launching short lived containers,
+// whereas the zygote's address space is tiny.
+//
+// The zygote clones processes with CLONE_PARENT so they are children
+// of the slave, which reaps them (and learns their exit statuses)
+// exactly as if it had forked them. The file descriptors the process
+// would have inherited from the slave are passed along with each
+// request and installed at the same numbers.
+class Zygote
+{
+public:
+  // Spawns 'mesos-containerizer zygote' from the given directory.
+  static Try<process::Owned<Zygote> > create(const std::string& directory);
+
+  // Closing the socket terminates the zygote.
+  ~Zygote();
+
+  // Forks a process like Launcher::fork, but with the I/O limited to
+  // files and open file descriptors. The process is cloned into the
+  // given namespaces (CLONE_NEW* flags) and joins the given cgroups
+  // (absolute paths) before it execs. Requests are handled one at a
+  // time; the caller blocks until the process has exec'ed.
+  Try<pid_t> fork(
+      const std::string& path,
+      const std::vector<std::string>& argv,
+      const process::Subprocess::IO& in,
+      const process::Subprocess::IO& out,
+      const process::Subprocess::IO& err,
+      const Option<flags::FlagsBase>& flags,
+      const Option<std::map<std::string, std::string> >& environment,
+      int namespaces,
+      const std::vector<std::string>& cgroups);
+
+private:
+  Zygote(const process::Subprocess& process, int socket);
+
+  Zygote(const Zygote&);              // No copying.
+  Zygote& operator = (const Zygote&); // No assigning.
+
+  const process::Subprocess process;
+
+  // The slave's end of the socket connected to the zygote.
+  const int socket;
+};
+
+
+// The 'zygote' subcommand of mesos-containerizer which serves the
+// requests of a Zygote.
+class MesosContainerizerZygote : public Subcommand
+{
+public:
+  static const std::string NAME;
+
+  struct Flags : public flags::FlagsBase
+  {
+    Flags();
+
+    Option<int> socket;
+  };
+
+  MesosContainerizerZygote() : Subcommand(NAME) {}
+
+  Flags flags;
+
+protected:
+  virtual int execute();
+  virtual flags::FlagsBase* getFlags() { return &flags; }
+};
+
+} // namespace slave {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __MESOS_CONTAINERIZER_ZYGOTE_HPP__
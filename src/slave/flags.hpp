@@ -99,6 +99,14 @@ public:
         "Directory path of Mesos binaries",
         PKGLIBEXECDIR);
 
+    add(&Flags::launcher_zygote,
+        "launcher_zygote",
+        "Whether to launch containers from a small helper process\n"
+        "('mesos-containerizer zygote' in the launcher_dir) which is\n"
+        "spawned once, rather than by forking the slave, whose large\n"
+        "address space makes forking slow. Linux only.",
+        false);
+
     add(&Flags::hadoop_home,
         "hadoop_home",
         "Path to find Hadoop installed (for\n"
@@ -119,6 +127,20 @@ public:
         "Directory path prepended to relative executor URIs",
         "");
 
+    add(&Flags::fetcher_cache_dir,
+        "fetcher_cache_dir",
+        "Parent directory for the fetcher cache. URIs that set 'cache'\n"
+        "are fetched into this directory once and retrieved from there\n"
+        "into sandboxes. The directory is cleaned up when the slave\n"
+        "first uses it and must not be shared between slaves.",
+        "/tmp/mesos/fetch");
+
+    add(&Flags::fetcher_cache_size,
+        "fetcher_cache_size",
+        "Size of the fetcher cache. The least recently used files that\n"
+        "are not in use by any fetch are evicted when this is exceeded.",
+        DEFAULT_FETCHER_CACHE_SIZE);
+
     add(&Flags::registration_backoff_factor,
         "registration_backoff_factor",
         "Slave initially picks a random amount of time between [0, b], where\n"
@@ -159,6 +181,20 @@ public:
         "be a value between 0.0 and 1.0",
         GC_DISK_HEADROOM);
 
+    add(&Flags::gc_removal_rate,
+        "gc_removal_rate",
+        "Maximum amount of disk space the garbage collector reclaims\n"
+        "per second (e.g., 100MB, 1GB, etc). Removing further paths is\n"
+        "held back for as long as reclaiming the space of the removed\n"
+        "paths takes at this rate.",
+        GC_REMOVAL_RATE);
+
+    add(&Flags::gc_max_concurrent_removals,
+        "gc_max_concurrent_removals",
+        "Maximum number of paths the garbage collector removes\n"
+        "concurrently.",
+        GC_MAX_CONCURRENT_REMOVALS);
+
     add(&Flags::disk_watch_interval,
         "disk_watch_interval",
         "Periodic time interval (e.g., 10secs, 2mins, etc)\n"
@@ -219,6 +255,15 @@ public:
         "via the CFS bandwidth limiting subfeature.\n",
         false);
 
+    add(&Flags::cgroups_adaptive_cfs,
+        "cgroups_adaptive_cfs",
+        "Adapt the CFS quota of containers to the load of the host: a\n"
+        "throttled container may burst above its cpus allocation while\n"
+        "the host's cpus are idle and is clamped back to its allocation\n"
+        "when the host is under contention. Requires\n"
+        "--cgroups_enable_cfs.\n",
+        false);
+
     // TODO(antonl): Set default to true in future releases.
     add(&Flags::cgroups_limit_swap,
         "cgroups_limit_swap",
@@ -226,6 +271,14 @@ public:
         "swap instead of just memory.\n",
         false);
 
+    add(&Flags::cgroups_memory_pressure_limit,
+        "cgroups_memory_pressure_limit",
+        "If set, a container is destroyed as soon as its memory cgroup\n"
+        "reports memory pressure of the given level ('low', 'medium' or\n"
+        "'critical'), rather than waiting for the kernel OOM killer.\n"
+        "Memory pressure events are counted in the container's resource\n"
+        "statistics regardless of this flag.\n");
+
     add(&Flags::slave_subsystems,
         "slave_subsystems",
         "List of comma-separated cgroup subsystems to run the slave binary\n"
@@ -340,6 +393,17 @@ public:
         "before it kills that instance.",
         Seconds(0));
 
+    add(&Flags::docker_socket,
+        "docker_socket",
+        "The path of the unix socket of the Docker daemon\n"
+        "(e.g., /var/run/docker.sock). If set, the docker containerizer\n"
+        "inspects and lists containers through the remote API of the\n"
+        "daemon over a persistent connection instead of running the docker\n"
+        "executable, and caches the state of containers until the event\n"
+        "stream of the daemon reports a change. The resource usage of\n"
+        "containers is then also read from their cgroups rather than\n"
+        "from their process trees.");
+
 #ifdef WITH_NETWORK_ISOLATOR
     add(&Flags::ephemeral_ports_per_container,
         "ephemeral_ports_per_container",
@@ -395,9 +459,16 @@ public:
     add(&Flags::enforce_container_disk_quota,
         "enforce_container_disk_quota",
         "Whether to enable disk quota enforcement for containers. This flag\n"
-        "is used for the 'posix/disk' isolator.",
+        "is used for the 'posix/disk' and 'xfs/disk' isolators.",
         false);
 
+    add(&Flags::xfs_project_range,
+        "xfs_project_range",
+        "The ranges of XFS project IDs to use for tracking the disk usage\n"
+        "of containers. Each container is assigned a project ID from this\n"
+        "range. This flag is used for the 'xfs/disk' isolator.",
+        "[5000-10000]");
+
     // This help message for --modules flag is the same for
     // {master,slave,tests}/flags.hpp and should always be kept in
     // sync.
@@ -466,14 +537,19 @@ public:
   Option<std::string> attributes;
   std::string work_dir;
   std::string launcher_dir;
+  bool launcher_zygote;
   std::string hadoop_home; // TODO(benh): Make an Option.
   bool switch_user;
   std::string frameworks_home;  // TODO(benh): Make an Option.
+  std::string fetcher_cache_dir;
+  Bytes fetcher_cache_size;
   Duration registration_backoff_factor;
   Duration executor_registration_timeout;
   Duration executor_shutdown_grace_period;
   Duration gc_delay;
   double gc_disk_headroom;
+  Bytes gc_removal_rate;
+  size_t gc_max_concurrent_removals;
   Duration disk_watch_interval;
   Duration resource_monitoring_interval;
   // TODO(cmaloney): Remove checkpoint variable entirely, fixing tests
@@ -487,7 +563,9 @@ public:
   std::string cgroups_hierarchy;
   std::string cgroups_root;
   bool cgroups_enable_cfs;
+  bool cgroups_adaptive_cfs;
   bool cgroups_limit_swap;
+  Option<std::string> cgroups_memory_pressure_limit;
   Option<std::string> slave_subsystems;
   Option<std::string> perf_events;
   Duration perf_interval;
@@ -502,6 +580,7 @@ public:
   Duration docker_remove_delay;
   Option<ContainerInfo> default_container_info;
   Duration docker_stop_timeout;
+  Option<std::string> docker_socket;
 #ifdef WITH_NETWORK_ISOLATOR
   uint16_t ephemeral_ports_per_container;
   Option<std::string> eth0_name;
@@ -512,6 +591,7 @@ public:
 #endif
   Duration container_disk_watch_interval;
   bool enforce_container_disk_quota;
+  std::string xfs_project_range;
   Option<Modules> modules;
   std::string authenticatee;
   Option<std::string> hooks;
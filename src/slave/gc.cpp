@@ -16,16 +16,25 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <fts.h>
+#include <unistd.h>
+
 #include <list>
 
+#include <process/defer.hpp>
 #include <process/delay.hpp>
 #include <process/dispatch.hpp>
+#include <process/id.hpp>
+
+#include <process/metrics/metrics.hpp>
 
 #include <stout/foreach.hpp>
 #include <stout/os.hpp>
 
 #include "logging/logging.hpp"
 
+#include "slave/constants.hpp"
 #include "slave/gc.hpp"
 
 using namespace process;
@@ -41,11 +50,120 @@ namespace internal {
 namespace slave {
 
 
+// Removes paths on behalf of the garbage collector. A removal blocks
+// the remover until the whole tree has been deleted, hence the
+// garbage collector runs one remover per concurrent removal.
+class PathRemoverProcess : public Process<PathRemoverProcess>
+{
+public:
+  PathRemoverProcess() : ProcessBase(ID::generate("__gc_remover__")) {}
+
+  virtual ~PathRemoverProcess() {}
+
+  // Deletes the file or directory tree at the given path, akin to
+  // 'rm -r', and returns the disk space that has been reclaimed.
+  // The space is accounted while deleting so that the tree is only
+  // walked once. A file is only accounted when its last link is
+  // removed, as only then is its space reclaimed.
+  Try<Bytes> remove(const string& path)
+  {
+    char* paths[] = {const_cast<char*>(path.c_str()), NULL};
+
+    FTS* tree = fts_open(paths, FTS_NOCHDIR | FTS_PHYSICAL, NULL);
+    if (tree == NULL) {
+      return ErrnoError();
+    }
+
+    uint64_t blocks = 0;
+
+    FTSENT* node;
+    while ((node = fts_read(tree)) != NULL) {
+      switch (node->fts_info) {
+        case FTS_DP:
+          if (::rmdir(node->fts_path) < 0 && errno != ENOENT) {
+            ErrnoError error;
+            fts_close(tree);
+            return error;
+          }
+          blocks += node->fts_statp->st_blocks;
+          break;
+        case FTS_F:
+        case FTS_SL:
+        case FTS_SLNONE:
+        case FTS_DEFAULT:
+          if (::unlink(node->fts_path) < 0 && errno != ENOENT) {
+            ErrnoError error;
+            fts_close(tree);
+            return error;
+          }
+          if (node->fts_statp->st_nlink == 1) {
+            blocks += node->fts_statp->st_blocks;
+          }
+          break;
+        case FTS_DNR:
+        case FTS_NS:
+        case FTS_ERR: {
+          errno = node->fts_errno;
+          ErrnoError error;
+          fts_close(tree);
+          return error;
+        }
+        default:
+          break;
+      }
+    }
+
+    if (errno != 0) {
+      ErrnoError error;
+      fts_close(tree);
+      return error;
+    }
+
+    if (fts_close(tree) < 0) {
+      return ErrnoError();
+    }
+
+    // Note that 'st_blocks' is in units of 512 bytes.
+    return Bytes(blocks * 512);
+  }
+};
+
+
+GarbageCollectorProcess::GarbageCollectorProcess(const Flags& _flags)
+  : flags(_flags),
+    metrics(*this) {}
+
+
 GarbageCollectorProcess::~GarbageCollectorProcess()
 {
   foreachvalue (const PathInfo& info, paths) {
     info.promise->discard();
   }
+
+  foreachvalue (const PathInfo& info, removals) {
+    info.promise->discard();
+  }
+}
+
+
+void GarbageCollectorProcess::initialize()
+{
+  for (size_t i = 0; i < flags.gc_max_concurrent_removals; i++) {
+    PID<PathRemoverProcess> remover = spawn(new PathRemoverProcess(), true);
+
+    removers.push_back(remover);
+    idle.push_back(remover);
+  }
+}
+
+
+void GarbageCollectorProcess::finalize()
+{
+  // NOTE: A removal in progress is finished before its remover is
+  // terminated, but the result is dropped.
+  foreach (const PID<PathRemoverProcess>& remover, removers) {
+    terminate(remover);
+  }
 }
 
 
@@ -114,67 +232,154 @@ bool GarbageCollectorProcess::unschedule(const string& path)
 void GarbageCollectorProcess::reset()
 {
   Clock::cancel(timer); // Cancel the existing timer, if any.
-  if (!paths.empty()) {
-    Timeout removalTime = (*paths.begin()).first; // Get the first entry.
+  timer = Timer(); // Reset the timer.
 
-    timer = delay(removalTime.remaining(), self(), &Self::remove, removalTime);
-  } else {
-    timer = Timer(); // Reset the timer.
+  if (paths.empty()) {
+    return;
+  }
+
+  Timeout removalTime = (*paths.begin()).first; // Get the first entry.
+
+  if (!due(removalTime)) {
+    timer = delay(removalTime.remaining(), self(), &Self::remove);
+  } else if (!throttle.expired()) {
+    // Wait for the removal rate to allow for further removals.
+    timer = delay(throttle.remaining(), self(), &Self::remove);
+  } else if (!idle.empty()) {
+    timer = delay(Seconds(0), self(), &Self::remove);
   }
+
+  // Otherwise all concurrent removals are in progress and 'remove'
+  // is invoked again once one of them has completed.
 }
 
 
-void GarbageCollectorProcess::remove(const Timeout& removalTime)
+bool GarbageCollectorProcess::due(const Timeout& removalTime) const
 {
-  // TODO(bmahler): Other dispatches can block waiting for a removal
-  // operation. To fix this, the removal operation can be done
-  // asynchronously in another thread.
-  if (paths.count(removalTime) > 0) {
-    foreach (const PathInfo& info, paths.get(removalTime)) {
-      LOG(INFO) << "Deleting " << info.path;
+  return removalTime.remaining() == Seconds(0) ||
+    (pruning.isSome() && removalTime <= pruning.get());
+}
 
-      Try<Nothing> rmdir = os::rmdir(info.path);
 
-      if (rmdir.isError()) {
-        LOG(WARNING) << "Failed to delete '" << info.path << "': "
-                     << rmdir.error();
-        info.promise->fail(rmdir.error());
-      } else {
-        LOG(INFO) << "Deleted '" << info.path << "'";
-        info.promise->set(rmdir.get());
-      }
+void GarbageCollectorProcess::remove()
+{
+  while (!paths.empty() && throttle.expired() && !idle.empty()) {
+    Timeout removalTime = (*paths.begin()).first;
 
-      timeouts.erase(info.path);
+    if (!due(removalTime)) {
+      break;
     }
 
-    paths.remove(removalTime);
-  } else {
-    // This occurs when either:
-    //   1. The path(s) has already been removed (e.g. by prune()).
-    //   2. All paths under the removal time were unscheduled.
-    LOG(INFO) << "Ignoring gc event at " << removalTime.remaining()
-              << " as the paths were already removed, or were unscheduled";
+    // Make a copy, as we erase the entry below.
+    const PathInfo info = (*paths.begin()).second;
+
+    CHECK(paths.remove(removalTime, info));
+    CHECK(timeouts.erase(info.path) > 0);
+
+    LOG(INFO) << "Deleting " << info.path;
+
+    const PID<PathRemoverProcess> remover = idle.front();
+    idle.pop_front();
+
+    removals.put(info.path, info);
+
+    metrics.path_removal_latency
+      .time(dispatch(remover, &PathRemoverProcess::remove, info.path))
+      .onAny(defer(self(), &Self::_remove, info, remover, lambda::_1));
   }
 
   reset(); // Schedule the timer for next event.
 }
 
 
-void GarbageCollectorProcess::prune(const Duration& d)
+void GarbageCollectorProcess::_remove(
+    const PathInfo& info,
+    const PID<PathRemoverProcess>& remover,
+    const Future<Try<Bytes> >& removal)
 {
-  foreach (const Timeout& removalTime, paths.keys()) {
-    if (removalTime.remaining() <= d) {
-      LOG(INFO) << "Pruning directories with remaining removal time "
-                << removalTime.remaining();
-      dispatch(self(), &GarbageCollectorProcess::remove, removalTime);
-    }
+  removals.erase(info.path);
+  idle.push_back(remover);
+
+  if (!removal.isReady() || removal.get().isError()) {
+    const string error = !removal.isReady()
+      ? (removal.isFailed() ? removal.failure() : "discarded")
+      : removal.get().error();
+
+    LOG(WARNING) << "Failed to delete '" << info.path << "': " << error;
+    info.promise->fail(error);
+
+    ++metrics.path_removals_failed;
+  } else {
+    LOG(INFO) << "Deleted '" << info.path << "'";
+    info.promise->set(Nothing());
+
+    const Bytes reclaimed = removal.get().get();
+
+    ++metrics.path_removals_succeeded;
+    metrics.bytes_reclaimed += reclaimed.bytes();
+
+    // Hold back further removals for as long as reclaiming the space
+    // takes at the removal rate, in addition to any earlier delay.
+    throttle = Timeout::in(
+        throttle.remaining() +
+        Seconds(1) * ((double) reclaimed.bytes() /
+                      flags.gc_removal_rate.bytes()));
   }
+
+  remove(); // Continue with the paths that are due.
+}
+
+
+void GarbageCollectorProcess::prune(const Duration& d)
+{
+  LOG(INFO) << "Pruning directories with remaining removal time " << d
+            << " or less";
+
+  pruning = Timeout::in(d);
+
+  remove();
+}
+
+
+GarbageCollectorProcess::Metrics::Metrics(const GarbageCollectorProcess& gc)
+  : paths_scheduled(
+        "gc/paths_scheduled",
+        defer(gc, &GarbageCollectorProcess::_paths_scheduled)),
+    path_removals_pending(
+        "gc/path_removals_pending",
+        defer(gc, &GarbageCollectorProcess::_path_removals_pending)),
+    path_removals_succeeded(
+        "gc/path_removals_succeeded"),
+    path_removals_failed(
+        "gc/path_removals_failed"),
+    bytes_reclaimed(
+        "gc/bytes_reclaimed"),
+    path_removal_latency(
+        "gc/path_removal_latency")
+{
+  process::metrics::add(paths_scheduled);
+  process::metrics::add(path_removals_pending);
+  process::metrics::add(path_removals_succeeded);
+  process::metrics::add(path_removals_failed);
+  process::metrics::add(bytes_reclaimed);
+  process::metrics::add(path_removal_latency);
+}
+
+
+GarbageCollectorProcess::Metrics::~Metrics()
+{
+  process::metrics::remove(paths_scheduled);
+  process::metrics::remove(path_removals_pending);
+  process::metrics::remove(path_removals_succeeded);
+  process::metrics::remove(path_removals_failed);
+  process::metrics::remove(bytes_reclaimed);
+  process::metrics::remove(path_removal_latency);
 }
 
 
-GarbageCollector::GarbageCollector()
+GarbageCollector::GarbageCollector(const Flags& flags)
 {
-  process = new GarbageCollectorProcess();
+  process = new GarbageCollectorProcess(flags);
   spawn(process);
 }
 
@@ -19,27 +19,37 @@
 #ifndef __SLAVE_GC_HPP__
 #define __SLAVE_GC_HPP__
 
+#include <list>
 #include <string>
 #include <vector>
 
 #include <process/future.hpp>
 #include <process/owned.hpp>
+#include <process/pid.hpp>
 #include <process/process.hpp>
 #include <process/timeout.hpp>
 #include <process/timer.hpp>
 
+#include <process/metrics/counter.hpp>
+#include <process/metrics/gauge.hpp>
+#include <process/metrics/timer.hpp>
+
+#include <stout/bytes.hpp>
 #include <stout/duration.hpp>
 #include <stout/hashmap.hpp>
 #include <stout/multimap.hpp>
 #include <stout/nothing.hpp>
 #include <stout/try.hpp>
 
+#include "slave/flags.hpp"
+
 namespace mesos {
 namespace internal {
 namespace slave {
 
 // Forward declarations.
 class GarbageCollectorProcess;
+class PathRemoverProcess;
 
 // Provides an abstraction for removing files and directories after
 // some point at which they are no longer considered necessary to keep
@@ -51,7 +61,7 @@ class GarbageCollectorProcess;
 class GarbageCollector
 {
 public:
-  GarbageCollector();
+  explicit GarbageCollector(const Flags& flags = Flags());
   virtual ~GarbageCollector();
 
   // Schedules the specified path for removal after the specified
@@ -76,7 +86,10 @@ public:
   virtual process::Future<bool> unschedule(const std::string& path);
 
   // Deletes all the directories, whose scheduled garbage collection time
-  // is within the next 'd' duration of time.
+  // is within the next 'd' duration of time. Directories are deleted
+  // in the order of their scheduled garbage collection time (i.e., the
+  // oldest first) at the rate the garbage collector reclaims disk
+  // space, and a subsequent prune replaces the previous one.
   virtual void prune(const Duration& d);
 
 private:
@@ -88,8 +101,13 @@ class GarbageCollectorProcess :
     public process::Process<GarbageCollectorProcess>
 {
 public:
+  explicit GarbageCollectorProcess(const Flags& flags);
+
   virtual ~GarbageCollectorProcess();
 
+  virtual void initialize();
+  virtual void finalize();
+
   process::Future<Nothing> schedule(
       const Duration& d,
       const std::string& path);
@@ -99,10 +117,6 @@ public:
   void prune(const Duration& d);
 
 private:
-  void reset();
-
-  void remove(const process::Timeout& removalTime);
-
   struct PathInfo
   {
     PathInfo(const std::string& _path,
@@ -118,6 +132,24 @@ private:
     const process::Owned<process::Promise<Nothing> > promise;
   };
 
+  void reset();
+
+  // Returns true if the path(s) at the removal time are due, either
+  // because their removal time has elapsed or because they are
+  // being pruned.
+  bool due(const process::Timeout& removalTime) const;
+
+  // Starts removing the due paths, oldest first, within the limits
+  // on concurrent removals and on the removal rate.
+  void remove();
+
+  void _remove(
+      const PathInfo& info,
+      const process::PID<PathRemoverProcess>& remover,
+      const process::Future<Try<Bytes> >& removal);
+
+  const Flags flags;
+
   // Store all the timeouts and corresponding paths to delete.
   // NOTE: We are using Multimap here instead of Multihashmap, because
   // we need the keys of the map (deletion time) to be sorted.
@@ -127,7 +159,49 @@ private:
   // it exists in our paths mapping.
   hashmap<std::string, process::Timeout> timeouts;
 
+  // The paths that are currently being removed. Removal is done by
+  // the removers so that the actor is not blocked on the file system,
+  // one remover per concurrent removal.
+  hashmap<std::string, PathInfo> removals;
+
+  std::vector<process::PID<PathRemoverProcess> > removers;
+  std::list<process::PID<PathRemoverProcess> > idle;
+
+  // Paths scheduled for removal up to this time are pruned.
+  Option<process::Timeout> pruning;
+
+  // Removals are held back until this elapses, i.e., for as long as
+  // reclaiming the space of the previous removals takes at the
+  // removal rate.
+  process::Timeout throttle;
+
   process::Timer timer;
+
+  struct Metrics
+  {
+    explicit Metrics(const GarbageCollectorProcess& gc);
+    ~Metrics();
+
+    process::metrics::Gauge paths_scheduled;
+    process::metrics::Gauge path_removals_pending;
+    process::metrics::Counter path_removals_succeeded;
+    process::metrics::Counter path_removals_failed;
+    process::metrics::Counter bytes_reclaimed;
+    process::metrics::Timer<Milliseconds> path_removal_latency;
+  } metrics;
+
+  // The paths that are scheduled for removal but whose removal has
+  // not been started yet.
+  double _paths_scheduled()
+  {
+    return timeouts.size();
+  }
+
+  // The removals that have been started but not finished yet.
+  double _path_removals_pending()
+  {
+    return removals.size();
+  }
 };
 
 } // namespace slave {
@@ -200,7 +200,7 @@ int main(int argc, char** argv)
   LOG(INFO) << "Starting Mesos slave";
 
   Files files;
-  GarbageCollector gc;
+  GarbageCollector gc(flags);
   StatusUpdateManager statusUpdateManager(flags);
 
   Slave* slave = new Slave(
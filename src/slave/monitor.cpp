@@ -33,7 +33,6 @@
 #include <process/statistics.hpp>
 
 #include <stout/json.hpp>
-#include <stout/lambda.hpp>
 #include <stout/protobuf.hpp>
 
 #include "slave/containerizer/containerizer.hpp"
@@ -63,7 +62,7 @@ const size_t MONITORING_ARCHIVED_TIME_SERIES = 25;
 Future<Nothing> ResourceMonitorProcess::start(
     const ContainerID& containerId,
     const ExecutorInfo& executorInfo,
-    const Duration& interval)
+    const Duration& _interval)
 {
   if (monitored.contains(containerId)) {
     return Failure("Already monitored");
@@ -74,8 +73,18 @@ Future<Nothing> ResourceMonitorProcess::start(
                      MONITORING_TIME_SERIES_WINDOW,
                      MONITORING_TIME_SERIES_CAPACITY);
 
-  // Schedule the resource collection.
-  delay(interval, self(), &Self::collect, containerId, interval);
+  // All containers are collected in the same batch, so we collect at
+  // the smallest interval requested. Any change takes effect once the
+  // currently scheduled collection completes.
+  if (interval.isNone() || _interval < interval.get()) {
+    interval = _interval;
+  }
+
+  // Schedule the batched resource collection if needed.
+  if (!collecting) {
+    collecting = true;
+    delay(interval.get(), self(), &Self::collect);
+  }
 
   return Nothing();
 }
@@ -98,28 +107,56 @@ Future<Nothing> ResourceMonitorProcess::stop(
 }
 
 
-void ResourceMonitorProcess::collect(
-    const ContainerID& containerId,
-    const Duration& interval)
+void ResourceMonitorProcess::collect()
 {
-  // Has monitoring stopped?
-  if (!monitored.contains(containerId)) {
+  CHECK(collecting);
+  CHECK_SOME(interval);
+
+  // Has monitoring stopped for all containers? The next call to
+  // 'start' will schedule a new collection.
+  if (monitored.empty()) {
+    collecting = false;
     return;
   }
 
-  containerizer->usage(containerId)
-    .onAny(defer(self(),
-                 &Self::_collect,
-                 lambda::_1,
-                 containerId,
-                 interval));
+  list<ContainerID> containerIds;
+  list<Future<ResourceStatistics> > futures;
+
+  foreachkey (const ContainerID& containerId, monitored) {
+    // TODO(bmahler): Consider a batch usage API on the Containerizer.
+    containerIds.push_back(containerId);
+    futures.push_back(containerizer->usage(containerId));
+  }
+
+  // Wait for the entire batch so that at most one collection is
+  // outstanding at any time, regardless of the number of containers.
+  process::await(futures)
+    .onAny(defer(self(), &Self::_collect, containerIds, futures));
 }
 
 
 void ResourceMonitorProcess::_collect(
-    const Future<ResourceStatistics>& statistics,
+    const list<ContainerID>& containerIds,
+    const list<Future<ResourceStatistics> >& statistics)
+{
+  CHECK_EQ(containerIds.size(), statistics.size());
+
+  list<ContainerID>::const_iterator containerId = containerIds.begin();
+  list<Future<ResourceStatistics> >::const_iterator future =
+    statistics.begin();
+
+  for (; containerId != containerIds.end(); ++containerId, ++future) {
+    record(*containerId, *future);
+  }
+
+  // Schedule the next collection.
+  delay(interval.get(), self(), &Self::collect);
+}
+
+
+void ResourceMonitorProcess::record(
     const ContainerID& containerId,
-    const Duration& interval)
+    const Future<ResourceStatistics>& statistics)
 {
   // Has monitoring been stopped?
   if (!monitored.contains(containerId)) {
@@ -158,22 +195,6 @@ void ResourceMonitorProcess::_collect(
           statistics.get(), time.get());
     }
   }
-
-  // Schedule the next collection.
-  delay(interval, self(), &Self::collect, containerId, interval);
-}
-
-
-ResourceMonitorProcess::Usage ResourceMonitorProcess::usage(
-    const ContainerID& containerId,
-    const ExecutorInfo& executorInfo)
-{
-  Usage usage;
-  usage.containerId = containerId;
-  usage.executorInfo = executorInfo;
-  usage.statistics = containerizer->usage(containerId);
-
-  return usage;
 }
 
 
@@ -187,47 +208,24 @@ Future<http::Response> ResourceMonitorProcess::statistics(
 
 Future<http::Response> ResourceMonitorProcess::_statistics(
     const http::Request& request)
-{
-  list<Usage> usages;
-  list<Future<ResourceStatistics> > futures;
-
-  foreachpair (const ContainerID& containerId,
-               const MonitoringInfo& info,
-               monitored) {
-    // TODO(bmahler): Consider a batch usage API on the Containerizer.
-    usages.push_back(usage(containerId, info.executorInfo));
-    futures.push_back(usages.back().statistics);
-  }
-
-  return process::await(futures)
-    .then(defer(self(), &Self::__statistics, usages, request));
-}
-
-
-Future<http::Response> ResourceMonitorProcess::__statistics(
-    const list<ResourceMonitorProcess::Usage>& usages,
-    const http::Request& request)
 {
   JSON::Array result;
 
-  foreach (const Usage& usage, usages) {
-    if (usage.statistics.isFailed()) {
-      LOG(WARNING) << "Failed to get resource usage for "
-                   << " container " << usage.containerId
-                   << " for executor " << usage.executorInfo.executor_id()
-                   << " of framework " << usage.executorInfo.framework_id()
-                   << ": " << usage.statistics.failure();
-      continue;
-    } else if (usage.statistics.isDiscarded()) {
+  foreachvalue (const MonitoringInfo& info, monitored) {
+    // Containers that have not been collected yet are omitted.
+    Option<TimeSeries<ResourceStatistics>::Value> latest =
+      info.statistics.latest();
+
+    if (latest.isNone()) {
       continue;
     }
 
     JSON::Object entry;
-    entry.values["framework_id"] = usage.executorInfo.framework_id().value();
-    entry.values["executor_id"] = usage.executorInfo.executor_id().value();
-    entry.values["executor_name"] = usage.executorInfo.name();
-    entry.values["source"] = usage.executorInfo.source();
-    entry.values["statistics"] = JSON::Protobuf(usage.statistics.get());
+    entry.values["framework_id"] = info.executorInfo.framework_id().value();
+    entry.values["executor_id"] = info.executorInfo.executor_id().value();
+    entry.values["executor_name"] = info.executorInfo.name();
+    entry.values["source"] = info.executorInfo.source();
+    entry.values["statistics"] = JSON::Protobuf(latest.get().data);
 
     result.values.push_back(entry);
   }
@@ -242,8 +240,8 @@ const string ResourceMonitorProcess::STATISTICS_HELP = HELP(
     USAGE(
         "/statistics.json"),
     DESCRIPTION(
-        "Returns the current resource consumption data for containers",
-        "running under this slave.",
+        "Returns the most recently collected resource consumption data",
+        "for containers running under this slave.",
         "",
         "Example:",
         "",
@@ -19,6 +19,7 @@
 #ifndef __SLAVE_MONITOR_HPP__
 #define __SLAVE_MONITOR_HPP__
 
+#include <list>
 #include <map>
 #include <string>
 
@@ -96,6 +97,7 @@ public:
     : ProcessBase("monitor"),
       containerizer(_containerizer),
       limiter(2, Seconds(1)), // 2 permits per second.
+      collecting(false),
       archive(MONITORING_ARCHIVED_TIME_SERIES) {}
 
   virtual ~ResourceMonitorProcess() {}
@@ -121,36 +123,27 @@ protected:
   }
 
 private:
-  void collect(
-      const ContainerID& containerId,
-      const Duration& interval);
+  // Collects the usage of all monitored containers in a single batch
+  // and schedules the next collection, rather than keeping a separate
+  // timer (and a separate containerizer round-trip) per container.
+  void collect();
   void _collect(
-      const process::Future<ResourceStatistics>& statistics,
-      const ContainerID& containerId,
-      const Duration& interval);
-
-  // This is a convenience struct for bundling usage information.
-  struct Usage
-  {
-    ContainerID containerId;
-    ExecutorInfo executorInfo;
-    process::Future<ResourceStatistics> statistics;
-  };
+      const std::list<ContainerID>& containerIds,
+      const std::list<process::Future<ResourceStatistics> >& statistics);
 
-  // Helper for returning the usage for a particular executor.
-  Usage usage(
+  // Records the outcome of a single container's collection.
+  void record(
       const ContainerID& containerId,
-      const ExecutorInfo& executorInfo);
+      const process::Future<ResourceStatistics>& statistics);
 
   // HTTP Endpoints.
   // Returns the monitoring statistics. Requests have no parameters.
+  // The statistics are served from the latest collection rather than
+  // by querying the containerizer on each request.
   process::Future<process::http::Response> statistics(
       const process::http::Request& request);
   process::Future<process::http::Response> _statistics(
       const process::http::Request& request);
-  process::Future<process::http::Response> __statistics(
-      const std::list<Usage>& usages,
-      const process::http::Request& request);
 
   static const std::string STATISTICS_HELP;
 
@@ -159,6 +152,13 @@ private:
   // Used to rate limit the statistics.json endpoint.
   process::RateLimiter limiter;
 
+  // The interval between batched collections. This is the smallest
+  // interval requested by any of the monitored containers.
+  Option<Duration> interval;
+
+  // Whether a batched collection is scheduled or in progress.
+  bool collecting;
+
   // Monitoring information for an executor.
   struct MonitoringInfo {
     // boost::circular_buffer needs a default constructor.
@@ -289,6 +289,16 @@ void Slave::initialize()
             << "' for --gc_disk_headroom. Must be between 0.0 and 1.0.";
   }
 
+  if (flags.gc_removal_rate == Bytes(0)) {
+    EXIT(1) << "Invalid value '" << flags.gc_removal_rate
+            << "' for --gc_removal_rate. Must be positive.";
+  }
+
+  if (flags.gc_max_concurrent_removals == 0) {
+    EXIT(1) << "Invalid value '" << flags.gc_max_concurrent_removals
+            << "' for --gc_max_concurrent_removals. Must be positive.";
+  }
+
   // Ensure slave work directory exists.
   CHECK_SOME(os::mkdir(flags.work_dir))
     << "Failed to create slave work directory '" << flags.work_dir << "'";
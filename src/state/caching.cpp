@@ -0,0 +1,390 @@
+#include <stdint.h>
+
+#include <list>
+#include <set>
+#include <string>
+
+#include <process/defer.hpp>
+#include <process/dispatch.hpp>
+#include <process/future.hpp>
+#include <process/process.hpp>
+
+#include <process/metrics/counter.hpp>
+#include <process/metrics/gauge.hpp>
+#include <process/metrics/metrics.hpp>
+
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/lambda.hpp>
+#include <stout/none.hpp>
+#include <stout/option.hpp>
+#include <stout/uuid.hpp>
+
+#include "messages/state.hpp"
+
+#include "state/caching.hpp"
+#include "state/storage.hpp"
+
+using namespace process;
+
+// Note that we don't add 'using std::set' here because we need
+// 'std::' to disambiguate the 'set' member.
+using std::list;
+using std::string;
+
+namespace mesos {
+namespace internal {
+namespace state {
+
+class CachingStorageProcess : public Process<CachingStorageProcess>
+{
+public:
+  CachingStorageProcess(Storage* storage, const string& metricsPrefix);
+
+  virtual ~CachingStorageProcess() {}
+
+  // Storage implementation.
+  Future<Option<Entry> > get(const string& name);
+  Future<bool> set(const Entry& entry, const UUID& uuid);
+  Future<bool> expunge(const Entry& entry);
+  Future<std::set<string> > names();
+
+protected:
+  virtual void finalize();
+
+private:
+  // Continuations.
+  void _get(
+      const string& name,
+      uint64_t generation,
+      const Future<Option<Entry> >& future);
+
+  void _set(
+      const Entry& entry,
+      uint64_t generation,
+      const Future<bool>& future);
+
+  void _expunge(
+      const Entry& entry,
+      uint64_t generation,
+      const Future<bool>& future);
+
+  // Removes the entry from the cache and makes sure the result of
+  // any operation that is currently outstanding doesn't get cached.
+  void invalidate(const string& name);
+
+  // Marks an operation on the entry as outstanding and returns the
+  // current generation of the entry.
+  uint64_t begin(const string& name);
+
+  // Marks an operation on the entry as no longer outstanding and
+  // returns whether the generation of the entry is still the given
+  // one, i.e., whether the result of the operation can be cached.
+  bool end(const string& name, uint64_t generation);
+
+  double _hit_rate();
+
+  Storage* storage;
+
+  // The cached entries where 'None' means the entry doesn't exist.
+  hashmap<string, Option<Entry> > entries;
+
+  // The callers waiting for the outstanding 'get' of an entry. Each
+  // gets its own promise so that one of them discarding its future
+  // doesn't affect the others.
+  hashmap<string, list<Promise<Option<Entry> >*> > waiters;
+
+  // Incremented for an entry whenever it might have been changed. The
+  // result of an operation is only cached if the generation hasn't
+  // changed while it was outstanding. Generations are only kept for
+  // the entries with outstanding operations, as no result can be
+  // compared against the generation of any other entry.
+  struct Generation
+  {
+    Generation() : value(0), outstanding(0) {}
+
+    uint64_t value;
+    size_t outstanding;
+  };
+
+  hashmap<string, Generation> generations;
+
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t coalesced;
+
+  struct Metrics
+  {
+    Metrics(const CachingStorageProcess& process, const string& prefix)
+      : hits(prefix + "caching_storage/hits"),
+        misses(prefix + "caching_storage/misses"),
+        coalesced(prefix + "caching_storage/coalesced"),
+        hit_rate(
+            prefix + "caching_storage/hit_rate",
+            defer(process, &CachingStorageProcess::_hit_rate))
+    {
+      process::metrics::add(hits);
+      process::metrics::add(misses);
+      process::metrics::add(coalesced);
+      process::metrics::add(hit_rate);
+    }
+
+    ~Metrics()
+    {
+      process::metrics::remove(hits);
+      process::metrics::remove(misses);
+      process::metrics::remove(coalesced);
+      process::metrics::remove(hit_rate);
+    }
+
+    process::metrics::Counter hits;
+    process::metrics::Counter misses;
+    process::metrics::Counter coalesced;
+    process::metrics::Gauge hit_rate;
+  } metrics;
+};
+
+
+CachingStorageProcess::CachingStorageProcess(
+    Storage* _storage,
+    const string& metricsPrefix)
+  : storage(_storage),
+    hits(0),
+    misses(0),
+    coalesced(0),
+    metrics(*this, metricsPrefix) {}
+
+
+void CachingStorageProcess::finalize()
+{
+  foreachvalue (const list<Promise<Option<Entry> >*>& promises, waiters) {
+    foreach (Promise<Option<Entry> >* promise, promises) {
+      promise->discard();
+      delete promise;
+    }
+  }
+
+  waiters.clear();
+}
+
+
+Future<Option<Entry> > CachingStorageProcess::get(const string& name)
+{
+  Option<Option<Entry> > entry = entries.get(name);
+
+  if (entry.isSome()) {
+    hits++;
+    ++metrics.hits;
+    return entry.get();
+  }
+
+  Promise<Option<Entry> >* promise = new Promise<Option<Entry> >();
+
+  if (waiters.contains(name)) {
+    coalesced++;
+    ++metrics.coalesced;
+    waiters[name].push_back(promise);
+    return promise->future();
+  }
+
+  misses++;
+  ++metrics.misses;
+  waiters[name].push_back(promise);
+
+  storage->get(name)
+    .onAny(defer(self(), &Self::_get, name, begin(name), lambda::_1));
+
+  return promise->future();
+}
+
+
+void CachingStorageProcess::_get(
+    const string& name,
+    uint64_t generation,
+    const Future<Option<Entry> >& future)
+{
+  if (end(name, generation) && future.isReady()) {
+    entries[name] = future.get();
+  }
+
+  CHECK(waiters.contains(name));
+
+  foreach (Promise<Option<Entry> >* promise, waiters[name]) {
+    if (future.isReady()) {
+      promise->set(future.get());
+    } else if (future.isFailed()) {
+      promise->fail(future.failure());
+    } else {
+      promise->discard();
+    }
+    delete promise;
+  }
+
+  waiters.erase(name);
+}
+
+
+Future<bool> CachingStorageProcess::set(const Entry& entry, const UUID& uuid)
+{
+  invalidate(entry.name());
+
+  Future<bool> future = storage->set(entry, uuid);
+
+  future.onAny(defer(
+      self(),
+      &Self::_set,
+      entry,
+      begin(entry.name()),
+      lambda::_1));
+
+  return future;
+}
+
+
+void CachingStorageProcess::_set(
+    const Entry& entry,
+    uint64_t generation,
+    const Future<bool>& future)
+{
+  // Only the entry that was set can be cached, otherwise we don't
+  // know what is stored (e.g., after a failure) so we leave it to
+  // the next 'get' to find out.
+  if (end(entry.name(), generation) && future.isReady() && future.get()) {
+    entries[entry.name()] = entry;
+  }
+
+  // A 'get' that was outstanding during the 'set' might return the
+  // entry from before or after it so we make sure it's not cached.
+  if (generations.contains(entry.name())) {
+    generations[entry.name()].value++;
+  }
+}
+
+
+Future<bool> CachingStorageProcess::expunge(const Entry& entry)
+{
+  invalidate(entry.name());
+
+  Future<bool> future = storage->expunge(entry);
+
+  future.onAny(defer(
+      self(),
+      &Self::_expunge,
+      entry,
+      begin(entry.name()),
+      lambda::_1));
+
+  return future;
+}
+
+
+void CachingStorageProcess::_expunge(
+    const Entry& entry,
+    uint64_t generation,
+    const Future<bool>& future)
+{
+  if (end(entry.name(), generation) && future.isReady() && future.get()) {
+    entries[entry.name()] = None();
+  }
+
+  // See comment in '_set' above.
+  if (generations.contains(entry.name())) {
+    generations[entry.name()].value++;
+  }
+}
+
+
+Future<std::set<string> > CachingStorageProcess::names()
+{
+  return storage->names();
+}
+
+
+void CachingStorageProcess::invalidate(const string& name)
+{
+  entries.erase(name);
+
+  if (generations.contains(name)) {
+    generations[name].value++;
+  }
+}
+
+
+uint64_t CachingStorageProcess::begin(const string& name)
+{
+  Generation& generation = generations[name];
+  generation.outstanding++;
+  return generation.value;
+}
+
+
+bool CachingStorageProcess::end(const string& name, uint64_t generation)
+{
+  CHECK(generations.contains(name));
+
+  Generation& current = generations[name];
+  CHECK_GT(current.outstanding, 0u);
+
+  const bool unchanged = current.value == generation;
+
+  if (--current.outstanding == 0) {
+    generations.erase(name);
+  }
+
+  return unchanged;
+}
+
+
+double CachingStorageProcess::_hit_rate()
+{
+  const uint64_t total = hits + misses + coalesced;
+
+  if (total == 0) {
+    return 0.0;
+  }
+
+  return hits / static_cast<double>(total);
+}
+
+
+CachingStorage::CachingStorage(Storage* storage, const string& metricsPrefix)
+{
+  process = new CachingStorageProcess(storage, metricsPrefix);
+  spawn(process);
+}
+
+
+CachingStorage::~CachingStorage()
+{
+  terminate(process);
+  wait(process);
+  delete process;
+}
+
+
+Future<Option<Entry> > CachingStorage::get(const string& name)
+{
+  return dispatch(process, &CachingStorageProcess::get, name);
+}
+
+
+Future<bool> CachingStorage::set(const Entry& entry, const UUID& uuid)
+{
+  return dispatch(process, &CachingStorageProcess::set, entry, uuid);
+}
+
+
+Future<bool> CachingStorage::expunge(const Entry& entry)
+{
+  return dispatch(process, &CachingStorageProcess::expunge, entry);
+}
+
+
+Future<std::set<string> > CachingStorage::names()
+{
+  return dispatch(process, &CachingStorageProcess::names);
+}
+
+} // namespace state {
+} // namespace internal {
+} // namespace mesos {
@@ -0,0 +1,64 @@
+#ifndef __STATE_CACHING_HPP__
+#define __STATE_CACHING_HPP__
+
+#include <set>
+#include <string>
+
+#include <process/future.hpp>
+
+#include <stout/option.hpp>
+#include <stout/uuid.hpp>
+
+#include "messages/state.hpp"
+
+#include "state/storage.hpp"
+
+namespace mesos {
+namespace internal {
+namespace state {
+
+// Forward declarations.
+class CachingStorageProcess;
+
+
+// A storage that caches the entries of another storage. Entries are
+// read through the cache: a 'get' for an entry that is cached does
+// not reach the underlying storage and concurrent 'get's for the same
+// entry are coalesced into a single 'get'. An entry is invalidated by
+// every 'set' or 'expunge' of it and replaced with the entry that was
+// set (if the set succeeded).
+//
+// If the underlying storage is also modified by someone else, the
+// cache might return an outdated entry. Since entries are versioned
+// (by their UUID) a subsequent 'set' of such an entry fails (as if
+// it raced with the other modification) and invalidates the cache.
+//
+// The cache reports the metrics 'caching_storage/hits',
+// 'caching_storage/misses', 'caching_storage/coalesced' (the 'get's
+// that waited for an outstanding 'get') and 'caching_storage/hit_rate'
+// (the fraction of all 'get's that were hits), each prefixed with the
+// 'metricsPrefix' the cache was created with (e.g., "registrar/").
+class CachingStorage : public Storage
+{
+public:
+  // Note that the underlying storage is not owned. The metrics prefix
+  // must be unique among the caches that exist at the same time.
+  CachingStorage(Storage* storage, const std::string& metricsPrefix);
+
+  virtual ~CachingStorage();
+
+  // Storage implementation.
+  virtual process::Future<Option<Entry> > get(const std::string& name);
+  virtual process::Future<bool> set(const Entry& entry, const UUID& uuid);
+  virtual process::Future<bool> expunge(const Entry& entry);
+  virtual process::Future<std::set<std::string> > names();
+
+private:
+  CachingStorageProcess* process;
+};
+
+} // namespace state {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __STATE_CACHING_HPP__
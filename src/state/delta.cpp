@@ -0,0 +1,262 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include <stout/error.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/option.hpp>
+#include <stout/stringify.hpp>
+#include <stout/try.hpp>
+
+#include "state/delta.hpp"
+
+using std::string;
+
+namespace mesos {
+namespace internal {
+namespace state {
+namespace delta {
+
+// The delta is encoded as a sequence of unsigned varints:
+//
+//   <source size> <target size> <instruction>*
+//
+// where each instruction starts with '(length << 1) | kind'. A
+// LITERAL is followed by 'length' bytes that are copied into the
+// target verbatim while a COPY is followed by the offset in the
+// source from which 'length' bytes are copied.
+enum Kind
+{
+  LITERAL = 0,
+  COPY = 1
+};
+
+
+// The smallest size of a block that we index in the source. Larger
+// sources use larger blocks so that the index stays bounded.
+static const size_t MIN_BLOCK_SIZE = 16;
+static const size_t MAX_BLOCKS = 64 * 1024;
+
+
+static void encode(uint64_t value, string* data)
+{
+  while (value >= 0x80) {
+    data->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  data->push_back(static_cast<char>(value));
+}
+
+
+static Try<uint64_t> decode(const string& data, size_t* index)
+{
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*index >= data.size()) {
+      return Error("Unexpected end of delta");
+    }
+
+    uint8_t byte = static_cast<uint8_t>(data[(*index)++]);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+
+  return Error("Malformed varint in delta");
+}
+
+
+// A rolling checksum over a window of bytes (see rsync). The checksum
+// of the window shifted by one byte can be computed in constant time
+// from the checksum of the previous window.
+class Checksum
+{
+public:
+  Checksum(const char* data, size_t length)
+    : a(0), b(0), length(length)
+  {
+    for (size_t i = 0; i < length; i++) {
+      uint8_t byte = static_cast<uint8_t>(data[i]);
+      a += byte;
+      b += (length - i) * byte;
+    }
+  }
+
+  void roll(char out, char in)
+  {
+    a -= static_cast<uint8_t>(out);
+    a += static_cast<uint8_t>(in);
+    b -= length * static_cast<uint8_t>(out);
+    b += a;
+  }
+
+  uint32_t value() const
+  {
+    return (a & 0xffff) | (b << 16);
+  }
+
+private:
+  uint32_t a;
+  uint32_t b;
+  uint32_t length;
+};
+
+
+Try<string> diff(const string& source, const string& target)
+{
+  string delta;
+
+  encode(source.size(), &delta);
+  encode(target.size(), &delta);
+
+  const size_t size = std::max(MIN_BLOCK_SIZE, source.size() / MAX_BLOCKS);
+
+  // Index the (non-overlapping) blocks of the source by checksum,
+  // keeping the first block for each checksum.
+  hashmap<uint32_t, size_t> blocks;
+  for (size_t offset = 0; offset + size <= source.size(); offset += size) {
+    uint32_t checksum = Checksum(source.data() + offset, size).value();
+    if (!blocks.contains(checksum)) {
+      blocks[checksum] = offset;
+    }
+  }
+
+  // Start of the pending literal in the target.
+  size_t literal = 0;
+
+  size_t index = 0;
+
+  if (!blocks.empty() && target.size() >= size) {
+    Checksum checksum(target.data(), size);
+
+    while (true) {
+      Option<size_t> offset = blocks.get(checksum.value());
+
+      if (offset.isSome() &&
+          memcmp(source.data() + offset.get(),
+                 target.data() + index,
+                 size) == 0) {
+        // Extend the match backwards into the pending literal and
+        // forwards as far as the source and the target agree.
+        size_t begin = index;
+        size_t from = offset.get();
+        while (begin > literal && from > 0 &&
+               source[from - 1] == target[begin - 1]) {
+          begin--;
+          from--;
+        }
+
+        size_t end = index + size;
+        size_t to = offset.get() + size;
+        while (end < target.size() && to < source.size() &&
+               source[to] == target[end]) {
+          end++;
+          to++;
+        }
+
+        if (begin > literal) {
+          encode(((begin - literal) << 1) | LITERAL, &delta);
+          delta.append(target, literal, begin - literal);
+        }
+
+        encode(((end - begin) << 1) | COPY, &delta);
+        encode(from, &delta);
+
+        index = literal = end;
+
+        if (index + size > target.size()) {
+          break;
+        }
+
+        checksum = Checksum(target.data() + index, size);
+        continue;
+      }
+
+      if (index + size >= target.size()) {
+        break;
+      }
+
+      checksum.roll(target[index], target[index + size]);
+      index++;
+    }
+  }
+
+  if (literal < target.size()) {
+    encode(((target.size() - literal) << 1) | LITERAL, &delta);
+    delta.append(target, literal, string::npos);
+  }
+
+  return delta;
+}
+
+
+Try<string> patch(const string& source, const string& delta)
+{
+  size_t index = 0;
+
+  Try<uint64_t> size = decode(delta, &index);
+  if (size.isError()) {
+    return Error(size.error());
+  } else if (size.get() != source.size()) {
+    return Error(
+        "Delta was computed against a source of size " +
+        stringify(size.get()) + " rather than " + stringify(source.size()));
+  }
+
+  size = decode(delta, &index);
+  if (size.isError()) {
+    return Error(size.error());
+  }
+
+  // The target size of a corrupt delta may be arbitrarily large, so
+  // no more than the size of the source and the delta combined is
+  // reserved up front (repeated copies may still grow the target).
+  string target;
+  target.reserve(
+      std::min<uint64_t>(size.get(), source.size() + delta.size()));
+
+  while (index < delta.size()) {
+    Try<uint64_t> instruction = decode(delta, &index);
+    if (instruction.isError()) {
+      return Error(instruction.error());
+    }
+
+    const uint64_t length = instruction.get() >> 1;
+
+    if ((instruction.get() & 1) == LITERAL) {
+      if (length > delta.size() - index) {
+        return Error("Literal extends past the end of the delta");
+      }
+
+      target.append(delta, index, length);
+      index += length;
+    } else {
+      Try<uint64_t> offset = decode(delta, &index);
+      if (offset.isError()) {
+        return Error(offset.error());
+      } else if (offset.get() > source.size() ||
+                 length > source.size() - offset.get()) {
+        return Error("Copy extends past the end of the source");
+      }
+
+      target.append(source, offset.get(), length);
+    }
+  }
+
+  if (target.size() != size.get()) {
+    return Error(
+        "Patched " + stringify(target.size()) + " bytes rather than the " +
+        stringify(size.get()) + " bytes expected");
+  }
+
+  return target;
+}
+
+} // namespace delta {
+} // namespace state {
+} // namespace internal {
+} // namespace mesos {
@@ -0,0 +1,37 @@
+#ifndef __STATE_DELTA_HPP__
+#define __STATE_DELTA_HPP__
+
+#include <string>
+
+#include <stout/try.hpp>
+
+namespace mesos {
+namespace internal {
+namespace state {
+namespace delta {
+
+// Binary deltas between two (arbitrary) strings, used for storing
+// the differences between successive values of a variable.
+//
+// The delta is computed by indexing the blocks of the source by a
+// rolling checksum (as done by rsync) and scanning the target for
+// blocks that also occur in the source. Matching regions are then
+// encoded as a copy from the source while everything else is encoded
+// as a literal. Unlike svn::diff, which is line oriented, this works
+// well for serialized protobufs and takes linear time in the size of
+// the source and target.
+
+// Returns a delta that transforms 'source' into 'target'.
+Try<std::string> diff(const std::string& source, const std::string& target);
+
+
+// Returns the result of applying 'delta' to 'source' or an error if
+// the delta is malformed or was not computed against 'source'.
+Try<std::string> patch(const std::string& source, const std::string& delta);
+
+} // namespace delta {
+} // namespace state {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __STATE_DELTA_HPP__
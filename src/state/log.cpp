@@ -27,6 +27,7 @@
 
 #include "log/log.hpp"
 
+#include "state/delta.hpp"
 #include "state/log.hpp"
 
 using namespace mesos::internal::log;
@@ -60,7 +61,10 @@ namespace state {
 class LogStorageProcess : public Process<LogStorageProcess>
 {
 public:
-  LogStorageProcess(Log* log, size_t diffsBetweenSnapshots);
+  LogStorageProcess(
+      Log* log,
+      size_t diffsBetweenSnapshots,
+      bool binaryDiffs);
 
   virtual ~LogStorageProcess();
 
@@ -97,7 +101,8 @@ private:
   Future<bool> __set(const state::Entry& entry, const UUID& uuid);
   Future<bool> ___set(
       const state::Entry& entry,
-      size_t diff,
+      size_t diffs,
+      size_t bytes,
       Option<Log::Position> position);
 
   Future<bool> _expunge(const state::Entry& entry);
@@ -113,6 +118,10 @@ private:
 
   const size_t diffsBetweenSnapshots;
 
+  // Whether to write diffs as Operation::Diff::BINARY rather than
+  // Operation::Diff::SVN. Both formats are always read.
+  const bool binaryDiffs;
+
   // Used to serialize Log::Writer::append/truncate operations.
   Mutex mutex;
 
@@ -133,10 +142,12 @@ private:
   {
     Snapshot(const Log::Position& position,
              const state::Entry& entry,
-             size_t diffs = 0)
+             size_t diffs = 0,
+             size_t bytes = 0)
       : position(position),
         entry(entry),
-        diffs(diffs) {}
+        diffs(diffs),
+        bytes(bytes) {}
 
     // Returns a snapshot after having applied the specified diff.
     Try<Snapshot> patch(const Operation::Diff& diff) const
@@ -145,9 +156,16 @@ private:
         return Error("Attempted to patch the wrong snapshot");
       }
 
-      Try<string> patch = svn::patch(
-          entry.value(),
-          svn::Diff(diff.entry().value()));
+      Try<string> patch = Error("Unknown diff format");
+
+      switch (diff.format()) {
+        case Operation::Diff::SVN:
+          patch = svn::patch(entry.value(), svn::Diff(diff.entry().value()));
+          break;
+        case Operation::Diff::BINARY:
+          patch = delta::patch(entry.value(), diff.entry().value());
+          break;
+      }
 
       if (patch.isError()) {
         return Error(patch.error());
@@ -156,7 +174,11 @@ private:
       Entry entry(diff.entry());
       entry.set_value(patch.get());
 
-      return Snapshot(position, entry, diffs + 1);
+      return Snapshot(
+          position,
+          entry,
+          diffs + 1,
+          bytes + diff.entry().value().size());
     }
 
     // Position in the log where this snapshot is located. NOTE: if
@@ -173,6 +195,11 @@ private:
     // underlying log that make up this "snapshot". If this snapshot
     // is actually represented in the log this value is 0.
     const size_t diffs;
+
+    // The total size of the Operation::DIFFs that make up this
+    // "snapshot", i.e., how much needs to be read from the log in
+    // addition to the snapshot itself.
+    const size_t bytes;
   };
 
   // All known snapshots indexed by name. Note that 'hashmap::get'
@@ -198,10 +225,14 @@ private:
 };
 
 
-LogStorageProcess::LogStorageProcess(Log* log, size_t diffsBetweenSnapshots)
+LogStorageProcess::LogStorageProcess(
+    Log* log,
+    size_t diffsBetweenSnapshots,
+    bool binaryDiffs)
   : reader(log),
     writer(log),
-    diffsBetweenSnapshots(diffsBetweenSnapshots) {}
+    diffsBetweenSnapshots(diffsBetweenSnapshots),
+    binaryDiffs(binaryDiffs) {}
 
 
 LogStorageProcess::~LogStorageProcess() {}
@@ -260,8 +291,10 @@ Future<Nothing> LogStorageProcess::_start(
     // If we've started before (i.e., have an 'index' position) we
     // should also expect know the last 'truncated' position.
     CHECK_SOME(truncated);
-    return reader.read(index.get(), position.get())
-      .then(defer(self(), &Self::apply, lambda::_1));
+    return reader.stream(
+        index.get(),
+        position.get(),
+        defer(self(), &Self::apply, lambda::_1));
   }
 
   return reader.beginning()
@@ -277,8 +310,12 @@ Future<Nothing> LogStorageProcess::__start(
 
   truncated = beginning; // Cache for future truncations.
 
-  return reader.read(beginning, position)
-    .then(defer(self(), &Self::apply, lambda::_1));
+  // Stream the entries rather than reading them all at once so that
+  // recovering a long log doesn't need to hold all of it in memory.
+  return reader.stream(
+      beginning,
+      position,
+      defer(self(), &Self::apply, lambda::_1));
 }
 
 
@@ -471,9 +508,21 @@ Future<bool> LogStorageProcess::__set(
     metrics.diff.start();
 
     // Construct the diff of the last snapshot.
-    Try<svn::Diff> diff = svn::diff(
-        snapshot.get().entry.value(),
-        entry.value());
+    Try<string> diff = Error("Unknown diff format");
+
+    if (binaryDiffs) {
+      diff = delta::diff(snapshot.get().entry.value(), entry.value());
+    } else {
+      Try<svn::Diff> _diff = svn::diff(
+          snapshot.get().entry.value(),
+          entry.value());
+
+      if (_diff.isError()) {
+        diff = Error(_diff.error());
+      } else {
+        diff = _diff.get().data;
+      }
+    }
 
     Duration elapsed = metrics.diff.stop();
 
@@ -482,18 +531,31 @@ Future<bool> LogStorageProcess::__set(
       return Failure("Failed to construct diff: " + diff.error());
     }
 
-    VLOG(1) << "Created an SVN diff in " << elapsed
-            << " of size " << Bytes(diff.get().data.size()) << " which is "
-            << (diff.get().data.size() / (double) entry.value().size()) * 100.0
-            << "% the original size (" << Bytes(entry.value().size()) << ")";
+    // The diffs since the last snapshot all need to be read (and
+    // applied) when recovering, so we only write this diff if all of
+    // them together are still smaller than a snapshot would be.
+    const size_t bytes = snapshot.get().bytes + diff.get().size();
+
+    VLOG(1) << "Created " << (binaryDiffs ? "a binary" : "an SVN")
+            << " diff in " << elapsed
+            << " of size " << Bytes(diff.get().size()) << " which is "
+            << (diff.get().size() / (double) entry.value().size()) * 100.0
+            << "% the original size (" << Bytes(entry.value().size()) << ")"
+            << " for a total of " << Bytes(bytes) << " in "
+            << snapshot.get().diffs + 1 << " diffs since the last snapshot";
 
-    // Only write the diff if it provides a reduction in size.
-    if (diff.get().data.size() < entry.value().size()) {
+    if (bytes < entry.value().size()) {
       // Append a diff operation.
       Operation operation;
       operation.set_type(Operation::DIFF);
       operation.mutable_diff()->mutable_entry()->CopyFrom(entry);
-      operation.mutable_diff()->mutable_entry()->set_value(diff.get().data);
+      operation.mutable_diff()->mutable_entry()->set_value(diff.get());
+
+      // NOTE: We leave the format unset for svn diffs so that the
+      // operation is identical to what older versions wrote.
+      if (binaryDiffs) {
+        operation.mutable_diff()->set_format(Operation::Diff::BINARY);
+      }
 
       string value;
       if (!operation.SerializeToString(&value)) {
@@ -505,6 +567,7 @@ Future<bool> LogStorageProcess::__set(
                     &Self::___set,
                     entry,
                     snapshot.get().diffs + 1,
+                    bytes,
                     lambda::_1));
     }
   }
@@ -520,13 +583,14 @@ Future<bool> LogStorageProcess::__set(
   }
 
   return writer.append(value)
-    .then(defer(self(), &Self::___set, entry, 0, lambda::_1));
+    .then(defer(self(), &Self::___set, entry, 0, 0, lambda::_1));
 }
 
 
 Future<bool> LogStorageProcess::___set(
     const state::Entry& entry,
     size_t diffs,
+    size_t bytes,
     Option<Log::Position> position)
 {
   if (position.isNone()) {
@@ -547,7 +611,7 @@ Future<bool> LogStorageProcess::___set(
     position = snapshots.get(entry.name()).get().position;
   }
 
-  Snapshot snapshot(position.get(), entry, diffs);
+  Snapshot snapshot(position.get(), entry, diffs, bytes);
   snapshots.put(snapshot.entry.name(), snapshot);
 
   // And truncate the log if necessary.
@@ -633,9 +697,12 @@ Future<std::set<string> > LogStorageProcess::_names()
 }
 
 
-LogStorage::LogStorage(Log* log, size_t diffsBetweenSnapshots)
+LogStorage::LogStorage(
+    Log* log,
+    size_t diffsBetweenSnapshots,
+    bool binaryDiffs)
 {
-  process = new LogStorageProcess(log, diffsBetweenSnapshots);
+  process = new LogStorageProcess(log, diffsBetweenSnapshots, binaryDiffs);
   spawn(process);
 }
 
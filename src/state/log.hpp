@@ -26,7 +26,15 @@ class LogStorageProcess;
 class LogStorage : public Storage
 {
 public:
-  LogStorage(log::Log* log, size_t diffsBetweenSnapshots = 0);
+  // NOTE: Binary diffs (see state/delta.hpp) can not be read by
+  // versions of LogStorage that only know about svn diffs. They
+  // should only be enabled once every reader of the log has been
+  // upgraded, and disabled (followed by storing each variable at
+  // least 'diffsBetweenSnapshots' times) before downgrading.
+  LogStorage(
+      log::Log* log,
+      size_t diffsBetweenSnapshots = 0,
+      bool binaryDiffs = false);
 
   virtual ~LogStorage();
 
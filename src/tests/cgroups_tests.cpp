@@ -36,6 +36,7 @@
 
 #include <gmock/gmock.h>
 
+#include <process/collect.hpp>
 #include <process/gtest.hpp>
 
 #include <stout/gtest.hpp>
@@ -45,6 +46,7 @@
 #include <stout/os.hpp>
 #include <stout/path.hpp>
 #include <stout/proc.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/stringify.hpp>
 #include <stout/strings.hpp>
 
@@ -55,6 +57,7 @@
 
 using namespace process;
 
+using std::list;
 using std::set;
 
 namespace mesos {
@@ -603,6 +606,98 @@ TEST_F(CgroupsAnyHierarchyWithCpuMemoryTest, ROOT_CGROUPS_Listen)
 }
 
 
+TEST_F(CgroupsAnyHierarchyWithCpuMemoryTest, ROOT_CGROUPS_MemoryPressure)
+{
+  using cgroups::memory::pressure::Counter;
+
+  std::string hierarchy = path::join(baseHierarchy, "memory");
+  ASSERT_SOME(cgroups::create(hierarchy, TEST_CGROUPS_ROOT));
+
+  Try<Owned<Counter>> low = Counter::create(
+      hierarchy, TEST_CGROUPS_ROOT, cgroups::memory::pressure::LOW);
+  ASSERT_SOME(low)
+    << "-------------------------------------------------------------\n"
+    << "We cannot run this test because it appears you do not have\n"
+    << "a modern enough version of the Linux kernel (3.10+) to\n"
+    << "support memory pressure notifications.\n"
+    << "-------------------------------------------------------------";
+
+  Try<Owned<Counter>> critical = Counter::create(
+      hierarchy, TEST_CGROUPS_ROOT, cgroups::memory::pressure::CRITICAL);
+  ASSERT_SOME(critical);
+
+  AWAIT_EXPECT_EQ(0u, low.get()->value());
+  AWAIT_EXPECT_EQ(0u, critical.get()->value());
+
+  // Disable the OOM killer so that the memory hog below keeps the
+  // cgroup under pressure rather than getting killed.
+  ASSERT_SOME(cgroups::memory::oom::killer::disable(
+        hierarchy, TEST_CGROUPS_ROOT));
+
+  // Limit the memory usage of the test cgroup to 64MB.
+  ASSERT_SOME(cgroups::memory::limit_in_bytes(
+      hierarchy, TEST_CGROUPS_ROOT, Megabytes(64)));
+
+  pid_t pid = ::fork();
+  ASSERT_NE(-1, pid);
+
+  if (pid == 0) {
+    // In child process. Put self into the test cgroup and touch more
+    // memory than the cgroup is allowed to use.
+    Try<Nothing> assign =
+      cgroups::assign(hierarchy, TEST_CGROUPS_ROOT, ::getpid());
+
+    if (assign.isError()) {
+      std::cerr << "Failed to assign cgroup: " << assign.error() << std::endl;
+      abort();
+    }
+
+    size_t size = 1024 * 1024 * 512;
+    void* buffer = NULL;
+
+    if (posix_memalign(&buffer, getpagesize(), size) != 0) {
+      perror("Failed to allocate page-aligned memory, posix_memalign");
+      abort();
+    }
+
+    while (true) {
+      memset(buffer, 1, size);
+    }
+  }
+
+  // In parent process. Wait for the pressure to be reported.
+  Duration waited = Duration::zero();
+  do {
+    Future<uint64_t> value = low.get()->value();
+    AWAIT_READY(value);
+
+    if (value.get() > 0u) {
+      break;
+    }
+
+    os::sleep(Milliseconds(100));
+    waited += Milliseconds(100);
+  } while (waited < Seconds(10));
+
+  // Kill the child process.
+  EXPECT_NE(-1, ::kill(pid, SIGKILL));
+
+  int status;
+  EXPECT_NE(-1, ::waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFSIGNALED(status));
+  EXPECT_EQ(SIGKILL, WTERMSIG(status));
+
+  Future<uint64_t> lowValue = low.get()->value();
+  AWAIT_READY(lowValue);
+  EXPECT_LT(0u, lowValue.get());
+
+  // Every critical event is also a low event.
+  Future<uint64_t> criticalValue = critical.get()->value();
+  AWAIT_READY(criticalValue);
+  EXPECT_GE(lowValue.get(), criticalValue.get());
+}
+
+
 TEST_F(CgroupsAnyHierarchyWithFreezerTest, ROOT_CGROUPS_Freeze)
 {
   int pipes[2];
@@ -954,6 +1049,53 @@ TEST_F(CgroupsAnyHierarchyWithFreezerTest, ROOT_CGROUPS_DestroyTracedProcess)
 }
 
 
+// Destroys many cgroups, each with a running process, concurrently as
+// happens when a framework with many tasks on the slave is torn down.
+TEST_F(CgroupsAnyHierarchyWithFreezerTest,
+       ROOT_CGROUPS_BENCHMARK_DestroyConcurrently)
+{
+  const size_t count = 200;
+
+  std::string hierarchy = path::join(baseHierarchy, "freezer");
+  ASSERT_SOME(cgroups::create(hierarchy, TEST_CGROUPS_ROOT));
+
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < count; i++) {
+    std::string cgroup = path::join(TEST_CGROUPS_ROOT, stringify(i));
+    ASSERT_SOME(cgroups::create(hierarchy, cgroup));
+
+    pid_t pid = ::fork();
+    ASSERT_NE(-1, pid);
+
+    if (pid == 0) {
+      // In child process.
+      while (true) { sleep(1); }
+
+      ABORT("Child should not reach this statement");
+    }
+
+    // In parent process.
+    ASSERT_SOME(cgroups::assign(hierarchy, cgroup, pid));
+
+    paths.push_back(cgroup);
+  }
+
+  Stopwatch watch;
+  watch.start();
+
+  list<Future<Nothing> > destroys;
+  foreach (const std::string& cgroup, paths) {
+    destroys.push_back(cgroups::destroy(hierarchy, cgroup));
+  }
+
+  AWAIT_READY_FOR(collect(destroys), Minutes(1));
+
+  LOG(INFO) << "Destroyed " << count << " cgroups in " << watch.elapsed();
+
+  AWAIT_READY(cgroups::destroy(hierarchy, TEST_CGROUPS_ROOT));
+}
+
+
 class CgroupsAnyHierarchyWithPerfEventTest
   : public CgroupsAnyHierarchyTest
 {
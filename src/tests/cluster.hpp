@@ -500,7 +500,7 @@ inline Try<process::PID<slave::Slave> > Cluster::Slaves::start(
 
   // Create a garbage collector if one wasn't provided.
   if (gc.isNone()) {
-    slave.gc.reset(new slave::GarbageCollector());
+    slave.gc.reset(new slave::GarbageCollector(flags));
   }
 
   // Create a status update manager if one wasn't provided.
@@ -16,6 +16,10 @@
  * limitations under the License.
  */
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <list>
 #include <map>
 #include <string>
 #include <vector>
@@ -26,9 +30,16 @@
 
 #include <mesos/slave/isolator.hpp>
 
+#include <process/collect.hpp>
 #include <process/future.hpp>
+#include <process/gtest.hpp>
 #include <process/owned.hpp>
+#include <process/reap.hpp>
 
+#include <stout/bytes.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/strings.hpp>
 
 #include "slave/flags.hpp"
@@ -37,6 +48,9 @@
 #include "slave/containerizer/launcher.hpp"
 
 #include "slave/containerizer/mesos/containerizer.hpp"
+#ifdef __linux__
+#include "slave/containerizer/mesos/zygote.hpp"
+#endif // __linux__
 
 #include "tests/flags.hpp"
 #include "tests/isolator.hpp"
@@ -48,6 +62,7 @@ using namespace mesos::internal::slave;
 
 using namespace mesos::slave;
 
+using std::list;
 using std::map;
 using std::string;
 using std::vector;
@@ -320,6 +335,311 @@ TEST_F(MesosContainerizerExecuteTest, IoRedirection)
 }
 
 
+// An isolator whose 'prepare' does not complete until the test
+// satisfies 'promise'.
+class PendingPrepareIsolatorProcess : public IsolatorProcess
+{
+public:
+  virtual Future<Nothing> recover(const list<ExecutorRunState>& states)
+  {
+    return Nothing();
+  }
+
+  virtual Future<Option<CommandInfo>> prepare(
+      const ContainerID& containerId,
+      const ExecutorInfo& executorInfo,
+      const string& directory,
+      const Option<string>& user)
+  {
+    prepared.set(Nothing());
+    return promise.future();
+  }
+
+  virtual Future<Nothing> isolate(const ContainerID& containerId, pid_t pid)
+  {
+    return Nothing();
+  }
+
+  virtual Future<Limitation> watch(const ContainerID& containerId)
+  {
+    return Future<Limitation>();
+  }
+
+  virtual Future<Nothing> update(
+      const ContainerID& containerId,
+      const Resources& resources)
+  {
+    return Nothing();
+  }
+
+  virtual Future<ResourceStatistics> usage(const ContainerID& containerId)
+  {
+    return ResourceStatistics();
+  }
+
+  virtual Future<Nothing> cleanup(const ContainerID& containerId)
+  {
+    return Nothing();
+  }
+
+  Promise<Nothing> prepared;
+  Promise<Option<CommandInfo>> promise;
+};
+
+
+// This test verifies that the executor's URIs are only fetched once
+// the isolators have been prepared (some isolators expect an empty
+// sandbox when preparing) and that the launch stages are reported in
+// the metrics accordingly.
+TEST_F(MesosContainerizerExecuteTest, FetchAfterPreparing)
+{
+  string fromDir = path::join(os::getcwd(), "from");
+  ASSERT_SOME(os::mkdir(fromDir));
+  string testFile = path::join(fromDir, "test");
+  ASSERT_SOME(os::write(testFile, "data"));
+
+  string directory = path::join(os::getcwd(), "sandbox");
+  ASSERT_SOME(os::mkdir(directory));
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+
+  Try<Launcher*> launcher = PosixLauncher::create(flags);
+  ASSERT_SOME(launcher);
+
+  PendingPrepareIsolatorProcess* isolatorProcess =
+    new PendingPrepareIsolatorProcess();
+
+  vector<Owned<Isolator>> isolators;
+  isolators.push_back(Owned<Isolator>(
+      new Isolator(Owned<IsolatorProcess>(isolatorProcess))));
+
+  Fetcher fetcher;
+
+  MesosContainerizer containerizer(
+      flags,
+      true,
+      &fetcher,
+      Owned<Launcher>(launcher.get()),
+      isolators);
+
+  ContainerID containerId;
+  containerId.set_value("test_container");
+
+  // The executor only succeeds if the URI was fetched into its
+  // sandbox.
+  ExecutorInfo executorInfo = CREATE_EXECUTOR_INFO("executor", "test -f test");
+  executorInfo.mutable_command()->add_uris()->set_value("file://" + testFile);
+
+  Future<bool> launch = containerizer.launch(
+      containerId,
+      executorInfo,
+      directory,
+      None(),
+      SlaveID(),
+      process::PID<Slave>(),
+      false);
+
+  AWAIT_READY(isolatorProcess->prepared.future());
+
+  // Nothing gets fetched while the isolator is still preparing.
+  string fetched = path::join(directory, "test");
+
+  os::sleep(Milliseconds(100));
+
+  EXPECT_FALSE(os::exists(fetched));
+  EXPECT_TRUE(launch.isPending());
+
+  isolatorProcess->promise.set(Option<CommandInfo>::none());
+
+  AWAIT_READY(launch);
+  EXPECT_TRUE(launch.get());
+
+  EXPECT_TRUE(os::exists(fetched));
+
+  Future<containerizer::Termination> wait = containerizer.wait(containerId);
+  AWAIT_READY(wait);
+
+  EXPECT_TRUE(wait.get().has_status());
+  EXPECT_EQ(0, wait.get().status());
+
+  JSON::Object metrics = Metrics();
+  EXPECT_EQ(1u, metrics.values.count("containerizer/mesos/launch_latency_ms"));
+  EXPECT_EQ(
+      1u,
+      metrics.values.count("containerizer/mesos/launch_prepare_latency_ms"));
+  EXPECT_EQ(
+      1u,
+      metrics.values.count("containerizer/mesos/launch_fetch_latency_ms"));
+  EXPECT_EQ(
+      1u,
+      metrics.values.count("containerizer/mesos/launch_fork_latency_ms"));
+  EXPECT_EQ(
+      1u,
+      metrics.values.count("containerizer/mesos/launch_isolate_latency_ms"));
+  EXPECT_EQ(
+      1u,
+      metrics.values.count(
+          "containerizer/mesos/launch_fetch_wait_latency_ms"));
+
+  // The fetch is started after preparing has finished and completes
+  // before the launch does, so the two don't overlap.
+  const double launching =
+    metrics.values["containerizer/mesos/launch_latency_ms"]
+      .as<JSON::Number>().value;
+  const double preparing =
+    metrics.values["containerizer/mesos/launch_prepare_latency_ms"]
+      .as<JSON::Number>().value;
+  const double fetching =
+    metrics.values["containerizer/mesos/launch_fetch_latency_ms"]
+      .as<JSON::Number>().value;
+
+  EXPECT_LE(100.0, preparing);
+  EXPECT_LE(preparing + fetching, launching);
+}
+
+
+#ifdef __linux__
+class LauncherZygoteTest : public tests::TemporaryDirectoryTest {};
+
+
+// Checks that a process forked using the zygote is a child of the
+// slave, has its I/O redirected, its environment set and inherits
+// the slave's file descriptors which are not close-on-exec. The
+// zygote is used directly because the launcher silently falls back
+// to forking the slave if the zygote fails.
+TEST_F(LauncherZygoteTest, Fork)
+{
+  Try<process::Owned<Zygote> > zygote =
+    Zygote::create(path::join(tests::flags.build_dir, "src"));
+
+  ASSERT_SOME(zygote);
+
+  int pipes[2];
+  ASSERT_NE(-1, ::pipe(pipes));
+
+  map<string, string> environment;
+  environment["MESOS_TEST_MESSAGE"] = "hello";
+
+  vector<string> argv(3);
+  argv[0] = "sh";
+  argv[1] = "-c";
+  argv[2] = "echo $MESOS_TEST_MESSAGE; "
+            "echo inherited >&" + stringify(pipes[1]) + "; "
+            "exit 3";
+
+  Try<pid_t> pid = zygote.get()->fork(
+      "/bin/sh",
+      argv,
+      process::Subprocess::FD(STDIN_FILENO),
+      process::Subprocess::PATH(path::join(os::getcwd(), "stdout")),
+      process::Subprocess::FD(STDERR_FILENO),
+      None(),
+      environment,
+      0,
+      vector<string>());
+
+  ASSERT_SOME(pid);
+
+  ASSERT_SOME(os::close(pipes[1]));
+
+  // The process is our child, so we learn its exit status.
+  process::Future<Option<int> > status = process::reap(pid.get());
+  AWAIT_READY(status);
+  ASSERT_SOME(status.get());
+  EXPECT_TRUE(WIFEXITED(status.get().get()));
+  EXPECT_EQ(3, WEXITSTATUS(status.get().get()));
+
+  EXPECT_SOME_EQ("hello\n", os::read(path::join(os::getcwd(), "stdout")));
+
+  char buffer[16];
+  ssize_t length = ::read(pipes[0], buffer, sizeof(buffer));
+  ASSERT_LT(0, length);
+  EXPECT_EQ("inherited\n", string(buffer, length));
+
+  ASSERT_SOME(os::close(pipes[0]));
+}
+
+
+// Measures the latency of launching short lived processes back to
+// back from a process with a large address space, forking it directly
+// and using the zygote.
+class Launcher_BENCHMARK_Test
+  : public tests::TemporaryDirectoryTest,
+    public ::testing::WithParamInterface<bool> {};
+
+
+INSTANTIATE_TEST_CASE_P(
+    Zygote,
+    Launcher_BENCHMARK_Test,
+    ::testing::Bool());
+
+
+TEST_P(Launcher_BENCHMARK_Test, Launch)
+{
+  const size_t launches = 1000;
+
+  // Touch some memory to resemble the address space of a slave.
+  vector<char> memory(Megabytes(512).bytes(), 1);
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+  flags.launcher_zygote = GetParam();
+
+  Try<Launcher*> launcher = PosixLauncher::create(flags);
+  ASSERT_SOME(launcher);
+
+  vector<string> argv(1);
+  argv[0] = "true";
+
+  vector<Duration> latencies;
+  list<process::Future<Nothing> > destroys;
+
+  Stopwatch total;
+  total.start();
+
+  for (size_t i = 0; i < launches; i++) {
+    ContainerID containerId;
+    containerId.set_value(stringify(i));
+
+    Stopwatch watch;
+    watch.start();
+
+    Try<pid_t> pid = launcher.get()->fork(
+        containerId,
+        "/bin/true",
+        argv,
+        process::Subprocess::FD(STDIN_FILENO),
+        process::Subprocess::FD(STDOUT_FILENO),
+        process::Subprocess::FD(STDERR_FILENO),
+        None(),
+        None(),
+        None());
+
+    latencies.push_back(watch.elapsed());
+
+    ASSERT_SOME(pid);
+
+    destroys.push_back(launcher.get()->destroy(containerId));
+  }
+
+  AWAIT_READY_FOR(collect(destroys), Minutes(1));
+
+  std::sort(latencies.begin(), latencies.end());
+
+  LOG(INFO) << "Launched " << launches << " processes "
+            << (GetParam() ? "using the zygote" : "forking directly")
+            << " in " << total.elapsed()
+            << ", launch latency p50 " << latencies[launches / 2]
+            << ", p90 " << latencies[launches * 9 / 10]
+            << ", p99 " << latencies[launches * 99 / 100]
+            << ", max " << latencies.back();
+
+  delete launcher.get();
+}
+#endif // __linux__
+
+
 class MesosContainerizerDestroyTest : public MesosTest {};
 
 class MockMesosContainerizerProcess : public MesosContainerizerProcess
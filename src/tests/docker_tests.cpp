@@ -16,17 +16,32 @@
  * limitations under the License.
  */
 
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #include <gtest/gtest.h>
 
+#include <process/defer.hpp>
+#include <process/dispatch.hpp>
 #include <process/future.hpp>
 #include <process/gtest.hpp>
+#include <process/io.hpp>
 #include <process/owned.hpp>
+#include <process/process.hpp>
 #include <process/subprocess.hpp>
 
 #include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/json.hpp>
 #include <stout/option.hpp>
+#include <stout/os.hpp>
 #include <stout/gtest.hpp>
+#include <stout/path.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
 
+#include "docker/daemon.hpp"
 #include "docker/docker.hpp"
 
 #include "mesos/resources.hpp"
@@ -38,6 +53,7 @@ using namespace process;
 
 using std::list;
 using std::string;
+using std::vector;
 
 namespace mesos {
 namespace internal {
@@ -317,6 +333,325 @@ TEST(DockerTest, ROOT_DOCKER_CancelPull)
   AWAIT_DISCARDED(future);
 }
 
+
+// A fake Docker daemon serving the parts of the remote API that are
+// used by DockerDaemon on a unix socket.
+class FakeDockerDaemonProcess : public Process<FakeDockerDaemonProcess>
+{
+public:
+  explicit FakeDockerDaemonProcess(const string& path)
+    : inspected(0)
+  {
+    // Listen right away so that clients can connect as soon as this
+    // constructor returns.
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    PCHECK(s >= 0) << "Failed to create socket";
+    PCHECK(::bind(s, (struct sockaddr*) &address, sizeof(address)) == 0)
+      << "Failed to bind to '" << path << "'";
+    PCHECK(::listen(s, 16) == 0) << "Failed to listen on '" << path << "'";
+  }
+
+  virtual ~FakeDockerDaemonProcess()
+  {
+    os::close(s);
+  }
+
+  // Adds a container, which is running unless 'pid' is 0.
+  void add(const string& name, const string& id, pid_t pid)
+  {
+    names[id] = name;
+    pids[id] = pid;
+  }
+
+  // Stops a container and emits the corresponding event.
+  void die(const string& id)
+  {
+    pids[id] = 0;
+
+    CHECK_SOME(events);
+
+    JSON::Object event;
+    event.values["status"] = "die";
+    event.values["id"] = id;
+
+    const string data = stringify(event) + "\n";
+
+    ASSERT_SOME(os::write(
+        events.get(),
+        strings::format("%zx\r\n", data.size()).get() + data + "\r\n"));
+  }
+
+  // Returns the number of containers that were inspected.
+  size_t inspects()
+  {
+    return inspected;
+  }
+
+  Future<Nothing> watching()
+  {
+    return watched.future();
+  }
+
+protected:
+  virtual void initialize()
+  {
+    accept();
+  }
+
+  virtual void finalize()
+  {
+    accepting.discard();
+
+    foreachpair (int fd, Future<short> poll, receiving) {
+      poll.discard();
+      os::close(fd);
+    }
+  }
+
+private:
+  void accept()
+  {
+    accepting = io::poll(s, io::READ);
+    accepting.onAny(defer(self(), &Self::_accept, lambda::_1));
+  }
+
+  void _accept(const Future<short>& poll)
+  {
+    if (!poll.isReady()) {
+      return;
+    }
+
+    int fd = ::accept(s, NULL, NULL);
+    if (fd >= 0) {
+      buffers[fd] = "";
+      receive(fd);
+    }
+
+    accept();
+  }
+
+  void receive(int fd)
+  {
+    receiving[fd] = io::poll(fd, io::READ);
+    receiving[fd].onAny(defer(self(), &Self::_receive, fd, lambda::_1));
+  }
+
+  void _receive(int fd, const Future<short>& poll)
+  {
+    char data[4096];
+    ssize_t length = poll.isReady() ? ::read(fd, data, sizeof(data)) : -1;
+
+    if (length <= 0) {
+      os::close(fd);
+      receiving.erase(fd);
+      buffers.erase(fd);
+      return;
+    }
+
+    buffers[fd].append(data, length);
+
+    size_t end = buffers[fd].find("\r\n\r\n");
+    while (end != string::npos) {
+      // The request line is of the form 'GET /events HTTP/1.1'.
+      vector<string> tokens =
+        strings::tokenize(buffers[fd].substr(0, end), " ");
+
+      buffers[fd].erase(0, end + 4);
+
+      ASSERT_LE(2u, tokens.size());
+      handle(fd, tokens[1]);
+
+      end = buffers[fd].find("\r\n\r\n");
+    }
+
+    receive(fd);
+  }
+
+  void handle(int fd, const string& path)
+  {
+    if (path == "/events") {
+      ASSERT_SOME(os::write(
+          fd,
+          "HTTP/1.1 200 OK\r\n"
+          "Content-Type: application/json\r\n"
+          "Transfer-Encoding: chunked\r\n"
+          "\r\n"));
+
+      events = fd;
+      watched.set(Nothing());
+    } else if (strings::startsWith(path, "/containers/json")) {
+      JSON::Array array;
+
+      foreachpair (const string& id, pid_t pid, pids) {
+        if (pid != 0 || path == "/containers/json?all=1") {
+          JSON::Array _names;
+          _names.values.push_back("/" + names[id]);
+
+          JSON::Object object;
+          object.values["Id"] = id;
+          object.values["Names"] = _names;
+          array.values.push_back(object);
+        }
+      }
+
+      respond(fd, "200 OK", stringify(array));
+    } else if (strings::startsWith(path, "/containers/")) {
+      inspected++;
+
+      string container = strings::remove(
+          strings::remove(path, "/containers/", strings::PREFIX),
+          "/json",
+          strings::SUFFIX);
+
+      foreachpair (const string& id, const string& name, names) {
+        if (container == id || container == name) {
+          JSON::Object state;
+          state.values["Pid"] = pids[id];
+
+          JSON::Object object;
+          object.values["Id"] = id;
+          object.values["Name"] = "/" + name;
+          object.values["State"] = state;
+
+          respond(fd, "200 OK", stringify(object));
+          return;
+        }
+      }
+
+      respond(fd, "404 Not Found", "no such id: " + container);
+    } else {
+      respond(fd, "404 Not Found", "page not found");
+    }
+  }
+
+  void respond(int fd, const string& status, const string& body)
+  {
+    ASSERT_SOME(os::write(
+        fd,
+        "HTTP/1.1 " + status + "\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: " + stringify(body.size()) + "\r\n"
+        "\r\n" + body));
+  }
+
+  int s;
+  Future<short> accepting;
+  hashmap<int, Future<short> > receiving;
+  hashmap<int, string> buffers;
+  Option<int> events;
+  Promise<Nothing> watched;
+
+  hashmap<string, string> names;
+  hashmap<string, pid_t> pids;
+  size_t inspected;
+};
+
+
+// This test verifies that DockerDaemon serves repeated inspects of a
+// container from its cache, and that an event for the container from
+// the daemon invalidates the cached container.
+TEST(DockerTest, DaemonInspect)
+{
+  Try<string> directory = environment->mkdtemp();
+  ASSERT_SOME(directory);
+
+  const string socket = path::join(directory.get(), "docker.sock");
+
+  FakeDockerDaemonProcess process(socket);
+  process.add("mesos-1", "1", 42);
+  process.add("mesos-2", "2", 0);
+  process.add("other", "3", 43);
+
+  spawn(process);
+
+  Try<Docker*> create = DockerDaemon::create("docker", socket, false);
+  ASSERT_SOME(create);
+
+  Owned<Docker> docker(create.get());
+
+  AWAIT_READY(dispatch(process, &FakeDockerDaemonProcess::watching));
+
+  // Containers only get cached once the client has processed the
+  // response to its request for the event stream, so inspect until
+  // an inspect does not reach the daemon anymore.
+  Future<size_t> inspects;
+  Duration waited = Duration::zero();
+  do {
+    AWAIT_READY(docker->inspect("mesos-1"));
+
+    inspects = dispatch(process, &FakeDockerDaemonProcess::inspects);
+    AWAIT_READY(inspects);
+
+    AWAIT_READY(docker->inspect("mesos-1"));
+
+    if (inspects.get() ==
+        dispatch(process, &FakeDockerDaemonProcess::inspects).get()) {
+      break;
+    }
+
+    os::sleep(Milliseconds(10));
+    waited += Milliseconds(10);
+  } while (waited < Seconds(5));
+
+  for (int i = 0; i < 10; i++) {
+    Future<Docker::Container> container = docker->inspect("mesos-1");
+    AWAIT_READY(container);
+
+    EXPECT_EQ("1", container.get().id);
+    EXPECT_EQ("/mesos-1", container.get().name);
+    EXPECT_SOME_EQ(42, container.get().pid);
+  }
+
+  AWAIT_EXPECT_EQ(
+      inspects.get(),
+      dispatch(process, &FakeDockerDaemonProcess::inspects));
+
+  // Once the container dies the client inspects it again.
+  dispatch(process, &FakeDockerDaemonProcess::die, "1");
+
+  Future<Docker::Container> container;
+  waited = Duration::zero();
+  do {
+    container = docker->inspect("mesos-1");
+    AWAIT_READY(container);
+
+    if (container.get().pid.isNone()) {
+      break;
+    }
+
+    os::sleep(Milliseconds(10));
+    waited += Milliseconds(10);
+  } while (waited < Seconds(5));
+
+  EXPECT_NONE(container.get().pid);
+
+  AWAIT_FAILED(docker->inspect("mesos-4"));
+
+  // Only running containers are listed unless asked for all of them.
+  Future<list<Docker::Container> > containers = docker->ps(false, "mesos-");
+  AWAIT_READY(containers);
+  EXPECT_TRUE(containers.get().empty());
+
+  containers = docker->ps(true, "mesos-");
+  AWAIT_READY(containers);
+  ASSERT_EQ(2u, containers.get().size());
+
+  foreach (const Docker::Container& container, containers.get()) {
+    EXPECT_TRUE(strings::startsWith(container.name, "/mesos-"));
+    EXPECT_NONE(container.pid);
+  }
+
+  docker.reset();
+
+  terminate(process);
+  wait(process);
+}
+
 } // namespace tests {
 } // namespace internal {
 } // namespace mesos {
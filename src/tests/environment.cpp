@@ -259,6 +259,42 @@ private:
 };
 
 
+class XfsFilter : public TestFilter
+{
+public:
+  XfsFilter()
+  {
+#ifdef __linux__
+    Try<int> check = os::shell(NULL, "which mkfs.xfs >/dev/null 2>&1");
+    if (check.isError()) {
+      xfsError = Error(check.error());
+    } else if (check.get() != 0) {
+      xfsError = Error("The 'mkfs.xfs' command is not available");
+    }
+#else
+    xfsError = Error("XFS tests not supported on non-Linux systems");
+#endif // __linux__
+
+    if (xfsError.isSome()) {
+      std::cerr
+        << "-------------------------------------------------------------\n"
+        << "We cannot run any XFS tests because:\n"
+        << xfsError.get().message << "\n"
+        << "-------------------------------------------------------------"
+        << std::endl;
+    }
+  }
+
+  bool disable(const ::testing::TestInfo* test) const
+  {
+    return matches(test, "XFS_") && xfsError.isSome();
+  }
+
+private:
+  Option<Error> xfsError;
+};
+
+
 // Return list of disabled tests based on test name based filters.
 static vector<string> disabled(
     const ::testing::UnitTest* unitTest,
@@ -330,6 +366,7 @@ Environment::Environment(const Flags& _flags) : flags(_flags)
   filters.push_back(Owned<TestFilter>(new DockerFilter()));
   filters.push_back(Owned<TestFilter>(new BenchmarkFilter()));
   filters.push_back(Owned<TestFilter>(new NetworkIsolatorTestFilter()));
+  filters.push_back(Owned<TestFilter>(new XfsFilter()));
 
   // Construct the filter string to handle system or platform specific tests.
   ::testing::UnitTest* unitTest = ::testing::UnitTest::GetInstance();
@@ -18,8 +18,12 @@
 
 #include <unistd.h>
 
+#include <sys/stat.h>
+
+#include <list>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <hdfs/hdfs.hpp>
 
@@ -701,6 +705,473 @@ TEST_F(FetcherTest, ExtractNotExecutable)
 }
 
 
+// Tests that a URI that requests caching is retrieved from the cache
+// once it has been fetched, even if it is no longer available at the
+// source.
+TEST_F(FetcherTest, CachedURI)
+{
+  Try<string> path = os::mktemp();
+  ASSERT_SOME(path);
+  ASSERT_SOME(os::write(path.get(), "cached"));
+
+  Try<string> basename = os::basename(path.get());
+  ASSERT_SOME(basename);
+
+  CommandInfo commandInfo;
+  CommandInfo::URI* uri = commandInfo.add_uris();
+  uri->set_value(path.get());
+  uri->set_extract(false);
+  uri->set_cache(true);
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+  flags.fetcher_cache_dir = path::join(os::getcwd(), "cache");
+
+  Fetcher fetcher;
+
+  const string sandbox1 = path::join(os::getcwd(), "sandbox1");
+  ASSERT_SOME(os::mkdir(sandbox1));
+
+  ContainerID containerId1;
+  containerId1.set_value(UUID::random().toString());
+
+  AWAIT_READY(fetcher.fetch(
+      containerId1, commandInfo, sandbox1, None(), flags));
+
+  ASSERT_SOME_EQ("cached", os::read(path::join(sandbox1, basename.get())));
+
+  // Remove the source, subsequent fetches must use the cache.
+  ASSERT_SOME(os::rm(path.get()));
+
+  const string sandbox2 = path::join(os::getcwd(), "sandbox2");
+  ASSERT_SOME(os::mkdir(sandbox2));
+
+  ContainerID containerId2;
+  containerId2.set_value(UUID::random().toString());
+
+  AWAIT_READY(fetcher.fetch(
+      containerId2, commandInfo, sandbox2, None(), flags));
+
+  ASSERT_SOME_EQ("cached", os::read(path::join(sandbox2, basename.get())));
+}
+
+
+// Tests that URIs (cached or not) are fetched into a sandbox whose
+// path contains quotes, without the path being interpreted by a
+// shell.
+TEST_F(FetcherTest, QuotedSandbox)
+{
+  Try<string> path1 = os::mktemp();
+  ASSERT_SOME(path1);
+  ASSERT_SOME(os::write(path1.get(), "bypassed"));
+
+  Try<string> path2 = os::mktemp();
+  ASSERT_SOME(path2);
+  ASSERT_SOME(os::write(path2.get(), "cached"));
+
+  Try<string> basename1 = os::basename(path1.get());
+  ASSERT_SOME(basename1);
+
+  Try<string> basename2 = os::basename(path2.get());
+  ASSERT_SOME(basename2);
+
+  CommandInfo commandInfo;
+
+  CommandInfo::URI* uri = commandInfo.add_uris();
+  uri->set_value(path1.get());
+  uri->set_extract(false);
+
+  uri = commandInfo.add_uris();
+  uri->set_value(path2.get());
+  uri->set_extract(false);
+  uri->set_cache(true);
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+  flags.fetcher_cache_dir = path::join(os::getcwd(), "cache");
+
+  Fetcher fetcher;
+
+  const string sandbox =
+    path::join(os::getcwd(), "sand'box; touch injected; '");
+  ASSERT_SOME(os::mkdir(sandbox));
+
+  ContainerID containerId;
+  containerId.set_value(UUID::random().toString());
+
+  AWAIT_READY(fetcher.fetch(containerId, commandInfo, sandbox, None(), flags));
+
+  EXPECT_SOME_EQ("bypassed", os::read(path::join(sandbox, basename1.get())));
+  EXPECT_SOME_EQ("cached", os::read(path::join(sandbox, basename2.get())));
+
+  EXPECT_FALSE(os::exists(path::join(os::getcwd(), "injected")));
+  EXPECT_FALSE(os::exists(path::join(sandbox, "injected")));
+
+  ASSERT_SOME(os::rm(path1.get()));
+  ASSERT_SOME(os::rm(path2.get()));
+}
+
+
+// Tests that concurrent fetches of the same cached URI fetch it only
+// once, i.e., that both sandboxes are populated from the same cache
+// entry.
+TEST_F(FetcherTest, ConcurrentCachedURI)
+{
+  Try<string> path = os::mktemp();
+  ASSERT_SOME(path);
+  ASSERT_SOME(os::write(path.get(), "cached"));
+
+  Try<string> basename = os::basename(path.get());
+  ASSERT_SOME(basename);
+
+  CommandInfo commandInfo;
+  CommandInfo::URI* uri = commandInfo.add_uris();
+  uri->set_value(path.get());
+  uri->set_extract(false);
+  uri->set_cache(true);
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+  flags.fetcher_cache_dir = path::join(os::getcwd(), "cache");
+
+  Fetcher fetcher;
+
+  const string sandbox1 = path::join(os::getcwd(), "sandbox1");
+  ASSERT_SOME(os::mkdir(sandbox1));
+
+  const string sandbox2 = path::join(os::getcwd(), "sandbox2");
+  ASSERT_SOME(os::mkdir(sandbox2));
+
+  ContainerID containerId1;
+  containerId1.set_value(UUID::random().toString());
+
+  ContainerID containerId2;
+  containerId2.set_value(UUID::random().toString());
+
+  Future<Nothing> fetch1 =
+    fetcher.fetch(containerId1, commandInfo, sandbox1, None(), flags);
+
+  Future<Nothing> fetch2 =
+    fetcher.fetch(containerId2, commandInfo, sandbox2, None(), flags);
+
+  AWAIT_READY(fetch1);
+  AWAIT_READY(fetch2);
+
+  const string file1 = path::join(sandbox1, basename.get());
+  const string file2 = path::join(sandbox2, basename.get());
+
+  ASSERT_SOME_EQ("cached", os::read(file1));
+  ASSERT_SOME_EQ("cached", os::read(file2));
+
+  struct stat s1;
+  ASSERT_EQ(0, ::stat(file1.c_str(), &s1));
+
+  struct stat s2;
+  ASSERT_EQ(0, ::stat(file2.c_str(), &s2));
+
+  // The sandboxes hold copies rather than links to the cached file.
+  EXPECT_NE(s1.st_ino, s2.st_ino);
+  EXPECT_EQ(1u, s1.st_nlink);
+  EXPECT_EQ(1u, s2.st_nlink);
+
+  // Both sandboxes were populated from the same cache entry.
+  Try<std::list<string> > entries = os::ls(flags.fetcher_cache_dir);
+  ASSERT_SOME(entries);
+  EXPECT_EQ(1u, entries.get().size());
+
+  ASSERT_SOME(os::rm(path.get()));
+}
+
+
+// Tests that the cache entries of a discarded fetch are released so
+// that the fetches waiting for them do not hang.
+TEST_F(FetcherTest, DiscardCachedURI)
+{
+  Try<string> path = os::mktemp();
+  ASSERT_SOME(path);
+  ASSERT_SOME(os::write(path.get(), "cached"));
+
+  Try<string> basename = os::basename(path.get());
+  ASSERT_SOME(basename);
+
+  CommandInfo commandInfo;
+  CommandInfo::URI* uri = commandInfo.add_uris();
+  uri->set_value(path.get());
+  uri->set_extract(false);
+  uri->set_cache(true);
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+  flags.fetcher_cache_dir = path::join(os::getcwd(), "cache");
+
+  Fetcher fetcher;
+
+  const string sandbox1 = path::join(os::getcwd(), "sandbox1");
+  ASSERT_SOME(os::mkdir(sandbox1));
+
+  const string sandbox2 = path::join(os::getcwd(), "sandbox2");
+  ASSERT_SOME(os::mkdir(sandbox2));
+
+  ContainerID containerId1;
+  containerId1.set_value(UUID::random().toString());
+
+  ContainerID containerId2;
+  containerId2.set_value(UUID::random().toString());
+
+  Future<Nothing> fetch1 =
+    fetcher.fetch(containerId1, commandInfo, sandbox1, None(), flags);
+
+  // The second fetch waits for the first one to populate the cache.
+  Future<Nothing> fetch2 =
+    fetcher.fetch(containerId2, commandInfo, sandbox2, None(), flags);
+
+  fetch1.discard();
+
+  AWAIT_DISCARDED(fetch1);
+
+  // The second fetch falls back to fetching bypassing the cache.
+  AWAIT_READY(fetch2);
+
+  EXPECT_SOME_EQ("cached", os::read(path::join(sandbox2, basename.get())));
+
+  // The entry of the discarded fetch has been removed.
+  Try<std::list<string>> entries = os::ls(flags.fetcher_cache_dir);
+  ASSERT_SOME(entries);
+  EXPECT_TRUE(entries.get().empty());
+
+  ASSERT_SOME(os::rm(path.get()));
+}
+
+
+// Tests that a task modifying a cached file in its sandbox does not
+// modify the cached file, i.e., later fetches get the original file.
+TEST_F(FetcherTest, ModifyCachedURI)
+{
+  Try<string> path = os::mktemp();
+  ASSERT_SOME(path);
+  ASSERT_SOME(os::write(path.get(), "cached"));
+
+  Try<string> basename = os::basename(path.get());
+  ASSERT_SOME(basename);
+
+  CommandInfo commandInfo;
+  CommandInfo::URI* uri = commandInfo.add_uris();
+  uri->set_value(path.get());
+  uri->set_extract(false);
+  uri->set_cache(true);
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+  flags.fetcher_cache_dir = path::join(os::getcwd(), "cache");
+
+  Fetcher fetcher;
+
+  const string sandbox1 = path::join(os::getcwd(), "sandbox1");
+  ASSERT_SOME(os::mkdir(sandbox1));
+
+  ContainerID containerId1;
+  containerId1.set_value(UUID::random().toString());
+
+  AWAIT_READY(fetcher.fetch(
+      containerId1, commandInfo, sandbox1, None(), flags));
+
+  // Modify the file in place (rather than replacing it).
+  ASSERT_SOME_EQ(0, os::shell(
+      NULL,
+      "echo modified > %s",
+      path::join(sandbox1, basename.get()).c_str()));
+
+  ASSERT_SOME(os::rm(path.get()));
+
+  const string sandbox2 = path::join(os::getcwd(), "sandbox2");
+  ASSERT_SOME(os::mkdir(sandbox2));
+
+  ContainerID containerId2;
+  containerId2.set_value(UUID::random().toString());
+
+  AWAIT_READY(fetcher.fetch(
+      containerId2, commandInfo, sandbox2, None(), flags));
+
+  EXPECT_SOME_EQ("cached", os::read(path::join(sandbox2, basename.get())));
+}
+
+
+// Tests that cached files are evicted once the cache exceeds its size
+// and are fetched again afterwards.
+TEST_F(FetcherTest, CacheEviction)
+{
+  Try<string> path = os::mktemp();
+  ASSERT_SOME(path);
+  ASSERT_SOME(os::write(path.get(), "cached"));
+
+  CommandInfo commandInfo;
+  CommandInfo::URI* uri = commandInfo.add_uris();
+  uri->set_value(path.get());
+  uri->set_extract(false);
+  uri->set_cache(true);
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+  flags.fetcher_cache_dir = path::join(os::getcwd(), "cache");
+  flags.fetcher_cache_size = Bytes(0);
+
+  Fetcher fetcher;
+
+  const string sandbox1 = path::join(os::getcwd(), "sandbox1");
+  ASSERT_SOME(os::mkdir(sandbox1));
+
+  ContainerID containerId1;
+  containerId1.set_value(UUID::random().toString());
+
+  AWAIT_READY(fetcher.fetch(
+      containerId1, commandInfo, sandbox1, None(), flags));
+
+  // The file does not fit into the cache, hence it has been evicted.
+  Try<std::list<string>> entries = os::ls(flags.fetcher_cache_dir);
+  ASSERT_SOME(entries);
+  EXPECT_TRUE(entries.get().empty());
+
+  ASSERT_SOME(os::rm(path.get()));
+
+  const string sandbox2 = path::join(os::getcwd(), "sandbox2");
+  ASSERT_SOME(os::mkdir(sandbox2));
+
+  ContainerID containerId2;
+  containerId2.set_value(UUID::random().toString());
+
+  AWAIT_FAILED(fetcher.fetch(
+      containerId2, commandInfo, sandbox2, None(), flags));
+}
+
+
+// Tests that a cached archive is extracted once within the cache and
+// that sandboxes are populated from the extracted tree.
+TEST_F(FetcherTest, CachedArchive)
+{
+  Try<string> path = os::mktemp();
+  ASSERT_SOME(path);
+  ASSERT_SOME(os::write(path.get(), "hello world"));
+
+  ASSERT_SOME(os::tar(path.get(), path.get() + ".tar.gz"));
+
+  CommandInfo commandInfo;
+  CommandInfo::URI* uri = commandInfo.add_uris();
+  uri->set_value(path.get() + ".tar.gz");
+  uri->set_extract(true);
+  uri->set_cache(true);
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+  flags.fetcher_cache_dir = path::join(os::getcwd(), "cache");
+
+  Fetcher fetcher;
+
+  const string sandbox1 = path::join(os::getcwd(), "sandbox1");
+  ASSERT_SOME(os::mkdir(sandbox1));
+
+  ContainerID containerId1;
+  containerId1.set_value(UUID::random().toString());
+
+  AWAIT_READY(fetcher.fetch(
+      containerId1, commandInfo, sandbox1, None(), flags));
+
+  ASSERT_SOME_EQ("hello world", os::read(path::join(sandbox1, path.get())));
+
+  // Remove the source archive, the second sandbox must be populated
+  // from the tree extracted within the cache.
+  ASSERT_SOME(os::rm(path.get()));
+  ASSERT_SOME(os::rm(path.get() + ".tar.gz"));
+
+  const string sandbox2 = path::join(os::getcwd(), "sandbox2");
+  ASSERT_SOME(os::mkdir(sandbox2));
+
+  ContainerID containerId2;
+  containerId2.set_value(UUID::random().toString());
+
+  AWAIT_READY(fetcher.fetch(
+      containerId2, commandInfo, sandbox2, None(), flags));
+
+  ASSERT_SOME_EQ("hello world", os::read(path::join(sandbox2, path.get())));
+}
+
+
+// Tests that all URIs of a command are fetched, which the
+// mesos-fetcher does in parallel.
+TEST_F(FetcherTest, MultipleURIs)
+{
+  ContainerID containerId;
+  containerId.set_value(UUID::random().toString());
+
+  CommandInfo commandInfo;
+
+  std::vector<string> paths;
+  for (int i = 0; i < 5; i++) {
+    Try<string> path = os::mktemp();
+    ASSERT_SOME(path);
+    ASSERT_SOME(os::write(path.get(), stringify(i)));
+
+    ASSERT_SOME(os::tar(path.get(), path.get() + ".tar.gz"));
+    ASSERT_SOME(os::rm(path.get()));
+
+    CommandInfo::URI* uri = commandInfo.add_uris();
+    uri->set_value(path.get() + ".tar.gz");
+    uri->set_extract(true);
+
+    paths.push_back(path.get());
+  }
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+
+  Fetcher fetcher;
+
+  AWAIT_READY(fetcher.fetch(
+      containerId, commandInfo, os::getcwd(), None(), flags));
+
+  for (size_t i = 0; i < paths.size(); i++) {
+    ASSERT_SOME_EQ(stringify(i), os::read(path::join(".", paths[i])));
+    ASSERT_SOME(os::rm(paths[i] + ".tar.gz"));
+  }
+}
+
+
+// Tests that URIs that are fetched to the same file in the sandbox
+// are fetched one after the other, in order, so that the file holds
+// the last of them.
+TEST_F(FetcherTest, SameFilename)
+{
+  ContainerID containerId;
+  containerId.set_value(UUID::random().toString());
+
+  CommandInfo commandInfo;
+
+  for (int i = 0; i < 3; i++) {
+    const string directory = path::join(os::getcwd(), stringify(i));
+    ASSERT_SOME(os::mkdir(directory));
+
+    const string path = path::join(directory, "file");
+    ASSERT_SOME(os::write(path, stringify(i)));
+
+    CommandInfo::URI* uri = commandInfo.add_uris();
+    uri->set_value(path);
+    uri->set_extract(false);
+  }
+
+  const string sandbox = path::join(os::getcwd(), "sandbox");
+  ASSERT_SOME(os::mkdir(sandbox));
+
+  slave::Flags flags;
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+
+  Fetcher fetcher;
+
+  AWAIT_READY(fetcher.fetch(
+      containerId, commandInfo, sandbox, None(), flags));
+
+  EXPECT_SOME_EQ("2", os::read(path::join(sandbox, "file")));
+}
+
+
 // Tests fetching via the local HDFS client. Since we cannot rely on
 // Hadoop being installed, we use our own mock version that works on
 // the local file system only, but this lets us exercise the exact
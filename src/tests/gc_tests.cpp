@@ -36,6 +36,7 @@
 
 #include <stout/duration.hpp>
 #include <stout/gtest.hpp>
+#include <stout/json.hpp>
 #include <stout/nothing.hpp>
 #include <stout/os.hpp>
 
@@ -246,6 +247,75 @@ TEST_F(GarbageCollectorTest, Prune)
 }
 
 
+// This test verifies that the garbage collector holds back removals
+// for as long as reclaiming the removed space takes at the removal
+// rate, and that it reports the reclaimed space.
+TEST_F(GarbageCollectorTest, RemovalRate)
+{
+  slave::Flags flags;
+  flags.gc_removal_rate = Kilobytes(1);
+  flags.gc_max_concurrent_removals = 1;
+
+  GarbageCollector gc(flags);
+
+  ASSERT_SOME(os::write("file1", string(Kilobytes(4).bytes(), 'x')));
+  ASSERT_SOME(os::write("file2", string(Kilobytes(4).bytes(), 'x')));
+
+  Clock::pause();
+
+  Future<Nothing> schedule1 = gc.schedule(Seconds(10), "file1");
+  Future<Nothing> schedule2 = gc.schedule(Seconds(10), "file2");
+
+  Clock::settle();
+
+  // Advance the clock to make both paths due at once.
+  Clock::advance(Seconds(10));
+  Clock::settle();
+
+  AWAIT_READY(schedule1);
+  EXPECT_FALSE(os::exists("file1"));
+
+  // The second path is held back by the removal rate.
+  EXPECT_TRUE(schedule2.isPending());
+  EXPECT_TRUE(os::exists("file2"));
+
+  JSON::Object metrics = Metrics();
+
+  EXPECT_EQ(1u, metrics.values["gc/paths_scheduled"]);
+  EXPECT_EQ(0u, metrics.values["gc/path_removals_pending"]);
+  EXPECT_EQ(1u, metrics.values["gc/path_removals_succeeded"]);
+
+  ASSERT_EQ(1u, metrics.values.count("gc/bytes_reclaimed"));
+
+  const double reclaimed =
+    metrics.values["gc/bytes_reclaimed"].as<JSON::Number>().value;
+
+  // The file has been accounted by the disk space it used.
+  EXPECT_LT(0.0, reclaimed);
+
+  const Duration delay =
+    Seconds(1) * (reclaimed / flags.gc_removal_rate.bytes());
+
+  Clock::advance(delay - Milliseconds(1));
+  Clock::settle();
+
+  EXPECT_TRUE(schedule2.isPending());
+
+  Clock::advance(Milliseconds(1));
+  Clock::settle();
+
+  AWAIT_READY(schedule2);
+  EXPECT_FALSE(os::exists("file2"));
+
+  metrics = Metrics();
+
+  EXPECT_EQ(0u, metrics.values["gc/paths_scheduled"]);
+  EXPECT_EQ(2u, metrics.values["gc/path_removals_succeeded"]);
+
+  Clock::resume();
+}
+
+
 class GarbageCollectorIntegrationTest : public MesosTest {};
 
 
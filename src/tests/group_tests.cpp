@@ -18,15 +18,23 @@
 
 #include <gmock/gmock.h>
 
+#include <list>
+#include <set>
 #include <string>
 
+#include <process/collect.hpp>
 #include <process/future.hpp>
 #include <process/gmock.hpp>
 #include <process/gtest.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+#include <stout/try.hpp>
 
 #include "tests/zookeeper.hpp"
 
@@ -38,6 +46,8 @@ using zookeeper::GroupProcess;
 
 using process::Future;
 
+using std::list;
+using std::set;
 using std::string;
 
 using testing::_;
@@ -193,6 +203,137 @@ TEST_F(GroupTest, GroupCancelWithDisconnect)
 }
 
 
+// Tests that when a batch of cancels fails because one of the
+// memberships no longer exists (i.e., it has expired but the group
+// has yet to learn about it) the other cancels still succeed.
+TEST_F(GroupTest, GroupCancelsWithRemovedMembership)
+{
+  Group group(server->connectString(), NO_TIMEOUT, "/test/");
+
+  Future<Group::Membership> membership1 = group.join("hello");
+
+  AWAIT_READY(membership1);
+
+  Future<Group::Membership> membership2 = group.join("world");
+
+  AWAIT_READY(membership2);
+
+  // Drop the updates from ZooKeeper so that the group doesn't learn
+  // that we remove the first membership below.
+  DROP_DISPATCHES(_, &GroupProcess::updated);
+
+  ZooKeeperTest::TestWatcher watcher;
+
+  ZooKeeper zk(server->connectString(), NO_TIMEOUT, &watcher);
+  watcher.awaitSessionEvent(ZOO_CONNECTED_STATE);
+
+  Try<string> sequence = strings::format("%.*d", 10, membership1.get().id());
+  ASSERT_SOME(sequence);
+
+  ASSERT_EQ(ZOK, zk.remove("/test/" + sequence.get(), -1));
+
+  // Cancel both memberships while disconnected so that they are
+  // performed as a single batch once reconnected.
+  server->shutdownNetwork();
+
+  Future<bool> cancellation1 = group.cancel(membership1.get());
+  Future<bool> cancellation2 = group.cancel(membership2.get());
+
+  EXPECT_TRUE(cancellation1.isPending());
+  EXPECT_TRUE(cancellation2.isPending());
+
+  server->startNetwork();
+
+  AWAIT_EXPECT_EQ(false, cancellation1);
+  AWAIT_EXPECT_EQ(true, cancellation2);
+
+  AWAIT_EXPECT_EQ(true, membership2.get().cancelled());
+}
+
+
+// Tests that cancelling a membership more than once in the same
+// batch only cancels it once.
+TEST_F(GroupTest, GroupDuplicateCancels)
+{
+  Group group(server->connectString(), NO_TIMEOUT, "/test/");
+
+  Future<Group::Membership> membership = group.join("hello world");
+
+  AWAIT_READY(membership);
+
+  // Cancel the membership twice while disconnected so that both are
+  // performed as a single batch once reconnected.
+  server->shutdownNetwork();
+
+  Future<bool> cancellation1 = group.cancel(membership.get());
+  Future<bool> cancellation2 = group.cancel(membership.get());
+
+  EXPECT_TRUE(cancellation1.isPending());
+  EXPECT_TRUE(cancellation2.isPending());
+
+  server->startNetwork();
+
+  AWAIT_EXPECT_EQ(true, cancellation1);
+  AWAIT_EXPECT_EQ(false, cancellation2);
+
+  AWAIT_EXPECT_EQ(true, membership.get().cancelled());
+
+  Future<std::set<Group::Membership> > memberships = group.watch();
+
+  AWAIT_READY(memberships);
+  EXPECT_EQ(0u, memberships.get().size());
+}
+
+
+// Tests that the data of a membership that has been fetched (and
+// cached) is not returned once the membership is gone.
+TEST_F(GroupTest, GroupDataWithCancelledMembership)
+{
+  Group group1(server->connectString(), NO_TIMEOUT, "/test/");
+  Group group2(server->connectString(), NO_TIMEOUT, "/test/");
+
+  Future<Group::Membership> membership = group1.join("hello world");
+
+  AWAIT_READY(membership);
+
+  Future<std::set<Group::Membership> > memberships = group2.watch();
+
+  AWAIT_READY(memberships);
+
+  // NOTE: Since 'group1' joining doesn't guarantee that 'group2'
+  // knows about it synchronously, we might have to watch again.
+  if (memberships.get().empty()) {
+    memberships = group2.watch(memberships.get());
+    AWAIT_READY(memberships);
+  }
+
+  ASSERT_EQ(1u, memberships.get().count(membership.get()));
+
+  // Fetch the data twice, the second time from the cache.
+  Future<Option<string> > data = group2.data(membership.get());
+
+  AWAIT_READY(data);
+  EXPECT_SOME_EQ("hello world", data.get());
+
+  data = group2.data(membership.get());
+
+  AWAIT_READY(data);
+  EXPECT_SOME_EQ("hello world", data.get());
+
+  AWAIT_EXPECT_EQ(true, group1.cancel(membership.get()));
+
+  memberships = group2.watch(memberships.get());
+
+  AWAIT_READY(memberships);
+  EXPECT_EQ(0u, memberships.get().size());
+
+  data = group2.data(membership.get());
+
+  AWAIT_READY(data);
+  EXPECT_NONE(data.get());
+}
+
+
 TEST_F(GroupTest, GroupWatchWithSessionExpiration)
 {
   Group group(server->connectString(), NO_TIMEOUT, "/test/");
@@ -435,6 +576,62 @@ TEST_F(GroupTest, LabelledGroup)
   ASSERT_TRUE(membership.get().cancelled().get());
 }
 
+
+// Measures joining, fetching the data of and cancelling many
+// memberships at once. The joins and cancels get batched into multi
+// operations and the data is only fetched from ZooKeeper once.
+TEST_F(GroupTest, BENCHMARK_Memberships)
+{
+  Group group(server->connectString(), NO_TIMEOUT, "/test/");
+
+  const size_t counts[] = {10U, 100U, 1000U};
+
+  foreach (size_t count, counts) {
+    Stopwatch watch;
+    watch.start();
+
+    list<Future<Group::Membership> > joins;
+    for (size_t i = 0; i < count; i++) {
+      joins.push_back(group.join("member " + stringify(i)));
+    }
+
+    AWAIT_READY_FOR(process::collect(joins), Minutes(1));
+
+    LOG(INFO) << "Joined " << count << " memberships in " << watch.elapsed();
+
+    Future<set<Group::Membership> > memberships = group.watch();
+
+    AWAIT_READY(memberships);
+    ASSERT_EQ(count, memberships.get().size());
+
+    for (int round = 0; round < 2; round++) {
+      watch.start();
+
+      list<Future<Option<string> > > datas;
+      foreach (const Group::Membership& membership, memberships.get()) {
+        datas.push_back(group.data(membership));
+      }
+
+      AWAIT_READY_FOR(process::collect(datas), Minutes(1));
+
+      LOG(INFO) << "Fetched the data of " << count << " memberships in "
+                << watch.elapsed() << (round == 0 ? "" : " (cached)");
+    }
+
+    watch.start();
+
+    list<Future<bool> > cancels;
+    foreach (const Future<Group::Membership>& membership, joins) {
+      cancels.push_back(group.cancel(membership.get()));
+    }
+
+    AWAIT_READY_FOR(process::collect(cancels), Minutes(1));
+
+    LOG(INFO) << "Cancelled " << count << " memberships in "
+              << watch.elapsed();
+  }
+}
+
 } // namespace tests {
 } // namespace internal {
 } // namespace mesos {
@@ -21,7 +21,14 @@
 
 #include <process/clock.hpp>
 #include <process/future.hpp>
+#include <process/http.hpp>
 #include <process/pid.hpp>
+#include <process/process.hpp>
+
+#include <stout/lambda.hpp>
+#include <stout/stopwatch.hpp>
+
+#include "health-check/health_checker.hpp"
 
 #include "slave/slave.hpp"
 
@@ -43,6 +50,8 @@ using mesos::internal::slave::Slave;
 using process::Clock;
 using process::Future;
 using process::PID;
+using process::Process;
+using process::Promise;
 
 using testing::_;
 using testing::AtMost;
@@ -434,20 +443,17 @@ TEST_F(HealthCheckTest, DISABLED_ConsecutiveFailures)
   vector<TaskInfo> tasks = populateTasks(
     "sleep 120", "exit 1", offers.get()[0], 0, 4);
 
-  // Expecting four unhealthy updates and one final kill update.
+  // Expecting an unhealthy update on the first failure, another one
+  // once the task is to be killed, and one final kill update.
   Future<TaskStatus> statusRunning;
   Future<TaskStatus> status1;
   Future<TaskStatus> status2;
-  Future<TaskStatus> status3;
-  Future<TaskStatus> status4;
   Future<TaskStatus> statusKilled;
 
   EXPECT_CALL(sched, statusUpdate(&driver, _))
     .WillOnce(FutureArg<1>(&statusRunning))
     .WillOnce(FutureArg<1>(&status1))
     .WillOnce(FutureArg<1>(&status2))
-    .WillOnce(FutureArg<1>(&status3))
-    .WillOnce(FutureArg<1>(&status4))
     .WillOnce(FutureArg<1>(&statusKilled));
 
   driver.launchTasks(offers.get()[0].id(), tasks);
@@ -463,14 +469,6 @@ TEST_F(HealthCheckTest, DISABLED_ConsecutiveFailures)
   EXPECT_EQ(TASK_RUNNING, status2.get().state());
   EXPECT_FALSE(status2.get().healthy());
 
-  AWAIT_READY(status3);
-  EXPECT_EQ(TASK_RUNNING, status3.get().state());
-  EXPECT_FALSE(status3.get().healthy());
-
-  AWAIT_READY(status4);
-  EXPECT_EQ(TASK_RUNNING, status4.get().state());
-  EXPECT_FALSE(status4.get().healthy());
-
   AWAIT_READY(statusKilled);
   EXPECT_EQ(TASK_KILLED, statusKilled.get().state());
   EXPECT_TRUE(statusKilled.get().has_healthy());
@@ -616,6 +614,229 @@ TEST_F(HealthCheckTest, DISABLED_GracePeriod)
   Shutdown();
 }
 
+
+// Collects the health statuses reported by a HealthChecker until the
+// expected number of statuses was reported.
+struct HealthStatuses
+{
+  explicit HealthStatuses(size_t _expected) : expected(_expected) {}
+
+  void reported(const vector<TaskHealthStatus>& batch)
+  {
+    statuses.insert(statuses.end(), batch.begin(), batch.end());
+
+    if (statuses.size() >= expected) {
+      promise.set(Nothing());
+    }
+  }
+
+  const size_t expected;
+  vector<TaskHealthStatus> statuses;
+  Promise<Nothing> promise;
+};
+
+
+class HealthProcess : public Process<HealthProcess>
+{
+public:
+  HealthProcess()
+  {
+    route("/health", None(), &HealthProcess::health);
+  }
+
+  Future<process::http::Response> health(
+      const process::http::Request& request)
+  {
+    return process::http::OK();
+  }
+};
+
+
+static HealthCheck createHealthCheck(uint32_t consecutiveFailures = 3)
+{
+  HealthCheck check;
+  check.set_delay_seconds(0);
+  check.set_interval_seconds(0.01);
+  check.set_timeout_seconds(10);
+  check.set_grace_period_seconds(0);
+  check.set_consecutive_failures(consecutiveFailures);
+
+  return check;
+}
+
+
+// Testing that the health checker reports a task whose port accepts
+// connections as healthy once, and reports a task whose port does
+// not as unhealthy on the first failure and once it is to be killed.
+TEST(HealthCheckerTest, TCP)
+{
+  HealthProcess process;
+  spawn(process);
+
+  HealthStatuses statuses(3);
+
+  HealthChecker checker(
+      lambda::bind(&HealthStatuses::reported, &statuses, lambda::_1));
+
+  TaskID healthy;
+  healthy.set_value("healthy");
+
+  HealthCheck check = createHealthCheck();
+  check.mutable_tcp()->set_port(process.self().address.port);
+
+  AWAIT_READY(checker.add(healthy, check));
+
+  TaskID unhealthy;
+  unhealthy.set_value("unhealthy");
+
+  // Nothing listens on port 0.
+  check = createHealthCheck(2);
+  check.mutable_tcp()->set_port(0);
+
+  AWAIT_READY(checker.add(unhealthy, check));
+
+  AWAIT_READY(statuses.promise.future());
+
+  // The healthy task keeps passing its checks, which must not be
+  // reported again.
+  os::sleep(Milliseconds(100));
+
+  ASSERT_EQ(3u, statuses.statuses.size());
+
+  Option<TaskHealthStatus> passed;
+  vector<TaskHealthStatus> failed;
+
+  foreach (const TaskHealthStatus& status, statuses.statuses) {
+    if (status.task_id() == healthy) {
+      EXPECT_NONE(passed);
+      passed = status;
+    } else {
+      EXPECT_EQ(unhealthy, status.task_id());
+      failed.push_back(status);
+    }
+  }
+
+  ASSERT_SOME(passed);
+  EXPECT_TRUE(passed.get().healthy());
+  EXPECT_FALSE(passed.get().kill_task());
+
+  ASSERT_EQ(2u, failed.size());
+  EXPECT_FALSE(failed[0].healthy());
+  EXPECT_EQ(1, failed[0].consecutive_failures());
+  EXPECT_FALSE(failed[0].kill_task());
+  EXPECT_FALSE(failed[1].healthy());
+  EXPECT_EQ(2, failed[1].consecutive_failures());
+  EXPECT_TRUE(failed[1].kill_task());
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Testing that HTTP checks pass only for the expected statuses.
+TEST(HealthCheckerTest, HTTP)
+{
+  HealthProcess process;
+  spawn(process);
+
+  HealthStatuses statuses(2);
+
+  HealthChecker checker(
+      lambda::bind(&HealthStatuses::reported, &statuses, lambda::_1));
+
+  TaskID healthy;
+  healthy.set_value("healthy");
+
+  // Failing checks are only reported once before the task is to be
+  // killed.
+  HealthCheck check = createHealthCheck(1000);
+  check.mutable_http()->set_port(process.self().address.port);
+  check.mutable_http()->set_path("/" + process.self().id + "/health");
+  check.mutable_http()->add_statuses(200);
+
+  AWAIT_READY(checker.add(healthy, check));
+
+  TaskID unhealthy;
+  unhealthy.set_value("unhealthy");
+
+  check.mutable_http()->set_path("/" + process.self().id + "/unknown");
+
+  AWAIT_READY(checker.add(unhealthy, check));
+
+  AWAIT_READY(statuses.promise.future());
+
+  ASSERT_EQ(2u, statuses.statuses.size());
+
+  foreach (const TaskHealthStatus& status, statuses.statuses) {
+    EXPECT_EQ(status.task_id() == healthy, status.healthy());
+  }
+
+  // A health check needs exactly one strategy.
+  TaskID invalid;
+  invalid.set_value("invalid");
+
+  AWAIT_FAILED(checker.add(invalid, createHealthCheck()));
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Measures how long it takes for a single health checker to perform
+// the first health check of thousands of tasks on the same host.
+TEST(HealthCheckerTest, BENCHMARK_Checks)
+{
+  const size_t tasks = 5000;
+
+  HealthProcess process;
+  spawn(process);
+
+  foreach (const string& strategy, strings::tokenize("tcp,http", ",")) {
+    HealthStatuses statuses(tasks);
+
+    HealthChecker checker(
+        lambda::bind(&HealthStatuses::reported, &statuses, lambda::_1));
+
+    HealthCheck check = createHealthCheck();
+    check.set_interval_seconds(1);
+
+    if (strategy == "tcp") {
+      check.mutable_tcp()->set_port(process.self().address.port);
+    } else {
+      check.mutable_http()->set_port(process.self().address.port);
+      check.mutable_http()->set_path("/" + process.self().id + "/health");
+    }
+
+    Stopwatch watch;
+    watch.start();
+
+    for (size_t i = 0; i < tasks; i++) {
+      TaskID taskId;
+      taskId.set_value(stringify(i));
+
+      checker.add(taskId, check);
+    }
+
+    AWAIT_READY_FOR(statuses.promise.future(), Seconds(60));
+
+    watch.stop();
+
+    size_t healthy = 0;
+    foreach (const TaskHealthStatus& status, statuses.statuses) {
+      if (status.healthy()) {
+        healthy++;
+      }
+    }
+
+    LOG(INFO) << "Checked the health of " << tasks << " tasks using "
+              << strategy << " checks in " << watch.elapsed() << " ("
+              << healthy << " healthy)";
+  }
+
+  terminate(process);
+  wait(process);
+}
+
 } // namespace tests {
 } // namespace internal {
 } // namespace mesos {
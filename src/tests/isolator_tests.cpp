@@ -460,6 +460,124 @@ TEST_F(LimitedCpuIsolatorTest, ROOT_CGROUPS_Cfs)
 }
 
 
+// This test verifies that with the adaptive CFS quota a container
+// that is throttled gets to burst above its allocation while the host
+// is idle, and that the throttling is reported in its statistics.
+TEST_F(LimitedCpuIsolatorTest, ROOT_CGROUPS_Cfs_Adaptive)
+{
+  slave::Flags flags;
+
+  // Enable CFS to cap CPU utilization and let the quota adapt.
+  flags.cgroups_enable_cfs = true;
+  flags.cgroups_adaptive_cfs = true;
+
+  Try<Isolator*> isolator = CgroupsCpushareIsolatorProcess::create(flags);
+  CHECK_SOME(isolator);
+
+  Try<Launcher*> launcher = LinuxLauncher::create(flags);
+  CHECK_SOME(launcher);
+
+  // Set the executor's resources to 0.5 cpu.
+  ExecutorInfo executorInfo;
+  executorInfo.mutable_resources()->CopyFrom(
+      Resources::parse("cpus:0.5").get());
+
+  ContainerID containerId;
+  containerId.set_value("mesos_test_cfs_adaptive_cpu_limit");
+
+  // Use a relative temporary directory so it gets cleaned up
+  // automatically with the test.
+  Try<string> dir = os::mkdtemp(path::join(os::getcwd(), "XXXXXX"));
+  ASSERT_SOME(dir);
+
+  AWAIT_READY(
+      isolator.get()->prepare(containerId, executorInfo, dir.get(), None()));
+
+  // Max out a single core until the container is destroyed.
+  int pipes[2];
+  ASSERT_NE(-1, ::pipe(pipes));
+
+  vector<string> argv(3);
+  argv[0] = "sh";
+  argv[1] = "-c";
+  argv[2] = "cat /dev/urandom > /dev/null";
+
+  Try<pid_t> pid = launcher.get()->fork(
+      containerId,
+      "/bin/sh",
+      argv,
+      Subprocess::FD(STDIN_FILENO),
+      Subprocess::FD(STDOUT_FILENO),
+      Subprocess::FD(STDERR_FILENO),
+      None(),
+      None(),
+      lambda::bind(&childSetup, pipes));
+
+  ASSERT_SOME(pid);
+
+  // Reap the forked child.
+  Future<Option<int> > status = process::reap(pid.get());
+
+  // Continue in the parent.
+  ASSERT_SOME(os::close(pipes[0]));
+
+  // Isolate the forked child.
+  AWAIT_READY(isolator.get()->isolate(containerId, pid.get()));
+
+  // Now signal the child to continue.
+  char dummy;
+  ASSERT_LT(0, ::write(pipes[1], &dummy, sizeof(dummy)));
+
+  ASSERT_SOME(os::close(pipes[1]));
+
+  Try<string> hierarchy =
+    cgroups::prepare(flags.cgroups_hierarchy, "cpu", flags.cgroups_root);
+  ASSERT_SOME(hierarchy);
+
+  string cgroup = path::join(flags.cgroups_root, containerId.value());
+
+  // Wait for the quota to be raised above the 50 ms allocation. Like
+  // the test above, this assumes that the host is not heavily loaded.
+  Option<Duration> quota;
+  Duration waited = Duration::zero();
+  do {
+    Try<Duration> read = cgroups::cpu::cfs_quota_us(hierarchy.get(), cgroup);
+    ASSERT_SOME(read);
+
+    quota = read.get();
+    if (quota.get() > Milliseconds(50)) {
+      break;
+    }
+
+    os::sleep(Milliseconds(100));
+    waited += Milliseconds(100);
+  } while (waited < Seconds(10));
+
+  EXPECT_LT(Milliseconds(50), quota.get());
+
+  // The burst is capped by the maximum burst ratio.
+  EXPECT_GE(Milliseconds(200), quota.get());
+
+  Future<ResourceStatistics> usage = isolator.get()->usage(containerId);
+  AWAIT_READY(usage);
+
+  EXPECT_LT(0u, usage.get().cpus_nr_periods());
+  EXPECT_LT(0u, usage.get().cpus_nr_throttled());
+  EXPECT_LT(0.0, usage.get().cpus_throttled_time_secs());
+
+  // Ensure all processes are killed.
+  AWAIT_READY(launcher.get()->destroy(containerId));
+
+  AWAIT_READY(status);
+
+  // Let the isolator clean up.
+  AWAIT_READY(isolator.get()->cleanup(containerId));
+
+  delete isolator.get();
+  delete launcher.get();
+}
+
+
 // This test verifies that we can successfully launch a container with
 // a big (>= 10 cpus) cpu quota. This is to catch the regression
 // observed in MESOS-1049.
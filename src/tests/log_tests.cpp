@@ -34,12 +34,16 @@
 #include <process/protobuf.hpp>
 #include <process/shared.hpp>
 
+#include <stout/bytes.hpp>
+#include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
 #include <stout/none.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
 #include <stout/path.hpp>
 #include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
 #include <stout/try.hpp>
 
 #include "log/catchup.hpp"
@@ -50,6 +54,7 @@
 #include "log/storage.hpp"
 #include "log/recover.hpp"
 #include "log/replica.hpp"
+#include "log/segment.hpp"
 #include "log/tool/initialize.hpp"
 
 #include "tests/environment.hpp"
@@ -128,7 +133,7 @@ template <typename T>
 class LogStorageTest : public TemporaryDirectoryTest {};
 
 
-typedef ::testing::Types<LevelDBStorage> LogStorageTypes;
+typedef ::testing::Types<LevelDBStorage, SegmentStorage> LogStorageTypes;
 
 
 TYPED_TEST_CASE(LogStorageTest, LogStorageTypes);
@@ -316,6 +321,336 @@ TYPED_TEST(LogStorageTest, TruncateWithManyHoles)
 }
 
 
+TYPED_TEST(LogStorageTest, PersistBatch)
+{
+  TypeParam storage;
+
+  Try<Storage::State> state = storage.restore(os::getcwd() + "/.log");
+  ASSERT_SOME(state);
+
+  // Append from position 0 to position 9 and truncate to position 5
+  // (at position 10) all at once.
+  list<Action> actions;
+
+  for (uint64_t i = 0; i < 10; i++) {
+    Action action;
+    action.set_position(i);
+    action.set_promised(1);
+    action.set_performed(1);
+    action.set_learned(true);
+    action.set_type(Action::APPEND);
+    action.mutable_append()->set_bytes(stringify(i));
+
+    actions.push_back(action);
+  }
+
+  Action truncate;
+  truncate.set_position(10);
+  truncate.set_promised(1);
+  truncate.set_performed(1);
+  truncate.set_learned(true);
+  truncate.set_type(Action::TRUNCATE);
+  truncate.mutable_truncate()->set_to(5);
+
+  actions.push_back(truncate);
+
+  ASSERT_SOME(storage.persist(actions));
+
+  for (uint64_t i = 0; i < 11; i++) {
+    Try<Action> action = storage.read(i);
+
+    if (i < 5) {
+      EXPECT_ERROR(action);
+    } else if (i == 10) {
+      ASSERT_SOME(action);
+      EXPECT_EQ(Action::TRUNCATE, action.get().type());
+    } else {
+      ASSERT_SOME(action);
+      EXPECT_EQ(i, action.get().position());
+      ASSERT_TRUE(action.get().has_append());
+      EXPECT_EQ(stringify(i), action.get().append().bytes());
+    }
+  }
+}
+
+
+// Compares writing actions one at a time (one sync each) with
+// writing them in batches (see ReplicaProcess::commit).
+TYPED_TEST(LogStorageTest, BENCHMARK_Persist)
+{
+  TypeParam storage;
+
+  Try<Storage::State> state = storage.restore(os::getcwd() + "/.log");
+  ASSERT_SOME(state);
+
+  const size_t actions = 1000;
+  const string bytes(1024, 'x');
+
+  uint64_t position = 0;
+
+  foreach (size_t batch, list<size_t>({1, 10, 100})) {
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    for (size_t i = 0; i < actions; i += batch) {
+      list<Action> batched;
+      for (size_t j = 0; j < batch; j++) {
+        Action action;
+        action.set_position(position++);
+        action.set_promised(1);
+        action.set_performed(1);
+        action.set_learned(true);
+        action.set_type(Action::APPEND);
+        action.mutable_append()->set_bytes(bytes);
+
+        batched.push_back(action);
+      }
+
+      ASSERT_SOME(storage.persist(batched));
+    }
+
+    Duration elapsed = stopwatch.elapsed();
+
+    LOG(INFO) << "Persisted " << actions << " actions in batches of "
+              << batch << " in " << elapsed << " ("
+              << actions / elapsed.secs() << " actions/sec)";
+  }
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  for (uint64_t i = 0; i < position; i++) {
+    ASSERT_SOME(storage.read(i));
+  }
+
+  LOG(INFO) << "Read " << position << " actions in " << stopwatch.elapsed();
+}
+
+
+class SegmentStorageTest : public TemporaryDirectoryTest {};
+
+
+// Returns the number of segments of the log at the specified path.
+static size_t segments(const string& path)
+{
+  Try<list<string> > entries = os::ls(path);
+  CHECK_SOME(entries);
+
+  size_t count = 0;
+  foreach (const string& entry, entries.get()) {
+    if (strings::endsWith(entry, ".segment")) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+
+TEST_F(SegmentStorageTest, TruncateAndRestore)
+{
+  const string path = os::getcwd() + "/.log";
+
+  {
+    // Use small segments so that the log spans many of them.
+    SegmentStorage storage(Bytes(512));
+
+    Try<Storage::State> state = storage.restore(path);
+    ASSERT_SOME(state);
+
+    Metadata metadata;
+    metadata.set_status(Metadata::VOTING);
+    metadata.set_promised(1);
+
+    ASSERT_SOME(storage.persist(metadata));
+
+    for (uint64_t i = 0; i < 100; i++) {
+      Action action;
+      action.set_position(i);
+      action.set_promised(1);
+      action.set_performed(1);
+      action.set_learned(true);
+      action.set_type(Action::APPEND);
+      action.mutable_append()->set_bytes(string(64, 'a' + i % 26));
+
+      ASSERT_SOME(storage.persist(action));
+    }
+
+    size_t count = segments(path);
+    EXPECT_LT(1u, count);
+
+    // Truncate to position 50 (at position 100).
+    Action truncate;
+    truncate.set_position(100);
+    truncate.set_promised(1);
+    truncate.set_performed(1);
+    truncate.set_learned(true);
+    truncate.set_type(Action::TRUNCATE);
+    truncate.mutable_truncate()->set_to(50);
+
+    ASSERT_SOME(storage.persist(truncate));
+
+    // The segments holding only truncated positions are dropped.
+    EXPECT_GT(count, segments(path));
+
+    EXPECT_ERROR(storage.read(10));
+    EXPECT_SOME(storage.read(60));
+  }
+
+  SegmentStorage storage(Bytes(512));
+
+  Try<Storage::State> state = storage.restore(path);
+  ASSERT_SOME(state);
+
+  EXPECT_EQ(Metadata::VOTING, state.get().metadata.status());
+  EXPECT_EQ(1u, state.get().metadata.promised());
+  EXPECT_EQ(50u, state.get().begin);
+  EXPECT_EQ(100u, state.get().end);
+  EXPECT_FALSE(state.get().learned.contains(49));
+  EXPECT_TRUE(state.get().learned.contains(50));
+  EXPECT_TRUE(state.get().learned.contains(100));
+  EXPECT_TRUE(state.get().unlearned.empty());
+
+  EXPECT_ERROR(storage.read(10));
+
+  Try<Action> action = storage.read(60);
+  ASSERT_SOME(action);
+  ASSERT_TRUE(action.get().has_append());
+  EXPECT_EQ(string(64, 'a' + 60 % 26), action.get().append().bytes());
+}
+
+
+TEST_F(SegmentStorageTest, TornWrite)
+{
+  const string path = os::getcwd() + "/.log";
+
+  {
+    SegmentStorage storage;
+
+    ASSERT_SOME(storage.restore(path));
+
+    for (uint64_t i = 0; i < 10; i++) {
+      Action action;
+      action.set_position(i);
+      action.set_promised(1);
+      action.set_performed(1);
+      action.set_type(Action::APPEND);
+      action.mutable_append()->set_bytes(stringify(i));
+
+      ASSERT_SOME(storage.persist(action));
+    }
+  }
+
+  // Corrupt the last record as if it was only partially written.
+  const string segment = path::join(path, "0000000000.segment");
+
+  Try<string> contents = os::read(segment);
+  ASSERT_SOME(contents);
+
+  string data = contents.get();
+  size_t last = data.find_last_not_of('\0');
+  ASSERT_NE(string::npos, last);
+  data[last] = ~data[last];
+
+  ASSERT_SOME(os::write(segment, data));
+
+  SegmentStorage storage;
+
+  Try<Storage::State> state = storage.restore(path);
+  ASSERT_SOME(state);
+
+  EXPECT_EQ(8u, state.get().end);
+  EXPECT_ERROR(storage.read(9));
+
+  // The next record overwrites the torn one.
+  Action action;
+  action.set_position(9);
+  action.set_promised(1);
+  action.set_performed(1);
+  action.set_type(Action::APPEND);
+  action.mutable_append()->set_bytes("9");
+
+  ASSERT_SOME(storage.persist(action));
+  EXPECT_SOME(storage.read(9));
+}
+
+
+// Verifies that a log can be restored repeatedly after a torn write
+// when the records written since then leave the segment with the
+// torn write behind (i.e., it is no longer the last one).
+TEST_F(SegmentStorageTest, TornWriteAndRoll)
+{
+  const string path = os::getcwd() + "/.log";
+
+  {
+    SegmentStorage storage(Bytes(512));
+
+    ASSERT_SOME(storage.restore(path));
+
+    for (uint64_t i = 0; i < 10; i++) {
+      Action action;
+      action.set_position(i);
+      action.set_promised(1);
+      action.set_performed(1);
+      action.set_type(Action::APPEND);
+      action.mutable_append()->set_bytes(string(16, 'a' + i));
+
+      ASSERT_SOME(storage.persist(action));
+    }
+  }
+
+  // Corrupt the last record as if it was only partially written.
+  const string segment = path::join(path, "0000000000.segment");
+
+  Try<string> contents = os::read(segment);
+  ASSERT_SOME(contents);
+
+  string data = contents.get();
+  size_t last = data.find_last_not_of('\0');
+  ASSERT_NE(string::npos, last);
+  data[last] = ~data[last];
+
+  ASSERT_SOME(os::write(segment, data));
+
+  {
+    SegmentStorage storage(Bytes(512));
+
+    Try<Storage::State> state = storage.restore(path);
+    ASSERT_SOME(state);
+    EXPECT_EQ(8u, state.get().end);
+
+    // A record shorter than the torn one, followed by enough records
+    // to start a new segment.
+    for (uint64_t i = 9; i < 30; i++) {
+      Action action;
+      action.set_position(i);
+      action.set_promised(1);
+      action.set_performed(1);
+      action.set_type(Action::APPEND);
+      action.mutable_append()->set_bytes(stringify(i));
+
+      ASSERT_SOME(storage.persist(action));
+    }
+  }
+
+  ASSERT_TRUE(os::exists(path::join(path, "0000000001.segment")));
+
+  SegmentStorage storage(Bytes(512));
+
+  Try<Storage::State> state = storage.restore(path);
+  ASSERT_SOME(state);
+  EXPECT_EQ(29u, state.get().end);
+
+  Try<Action> action = storage.read(9);
+  ASSERT_SOME(action);
+  EXPECT_EQ("9", action.get().append().bytes());
+
+  action = storage.read(29);
+  ASSERT_SOME(action);
+  EXPECT_EQ("29", action.get().append().bytes());
+}
+
+
 class ReplicaTest : public TemporaryDirectoryTest
 {
 protected:
@@ -522,6 +857,93 @@ TEST_F(ReplicaTest, Restore)
 }
 
 
+// A storage which blocks persisting a batch of actions until it is
+// released, to observe a replica while it is committing.
+class BlockingStorage : public LevelDBStorage
+{
+public:
+  virtual Try<Nothing> persist(const list<Action>& actions)
+  {
+    persisting.set(actions.size());
+    released.future().await();
+
+    return LevelDBStorage::persist(actions);
+  }
+
+  using LevelDBStorage::persist;
+
+  process::Promise<size_t> persisting;
+  process::Promise<Nothing> released;
+};
+
+
+// This test verifies that a replica does not acknowledge writes until
+// the batch of actions they belong to has been committed.
+TEST_F(ReplicaTest, GroupCommit)
+{
+  const string path = os::getcwd() + "/.log";
+  initializer.flags.path = path;
+  initializer.execute();
+
+  BlockingStorage* storage = new BlockingStorage();
+
+  Replica replica1(path, storage);
+
+  const uint64_t proposal = 1;
+
+  PromiseRequest request1;
+  request1.set_proposal(proposal);
+
+  Future<PromiseResponse> future1 =
+    protocol::promise(replica1.pid(), request1);
+
+  AWAIT_READY(future1);
+  EXPECT_TRUE(future1.get().okay());
+
+  WriteRequest request2;
+  request2.set_proposal(proposal);
+  request2.set_position(1);
+  request2.set_type(Action::APPEND);
+  request2.mutable_append()->set_bytes("hello");
+
+  WriteRequest request3;
+  request3.set_proposal(proposal);
+  request3.set_position(2);
+  request3.set_type(Action::APPEND);
+  request3.mutable_append()->set_bytes("world");
+
+  Future<WriteResponse> future2 = protocol::write(replica1.pid(), request2);
+  Future<WriteResponse> future3 = protocol::write(replica1.pid(), request3);
+
+  // Wait until the replica is committing (at least) the first write.
+  AWAIT_READY(storage->persisting.future());
+  EXPECT_LE(1u, storage->persisting.future().get());
+
+  EXPECT_TRUE(future2.isPending());
+  EXPECT_TRUE(future3.isPending());
+
+  storage->released.set(Nothing());
+
+  AWAIT_READY(future2);
+  EXPECT_TRUE(future2.get().okay());
+  EXPECT_EQ(1u, future2.get().position());
+
+  AWAIT_READY(future3);
+  EXPECT_TRUE(future3.get().okay());
+  EXPECT_EQ(2u, future3.get().position());
+
+  // Both writes are in the storage once acknowledged.
+  Replica replica2(path);
+
+  Future<list<Action> > actions = replica2.read(1, 2);
+
+  AWAIT_READY(actions);
+  ASSERT_EQ(2u, actions.get().size());
+  EXPECT_EQ("hello", actions.get().front().append().bytes());
+  EXPECT_EQ("world", actions.get().back().append().bytes());
+}
+
+
 // This test verifies that a non-VOTING replica does not reply to
 // promise or write requests.
 TEST_F(ReplicaTest, NonVoting)
@@ -1196,7 +1618,7 @@ TEST_F(CoordinatorTest, MultipleAppends)
 }
 
 
-TEST_F(CoordinatorTest, MultipleAppendsNotLearnedFill)
+TEST_F(CoordinatorTest, PipelinedAppends)
 {
   const string path1 = os::getcwd() + "/.log1";
   initializer.flags.path = path1;
@@ -1206,64 +1628,40 @@ TEST_F(CoordinatorTest, MultipleAppendsNotLearnedFill)
   initializer.flags.path = path2;
   initializer.execute();
 
-  const string path3 = os::getcwd() + "/.log3";
-  initializer.flags.path = path3;
-  initializer.execute();
-
   Shared<Replica> replica1(new Replica(path1));
   Shared<Replica> replica2(new Replica(path2));
 
-  // Drop messages here in order to obtain the pid of replica2. We
-  // only want to drop learned message sent to replica2.
-  DROP_MESSAGES(Eq(LearnedMessage().GetTypeName()), _, Eq(replica2->pid()));
-
   set<UPID> pids;
   pids.insert(replica1->pid());
   pids.insert(replica2->pid());
 
-  Shared<Network> network1(new Network(pids));
+  Shared<Network> network(new Network(pids));
 
-  Coordinator coord1(2, replica1, network1);
+  Coordinator coord(2, replica1, network, 4);
 
   {
-    Future<Option<uint64_t> > electing = coord1.elect();
+    Future<Option<uint64_t> > electing = coord.elect();
     AWAIT_READY(electing);
     EXPECT_SOME_EQ(0u, electing.get());
   }
 
-  for (uint64_t position = 1; position <= 10; position++) {
-    Future<Option<uint64_t> > appending = coord1.append(stringify(position));
-    AWAIT_READY(appending);
-    EXPECT_SOME_EQ(position, appending.get());
-  }
-
-  Shared<Replica> replica3(new Replica(path3));
-
-  pids.clear();
-  pids.insert(replica2->pid());
-  pids.insert(replica3->pid());
-
-  Shared<Network> network2(new Network(pids));
-
-  Coordinator coord2(2, replica3, network2);
-
-  {
-    // Note that the first election should fail because 'coord2' get's
-    // it's proposal number from 'replica3' which is any empty log and
-    // thus a second attempt will need to be made.
-    Future<Option<uint64_t> > electing = coord2.elect();
-    AWAIT_READY(electing);
-    ASSERT_NONE(electing.get());
+  for (uint64_t position = 1; position <= 12; position += 4) {
+    list<Future<Option<uint64_t> > > appendings;
+    for (uint64_t i = position; i < position + 4; i++) {
+      appendings.push_back(coord.append(stringify(i)));
+    }
 
-    electing = coord2.elect();
-    AWAIT_READY(electing);
-    EXPECT_SOME_EQ(10u, electing.get());
+    uint64_t i = position;
+    foreach (const Future<Option<uint64_t> >& appending, appendings) {
+      AWAIT_READY(appending);
+      EXPECT_SOME_EQ(i++, appending.get());
+    }
   }
 
   {
-    Future<list<Action> > actions = replica3->read(1, 10);
+    Future<list<Action> > actions = replica1->read(1, 12);
     AWAIT_READY(actions);
-    EXPECT_EQ(10u, actions.get().size());
+    EXPECT_EQ(12u, actions.get().size());
     foreach (const Action& action, actions.get()) {
       ASSERT_TRUE(action.has_type());
       ASSERT_EQ(Action::APPEND, action.type());
@@ -1273,7 +1671,7 @@ TEST_F(CoordinatorTest, MultipleAppendsNotLearnedFill)
 }
 
 
-TEST_F(CoordinatorTest, Truncate)
+TEST_F(CoordinatorTest, PipelinedAppendsNoQuorum)
 {
   const string path1 = os::getcwd() + "/.log1";
   initializer.flags.path = path1;
@@ -1292,7 +1690,7 @@ TEST_F(CoordinatorTest, Truncate)
 
   Shared<Network> network(new Network(pids));
 
-  Coordinator coord(2, replica1, network);
+  Coordinator coord(2, replica1, network, 2);
 
   {
     Future<Option<uint64_t> > electing = coord.elect();
@@ -1300,10 +1698,195 @@ TEST_F(CoordinatorTest, Truncate)
     EXPECT_SOME_EQ(0u, electing.get());
   }
 
-  for (uint64_t position = 1; position <= 10; position++) {
-    Future<Option<uint64_t> > appending = coord.append(stringify(position));
+  process::terminate(replica2->pid());
+  process::wait(replica2->pid());
+  replica2.reset();
+
+  Future<Option<uint64_t> > appending1 = coord.append("hello world");
+  Future<Option<uint64_t> > appending2 = coord.append("hello moto");
+
+  // The window is full.
+  AWAIT_FAILED(coord.append("hello hello"));
+
+  EXPECT_TRUE(appending1.isPending());
+  EXPECT_TRUE(appending2.isPending());
+
+  // Discarding the first write demotes the coordinator, which
+  // abandons the second one.
+  appending1.discard();
+  AWAIT_DISCARDED(appending1);
+  AWAIT_FAILED(appending2);
+
+  {
+    Future<Option<uint64_t> > appending = coord.append("hello hello");
     AWAIT_READY(appending);
-    EXPECT_SOME_EQ(position, appending.get());
+    EXPECT_NONE(appending.get());
+  }
+}
+
+
+TEST_F(CoordinatorTest, PipelinedAppendsDemoted)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+
+  Shared<Network> network1(new Network(pids));
+
+  Coordinator coord1(2, replica1, network1, 4);
+
+  {
+    Future<Option<uint64_t> > electing = coord1.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  Shared<Network> network2(new Network(pids));
+
+  Coordinator coord2(2, replica2, network2, 4);
+
+  {
+    Future<Option<uint64_t> > electing = coord2.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  Future<Option<uint64_t> > appending1 = coord1.append("hello world");
+  Future<Option<uint64_t> > appending2 = coord1.append("hello moto");
+
+  AWAIT_READY(appending1);
+  EXPECT_NONE(appending1.get());
+
+  AWAIT_READY(appending2);
+  EXPECT_NONE(appending2.get());
+
+  {
+    Future<Option<uint64_t> > appending = coord2.append("hello hello");
+    AWAIT_READY(appending);
+    EXPECT_SOME_EQ(1u, appending.get());
+  }
+}
+
+
+TEST_F(CoordinatorTest, MultipleAppendsNotLearnedFill)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  const string path3 = os::getcwd() + "/.log3";
+  initializer.flags.path = path3;
+  initializer.execute();
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+
+  // Drop messages here in order to obtain the pid of replica2. We
+  // only want to drop learned message sent to replica2.
+  DROP_MESSAGES(Eq(LearnedMessage().GetTypeName()), _, Eq(replica2->pid()));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+
+  Shared<Network> network1(new Network(pids));
+
+  Coordinator coord1(2, replica1, network1);
+
+  {
+    Future<Option<uint64_t> > electing = coord1.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  for (uint64_t position = 1; position <= 10; position++) {
+    Future<Option<uint64_t> > appending = coord1.append(stringify(position));
+    AWAIT_READY(appending);
+    EXPECT_SOME_EQ(position, appending.get());
+  }
+
+  Shared<Replica> replica3(new Replica(path3));
+
+  pids.clear();
+  pids.insert(replica2->pid());
+  pids.insert(replica3->pid());
+
+  Shared<Network> network2(new Network(pids));
+
+  Coordinator coord2(2, replica3, network2);
+
+  {
+    // Note that the first election should fail because 'coord2' get's
+    // it's proposal number from 'replica3' which is any empty log and
+    // thus a second attempt will need to be made.
+    Future<Option<uint64_t> > electing = coord2.elect();
+    AWAIT_READY(electing);
+    ASSERT_NONE(electing.get());
+
+    electing = coord2.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(10u, electing.get());
+  }
+
+  {
+    Future<list<Action> > actions = replica3->read(1, 10);
+    AWAIT_READY(actions);
+    EXPECT_EQ(10u, actions.get().size());
+    foreach (const Action& action, actions.get()) {
+      ASSERT_TRUE(action.has_type());
+      ASSERT_EQ(Action::APPEND, action.type());
+      EXPECT_EQ(stringify(action.position()), action.append().bytes());
+    }
+  }
+}
+
+
+TEST_F(CoordinatorTest, Truncate)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+
+  Shared<Network> network(new Network(pids));
+
+  Coordinator coord(2, replica1, network);
+
+  {
+    Future<Option<uint64_t> > electing = coord.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  for (uint64_t position = 1; position <= 10; position++) {
+    Future<Option<uint64_t> > appending = coord.append(stringify(position));
+    AWAIT_READY(appending);
+    EXPECT_SOME_EQ(position, appending.get());
   }
 
   {
@@ -1673,11 +2256,21 @@ TEST_F(RecoverTest, CatchupRetry)
   // promise phase even if replica1 reemerges later.
   DROP_MESSAGE(Eq(PromiseRequest().GetTypeName()), _, Eq(replica1->pid()));
 
+  // Drop the transfer requests so that the positions have to be
+  // filled using Paxos.
+  DROP_MESSAGES(Eq(TransferRequest().GetTypeName()), _, _);
+
   Future<Nothing> catching =
     catchup(2, replica3, network2, None(), positions, Seconds(10));
 
   Clock::pause();
 
+  // Wait for the transfers from replica1 and replica2 to time out.
+  Clock::settle();
+  Clock::advance(Seconds(10));
+  Clock::settle();
+  Clock::advance(Seconds(10));
+
   // Wait for the retry timer in 'catchup' to be setup.
   Clock::settle();
 
@@ -1699,6 +2292,165 @@ TEST_F(RecoverTest, CatchupRetry)
 }
 
 
+// The actions learned by the other replicas (including truncations)
+// are transferred in bulk rather than filled using Paxos.
+TEST_F(RecoverTest, CatchupTransfer)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  const string path3 = os::getcwd() + "/.log3";
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+
+  Shared<Network> network1(new Network(pids));
+
+  Coordinator coord(2, replica1, network1);
+
+  {
+    Future<Option<uint64_t> > electing = coord.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  for (uint64_t position = 1; position <= 10; position++) {
+    Future<Option<uint64_t> > appending = coord.append(stringify(position));
+    AWAIT_READY(appending);
+    EXPECT_SOME_EQ(position, appending.get());
+  }
+
+  {
+    Future<Option<uint64_t> > truncating = coord.truncate(4);
+    AWAIT_READY(truncating);
+    EXPECT_SOME_EQ(11u, truncating.get());
+  }
+
+  Shared<Replica> replica3(new Replica(path3));
+
+  pids.insert(replica3->pid());
+
+  Shared<Network> network2(new Network(pids));
+
+  // Make sure that none of the positions is filled using Paxos.
+  DROP_MESSAGES(Eq(PromiseRequest().GetTypeName()), _, _);
+  DROP_MESSAGES(Eq(WriteRequest().GetTypeName()), _, _);
+
+  IntervalSet<uint64_t> positions;
+  positions += (Bound<uint64_t>::closed(1), Bound<uint64_t>::closed(11));
+
+  Future<Nothing> catching =
+    catchup(2, replica3, network2, None(), positions, Seconds(10));
+
+  AWAIT_READY(catching);
+
+  AWAIT_EXPECT_EQ(4u, replica3->beginning());
+  AWAIT_EXPECT_EQ(11u, replica3->ending());
+
+  {
+    Future<IntervalSet<uint64_t> > missing = replica3->missing(1, 11);
+    AWAIT_READY(missing);
+    EXPECT_TRUE(missing.get().empty());
+  }
+
+  {
+    Future<list<Action> > actions = replica3->read(4, 10);
+    AWAIT_READY(actions);
+    EXPECT_EQ(7u, actions.get().size());
+    foreach (const Action& action, actions.get()) {
+      EXPECT_TRUE(action.learned());
+      ASSERT_TRUE(action.has_type());
+      ASSERT_EQ(Action::APPEND, action.type());
+      EXPECT_EQ(stringify(action.position()), action.append().bytes());
+    }
+  }
+}
+
+
+// Measures how long it takes a replica to catch-up logs of various
+// lengths from the other replicas.
+TEST_F(RecoverTest, BENCHMARK_Catchup)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+
+  Shared<Network> network1(new Network(pids));
+
+  const size_t window = 64;
+
+  Coordinator coord(2, replica1, network1, window);
+
+  {
+    Future<Option<uint64_t> > electing = coord.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  const string bytes(1024, 'x');
+
+  uint64_t end = 0;
+
+  foreach (uint64_t length, list<uint64_t>({1000, 10000, 100000})) {
+    while (end < length) {
+      list<Future<Option<uint64_t> > > appendings;
+      for (size_t i = 0; i < window && end + i < length; i++) {
+        appendings.push_back(coord.append(bytes));
+      }
+
+      foreach (const Future<Option<uint64_t> >& appending, appendings) {
+        AWAIT_READY_FOR(appending, Seconds(30));
+        EXPECT_SOME_EQ(++end, appending.get());
+      }
+    }
+
+    Shared<Replica> replica3(
+        new Replica(os::getcwd() + "/.log3." + stringify(length)));
+
+    set<UPID> pids_ = pids;
+    pids_.insert(replica3->pid());
+
+    Shared<Network> network2(new Network(pids_));
+
+    IntervalSet<uint64_t> positions;
+    positions += (Bound<uint64_t>::closed(1), Bound<uint64_t>::closed(end));
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    Future<Nothing> catching =
+      catchup(2, replica3, network2, None(), positions, Seconds(10));
+
+    AWAIT_READY_FOR(catching, Minutes(10));
+
+    Duration elapsed = stopwatch.elapsed();
+
+    LOG(INFO) << "Caught-up " << length << " positions in " << elapsed
+              << " (" << length / elapsed.secs() << " positions/sec)";
+  }
+}
+
+
 TEST_F(RecoverTest, AutoInitialization)
 {
   const string path1 = os::getcwd() + "/.log1";
@@ -1887,6 +2639,217 @@ TEST_F(LogTest, WriteRead)
 }
 
 
+// Verifies that entries written by a compressing writer are stored
+// compressed (if that makes them smaller) and read back as written.
+TEST_F(LogTest, WriteReadCompressed)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  Replica replica1(path1);
+
+  set<UPID> pids;
+  pids.insert(replica1.pid());
+
+  Log log(2, path2, pids);
+
+  Log::Writer writer(&log, 1, true);
+
+  Future<Option<Log::Position> > start = writer.start();
+
+  AWAIT_READY(start);
+  ASSERT_SOME(start.get());
+
+  const string data(1024, 'a');
+
+  Future<Option<Log::Position> > position1 = writer.append(data);
+
+  AWAIT_READY(position1);
+  ASSERT_SOME(position1.get());
+
+  Future<Option<Log::Position> > position2 = writer.append("hello world");
+
+  AWAIT_READY(position2);
+  ASSERT_SOME(position2.get());
+
+  // The entries have been written to (at least) a quorum of replicas
+  // so the remote replica has them too.
+  Future<uint64_t> ending = replica1.ending();
+  AWAIT_READY(ending);
+
+  Future<list<Action> > actions = replica1.read(ending.get() - 1, ending.get());
+
+  AWAIT_READY(actions);
+  ASSERT_EQ(2u, actions.get().size());
+
+  ASSERT_EQ(Action::APPEND, actions.get().front().type());
+  EXPECT_EQ(Action::Append::GZIP,
+            actions.get().front().append().compression());
+  EXPECT_GT(data.size(), actions.get().front().append().bytes().size());
+
+  // Compressing a short entry doesn't make it smaller.
+  ASSERT_EQ(Action::APPEND, actions.get().back().type());
+  EXPECT_EQ(Action::Append::NONE,
+            actions.get().back().append().compression());
+
+  Log::Reader reader(&log);
+
+  Future<list<Log::Entry> > entries =
+    reader.read(position1.get().get(), position2.get().get());
+
+  AWAIT_READY(entries);
+
+  ASSERT_EQ(2u, entries.get().size());
+  EXPECT_EQ(data, entries.get().front().data);
+  EXPECT_EQ("hello world", entries.get().back().data);
+}
+
+
+// Verifies that reading an entry whose checksum doesn't match its
+// bytes fails.
+TEST_F(LogTest, ReadChecksumMismatch)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  // Write the entry directly using a coordinator so that we can
+  // specify the checksum.
+  {
+    Shared<Replica> replica1(new Replica(path1));
+    Shared<Replica> replica2(new Replica(path2));
+
+    set<UPID> pids;
+    pids.insert(replica1->pid());
+    pids.insert(replica2->pid());
+
+    Shared<Network> network(new Network(pids));
+
+    Coordinator coord(2, replica2, network);
+
+    Future<Option<uint64_t> > electing = coord.elect();
+    AWAIT_READY(electing);
+    ASSERT_SOME(electing.get());
+
+    Action::Append append;
+    append.set_bytes("hello world");
+    append.set_cksum("abcd");
+
+    Future<Option<uint64_t> > appending = coord.append(append);
+    AWAIT_READY(appending);
+    ASSERT_SOME(appending.get());
+  }
+
+  Replica replica1(path1);
+
+  set<UPID> pids;
+  pids.insert(replica1.pid());
+
+  Log log(2, path2, pids);
+
+  Log::Reader reader(&log);
+
+  // The entry is the last one in the log.
+  Future<Log::Position> ending = reader.ending();
+  AWAIT_READY(ending);
+
+  Future<list<Log::Entry> > entries = reader.read(ending.get(), ending.get());
+  AWAIT_FAILED(entries);
+}
+
+
+// Helper for collecting the batches of a streamed read.
+static Future<Nothing> consume(
+    list<list<Log::Entry> >* batches,
+    const list<Log::Entry>& entries)
+{
+  batches->push_back(entries);
+  return Nothing();
+}
+
+
+static Future<Nothing> reject(const list<Log::Entry>& entries)
+{
+  return Failure("Rejected");
+}
+
+
+TEST_F(LogTest, Stream)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  Replica replica1(path1);
+
+  set<UPID> pids;
+  pids.insert(replica1.pid());
+
+  Log log(2, path2, pids);
+
+  Log::Writer writer(&log);
+
+  Future<Option<Log::Position> > start = writer.start();
+
+  AWAIT_READY(start);
+  ASSERT_SOME(start.get());
+
+  list<Log::Position> positions;
+
+  for (int i = 0; i < 10; i++) {
+    Future<Option<Log::Position> > position = writer.append(stringify(i));
+
+    AWAIT_READY(position);
+    ASSERT_SOME(position.get());
+
+    positions.push_back(position.get().get());
+  }
+
+  Log::Reader reader(&log);
+
+  list<list<Log::Entry> > batches;
+
+  Future<Nothing> stream = reader.stream(
+      positions.front(),
+      positions.back(),
+      lambda::bind(&consume, &batches, lambda::_1),
+      3);
+
+  AWAIT_READY(stream);
+
+  ASSERT_EQ(4u, batches.size());
+  EXPECT_EQ(3u, batches.front().size());
+  EXPECT_EQ(1u, batches.back().size());
+
+  // A failure of the consumer fails the stream.
+  AWAIT_FAILED(reader.stream(positions.front(), positions.back(), &reject));
+
+  int i = 0;
+  foreach (const list<Log::Entry>& entries, batches) {
+    foreach (const Log::Entry& entry, entries) {
+      EXPECT_EQ(positions.front(), entry.position);
+      EXPECT_EQ(stringify(i++), entry.data);
+      positions.pop_front();
+    }
+  }
+
+  EXPECT_EQ(10, i);
+}
+
+
 TEST_F(LogTest, Position)
 {
   const string path1 = os::getcwd() + "/.log1";
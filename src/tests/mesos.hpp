@@ -56,6 +56,8 @@
 
 #include "slave/containerizer/mesos/containerizer.hpp"
 
+#include "state/storage.hpp"
+
 #include "tests/cluster.hpp"
 #include "tests/utils.hpp"
 
@@ -700,6 +702,21 @@ public:
 };
 
 
+// Definition of a mock Storage to be used in tests with gmock.
+class MockStorage : public state::Storage
+{
+public:
+  MOCK_METHOD1(
+      get, process::Future<Option<state::Entry> >(const std::string&));
+  MOCK_METHOD2(
+      set, process::Future<bool>(const state::Entry&, const UUID&));
+  MOCK_METHOD1(
+      expunge, process::Future<bool>(const state::Entry&));
+  MOCK_METHOD0(
+      names, process::Future<std::set<std::string> >(void));
+};
+
+
 template <typename T = master::allocator::Allocator>
 class TestAllocator : public master::allocator::Allocator
 {
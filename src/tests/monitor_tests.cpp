@@ -167,6 +167,78 @@ TEST(MonitorTest, Collection)
 }
 
 
+// This test verifies that the usage of all monitored containers is
+// collected in a single batch per interval.
+TEST(MonitorTest, BatchedCollection)
+{
+  FrameworkID frameworkId;
+  frameworkId.set_value("framework");
+
+  ExecutorInfo executorInfo1;
+  executorInfo1.mutable_executor_id()->set_value("executor1");
+  executorInfo1.mutable_framework_id()->CopyFrom(frameworkId);
+
+  ExecutorInfo executorInfo2;
+  executorInfo2.mutable_executor_id()->set_value("executor2");
+  executorInfo2.mutable_framework_id()->CopyFrom(frameworkId);
+
+  ContainerID containerId1;
+  containerId1.set_value("container1");
+
+  ContainerID containerId2;
+  containerId2.set_value("container2");
+
+  ResourceStatistics statistics;
+  statistics.set_timestamp(0);
+
+  TestContainerizer containerizer;
+
+  Future<Nothing> usage1, usage2;
+  EXPECT_CALL(containerizer, usage(containerId1))
+    .WillOnce(DoAll(FutureSatisfy(&usage1),
+                    Return(statistics)));
+  EXPECT_CALL(containerizer, usage(containerId2))
+    .WillOnce(DoAll(FutureSatisfy(&usage2),
+                    Return(statistics)));
+
+  slave::ResourceMonitor monitor(&containerizer);
+
+  process::Clock::pause();
+
+  monitor.start(
+      containerId1,
+      executorInfo1,
+      slave::RESOURCE_MONITORING_INTERVAL);
+
+  // Start monitoring the second container half way through the
+  // interval, it should be collected along with the first one.
+  process::Clock::settle();
+  process::Clock::advance(slave::RESOURCE_MONITORING_INTERVAL / 2);
+
+  monitor.start(
+      containerId2,
+      executorInfo2,
+      slave::RESOURCE_MONITORING_INTERVAL);
+
+  process::Clock::settle();
+  process::Clock::advance(slave::RESOURCE_MONITORING_INTERVAL / 2);
+  process::Clock::settle();
+
+  AWAIT_READY(usage1);
+  AWAIT_READY(usage2);
+
+  // Wait until the containerizer has finished returning the statistics.
+  process::Clock::settle();
+
+  monitor.stop(containerId1);
+  monitor.stop(containerId2);
+
+  process::Clock::settle();
+  process::Clock::advance(slave::RESOURCE_MONITORING_INTERVAL);
+  process::Clock::settle();
+}
+
+
 TEST(MonitorTest, Statistics)
 {
   FrameworkID frameworkId;
@@ -221,13 +293,26 @@ TEST(MonitorTest, Statistics)
 
   process::UPID upid("monitor", process::address());
 
-  // Request the statistics, this will ask the isolator.
+  // Statistics are not available until the first collection.
   Future<Response> response = process::http::get(upid, "statistics.json");
 
-  AWAIT_READY(response);
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(OK().status, response);
+  AWAIT_EXPECT_RESPONSE_BODY_EQ("[]", response);
+
+  // Advance the clock to trigger the collection.
+  process::Clock::advance(slave::RESOURCE_MONITORING_INTERVAL);
+  process::Clock::settle();
+
+  AWAIT_READY(usage);
+
+  // Wait until the statistics have been recorded.
+  process::Clock::settle();
 
-  // The collection should have occurred on the isolator.
-  ASSERT_TRUE(usage.isReady());
+  // Request the statistics, this will be served from the collected
+  // statistics rather than asking the isolator.
+  response = process::http::get(upid, "statistics.json");
+
+  AWAIT_READY(response);
 
   AWAIT_EXPECT_RESPONSE_STATUS_EQ(OK().status, response);
   AWAIT_EXPECT_RESPONSE_HEADER_EQ(
@@ -16,13 +16,18 @@
  * limitations under the License.
  */
 
+#include <unistd.h>
+
 #include <set>
+#include <vector>
 
 #include <gmock/gmock.h>
 
 #include <process/clock.hpp>
 #include <process/gtest.hpp>
+#include <process/owned.hpp>
 
+#include <stout/bytes.hpp>
 #include <stout/gtest.hpp>
 #include <stout/stringify.hpp>
 
@@ -30,6 +35,7 @@
 
 using std::set;
 using std::string;
+using std::vector;
 
 using namespace process;
 
@@ -150,6 +156,82 @@ TEST_F(PerfTest, ROOT_SampleInit)
   EXPECT_LT(0.0, statistics.get().task_clock());
 }
 
+
+TEST_F(PerfTest, Native)
+{
+  set<string> events;
+  EXPECT_FALSE(perf::native(events));
+
+  // Hardware, software and hardware cache events.
+  events.insert("cycles");
+  events.insert("task-clock");
+  events.insert("L1-dcache-load-misses");
+  EXPECT_TRUE(perf::native(events));
+
+  // Add an event that cannot be counted natively.
+  events.insert("this-is-an-invalid-event");
+  EXPECT_FALSE(perf::native(events));
+}
+
+
+// Software events are counted by the kernel so this works without
+// any hardware performance counters (e.g., in a virtual machine).
+TEST_F(PerfTest, ROOT_Counters)
+{
+  set<string> events;
+  events.insert("task-clock");
+  events.insert("page-faults");
+  events.insert("context-switches");
+
+  Try<Owned<perf::Counters> > counters =
+    perf::Counters::open(events, ::getpid());
+  ASSERT_SOME(counters);
+
+  EXPECT_EQ(events.size(), counters.get()->size());
+
+  // The counters don't count until enabled.
+  Try<mesos::PerfStatistics> statistics = counters.get()->read();
+  ASSERT_SOME(statistics);
+  EXPECT_EQ(0.0, statistics.get().task_clock());
+
+  ASSERT_SOME(counters.get()->enable());
+
+  // Use some CPU time and touch some fresh pages.
+  volatile double sum = 0.0;
+  for (int i = 0; i < 10000000; i++) {
+    sum += i;
+  }
+
+  vector<char> pages(Megabytes(16).bytes(), 1);
+
+  ASSERT_SOME(counters.get()->disable());
+
+  statistics = counters.get()->read();
+  ASSERT_SOME(statistics);
+
+  ASSERT_TRUE(statistics.get().has_task_clock());
+  EXPECT_LT(0.0, statistics.get().task_clock());
+
+  ASSERT_TRUE(statistics.get().has_page_faults());
+  EXPECT_LT(0u, statistics.get().page_faults());
+
+  EXPECT_TRUE(statistics.get().has_context_switches());
+
+  // Disabled counters no longer change.
+  Try<mesos::PerfStatistics> again = counters.get()->read();
+  ASSERT_SOME(again);
+  EXPECT_EQ(statistics.get().task_clock(), again.get().task_clock());
+  EXPECT_EQ(statistics.get().page_faults(), again.get().page_faults());
+
+  // Enabling resets the counters.
+  ASSERT_SOME(counters.get()->enable());
+  ASSERT_SOME(counters.get()->disable());
+
+  again = counters.get()->read();
+  ASSERT_SOME(again);
+  EXPECT_GT(statistics.get().task_clock(), again.get().task_clock());
+}
+
 } // namespace tests {
 } // namespace internal {
 } // namespace mesos {
@@ -51,6 +51,7 @@
 #include "state/protobuf.hpp"
 #include "state/storage.hpp"
 
+#include "tests/mesos.hpp"
 #include "tests/utils.hpp"
 
 using namespace mesos::internal::master;
@@ -83,6 +84,7 @@ using state::LogStorage;
 using state::Storage;
 
 using state::protobuf::State;
+using state::protobuf::Variable;
 
 // TODO(xujyan): This class copies code from LogStateTest. It would
 // be nice to find a common location for log related base tests when
@@ -313,6 +315,181 @@ TEST_P(RegistrarTest, remove)
 }
 
 
+// Updates are stored as deltas which get replayed when recovering,
+// and folded into a snapshot every 'registry_max_deltas' updates.
+TEST_P(RegistrarTest, deltas)
+{
+  flags.registry_max_deltas = 2;
+
+  SlaveInfo info1;
+  info1.set_hostname("localhost");
+  info1.mutable_id()->set_value("1");
+
+  SlaveInfo info2;
+  info2.set_hostname("localhost");
+  info2.mutable_id()->set_value("2");
+
+  SlaveInfo info3;
+  info3.set_hostname("localhost");
+  info3.mutable_id()->set_value("3");
+
+  {
+    Registrar registrar(flags, state);
+    AWAIT_READY(registrar.recover(master));
+
+    // The first two updates (including the recovery) are deltas, the
+    // third one is a snapshot and the last two are deltas again.
+    AWAIT_EQ(true, registrar.apply(Owned<Operation>(new AdmitSlave(info1))));
+    AWAIT_EQ(true, registrar.apply(Owned<Operation>(new AdmitSlave(info2))));
+    AWAIT_EQ(true, registrar.apply(Owned<Operation>(new AdmitSlave(info3))));
+    AWAIT_EQ(true, registrar.apply(Owned<Operation>(new RemoveSlave(info1))));
+  }
+
+  MasterInfo info;
+  info.set_id("master");
+  info.set_ip(10000000);
+  info.set_port(5050);
+
+  {
+    Registrar registrar(flags, state);
+
+    Future<Registry> registry = registrar.recover(info);
+    AWAIT_READY(registry);
+
+    EXPECT_EQ(info, registry.get().master().info());
+
+    ASSERT_EQ(2, registry.get().slaves().slaves().size());
+    EXPECT_EQ(info2, registry.get().slaves().slaves(0).info());
+    EXPECT_EQ(info3, registry.get().slaves().slaves(1).info());
+
+    // Readmitting the removed slave appends it again.
+    if (flags.registry_strict) {
+      AWAIT_EQ(false,
+               registrar.apply(Owned<Operation>(new ReadmitSlave(info1))));
+    } else {
+      AWAIT_EQ(true,
+               registrar.apply(Owned<Operation>(new ReadmitSlave(info1))));
+    }
+  }
+
+  {
+    Registrar registrar(flags, state);
+
+    Future<Registry> registry = registrar.recover(master);
+    AWAIT_READY(registry);
+
+    EXPECT_EQ(master, registry.get().master().info());
+
+    if (flags.registry_strict) {
+      ASSERT_EQ(2, registry.get().slaves().slaves().size());
+    } else {
+      ASSERT_EQ(3, registry.get().slaves().slaves().size());
+      EXPECT_EQ(info1, registry.get().slaves().slaves(2).info());
+    }
+
+    EXPECT_EQ(info2, registry.get().slaves().slaves(0).info());
+    EXPECT_EQ(info3, registry.get().slaves().slaves(1).info());
+  }
+}
+
+
+// A registrar that was replaced by another registrar (e.g., that of a
+// master which does not know yet that it lost its leadership) must not
+// store deltas on top of the snapshots of the other registrar.
+TEST_P(RegistrarTest, replaced)
+{
+  flags.registry_max_deltas = 1;
+
+  SlaveInfo info1;
+  info1.set_hostname("localhost");
+  info1.mutable_id()->set_value("1");
+
+  SlaveInfo info2;
+  info2.set_hostname("localhost");
+  info2.mutable_id()->set_value("2");
+
+  SlaveInfo info3;
+  info3.set_hostname("localhost");
+  info3.mutable_id()->set_value("3");
+
+  MasterInfo info;
+  info.set_id("master");
+  info.set_ip(10000000);
+  info.set_port(5050);
+
+  // The recovery is stored as delta 1, the update as a snapshot.
+  Registrar registrar1(flags, state);
+  AWAIT_READY(registrar1.recover(master));
+  AWAIT_EQ(true, registrar1.apply(Owned<Operation>(new AdmitSlave(info1))));
+
+  // Likewise, delta 2 and a snapshot covering it.
+  Registrar registrar2(flags, state);
+  AWAIT_READY(registrar2.recover(info));
+  AWAIT_EQ(true, registrar2.apply(Owned<Operation>(new AdmitSlave(info2))));
+
+  // The replaced registrar finds that its snapshot was replaced,
+  // even once delta 2 has been expunged.
+  AWAIT_FAILED(registrar1.apply(Owned<Operation>(new AdmitSlave(info3))));
+
+  // A delta that is part of the snapshot (e.g., stored by a replaced
+  // registrar right after the other registrar checked it) is not
+  // replayed when recovering.
+  RegistryDelta delta;
+  delta.set_sequence(2);
+  delta.add_admitted()->mutable_info()->CopyFrom(info3);
+
+  Future<Variable<RegistryDelta> > variable =
+    state->fetch<RegistryDelta>("registry.delta.2");
+
+  AWAIT_READY(variable);
+  AWAIT_READY(state->store(variable.get().mutate(delta)));
+
+  Registrar registrar3(flags, state);
+
+  Future<Registry> registry = registrar3.recover(master);
+  AWAIT_READY(registry);
+
+  EXPECT_EQ(master, registry.get().master().info());
+
+  ASSERT_EQ(2, registry.get().slaves().slaves().size());
+  EXPECT_EQ(info1, registry.get().slaves().slaves(0).info());
+  EXPECT_EQ(info2, registry.get().slaves().slaves(1).info());
+
+  // Deltas continue after those covered by the snapshot.
+  AWAIT_EQ(true, registrar3.apply(Owned<Operation>(new AdmitSlave(info3))));
+
+  SlaveInfo info4;
+  info4.set_hostname("localhost");
+  info4.mutable_id()->set_value("4");
+
+  // The recovery is stored as delta 4, so the next update of
+  // 'registrar4' is stored as a snapshot.
+  Registrar registrar4(flags, state);
+  AWAIT_READY(registrar4.recover(info));
+
+  // The recovery of 'registrar5' only stores delta 5 (it allows for
+  // more deltas), which leaves the version of the snapshot unchanged.
+  flags.registry_max_deltas = 2;
+
+  Registrar registrar5(flags, state);
+  AWAIT_READY(registrar5.recover(master));
+
+  // The replaced registrar must not store its snapshot.
+  AWAIT_FAILED(registrar4.apply(Owned<Operation>(new AdmitSlave(info4))));
+
+  AWAIT_EQ(true, registrar5.apply(Owned<Operation>(new AdmitSlave(info4))));
+
+  Registrar registrar6(flags, state);
+
+  registry = registrar6.recover(master);
+  AWAIT_READY(registry);
+
+  ASSERT_EQ(4, registry.get().slaves().slaves().size());
+  EXPECT_EQ(info3, registry.get().slaves().slaves(2).info());
+  EXPECT_EQ(info4, registry.get().slaves().slaves(3).info());
+}
+
+
 TEST_P(RegistrarTest, bootstrap)
 {
   // Run 1 readmits a slave that is not present.
@@ -348,16 +525,6 @@ TEST_P(RegistrarTest, bootstrap)
 }
 
 
-class MockStorage : public Storage
-{
-public:
-  MOCK_METHOD1(get, Future<Option<Entry> >(const string&));
-  MOCK_METHOD2(set, Future<bool>(const Entry&, const UUID&));
-  MOCK_METHOD1(expunge, Future<bool>(const Entry&));
-  MOCK_METHOD0(names, Future<std::set<string> >(void));
-};
-
-
 TEST_P(RegistrarTest, fetchTimeout)
 {
   Clock::pause();
@@ -397,7 +564,10 @@ TEST_P(RegistrarTest, storeTimeout)
   Registrar registrar(flags, &state);
 
   EXPECT_CALL(storage, get(_))
-    .WillOnce(Return(None()));
+    .WillRepeatedly(Return(None()));
+
+  EXPECT_CALL(storage, names())
+    .WillOnce(Return(std::set<string>()));
 
   Future<Nothing> set;
   EXPECT_CALL(storage, set(_, _))
@@ -426,8 +596,24 @@ TEST_P(RegistrarTest, abort)
 
   Registrar registrar(flags, &state);
 
+  // Before storing a delta the registrar checks that the delta it
+  // stored last (here the recovery) is still there.
+  RegistryDelta delta;
+  delta.set_sequence(1);
+
+  Entry entry;
+  entry.set_name("registry.delta.1");
+  entry.set_uuid(UUID::random().toBytes());
+  entry.set_value(delta.SerializeAsString());
+
   EXPECT_CALL(storage, get(_))
-    .WillOnce(Return(None()));
+    .WillRepeatedly(Return(None()));
+
+  EXPECT_CALL(storage, get("registry.delta.1"))
+    .WillRepeatedly(Return(Option<Entry>(entry)));
+
+  EXPECT_CALL(storage, names())
+    .WillOnce(Return(std::set<string>()));
 
   EXPECT_CALL(storage, set(_, _))
     .WillOnce(Return(Future<bool>(true)))              // Recovery.
@@ -444,21 +630,113 @@ TEST_P(RegistrarTest, abort)
 }
 
 
+// Like 'abort' but storing the entire registry on every update.
+TEST_P(RegistrarTest, abortSnapshot)
+{
+  flags.registry_max_deltas = 0;
+
+  MockStorage storage;
+  State state(&storage);
+
+  Registrar registrar(flags, &state);
+
+  EXPECT_CALL(storage, get(_))
+    .WillRepeatedly(Return(None()));
+
+  EXPECT_CALL(storage, names())
+    .WillOnce(Return(std::set<string>()));
+
+  EXPECT_CALL(storage, set(_, _))
+    .WillOnce(Return(Future<bool>(true)))              // Recovery.
+    .WillOnce(Return(Future<bool>::failed("failure"))) // Failure.
+    .WillRepeatedly(Return(Future<bool>(true)));       // Success.
+
+  AWAIT_READY(registrar.recover(master));
+
+  // Storage failure.
+  AWAIT_FAILED(registrar.apply(Owned<Operation>(new AdmitSlave(slave))));
+
+  // The registrar should now be aborted!
+  AWAIT_FAILED(registrar.apply(Owned<Operation>(new AdmitSlave(slave))));
+}
+
+
+// Storage that counts the entries (and their bytes) being stored in
+// the underlying storage.
+class CountingStorage : public Storage
+{
+public:
+  explicit CountingStorage(Storage* _storage)
+    : storage(_storage), stores(0), bytes(0) {}
+
+  virtual Future<Option<Entry> > get(const string& name)
+  {
+    return storage->get(name);
+  }
+
+  virtual Future<bool> set(const Entry& entry, const UUID& uuid)
+  {
+    stores++;
+    bytes += entry.ByteSize();
+    return storage->set(entry, uuid);
+  }
+
+  virtual Future<bool> expunge(const Entry& entry)
+  {
+    return storage->expunge(entry);
+  }
+
+  virtual Future<std::set<string> > names()
+  {
+    return storage->names();
+  }
+
+  Storage* storage;
+
+  // NOTE: Only read these once the stores have completed.
+  size_t stores;
+  size_t bytes;
+};
+
+
 class Registrar_BENCHMARK_Test : public RegistrarTestBase,
                                  public WithParamInterface<size_t>
-{};
+{
+protected:
+  Registrar_BENCHMARK_Test() : stores(0), bytes(0) {}
+
+  // Logs the number of stores and the bytes stored since last time.
+  void report(const CountingStorage& storage, const string& phase)
+  {
+    const size_t count = storage.stores - stores;
+    const size_t size = storage.bytes - bytes;
+
+    LOG(INFO) << phase << " performed " << count << " stores of "
+              << Bytes(size) << " ("
+              << Bytes(count == 0 ? 0 : size / count) << " per store)";
+
+    stores = storage.stores;
+    bytes = storage.bytes;
+  }
+
+  size_t stores;
+  size_t bytes;
+};
 
 
 // The Registrar benchmark tests are parameterized by the number of slaves.
 INSTANTIATE_TEST_CASE_P(
     SlaveCount,
     Registrar_BENCHMARK_Test,
-    ::testing::Values(10000U, 20000U, 30000U, 50000U));
+    ::testing::Values(10000U, 20000U, 30000U, 50000U, 100000U));
 
 
 TEST_P(Registrar_BENCHMARK_Test, performance)
 {
-  Registrar registrar(flags, state);
+  CountingStorage storage(RegistrarTestBase::storage);
+  State state(&storage);
+
+  Registrar registrar(flags, &state);
   AWAIT_READY(registrar.recover(master));
 
   vector<SlaveInfo> infos;
@@ -490,6 +768,7 @@ TEST_P(Registrar_BENCHMARK_Test, performance)
   }
   AWAIT_READY_FOR(result, Minutes(5));
   LOG(INFO) << "Admitted " << slaveCount << " slaves in " << watch.elapsed();
+  report(storage, "Admitting");
 
   // Shuffle the slaves so we are readmitting them in random order (
   // same as in production).
@@ -502,9 +781,10 @@ TEST_P(Registrar_BENCHMARK_Test, performance)
   }
   AWAIT_READY_FOR(result, Minutes(5));
   LOG(INFO) << "Readmitted " << slaveCount << " slaves in " << watch.elapsed();
+  report(storage, "Readmitting");
 
   // Recover slaves.
-  Registrar registrar2(flags, state);
+  Registrar registrar2(flags, &state);
   watch.start();
   MasterInfo info;
   info.set_id("master");
@@ -514,6 +794,21 @@ TEST_P(Registrar_BENCHMARK_Test, performance)
   AWAIT_READY(registry);
   LOG(INFO) << "Recovered " << slaveCount << " slaves ("
             << Bytes(registry.get().ByteSize()) << ") in " << watch.elapsed();
+  report(storage, "Recovering");
+
+  // Update the registry one slave at a time (i.e., without batching)
+  // to determine the latency and the size of a single update.
+  const size_t updates = 100;
+
+  watch.start();
+  for (size_t i = 0; i < updates; i++) {
+    AWAIT_READY(registrar2.apply(Owned<Operation>(new RemoveSlave(infos[i]))));
+    AWAIT_READY(registrar2.apply(Owned<Operation>(new AdmitSlave(infos[i]))));
+  }
+  LOG(INFO) << "Performed " << 2 * updates << " single updates in "
+            << watch.elapsed() << " ("
+            << watch.elapsed() / (2 * updates) << " per update)";
+  report(storage, "Single updates");
 
   // Shuffle the slaves so we are removing them in random order (same
   // as in production).
@@ -526,6 +821,7 @@ TEST_P(Registrar_BENCHMARK_Test, performance)
   }
   AWAIT_READY_FOR(result, Minutes(5));
   LOG(INFO) << "Removed " << slaveCount << " slaves in " << watch.elapsed();
+  report(storage, "Removing");
 }
 
 } // namespace tests {
@@ -35,6 +35,7 @@
 #include <stout/ip.hpp>
 #include <stout/mac.hpp>
 #include <stout/net.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/stringify.hpp>
 
 #include "linux/routing/route.hpp"
@@ -201,6 +202,30 @@ TEST_F(RoutingTest, LinkStatistics)
 }
 
 
+// Verifies that dumping the statistics of all the links returns the
+// same links and statistics as asking for the links one by one.
+TEST_F(RoutingTest, LinksStatistics)
+{
+  Try<set<string> > links = net::links();
+  ASSERT_SOME(links);
+
+  Try<hashmap<string, hashmap<string, uint64_t> > > statistics =
+    link::statistics();
+
+  ASSERT_SOME(statistics);
+  EXPECT_EQ(links.get().size(), statistics.get().size());
+
+  foreach (const string& link, links.get()) {
+    ASSERT_TRUE(statistics.get().contains(link));
+
+    Result<hashmap<string, uint64_t> > expected = link::statistics(link);
+    ASSERT_SOME(expected);
+
+    EXPECT_EQ(expected.get().keys(), statistics.get().get(link).get().keys());
+  }
+}
+
+
 TEST_F(RoutingTest, LinkExists)
 {
   Try<set<string> > links = net::links();
@@ -327,6 +352,73 @@ TEST_F(RoutingVethTest, ROOT_LinkCreatePid)
 }
 
 
+// Compares collecting the statistics of many container-like veths
+// (with their peers in another network namespace) one link at a time
+// against a single dump of all the links.
+TEST_F(RoutingTest, ROOT_BENCHMARK_LinkStatistics)
+{
+  const size_t links = 256;
+
+  // Stack used in the child process.
+  unsigned long long stack[32];
+
+  pid_t pid = ::clone(child, &stack[31], CLONE_NEWNET | SIGCHLD, NULL);
+  ASSERT_NE(-1, pid);
+
+  vector<string> veths;
+  for (size_t i = 0; i < links; i++) {
+    const string veth = "veth-bench-" + stringify(i);
+    const string peer = "peer-bench-" + stringify(i);
+
+    // Clean up the link, in case it wasn't cleaned up properly from
+    // previous runs.
+    link::remove(veth);
+
+    ASSERT_SOME_TRUE(link::create(veth, peer, pid));
+    veths.push_back(veth);
+  }
+
+  Stopwatch watch;
+  watch.start();
+
+  foreach (const string& veth, veths) {
+    ASSERT_SOME(link::statistics(veth));
+  }
+
+  Duration separately = watch.elapsed();
+
+  watch.start();
+
+  Try<hashmap<string, hashmap<string, uint64_t> > > statistics =
+    link::statistics();
+
+  Duration batched = watch.elapsed();
+
+  ASSERT_SOME(statistics);
+
+  foreach (const string& veth, veths) {
+    EXPECT_TRUE(statistics.get().contains(veth));
+  }
+
+  LOG(INFO) << "Collected the statistics of " << links << " veths in "
+            << separately << " one link at a time and in " << batched
+            << " with a single dump";
+
+  foreach (const string& veth, veths) {
+    EXPECT_SOME_TRUE(link::remove(veth));
+  }
+
+  // Kill the child process.
+  ASSERT_NE(-1, kill(pid, SIGKILL));
+
+  // Wait for the child process.
+  int status;
+  EXPECT_NE(-1, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFSIGNALED(status));
+  EXPECT_EQ(SIGKILL, WTERMSIG(status));
+}
+
+
 TEST_F(RoutingVethTest, ROOT_LinkWait)
 {
   AWAIT_READY(link::removed(TEST_VETH_LINK));
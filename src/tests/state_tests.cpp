@@ -27,14 +27,20 @@
 #include <mesos/type_utils.hpp>
 
 #include <process/future.hpp>
+#include <process/gmock.hpp>
 #include <process/gtest.hpp>
 #include <process/protobuf.hpp>
 #include <process/pid.hpp>
 
+#include <stout/bytes.hpp>
 #include <stout/gtest.hpp>
+#include <stout/nothing.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/svn.hpp>
 #include <stout/try.hpp>
+#include <stout/uuid.hpp>
 
 #include <stout/protobuf.hpp>
 
@@ -47,6 +53,8 @@
 
 #include "messages/state.hpp"
 
+#include "state/caching.hpp"
+#include "state/delta.hpp"
 #include "state/in_memory.hpp"
 #include "state/leveldb.hpp"
 #include "state/log.hpp"
@@ -54,6 +62,7 @@
 #include "state/storage.hpp"
 #include "state/zookeeper.hpp"
 
+#include "tests/mesos.hpp"
 #include "tests/utils.hpp"
 #ifdef MESOS_HAS_JAVA
 #include "tests/zookeeper.hpp"
@@ -68,6 +77,10 @@ using std::set;
 using std::string;
 using std::vector;
 
+using testing::_;
+using testing::DoAll;
+using testing::Return;
+
 namespace mesos {
 namespace internal {
 namespace tests {
@@ -393,6 +406,164 @@ TEST_F(InMemoryStateTest, Names)
 }
 
 
+class CachingStateTest : public ::testing::Test
+{
+public:
+  CachingStateTest()
+    : storage(NULL),
+      caching(NULL),
+      state(NULL) {}
+
+protected:
+  virtual void SetUp()
+  {
+    storage = new state::InMemoryStorage();
+    caching = new state::CachingStorage(storage, "caching_state_test/");
+    state = new State(caching);
+  }
+
+  virtual void TearDown()
+  {
+    delete state;
+    delete caching;
+    delete storage;
+  }
+
+  state::Storage* storage;
+  state::Storage* caching;
+  State* state;
+};
+
+
+TEST_F(CachingStateTest, FetchAndStoreAndFetch)
+{
+  FetchAndStoreAndFetch(state);
+}
+
+
+TEST_F(CachingStateTest, FetchAndStoreAndStoreAndFetch)
+{
+  FetchAndStoreAndStoreAndFetch(state);
+}
+
+
+TEST_F(CachingStateTest, FetchAndStoreAndStoreFailAndFetch)
+{
+  FetchAndStoreAndStoreFailAndFetch(state);
+}
+
+
+TEST_F(CachingStateTest, FetchAndStoreAndExpungeAndFetch)
+{
+  FetchAndStoreAndExpungeAndFetch(state);
+}
+
+
+TEST_F(CachingStateTest, FetchAndStoreAndExpungeAndExpunge)
+{
+  FetchAndStoreAndExpungeAndExpunge(state);
+}
+
+
+TEST_F(CachingStateTest, FetchAndStoreAndExpungeAndStoreAndFetch)
+{
+  FetchAndStoreAndExpungeAndStoreAndFetch(state);
+}
+
+
+TEST_F(CachingStateTest, Names)
+{
+  Names(state);
+}
+
+
+// Tests that concurrent fetches are coalesced, that fetches are
+// served from the cache and that the cache reflects stores, including
+// a store that fails because the underlying storage was modified by
+// someone else.
+TEST_F(CachingStateTest, Cache)
+{
+  MockStorage storage;
+  state::CachingStorage caching(&storage, "cache/");
+  State state(&caching);
+
+  Slaves slaves;
+  slaves.add_slaves()->mutable_info()->set_hostname("localhost");
+  slaves.add_slaves()->mutable_info()->set_hostname("localhost");
+
+  // The variable as stored by someone else.
+  state::Entry entry;
+  entry.set_name("slaves");
+  entry.set_uuid(UUID::random().toBytes());
+  entry.set_value(slaves.SerializeAsString());
+
+  // Keep the first 'get' pending until both fetches are outstanding.
+  process::Promise<Option<state::Entry> > promise;
+
+  Future<Nothing> get;
+  EXPECT_CALL(storage, get("slaves"))
+    .WillOnce(DoAll(FutureSatisfy(&get),
+                    Return(promise.future())))
+    .WillOnce(Return(Option<state::Entry>(entry)));
+
+  Future<Variable<Slaves> > future1 = state.fetch<Slaves>("slaves");
+
+  AWAIT_READY(get);
+
+  Future<Variable<Slaves> > future2 = state.fetch<Slaves>("slaves");
+
+  promise.set(Option<state::Entry>::none());
+
+  AWAIT_READY(future1);
+  AWAIT_READY(future2);
+
+  JSON::Object metrics = Metrics();
+  EXPECT_EQ(0, metrics.values["cache/caching_storage/hits"]);
+  EXPECT_EQ(1, metrics.values["cache/caching_storage/misses"]);
+  EXPECT_EQ(1, metrics.values["cache/caching_storage/coalesced"]);
+
+  EXPECT_CALL(storage, set(_, _))
+    .WillOnce(Return(true))
+    .WillOnce(Return(false));
+
+  Variable<Slaves> variable = future1.get();
+
+  slaves.mutable_slaves()->RemoveLast();
+
+  Future<Option<Variable<Slaves> > > store =
+    state.store(variable.mutate(slaves));
+
+  AWAIT_READY(store);
+  ASSERT_SOME(store.get());
+
+  // The stored variable is cached.
+  future1 = state.fetch<Slaves>("slaves");
+  AWAIT_READY(future1);
+  EXPECT_EQ(1, future1.get().get().slaves().size());
+
+  // The cache still returns the stored variable after someone else
+  // stored 'entry', which means it can no longer be stored.
+  future1 = state.fetch<Slaves>("slaves");
+  AWAIT_READY(future1);
+  EXPECT_EQ(1, future1.get().get().slaves().size());
+
+  store = state.store(future1.get().mutate(slaves));
+  AWAIT_READY(store);
+  EXPECT_NONE(store.get());
+
+  // The failed store invalidated the cache.
+  future1 = state.fetch<Slaves>("slaves");
+  AWAIT_READY(future1);
+  EXPECT_EQ(2, future1.get().get().slaves().size());
+
+  metrics = Metrics();
+  EXPECT_EQ(2, metrics.values["cache/caching_storage/hits"]);
+  EXPECT_EQ(2, metrics.values["cache/caching_storage/misses"]);
+  EXPECT_EQ(1, metrics.values["cache/caching_storage/coalesced"]);
+  EXPECT_EQ(0.4, metrics.values["cache/caching_storage/hit_rate"]);
+}
+
+
 class LevelDBStateTest : public ::testing::Test
 {
 public:
@@ -500,7 +671,7 @@ protected:
     pids.insert(replica2->pid());
 
     log = new Log(2, path1, pids);
-    storage = new state::LogStorage(log, 1024);
+    storage = new state::LogStorage(log, 1024, true);
     state = new State(storage);
   }
 
@@ -515,6 +686,50 @@ protected:
     TemporaryDirectoryTest::TearDown();
   }
 
+  // Reads all the operations that are currently in the log.
+  void read(vector<Operation>* operations, Bytes* bytes = NULL)
+  {
+    // It's possible that we're doing truncation asynchronously which
+    // will cause the test to fail because we'll end up getting a
+    // pending position from Log::Reader::ending which will cause
+    // Log::Reader::read to fail. To remedy this, we pause the clock
+    // and wait for all executing processe to settle.
+    Clock::pause();
+    Clock::settle();
+    Clock::resume();
+
+    Log::Reader reader(log);
+
+    Future<Log::Position> beginning = reader.beginning();
+    Future<Log::Position> ending = reader.ending();
+
+    AWAIT_READY(beginning);
+    AWAIT_READY(ending);
+
+    Future<list<Log::Entry>> entries =
+      reader.read(beginning.get(), ending.get());
+
+    AWAIT_READY(entries);
+
+    // Convert each Log::Entry to a Operation.
+    foreach (const Log::Entry& entry, entries.get()) {
+      // Parse the Operation from the Log::Entry.
+      Operation operation;
+
+      google::protobuf::io::ArrayInputStream stream(
+          entry.data.data(),
+          entry.data.size());
+
+      ASSERT_TRUE(operation.ParseFromZeroCopyStream(&stream));
+
+      operations->push_back(operation);
+
+      if (bytes != NULL) {
+        *bytes += Bytes(entry.data.size());
+      }
+    }
+  }
+
   state::Storage* storage;
   State* state;
 
@@ -643,46 +858,386 @@ TEST_F(LogStateTest, Diff)
   AWAIT_READY(future2);
   ASSERT_SOME(future2.get());
 
-  // It's possible that we're doing truncation asynchronously which
-  // will cause the test to fail because we'll end up getting a
-  // pending position from Log::Reader::ending which will cause
-  // Log::Reader::read to fail. To remedy this, we pause the clock and
-  // wait for all executing processe to settle.
-  Clock::pause();
-  Clock::settle();
-  Clock::resume();
+  vector<Operation> operations;
+  read(&operations);
 
-  Log::Reader reader(log);
+  ASSERT_EQ(2u, operations.size());
+  EXPECT_EQ(Operation::SNAPSHOT, operations[0].type());
+  EXPECT_EQ(Operation::DIFF, operations[1].type());
+  EXPECT_EQ(Operation::Diff::BINARY, operations[1].diff().format());
+}
 
-  Future<Log::Position> beginning = reader.beginning();
-  Future<Log::Position> ending = reader.ending();
 
-  AWAIT_READY(beginning);
-  AWAIT_READY(ending);
+// Tests that svn diffs are still written when binary diffs are not
+// enabled, i.e., what LogStorage did before binary diffs existed.
+TEST_F(LogStateTest, SvnDiff)
+{
+  // Use another storage so that the writer of 'state' is never
+  // started (and thus can't demote the writer of 'storage2').
+  state::LogStorage storage2(log, 1024);
+  State state2(&storage2);
+
+  Future<Variable<Slaves>> future1 = state2.fetch<Slaves>("slaves");
+  AWAIT_READY(future1);
 
-  Future<list<Log::Entry>> entries = reader.read(beginning.get(), ending.get());
+  Variable<Slaves> variable = future1.get();
 
-  AWAIT_READY(entries);
+  Slaves slaves = variable.get();
+
+  for (size_t i = 0; i < 1024; i++) {
+    Slave* slave = slaves.add_slaves();
+    slave->mutable_info()->set_hostname("localhost" + stringify(i));
+  }
+
+  variable = variable.mutate(slaves);
+
+  Future<Option<Variable<Slaves>>> future2 = state2.store(variable);
+  AWAIT_READY(future2);
+  ASSERT_SOME(future2.get());
+
+  variable = future2.get().get();
+
+  slaves.mutable_slaves(0)->mutable_info()->set_hostname("host");
+
+  variable = variable.mutate(slaves);
+
+  future2 = state2.store(variable);
+  AWAIT_READY(future2);
+  ASSERT_SOME(future2.get());
 
-  // Convert each Log::Entry to a Operation.
   vector<Operation> operations;
+  read(&operations);
 
-  foreach (const Log::Entry& entry, entries.get()) {
-    // Parse the Operation from the Log::Entry.
-    Operation operation;
+  ASSERT_EQ(2u, operations.size());
+  EXPECT_EQ(Operation::SNAPSHOT, operations[0].type());
+  EXPECT_EQ(Operation::DIFF, operations[1].type());
+  EXPECT_FALSE(operations[1].diff().has_format());
+}
 
-    google::protobuf::io::ArrayInputStream stream(
-        entry.data.data(),
-        entry.data.size());
 
-    ASSERT_TRUE(operation.ParseFromZeroCopyStream(&stream));
+// Tests that an svn diff (as written by older versions) is applied
+// when recovering the log, even if binary diffs are enabled.
+TEST_F(LogStateTest, SvnDiffRecover)
+{
+  Slaves slaves1;
+  for (size_t i = 0; i < 1024; i++) {
+    Slave* slave = slaves1.add_slaves();
+    slave->mutable_info()->set_hostname("localhost" + stringify(i));
+  }
+
+  Slaves slaves2 = slaves1;
+  slaves2.mutable_slaves(0)->mutable_info()->set_hostname("host");
+
+  Operation snapshot;
+  snapshot.set_type(Operation::SNAPSHOT);
+  snapshot.mutable_snapshot()->mutable_entry()->set_name("slaves");
+  snapshot.mutable_snapshot()->mutable_entry()->set_uuid(
+      UUID::random().toBytes());
+  snapshot.mutable_snapshot()->mutable_entry()->set_value(
+      slaves1.SerializeAsString());
+
+  Try<svn::Diff> diff = svn::diff(
+      slaves1.SerializeAsString(),
+      slaves2.SerializeAsString());
+
+  ASSERT_SOME(diff);
+
+  Operation operation;
+  operation.set_type(Operation::DIFF);
+  operation.mutable_diff()->mutable_entry()->set_name("slaves");
+  operation.mutable_diff()->mutable_entry()->set_uuid(
+      UUID::random().toBytes());
+  operation.mutable_diff()->mutable_entry()->set_value(diff.get().data);
+
+  // Append the operations directly to the log (as an older version
+  // of LogStorage would have). The writer of 'state' gets elected
+  // after this writer when we fetch below.
+  {
+    Log::Writer writer(log);
 
-    operations.push_back(operation);
+    Future<Option<Log::Position>> position = writer.start();
+    AWAIT_READY(position);
+    ASSERT_SOME(position.get());
+
+    position = writer.append(snapshot.SerializeAsString());
+    AWAIT_READY(position);
+    ASSERT_SOME(position.get());
+
+    position = writer.append(operation.SerializeAsString());
+    AWAIT_READY(position);
+    ASSERT_SOME(position.get());
   }
 
-  ASSERT_EQ(2u, operations.size());
+  Future<Variable<Slaves>> future = state->fetch<Slaves>("slaves");
+  AWAIT_READY(future);
+
+  EXPECT_EQ(slaves2.SerializeAsString(),
+            future.get().get().SerializeAsString());
+}
+
+
+// Tests that a variable stored as a snapshot followed by diffs can
+// be recovered by another LogStorage and that a snapshot is written
+// instead of a diff once the diffs would add up to more than the
+// variable itself.
+TEST_F(LogStateTest, DiffRecover)
+{
+  Future<Variable<Slaves>> future1 = state->fetch<Slaves>("slaves");
+  AWAIT_READY(future1);
+
+  Variable<Slaves> variable = future1.get();
+
+  Slaves slaves = variable.get();
+
+  for (size_t i = 0; i < 1024; i++) {
+    Slave* slave = slaves.add_slaves();
+    slave->mutable_info()->set_hostname("localhost" + stringify(i));
+  }
+
+  // Store the full variable followed by some small mutations.
+  for (size_t i = 0; i < 4; i++) {
+    slaves.mutable_slaves(i * 100)->mutable_info()->set_hostname("host");
+
+    variable = variable.mutate(slaves);
+
+    Future<Option<Variable<Slaves>>> future2 = state->store(variable);
+    AWAIT_READY(future2);
+    ASSERT_SOME(future2.get());
+
+    variable = future2.get().get();
+  }
+
+  vector<Operation> operations;
+  read(&operations);
+
+  ASSERT_EQ(4u, operations.size());
   EXPECT_EQ(Operation::SNAPSHOT, operations[0].type());
   EXPECT_EQ(Operation::DIFF, operations[1].type());
+  EXPECT_EQ(Operation::DIFF, operations[2].type());
+  EXPECT_EQ(Operation::DIFF, operations[3].type());
+
+  // Now replace every slave so that the diff would be bigger than
+  // the variable itself.
+  for (int i = 0; i < slaves.slaves().size(); i++) {
+    slaves.mutable_slaves(i)->mutable_info()->set_hostname(
+        "slave" + stringify(i) + ".example.com");
+  }
+
+  variable = variable.mutate(slaves);
+
+  Future<Option<Variable<Slaves>>> future2 = state->store(variable);
+  AWAIT_READY(future2);
+  ASSERT_SOME(future2.get());
+
+  variable = future2.get().get();
+
+  operations.clear();
+  read(&operations);
+
+  ASSERT_FALSE(operations.empty());
+  EXPECT_EQ(Operation::SNAPSHOT, operations.back().type());
+
+  // Diffs are written again following the new snapshot.
+  slaves.mutable_slaves(0)->mutable_info()->set_hostname("host");
+
+  variable = variable.mutate(slaves);
+
+  future2 = state->store(variable);
+  AWAIT_READY(future2);
+  ASSERT_SOME(future2.get());
+
+  operations.clear();
+  read(&operations);
+
+  ASSERT_LE(2u, operations.size());
+  EXPECT_EQ(Operation::SNAPSHOT, operations[operations.size() - 2].type());
+  EXPECT_EQ(Operation::DIFF, operations.back().type());
+
+  // The diffs are applied when another storage reads the log. Note
+  // that this demotes the writer of 'state' so this must come last.
+  {
+    state::LogStorage storage2(log);
+    State state2(&storage2);
+
+    Future<Variable<Slaves>> future3 = state2.fetch<Slaves>("slaves");
+    AWAIT_READY(future3);
+
+    EXPECT_EQ(slaves.SerializeAsString(),
+              future3.get().get().SerializeAsString());
+  }
+}
+
+
+// Measures storing and fetching a large (~10MB) variable that is
+// mutated slightly between stores, which is written to the log as a
+// snapshot followed by (small) diffs.
+TEST_F(LogStateTest, BENCHMARK_Diff)
+{
+  const size_t slaves = 40000;
+  const size_t mutations = 10;
+
+  Future<Variable<Slaves>> future1 = state->fetch<Slaves>("slaves");
+  AWAIT_READY(future1);
+
+  Variable<Slaves> variable = future1.get();
+
+  Slaves value = variable.get();
+
+  for (size_t i = 0; i < slaves; i++) {
+    Slave* slave = value.add_slaves();
+    slave->mutable_info()->set_hostname(
+        "localhost" + stringify(i) + string(240, 'x'));
+  }
+
+  LOG(INFO) << "Storing a variable of " << Bytes(value.ByteSize())
+            << " followed by " << mutations << " mutations";
+
+  Stopwatch watch;
+  watch.start();
+
+  for (size_t i = 0; i <= mutations; i++) {
+    if (i > 0) {
+      value.mutable_slaves(i * 1000)->mutable_info()->set_hostname("host");
+    }
+
+    variable = variable.mutate(value);
+
+    Stopwatch store;
+    store.start();
+
+    Future<Option<Variable<Slaves>>> future2 = state->store(variable);
+    AWAIT_READY_FOR(future2, Minutes(1));
+    ASSERT_SOME(future2.get());
+
+    LOG(INFO) << (i == 0 ? "Stored the variable" : "Stored a mutation")
+              << " in " << store.elapsed();
+
+    variable = future2.get().get();
+  }
+
+  LOG(INFO) << "Stored the variable and " << mutations << " mutations in "
+            << watch.elapsed();
+
+  vector<Operation> operations;
+  Bytes bytes;
+  read(&operations, &bytes);
+
+  LOG(INFO) << "Wrote " << operations.size() << " operations of "
+            << bytes << " in total to the log";
+
+  // Measure the time it takes another storage to recover the
+  // variable from the log.
+  watch.start();
+
+  state::LogStorage storage2(log);
+  State state2(&storage2);
+
+  Future<Variable<Slaves>> future3 = state2.fetch<Slaves>("slaves");
+  AWAIT_READY_FOR(future3, Minutes(1));
+
+  LOG(INFO) << "Fetched the variable in " << watch.elapsed();
+
+  EXPECT_EQ(value.SerializeAsString(),
+            future3.get().get().SerializeAsString());
+}
+
+
+TEST(DeltaTest, Empty)
+{
+  const string value = "hello world";
+
+  Try<string> delta = state::delta::diff("", "");
+  ASSERT_SOME(delta);
+  EXPECT_SOME_EQ("", state::delta::patch("", delta.get()));
+
+  delta = state::delta::diff("", value);
+  ASSERT_SOME(delta);
+  EXPECT_SOME_EQ(value, state::delta::patch("", delta.get()));
+
+  delta = state::delta::diff(value, "");
+  ASSERT_SOME(delta);
+  EXPECT_SOME_EQ("", state::delta::patch(value, delta.get()));
+}
+
+
+TEST(DeltaTest, Patch)
+{
+  string source;
+  for (size_t i = 0; i < 1024; i++) {
+    source += "localhost" + stringify(i);
+  }
+
+  // Change a single byte in the middle.
+  string target = source;
+  target[source.size() / 2] = 'x';
+
+  Try<string> delta = state::delta::diff(source, target);
+  ASSERT_SOME(delta);
+  EXPECT_GT(source.size() / 10, delta.get().size());
+  EXPECT_SOME_EQ(target, state::delta::patch(source, delta.get()));
+
+  // Prepend and append to the source.
+  target = "prefix" + source + "suffix";
+
+  delta = state::delta::diff(source, target);
+  ASSERT_SOME(delta);
+  EXPECT_GT(source.size() / 10, delta.get().size());
+  EXPECT_SOME_EQ(target, state::delta::patch(source, delta.get()));
+}
+
+
+// Tests a target (and a source) that is shorter than the blocks
+// used to find matches between the target and the source.
+TEST(DeltaTest, Short)
+{
+  string source;
+  for (size_t i = 0; i < 1024; i++) {
+    source += "localhost" + stringify(i);
+  }
+
+  const string target = source.substr(0, 5);
+
+  Try<string> delta = state::delta::diff(source, target);
+  ASSERT_SOME(delta);
+  EXPECT_SOME_EQ(target, state::delta::patch(source, delta.get()));
+
+  delta = state::delta::diff(target, source);
+  ASSERT_SOME(delta);
+  EXPECT_SOME_EQ(source, state::delta::patch(target, delta.get()));
+}
+
+
+TEST(DeltaTest, Corrupt)
+{
+  string source;
+  for (size_t i = 0; i < 1024; i++) {
+    source += "localhost" + stringify(i);
+  }
+
+  string target = source;
+  target[source.size() / 2] = 'x';
+
+  Try<string> delta = state::delta::diff(source, target);
+  ASSERT_SOME(delta);
+
+  // Every truncation of the delta must be detected.
+  for (size_t i = 0; i < delta.get().size(); i++) {
+    EXPECT_ERROR(state::delta::patch(source, delta.get().substr(0, i)));
+  }
+
+  // Trailing garbage.
+  EXPECT_ERROR(state::delta::patch(source, delta.get() + "x"));
+
+  // A delta that was computed against another source.
+  EXPECT_ERROR(state::delta::patch(target + "x", delta.get()));
+
+  // A varint that never ends.
+  EXPECT_ERROR(state::delta::patch(source, string(16, '\xff')));
+
+  // A target size of 2^63 bytes (followed by a single literal byte)
+  // which must not be allocated up front.
+  EXPECT_ERROR(state::delta::patch(
+      "", string(1, '\x00') + string(9, '\x80') + "\x01" + "\x02x"));
 }
 
 
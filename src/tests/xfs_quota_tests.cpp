@@ -0,0 +1,435 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include <mesos/resources.hpp>
+
+#include <mesos/slave/isolator.hpp>
+
+#include <process/future.hpp>
+#include <process/gtest.hpp>
+#include <process/owned.hpp>
+
+#include <stout/bytes.hpp>
+#include <stout/gtest.hpp>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+#include <stout/result.hpp>
+#include <stout/try.hpp>
+
+#include "linux/fs.hpp"
+#include "linux/xfs.hpp"
+
+#include "slave/flags.hpp"
+
+#include "slave/containerizer/fetcher.hpp"
+#include "slave/containerizer/launcher.hpp"
+
+#include "slave/containerizer/isolators/xfs/disk.hpp"
+
+#include "slave/containerizer/mesos/containerizer.hpp"
+
+#include "tests/flags.hpp"
+#include "tests/mesos.hpp"
+#include "tests/utils.hpp"
+
+using namespace process;
+
+using mesos::internal::slave::Fetcher;
+using mesos::internal::slave::Launcher;
+using mesos::internal::slave::MesosContainerizer;
+using mesos::internal::slave::PosixLauncher;
+using mesos::internal::slave::Slave;
+using mesos::internal::slave::XfsDiskIsolatorProcess;
+
+using mesos::slave::ExecutorRunState;
+using mesos::slave::Isolator;
+
+using std::list;
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace internal {
+namespace tests {
+
+// Creates an XFS filesystem (mounted with project quotas enabled) on
+// a loopback device backed by a sparse image file in the sandbox.
+// NOTE: Requires 'mkfs.xfs' to be installed.
+class XfsTest : public TemporaryDirectoryTest
+{
+protected:
+  XfsTest() : mounted(false) {}
+
+  virtual void SetUp()
+  {
+    TemporaryDirectoryTest::SetUp();
+
+    mountPoint = path::join(os::getcwd(), "mnt");
+    ASSERT_SOME(os::mkdir(mountPoint));
+
+    // NOTE: Recent versions of mkfs.xfs refuse to create filesystems
+    // smaller than 300MB. The image is sparse.
+    ASSERT_SOME_EQ(0, os::shell(NULL, "truncate -s 400M disk.img"));
+    ASSERT_SOME_EQ(0, os::shell(NULL, "mkfs.xfs -q disk.img"));
+    ASSERT_SOME_EQ(0, os::shell(
+        NULL, "mount -o loop,prjquota disk.img %s", mountPoint.c_str()));
+
+    mounted = true;
+  }
+
+  virtual void TearDown()
+  {
+    if (mounted) {
+      ASSERT_SOME(fs::unmount(mountPoint, MNT_DETACH));
+      mounted = false;
+    }
+
+    TemporaryDirectoryTest::TearDown();
+  }
+
+  string mountPoint;
+  bool mounted;
+};
+
+
+TEST_F(XfsTest, ROOT_XFS_QuotaEnabled)
+{
+  EXPECT_SOME_TRUE(xfs::isQuotaEnabled(mountPoint));
+
+  // The sandbox is not on the loopback XFS filesystem.
+  Try<bool> enabled = xfs::isQuotaEnabled(os::getcwd());
+  if (enabled.isSome()) {
+    EXPECT_FALSE(enabled.get());
+  }
+}
+
+
+TEST_F(XfsTest, ROOT_XFS_ProjectAccounting)
+{
+  const uint32_t projectId = 5000;
+
+  string directory = path::join(mountPoint, "sandbox");
+  ASSERT_SOME(os::mkdir(directory));
+
+  ASSERT_SOME(xfs::setProjectId(directory, projectId));
+  EXPECT_SOME_EQ(projectId, xfs::getProjectId(directory));
+
+  // Files created in the directory inherit its project ID.
+  ASSERT_SOME_EQ(0, os::shell(
+      NULL,
+      "dd if=/dev/zero of=%s bs=1M count=4 conv=fsync",
+      path::join(directory, "file").c_str()));
+
+  EXPECT_SOME_EQ(projectId, xfs::getProjectId(path::join(directory, "file")));
+
+  Result<xfs::QuotaInfo> quota = xfs::getProjectQuota(directory, projectId);
+  ASSERT_SOME(quota);
+
+  EXPECT_LE(Megabytes(4), quota.get().used);
+  EXPECT_EQ(Bytes(0), quota.get().limit);
+  EXPECT_EQ(2u, quota.get().inodes);
+
+  // Removing the files releases the accounted usage.
+  ASSERT_SOME(os::rmdir(directory));
+
+  quota = xfs::getProjectQuota(mountPoint, projectId);
+  ASSERT_FALSE(quota.isError());
+
+  if (quota.isSome()) {
+    EXPECT_EQ(Bytes(0), quota.get().used);
+    EXPECT_EQ(0u, quota.get().inodes);
+  }
+}
+
+
+TEST_F(XfsTest, ROOT_XFS_ProjectQuotaEnforcement)
+{
+  const uint32_t projectId = 5001;
+
+  string directory = path::join(mountPoint, "sandbox");
+  ASSERT_SOME(os::mkdir(directory));
+
+  ASSERT_SOME(xfs::setProjectId(directory, projectId));
+  ASSERT_SOME(xfs::setProjectQuota(directory, projectId, Megabytes(1)));
+
+  Result<xfs::QuotaInfo> quota = xfs::getProjectQuota(directory, projectId);
+  ASSERT_SOME(quota);
+  EXPECT_EQ(Megabytes(1), quota.get().limit);
+
+  string file = path::join(directory, "file");
+
+  // Writing beyond the limit fails.
+  EXPECT_SOME_NE(0, os::shell(
+      NULL,
+      "dd if=/dev/zero of=%s bs=1M count=2 conv=fsync 2>/dev/null",
+      file.c_str()));
+
+  ASSERT_SOME(os::rm(file));
+
+  // Writing succeeds once the limit is removed.
+  ASSERT_SOME(xfs::clearProjectQuota(directory, projectId));
+
+  EXPECT_SOME_EQ(0, os::shell(
+      NULL,
+      "dd if=/dev/zero of=%s bs=1M count=2 conv=fsync",
+      file.c_str()));
+}
+
+
+class XfsIsolatorTest : public XfsTest
+{
+protected:
+  virtual void SetUp()
+  {
+    XfsTest::SetUp();
+
+    flags.work_dir = mountPoint;
+    flags.xfs_project_range = "[5000-5009]";
+    flags.enforce_container_disk_quota = true;
+  }
+
+  slave::Flags flags;
+};
+
+
+// Verifies that the isolator tags the working directory of a
+// container with a project ID, enforces the disk quota of the
+// container and frees the project ID once the container is cleaned
+// up and its working directory is removed.
+TEST_F(XfsIsolatorTest, ROOT_XFS_PrepareUpdateCleanup)
+{
+  Try<Isolator*> _isolator = XfsDiskIsolatorProcess::create(flags);
+  ASSERT_SOME(_isolator);
+  Owned<Isolator> isolator(_isolator.get());
+
+  ExecutorInfo executorInfo;
+
+  ContainerID containerId1;
+  containerId1.set_value("container1");
+
+  const string directory1 = path::join(mountPoint, "sandbox1");
+  ASSERT_SOME(os::mkdir(directory1));
+
+  AWAIT_READY(
+      isolator->prepare(containerId1, executorInfo, directory1, None()));
+  AWAIT_READY(isolator->isolate(containerId1, ::getpid()));
+
+  EXPECT_SOME_EQ(5000u, xfs::getProjectId(directory1));
+
+  AWAIT_READY(isolator->update(
+      containerId1,
+      Resources::parse("cpus:1;disk:1").get()));
+
+  Result<xfs::QuotaInfo> quota = xfs::getProjectQuota(directory1, 5000);
+  ASSERT_SOME(quota);
+  EXPECT_EQ(Megabytes(1), quota.get().limit);
+
+  Future<ResourceStatistics> usage = isolator->usage(containerId1);
+  AWAIT_READY(usage);
+  EXPECT_EQ(Megabytes(1).bytes(), usage.get().disk_limit_bytes());
+
+  // Writing beyond the quota fails.
+  EXPECT_SOME_NE(0, os::shell(
+      NULL,
+      "dd if=/dev/zero of=%s bs=1M count=2 conv=fsync 2>/dev/null",
+      path::join(directory1, "file").c_str()));
+
+  // The limitation is never satisfied, see XfsDiskIsolatorProcess.
+  Future<mesos::slave::Limitation> limitation = isolator->watch(containerId1);
+  EXPECT_TRUE(limitation.isPending());
+
+  AWAIT_READY(isolator->cleanup(containerId1));
+
+  // The quota is cleared but the working directory (which is only
+  // removed once garbage collected) is still accounted to project
+  // 5000, so the next container is assigned another project ID.
+  quota = xfs::getProjectQuota(directory1, 5000);
+  ASSERT_SOME(quota);
+  EXPECT_EQ(Bytes(0), quota.get().limit);
+
+  ContainerID containerId2;
+  containerId2.set_value("container2");
+
+  const string directory2 = path::join(mountPoint, "sandbox2");
+  ASSERT_SOME(os::mkdir(directory2));
+
+  AWAIT_READY(
+      isolator->prepare(containerId2, executorInfo, directory2, None()));
+
+  EXPECT_SOME_EQ(5001u, xfs::getProjectId(directory2));
+
+  AWAIT_READY(isolator->cleanup(containerId2));
+
+  // Once the working directory is removed project 5000 can be
+  // assigned again.
+  ASSERT_SOME(os::rmdir(directory1));
+
+  ContainerID containerId3;
+  containerId3.set_value("container3");
+
+  const string directory3 = path::join(mountPoint, "sandbox3");
+  ASSERT_SOME(os::mkdir(directory3));
+
+  AWAIT_READY(
+      isolator->prepare(containerId3, executorInfo, directory3, None()));
+
+  EXPECT_SOME_EQ(5000u, xfs::getProjectId(directory3));
+
+  AWAIT_READY(isolator->cleanup(containerId3));
+}
+
+
+// Verifies that a restarted isolator recovers the project IDs of the
+// running containers (and does not assign them again) and ignores
+// the containers that were not launched with the isolator.
+TEST_F(XfsIsolatorTest, ROOT_XFS_Recover)
+{
+  ExecutorInfo executorInfo;
+
+  ContainerID containerId1;
+  containerId1.set_value("container1");
+
+  const string directory1 = path::join(mountPoint, "sandbox1");
+  ASSERT_SOME(os::mkdir(directory1));
+
+  {
+    Try<Isolator*> _isolator = XfsDiskIsolatorProcess::create(flags);
+    ASSERT_SOME(_isolator);
+    Owned<Isolator> isolator(_isolator.get());
+
+    AWAIT_READY(
+        isolator->prepare(containerId1, executorInfo, directory1, None()));
+  }
+
+  ASSERT_SOME_EQ(0, os::shell(
+      NULL,
+      "dd if=/dev/zero of=%s bs=1M count=1 conv=fsync",
+      path::join(directory1, "file").c_str()));
+
+  // A container that was launched without the isolator.
+  ContainerID containerId2;
+  containerId2.set_value("container2");
+
+  const string directory2 = path::join(mountPoint, "sandbox2");
+  ASSERT_SOME(os::mkdir(directory2));
+
+  Try<Isolator*> _isolator = XfsDiskIsolatorProcess::create(flags);
+  ASSERT_SOME(_isolator);
+  Owned<Isolator> isolator(_isolator.get());
+
+  list<ExecutorRunState> states;
+  states.push_back(ExecutorRunState(containerId1, ::getpid(), directory1));
+  states.push_back(ExecutorRunState(containerId2, ::getpid(), directory2));
+
+  AWAIT_READY(isolator->recover(states));
+
+  Future<ResourceStatistics> usage = isolator->usage(containerId1);
+  AWAIT_READY(usage);
+  EXPECT_LE(Megabytes(1).bytes(), usage.get().disk_used_bytes());
+
+  AWAIT_FAILED(isolator->usage(containerId2));
+
+  // Project 5000 is still assigned to the recovered container.
+  ContainerID containerId3;
+  containerId3.set_value("container3");
+
+  const string directory3 = path::join(mountPoint, "sandbox3");
+  ASSERT_SOME(os::mkdir(directory3));
+
+  AWAIT_READY(
+      isolator->prepare(containerId3, executorInfo, directory3, None()));
+
+  EXPECT_SOME_EQ(5001u, xfs::getProjectId(directory3));
+
+  AWAIT_READY(isolator->cleanup(containerId1));
+  AWAIT_READY(isolator->cleanup(containerId3));
+}
+
+
+// Verifies that the URIs fetched into the working directory of a
+// container are accounted to the container's project, i.e., that the
+// containerizer does not start fetching before the isolator has set
+// the project ID of the (empty) working directory.
+TEST_F(XfsIsolatorTest, ROOT_XFS_FetchedURI)
+{
+  flags.launcher_dir = path::join(tests::flags.build_dir, "src");
+
+  Try<Isolator*> isolator = XfsDiskIsolatorProcess::create(flags);
+  ASSERT_SOME(isolator);
+
+  vector<Owned<Isolator> > isolators;
+  isolators.push_back(Owned<Isolator>(isolator.get()));
+
+  Try<Launcher*> launcher = PosixLauncher::create(flags);
+  ASSERT_SOME(launcher);
+
+  Fetcher fetcher;
+
+  MesosContainerizer containerizer(
+      flags,
+      true,
+      &fetcher,
+      Owned<Launcher>(launcher.get()),
+      isolators);
+
+  // The URI is outside of the XFS filesystem.
+  const string uri = path::join(os::getcwd(), "file");
+  ASSERT_SOME_EQ(0, os::shell(
+      NULL,
+      "dd if=/dev/zero of=%s bs=1M count=1",
+      uri.c_str()));
+
+  ExecutorInfo executorInfo = CREATE_EXECUTOR_INFO("executor", "exit 0");
+  executorInfo.mutable_command()->add_uris()->set_value(uri);
+
+  const string directory = path::join(mountPoint, "sandbox");
+  ASSERT_SOME(os::mkdir(directory));
+
+  ContainerID containerId;
+  containerId.set_value("container");
+
+  Future<bool> launch = containerizer.launch(
+      containerId,
+      executorInfo,
+      directory,
+      None(),
+      SlaveID(),
+      PID<Slave>(),
+      false);
+
+  AWAIT_READY(launch);
+  ASSERT_TRUE(launch.get());
+
+  Future<containerizer::Termination> wait = containerizer.wait(containerId);
+  AWAIT_READY(wait);
+
+  EXPECT_SOME_EQ(5000u, xfs::getProjectId(directory));
+  EXPECT_SOME_EQ(5000u, xfs::getProjectId(path::join(directory, "file")));
+}
+
+} // namespace tests {
+} // namespace internal {
+} // namespace mesos {
@@ -8,6 +8,7 @@
 #include <process/id.hpp>
 #include <process/process.hpp>
 
+#include <stout/bytes.hpp>
 #include <stout/check.hpp>
 #include <stout/duration.hpp>
 #include <stout/error.hpp>
@@ -43,6 +44,14 @@ namespace zookeeper {
 const Duration GroupProcess::RETRY_INTERVAL = Seconds(2);
 
 
+// Maximum number of joins or cancels performed in a single multi
+// operation, and the maximum amount of data of the joins in one, to
+// stay well below the size limit of a ZooKeeper request (1 MB by
+// default, see 'jute.maxbuffer').
+static const size_t MAX_BATCH_SIZE = 256;
+static const Bytes MAX_BATCH_BYTES = Kilobytes(512);
+
+
 // Helper for failing a queue of promises.
 template <typename T>
 void fail(queue<T*>* queue, const string& message)
@@ -56,6 +65,24 @@ void fail(queue<T*>* queue, const string& message)
 }
 
 
+// Helper for putting a batch taken off the front of a queue back.
+template <typename T>
+void requeue(const vector<T*>& batch, queue<T*>* queue)
+{
+  std::queue<T*> rest;
+  std::swap(rest, *queue);
+
+  foreach (T* t, batch) {
+    queue->push(t);
+  }
+
+  while (!rest.empty()) {
+    queue->push(rest.front());
+    rest.pop();
+  }
+}
+
+
 // Helper for discarding a queue of promises.
 template <typename T>
 void discard(queue<T*>* queue)
@@ -85,7 +112,9 @@ GroupProcess::GroupProcess(
     watcher(NULL),
     zk(NULL),
     state(DISCONNECTED),
-    retrying(false)
+    retrying(false),
+    flushing(false),
+    requests(0)
 {}
 
 
@@ -105,7 +134,9 @@ GroupProcess::GroupProcess(
     watcher(NULL),
     zk(NULL),
     state(DISCONNECTED),
-    retrying(false)
+    retrying(false),
+    flushing(false),
+    requests(0)
 {}
 
 
@@ -137,35 +168,22 @@ Future<Group::Membership> GroupProcess::join(
 {
   if (error.isSome()) {
     return Failure(error.get());
-  } else if (state != READY) {
-    Join* join = new Join(data, label);
-    pending.joins.push(join);
-    return join->promise.future();
   }
 
   // TODO(benh): Write a test to see how ZooKeeper fails setting znode
   // data when the data is larger than 1 MB so we know whether or not
   // to check for that here.
 
-  // TODO(benh): Only attempt if the pending queue is empty so that a
-  // client can assume a happens-before ordering of operations (i.e.,
-  // the first request will happen before the second, etc).
-
-  Result<Group::Membership> membership = doJoin(data, label);
+  Join* join = new Join(data, label, requests++);
+  pending.joins.push(join);
 
-  if (membership.isNone()) { // Try again later.
-    if (!retrying) {
-      delay(RETRY_INTERVAL, self(), &GroupProcess::retry, RETRY_INTERVAL);
-      retrying = true;
-    }
-    Join* join = new Join(data, label);
-    pending.joins.push(join);
-    return join->promise.future();
-  } else if (membership.isError()) {
-    return Failure(membership.error());
+  // If we're not READY the join gets performed by 'sync()'.
+  if (state == READY && !flushing) {
+    dispatch(self(), &GroupProcess::flush);
+    flushing = true;
   }
 
-  return membership.get();
+  return join->promise.future();
 }
 
 
@@ -182,31 +200,16 @@ Future<bool> GroupProcess::cancel(const Group::Membership& membership)
     return false;
   }
 
-  if (state != READY) {
-    Cancel* cancel = new Cancel(membership);
-    pending.cancels.push(cancel);
-    return cancel->promise.future();
-  }
-
-  // TODO(benh): Only attempt if the pending queue is empty so that a
-  // client can assume a happens-before ordering of operations (i.e.,
-  // the first request will happen before the second, etc).
-
-  Result<bool> cancellation = doCancel(membership);
+  Cancel* cancel = new Cancel(membership, requests++);
+  pending.cancels.push(cancel);
 
-  if (cancellation.isNone()) { // Try again later.
-    if (!retrying) {
-      delay(RETRY_INTERVAL, self(), &GroupProcess::retry, RETRY_INTERVAL);
-      retrying = true;
-    }
-    Cancel* cancel = new Cancel(membership);
-    pending.cancels.push(cancel);
-    return cancel->promise.future();
-  } else if (cancellation.isError()) {
-    return Failure(cancellation.error());
+  // If we're not READY the cancel gets performed by 'sync()'.
+  if (state == READY && !flushing) {
+    dispatch(self(), &GroupProcess::flush);
+    flushing = true;
   }
 
-  return cancellation.get();
+  return cancel->promise.future();
 }
 
 
@@ -220,6 +223,14 @@ Future<Option<string> > GroupProcess::data(const Group::Membership& membership)
     return data->promise.future();
   }
 
+  // The data of a membership never changes so we can use what we
+  // fetched before, as long as the membership still exists.
+  if (contents.count(membership.id()) > 0 &&
+      (owned.count(membership.id()) > 0 ||
+       unowned.count(membership.id()) > 0)) {
+    return Some(contents[membership.id()]);
+  }
+
   // TODO(benh): Only attempt if the pending queue is empty so that a
   // client can assume a happens-before ordering of operations (i.e.,
   // the first request will happen before the second, etc).
@@ -499,6 +510,7 @@ void GroupProcess::expired(int64_t sessionId)
   foreachpair (int32_t sequence, Promise<bool>* cancelled, utils::copy(owned)) {
     cancelled->set(false); // Since this was not requested.
     owned.erase(sequence); // Okay since iterating over a copy.
+    contents.erase(sequence);
     delete cancelled;
   }
 
@@ -584,13 +596,26 @@ Result<Group::Membership> GroupProcess::doJoin(
         "' in ZooKeeper: " + zk->message(code));
   }
 
+  Try<Group::Membership> membership = own(result, label);
+  if (membership.isError()) {
+    return Error(membership.error());
+  }
+
+  return membership.get();
+}
+
+
+Try<Group::Membership> GroupProcess::own(
+    const string& path,
+    const Option<string>& label)
+{
   // Invalidate the cache (it will/should get immediately populated
   // via the 'updated' callback of our ZooKeeper watcher).
   memberships = None();
 
   // Save the sequence number but only grab the basename. Example:
   // "/path/to/znode/label_0000000131" => "0000000131".
-  Try<string> basename = os::basename(result);
+  Try<string> basename = os::basename(path);
   if (basename.isError()) {
     return Error("Failed to get the sequence number: " + basename.error());
   }
@@ -634,16 +659,225 @@ Result<bool> GroupProcess::doCancel(const Group::Membership& membership)
         "' in ZooKeeper: " + zk->message(code));
   }
 
+  disown(membership);
+
+  return true;
+}
+
+
+void GroupProcess::disown(const Group::Membership& membership)
+{
   // Invalidate the cache (it will/should get immediately populated
   // via the 'updated' callback of our ZooKeeper watcher).
   memberships = None();
 
+  contents.erase(membership.id());
+
   // Let anyone waiting know the membership has been cancelled.
   CHECK(owned.count(membership.id()) == 1);
   Promise<bool>* cancelled = owned[membership.id()];
   cancelled->set(true);
   owned.erase(membership.id());
   delete cancelled;
+}
+
+
+bool GroupProcess::doJoins()
+{
+  CHECK_EQ(state, READY);
+
+  // Joins requested after the first pending cancel must wait for it.
+  const Option<uint64_t> until = pending.cancels.empty()
+    ? Option<uint64_t>::none()
+    : pending.cancels.front()->request;
+
+  while (!pending.joins.empty() &&
+         (until.isNone() || pending.joins.front()->request < until.get())) {
+    vector<Join*> batch;
+    Bytes bytes;
+
+    while (!pending.joins.empty() &&
+           (until.isNone() || pending.joins.front()->request < until.get()) &&
+           batch.size() < MAX_BATCH_SIZE) {
+      Join* join = pending.joins.front();
+
+      if (!batch.empty() &&
+          bytes + Bytes(join->data.size()) > MAX_BATCH_BYTES) {
+        break;
+      }
+
+      bytes += Bytes(join->data.size());
+      batch.push_back(join);
+      pending.joins.pop();
+    }
+
+    if (batch.size() > 1) {
+      // The paths and the buffers for the paths of the created znodes
+      // must outlive the multi operation.
+      vector<string> paths;
+      vector<string> buffers;
+      vector<zoo_op_t> ops(batch.size());
+
+      paths.reserve(batch.size());
+      buffers.reserve(batch.size());
+
+      for (size_t i = 0; i < batch.size(); i++) {
+        const Option<string>& label = batch[i]->label;
+
+        paths.push_back(
+            znode + "/" + (label.isSome() ? (label.get() + "_") : ""));
+
+        // Leave room for the sequence number that gets appended.
+        buffers.push_back(string(paths[i].size() + 16, '\0'));
+
+        zoo_create_op_init(
+            &ops[i],
+            paths[i].c_str(),
+            batch[i]->data.data(),
+            batch[i]->data.size(),
+            &acl,
+            ZOO_SEQUENCE | ZOO_EPHEMERAL,
+            &buffers[i][0],
+            buffers[i].size());
+      }
+
+      vector<zoo_op_result_t> results;
+
+      int code = zk->multi(ops, &results);
+
+      if (code == ZINVALIDSTATE || (code != ZOK && zk->retryable(code))) {
+        CHECK_NE(zk->getState(), ZOO_AUTH_FAILED_STATE);
+        requeue(batch, &pending.joins);
+        return false; // Try again later.
+      } else if (code == ZOK) {
+        for (size_t i = 0; i < batch.size(); i++) {
+          Try<Group::Membership> membership =
+            own(results[i].value, batch[i]->label);
+
+          if (membership.isError()) {
+            batch[i]->promise.fail(membership.error());
+          } else {
+            batch[i]->promise.set(membership.get());
+          }
+          delete batch[i];
+        }
+        continue;
+      }
+
+      LOG(WARNING) << "Failed to create " << batch.size()
+                   << " ephemeral nodes at '" << znode << "' in ZooKeeper: "
+                   << zk->message(code) << "; creating them one at a time";
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      Join* join = batch[i];
+      Result<Group::Membership> membership = doJoin(join->data, join->label);
+      if (membership.isNone()) {
+        requeue(vector<Join*>(batch.begin() + i, batch.end()), &pending.joins);
+        return false; // Try again later.
+      } else if (membership.isError()) {
+        join->promise.fail(membership.error());
+      } else {
+        join->promise.set(membership.get());
+      }
+      delete join;
+    }
+  }
+
+  return true;
+}
+
+
+bool GroupProcess::doCancels()
+{
+  CHECK_EQ(state, READY);
+
+  // Cancels requested after the first pending join must wait for it.
+  const Option<uint64_t> until = pending.joins.empty()
+    ? Option<uint64_t>::none()
+    : pending.joins.front()->request;
+
+  while (!pending.cancels.empty() &&
+         (until.isNone() || pending.cancels.front()->request < until.get())) {
+    vector<Cancel*> batch;
+
+    while (!pending.cancels.empty() &&
+           (until.isNone() || pending.cancels.front()->request < until.get()) &&
+           batch.size() < MAX_BATCH_SIZE) {
+      batch.push_back(pending.cancels.front());
+      pending.cancels.pop();
+    }
+
+    if (batch.size() > 1) {
+      // The paths must outlive the multi operation.
+      vector<string> paths;
+      vector<zoo_op_t> ops(batch.size());
+
+      paths.reserve(batch.size());
+
+      for (size_t i = 0; i < batch.size(); i++) {
+        paths.push_back(path::join(znode, zkBasename(batch[i]->membership)));
+        zoo_delete_op_init(&ops[i], paths[i].c_str(), -1);
+      }
+
+      LOG(INFO) << "Trying to remove " << batch.size() << " ephemeral nodes"
+                << " at '" << znode << "' in ZooKeeper";
+
+      vector<zoo_op_result_t> results;
+
+      int code = zk->multi(ops, &results);
+
+      if (code == ZINVALIDSTATE || (code != ZOK && zk->retryable(code))) {
+        CHECK_NE(zk->getState(), ZOO_AUTH_FAILED_STATE);
+        requeue(batch, &pending.cancels);
+        return false; // Try again later.
+      } else if (code == ZOK) {
+        foreach (Cancel* cancel, batch) {
+          disown(cancel->membership);
+          cancel->promise.set(true);
+          delete cancel;
+        }
+        continue;
+      }
+
+      // This is expected if any of the memberships have expired (or
+      // were cancelled more than once) which we learn about below.
+      LOG(INFO) << "Failed to remove " << batch.size() << " ephemeral nodes"
+                << " at '" << znode << "' in ZooKeeper: " << zk->message(code)
+                << "; removing them one at a time";
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      Cancel* cancel = batch[i];
+      Result<bool> cancellation = doCancel(cancel->membership);
+      if (cancellation.isNone()) {
+        requeue(
+            vector<Cancel*>(batch.begin() + i, batch.end()),
+            &pending.cancels);
+        return false; // Try again later.
+      } else if (cancellation.isError()) {
+        cancel->promise.fail(cancellation.error());
+      } else {
+        cancel->promise.set(cancellation.get());
+      }
+      delete cancel;
+    }
+  }
+
+  return true;
+}
+
+
+bool GroupProcess::doJoinsAndCancels()
+{
+  // Each call below performs the joins (cancels) up to the next
+  // pending cancel (join) so that a client can assume a
+  // happens-before ordering of its joins and cancels.
+  while (!pending.joins.empty() || !pending.cancels.empty()) {
+    if (!doJoins() || !doCancels()) {
+      return false; // Try again later.
+    }
+  }
 
   return true;
 }
@@ -664,6 +898,7 @@ Result<Option<string> > GroupProcess::doData(
   int code = zk->get(path, false, &result, NULL);
 
   if (code == ZNONODE) {
+    contents.erase(membership.id());
     return Option<string>::none();
   } else if (code == ZINVALIDSTATE || (code != ZOK && zk->retryable(code))) {
     CHECK_NE(zk->getState(), ZOO_AUTH_FAILED_STATE);
@@ -674,6 +909,13 @@ Result<Option<string> > GroupProcess::doData(
         "' in ZooKeeper: " + zk->message(code));
   }
 
+  // Only cache the data of memberships we know of since the cache is
+  // cleaned up when we learn that a membership is gone.
+  if (owned.count(membership.id()) > 0 ||
+      unowned.count(membership.id()) > 0) {
+    contents[membership.id()] = result;
+  }
+
   return Some(result);
 }
 
@@ -729,6 +971,7 @@ Try<bool> GroupProcess::cache()
     if (!sequences.contains(sequence)) {
       cancelled->set(false);
       owned.erase(sequence); // Okay since iterating over a copy.
+      contents.erase(sequence);
       delete cancelled;
     } else {
       current.insert(Group::Membership(
@@ -744,6 +987,7 @@ Try<bool> GroupProcess::cache()
     if (!sequences.contains(sequence)) {
       cancelled->set(false);
       unowned.erase(sequence); // Okay since iterating over a copy.
+      contents.erase(sequence);
       delete cancelled;
     } else {
       current.insert(Group::Membership(
@@ -813,34 +1057,9 @@ Try<bool> GroupProcess::sync()
     }
   }
 
-  // Do joins.
-  while (!pending.joins.empty()) {
-    Join* join = pending.joins.front();
-    Result<Group::Membership> membership = doJoin(join->data, join->label);
-    if (membership.isNone()) {
-      return false; // Try again later.
-    } else if (membership.isError()) {
-      join->promise.fail(membership.error());
-    } else {
-      join->promise.set(membership.get());
-    }
-    pending.joins.pop();
-    delete join;
-  }
-
-  // Do cancels.
-  while (!pending.cancels.empty()) {
-    Cancel* cancel = pending.cancels.front();
-    Result<bool> cancellation = doCancel(cancel->membership);
-    if (cancellation.isNone()) {
-      return false; // Try again later.
-    } else if (cancellation.isError()) {
-      cancel->promise.fail(cancellation.error());
-    } else {
-      cancel->promise.set(cancellation.get());
-    }
-    pending.cancels.pop();
-    delete cancel;
+  // Do joins and cancels.
+  if (!doJoinsAndCancels()) {
+    return false; // Try again later.
   }
 
   // Do datas.
@@ -879,6 +1098,26 @@ Try<bool> GroupProcess::sync()
 }
 
 
+void GroupProcess::flush()
+{
+  flushing = false;
+
+  // If we're not READY the pending joins and cancels get performed by
+  // 'sync()' once we are.
+  if (error.isSome() || state != READY) {
+    return;
+  }
+
+  if (!doJoinsAndCancels()) {
+    // Try again later.
+    if (!retrying) {
+      delay(RETRY_INTERVAL, self(), &GroupProcess::retry, RETRY_INTERVAL);
+      retrying = true;
+    }
+  }
+}
+
+
 void GroupProcess::retry(const Duration& duration)
 {
   if (!retrying) {
@@ -935,6 +1174,8 @@ void GroupProcess::abort(const string& message)
 
   owned.clear();
 
+  contents.clear();
+
   // Since we decided to abort, we expire the session to clean up
   // ephemeral ZNodes as necessary.
   delete CHECK_NOTNULL(zk);
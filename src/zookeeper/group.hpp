@@ -198,6 +198,27 @@ private:
   Result<bool> doCancel(const Group::Membership& membership);
   Result<Option<std::string> > doData(const Group::Membership& membership);
 
+  // Performs the pending joins (cancels) that were requested before
+  // any pending cancel (join) in batches, each using a single
+  // ZooKeeper multi operation. If a batch fails (e.g., because one of
+  // the memberships to cancel no longer exists) its operations are
+  // performed one at a time instead.
+  // Returns false if the failure is retryable and true otherwise.
+  bool doJoins();
+  bool doCancels();
+
+  // Performs all pending joins and cancels in the order they were
+  // requested. Returns false if the failure is retryable.
+  bool doJoinsAndCancels();
+
+  // Creates an owned membership for the znode created at 'path'.
+  Try<Group::Membership> own(
+      const std::string& path,
+      const Option<std::string>& label);
+
+  // Releases an owned membership after its znode has been removed.
+  void disown(const Group::Membership& membership);
+
   // Returns true if authentication is successful, false if the
   // failure is retryable and Error otherwise.
   Try<bool> authenticate();
@@ -221,6 +242,10 @@ private:
   // Updates any pending watches.
   void update();
 
+  // Performs the pending joins and cancels. These are deferred (see
+  // 'flushing') so that operations requested together are batched.
+  void flush();
+
   // Generic retry method. This mechanism is "generic" in the sense
   // that it is not specific to any particular operation, but rather
   // attempts to perform all pending operations (including caching
@@ -271,18 +296,22 @@ private:
 
   struct Join
   {
-    Join(const std::string& _data, const Option<std::string>& _label)
-      : data(_data), label(_label) {}
+    Join(const std::string& _data,
+         const Option<std::string>& _label,
+         uint64_t _request)
+      : data(_data), label(_label), request(_request) {}
     std::string data;
     const Option<std::string> label;
+    const uint64_t request;
     process::Promise<Group::Membership> promise;
   };
 
   struct Cancel
   {
-    explicit Cancel(const Group::Membership& _membership)
-      : membership(_membership) {}
+    Cancel(const Group::Membership& _membership, uint64_t _request)
+      : membership(_membership), request(_request) {}
     Group::Membership membership;
+    const uint64_t request;
     process::Promise<bool> promise;
   };
 
@@ -312,6 +341,13 @@ private:
   // Indicates there is a pending delayed retry.
   bool retrying;
 
+  // Indicates there is a pending flush.
+  bool flushing;
+
+  // Number of joins and cancels requested so far, used to perform
+  // them in the order they were requested (see 'doJoinsAndCancels').
+  uint64_t requests;
+
   // Expected ZooKeeper sequence numbers (either owned/created by this
   // group instance or not) and the promise we associate with their
   // "cancellation" (i.e., no longer part of the group).
@@ -322,6 +358,11 @@ private:
   // cache and 'Some' represents a valid cache.
   Option<std::set<Group::Membership> > memberships;
 
+  // Cache of the data of the memberships, by sequence number. The
+  // data of a membership is only set when it's created so an entry
+  // is valid until the membership is gone.
+  std::map<int32_t, std::string> contents;
+
   // The timer that determines whether we should quit waiting for the
   // connection to be restored.
   Option<process::Timer> timer;
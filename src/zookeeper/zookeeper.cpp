@@ -386,6 +386,41 @@ public:
     return future;
   }
 
+  Future<int> multi(
+      const vector<zoo_op_t>& ops,
+      vector<zoo_op_result_t>* results)
+  {
+    // Unlike the other operations the results are written directly
+    // into 'results' by the ZooKeeper client when it completes.
+    results->resize(ops.size());
+
+    if (ops.empty()) {
+      return ZOK;
+    }
+
+    Promise<int>* promise = new Promise<int>();
+
+    Future<int> future = promise->future();
+
+    tuple<Promise<int>*>* args = new tuple<Promise<int>*>(promise);
+
+    int ret = zoo_amulti(
+        zh,
+        ops.size(),
+        &ops[0],
+        &(*results)[0],
+        voidCompletion,
+        args);
+
+    if (ret != ZOK) {
+      delete promise;
+      delete args;
+      return ret;
+    }
+
+    return future;
+  }
+
 private:
   // This method is registered as a watcher callback function and is
   // invoked by a single ZooKeeper event thread.
@@ -645,6 +680,14 @@ int ZooKeeper::set(const string& path, const string& data, int version)
 }
 
 
+int ZooKeeper::multi(
+    const vector<zoo_op_t>& ops,
+    vector<zoo_op_result_t>* results)
+{
+  return dispatch(process, &ZooKeeperProcess::multi, ops, results).get();
+}
+
+
 string ZooKeeper::message(int code) const
 {
   return string(zerror(code));
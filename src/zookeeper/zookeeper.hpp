@@ -304,6 +304,29 @@ public:
    */
   int set(const std::string& path, const std::string& data, int version);
 
+  /**
+   * \brief executes multiple operations atomically and synchronously.
+   *
+   * Either all of the operations succeed or none of them is applied.
+   *
+   * \param ops the operations to execute, initialized using
+   *    zoo_create_op_init, zoo_delete_op_init, etc. Any buffers the
+   *    operations refer to (e.g., the buffer for the path of a created
+   *    node) must remain valid until this call returns.
+   * \param results will hold the result of each operation on return,
+   *    in the same order as 'ops'.
+   * \return the return code for the function call.
+   * ZOK operation completed succesfully
+   * ZNONODE, ZNODEEXISTS, etc the code of the first failed operation
+   *    (see 'results' for the code of each operation).
+   * ZBADARGUMENTS - invalid input parameters
+   * ZINVALIDSTATE - zhandle state is either ZOO_SESSION_EXPIRED_STATE or ZOO_AUTH_FAILED_STATE
+   * ZMARSHALLINGERROR - failed to marshall a request; possibly, out of memory
+   */
+  int multi(
+      const std::vector<zoo_op_t>& ops,
+      std::vector<zoo_op_result_t>* results);
+
   /**
    * \brief return a message describing the return code.
    *